@@ -22,6 +22,8 @@
 #define PCU_IF_MSG_TIME_IND	0x52	/* GSM time indication */
 #define PCU_IF_MSG_PAG_REQ	0x60	/* paging request */
 #define PCU_IF_MSG_TXT_IND	0x70	/* Text indication for BTS */
+#define PCU_IF_MSG_SHM_REQ	0x80	/* PCU offers shared memory rings */
+#define PCU_IF_MSG_SHM_CNF	0x81	/* BTS switched to the shared memory rings */
 
 /* sapi */
 #define PCU_IF_SAPI_RACH	0x01	/* channel request on CCCH */
@@ -115,7 +117,9 @@ struct gsm_pcu_if_rach_ind {
 struct gsm_pcu_if_info_trx {
 	uint16_t	arfcn;
 	uint8_t		pdch_mask;		/* PDCH channels per TS */
-	uint8_t		spare;
+	uint8_t		dyn_pdch_mask;		/* TS the PCU may switch to PDCH
+						 * with PCU_IF_MSG_ACT_REQ, was
+						 * spare (see gsm_pcu_if_act_req) */
 	uint8_t		tsc[8];			/* TSC per channel */
 	uint32_t	hlayer1;
 } __attribute__ ((packed));
@@ -158,6 +162,16 @@ struct gsm_pcu_if_info_ind {
 	uint32_t	remote_ip[2];
 } __attribute__ ((packed));
 
+/* Besides confirming the PDCH of the INFO.ind, the PCU may ask for a TS of
+ * dyn_pdch_mask to be switched to PDCH, resp. give one back after it
+ * stopped using it. The BTS answers with an INFO.ind carrying the new
+ * pdch_mask, a BTS that cannot switch the TS leaves it out.
+ *
+ * This needs a matching change in osmo-bts, which has to fill in
+ * dyn_pdch_mask and switch the TS on such requests. The octet used to be
+ * spare, so an osmo-bts without that change sends 0 and the PCU never asks
+ * for a dynamic TS. The PCU only ever gives back TS that are still in the
+ * dyn_pdch_mask of the last INFO.ind. */
 struct gsm_pcu_if_act_req {
 	uint8_t		activate;
 	uint8_t		trx_nr;
@@ -189,6 +203,21 @@ struct gsm_pcu_if_susp_req {
 	uint8_t		cause;
 } __attribute__ ((packed));
 
+/* PCU offers to exchange the primitives through shared memory. The message
+ * carries three file descriptors as SCM_RIGHTS: a memfd holding a struct
+ * gsm_pcu_if_shm, the eventfd the BTS writes to after filling the to_pcu
+ * ring and the eventfd the PCU writes to after filling the from_pcu ring.
+ * A BTS that maps the segment answers with PCU_IF_MSG_SHM_CNF, after that
+ * both sides only use the rings and keep the socket to detect a lost peer.
+ * A BTS that does not know the message ignores it, then the socket is used
+ * as before. The rings are negotiated by this exchange alone, so they do not
+ * change PCU_IF_VERSION. */
+struct gsm_pcu_if_shm_req {
+	uint32_t	size;		/* size of the segment */
+	uint16_t	ring_size;	/* PCU_IF_SHM_RING_SIZE */
+	uint16_t	slot_size;	/* sizeof(struct gsm_pcu_if) */
+} __attribute__ ((packed));
+
 struct gsm_pcu_if {
 	/* context based information */
 	uint8_t		msg_type;	/* message type */
@@ -209,7 +238,33 @@ struct gsm_pcu_if {
 		struct gsm_pcu_if_time_ind	time_ind;
 		struct gsm_pcu_if_pag_req	pag_req;
 		struct gsm_pcu_if_app_info_req	app_info_req;
+		struct gsm_pcu_if_shm_req	shm_req;
 	} u;
 } __attribute__ ((packed));
 
+#define PCU_IF_SHM_MAGIC	0x50435553	/* "PCUS" */
+#define PCU_IF_SHM_RING_SIZE	64		/* power of two */
+
+/* Ring of primitives with one producer and one consumer. The producer
+ * fills slots[head % PCU_IF_SHM_RING_SIZE] and then increments head, the
+ * consumer handles slots[tail % PCU_IF_SHM_RING_SIZE] and then increments
+ * tail. Both publish their index with release semantics and read the other
+ * one with acquire semantics, head and tail are on their own cache line. */
+struct gsm_pcu_if_shm_ring {
+	uint32_t	head;
+	uint8_t		spare_head[60];
+	uint32_t	tail;
+	uint8_t		spare_tail[60];
+	struct gsm_pcu_if slots[PCU_IF_SHM_RING_SIZE];
+};
+
+struct gsm_pcu_if_shm {
+	uint32_t	magic;		/* PCU_IF_SHM_MAGIC */
+	uint32_t	ring_size;	/* PCU_IF_SHM_RING_SIZE */
+	uint32_t	slot_size;	/* sizeof(struct gsm_pcu_if) */
+	uint8_t		spare[52];
+	struct gsm_pcu_if_shm_ring to_pcu;	/* BTS -> PCU */
+	struct gsm_pcu_if_shm_ring from_pcu;	/* PCU -> BTS */
+};
+
 #endif /* _PCUIF_PROTO_H */
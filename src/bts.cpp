@@ -31,6 +31,9 @@
 #include <gprs_debug.h>
 #include <cxx_linuxlist.h>
 #include <pdch.h>
+#include <pcu_utils.h>
+#include <gsmtap_export.h>
+#include <pcu_rt.h>
 
 extern "C" {
 	#include <osmocom/core/talloc.h>
@@ -87,6 +90,9 @@ static struct osmo_tdef T_defs_pcu[] = {
 	{ .T=-2002, .default_val=200, .unit=OSMO_TDEF_MS, .desc="Waiting after IMM.ASS confirm timer (ms)", .val=0 },
 	{ .T=-2030, .default_val=60,  .unit=OSMO_TDEF_S,  .desc="Time to keep an idle MS object alive (s)", .val=0 }, /* slightly above T3314 (default 44s, 24.008, 11.2.2) */
 	{ .T=-2031, .default_val=2000, .unit=OSMO_TDEF_MS, .desc="Time to keep an idle DL TBF alive (ms)",  .val=0 },
+	{ .T=-2032, .default_val=0,   .unit=OSMO_TDEF_MS, .desc="Time to keep an idle EGPRS UL TBF in extended mode, 0 to release it (ms)", .val=0 },
+	{ .T=-2033, .default_val=80,  .unit=OSMO_TDEF_MS, .desc="USF interval of an idle extended UL TBF (ms)", .val=0 },
+	{ .T=-2040, .default_val=0, .unit=OSMO_TDEF_MS, .desc="Suppress repeated paging for the same MI (ms), 0 = off", .val=0 },
 	{ .T=0, .default_val=0, .unit=OSMO_TDEF_S, .desc=NULL, .val=0 } /* empty item at the end */
 };
 
@@ -181,6 +187,24 @@ static const struct rate_ctr_desc bts_ctr_description[] = {
 	{ "egprs:uplink_mcs7",		"MCS7 Uplink          "},
 	{ "egprs:uplink_mcs8",		"MCS8 Uplink          "},
 	{ "egprs:uplink_mcs9",		"MCS9 Uplink          "},
+	{ "paging:suppressed",		"Paging Suppressed    "},
+	{ "paging:dropped",		"Paging Dropped       "},
+	{ "rach:queued",		"RACH Queued          "},
+	{ "rach:duplicate",		"RACH Duplicate       "},
+	{ "rach:dropped",		"RACH Dropped         "},
+	{ "rach:throttled",		"RACH Throttled       "},
+	{ "rach:early_rejected",	"RACH Early Rejected  "},
+	{ "poll:deferred_pending",	"Poll Deferred Pending"},
+	{ "poll:deferred_no_block",	"Poll Deferred No Blk "},
+	{ "poll:late_rrbp",		"Poll with RRBP > 0   "},
+	{ "llc:evicted",		"Evicted Frames       "},
+	{ "gsmtap:dropped",		"GSMTAP Dropped       "},
+	{ "tbf:rebalanced",		"TBF Rebalanced       "},
+	{ "tbf:alloc:failed",		"TBF Alloc Failed     "},
+	{ "pdch:dyn:activated",		"Dyn PDCH Activated   "},
+	{ "pdch:dyn:released",		"Dyn PDCH Released    "},
+	{ "tbf:ul:ext:idle",		"TBF UL Ext Idle      "},
+	{ "tbf:ul:ext:resumed",		"TBF UL Ext Resumed   "},
 };
 
 static const struct rate_ctr_group_desc bts_ctrg_desc = {
@@ -194,6 +218,22 @@ static const struct rate_ctr_group_desc bts_ctrg_desc = {
 static const struct osmo_stat_item_desc bts_stat_item_description[] = {
 	{ "ms.present",		"MS Present           ",
 		OSMO_STAT_ITEM_NO_UNIT, 4, 0},
+	{ "rts.latency.avg",	"RTS processing avg   ",
+		"us", 4, 0},
+	{ "rts.latency.p90",	"RTS processing p90   ",
+		"us", 4, 0},
+	{ "llc.delay.avg",	"LLC queue delay avg  ",
+		"ms", 4, 0},
+	{ "llc.delay.p90",	"LLC queue delay p90  ",
+		"ms", 4, 0},
+	{ "dl_ack.rtt.avg",	"DL Ack/Nack RTT avg  ",
+		"ms", 4, 0},
+	{ "dl_ack.rtt.p90",	"DL Ack/Nack RTT p90  ",
+		"ms", 4, 0},
+	{ "llc.queue.octets",	"LLC queued octets    ",
+		"bytes", 4, 0},
+	{ "llc.queue.frames",	"LLC queued frames    ",
+		OSMO_STAT_ITEM_NO_UNIT, 4, 0},
 };
 
 static const struct osmo_stat_item_group_desc bts_statg_desc = {
@@ -224,6 +264,93 @@ void bts_cleanup()
 	return BTS::main_bts()->cleanup();
 }
 
+/* (Re)start or stop the GSMTAP helper thread after the config changed */
+int bts_gsmtap_export_update(struct gprs_rlcmac_bts *bts)
+{
+	gsmtap_export_stop();
+
+	/* a pcap file is only written by the helper thread */
+	if (!bts->gsmtap_async && !bts->gsmtap_pcap_path)
+		return 0;
+
+	return gsmtap_export_start(bts->gsmtap ? gsmtap_inst_fd(bts->gsmtap) : -1,
+				   bts->gsmtap_pcap_path);
+}
+
+/* Start, restart or stop the realtime mode after the config changed */
+int bts_realtime_update(struct gprs_rlcmac_bts *bts)
+{
+	if (!bts->realtime) {
+		pcu_rt_stop();
+		return 0;
+	}
+
+	return pcu_rt_start(bts->rt_cpu, bts->rt_heap_mb, bts->rt_deadline_us,
+			    bts->rt_alloc_abort);
+}
+
+/* T number of each bts_tbf_timer_param, keep the order of the enum */
+static const int tbf_timer_T[_NUM_BTS_TP] = {
+	3169, 3191, 3193, 3195, -2000, -2001, -2002,
+};
+
+int bts_tbf_timer_param(int T)
+{
+	switch (T) {
+	case 3169: return BTS_TP_T3169;
+	case 3191: return BTS_TP_T3191;
+	case 3193: return BTS_TP_T3193;
+	case 3195: return BTS_TP_T3195;
+	case -2000: return BTS_TP_X2000;
+	case -2001: return BTS_TP_X2001;
+	case -2002: return BTS_TP_X2002;
+	default: return -1;
+	}
+}
+
+/* Must be called whenever a value in T_defs_bts or T_defs_pcu changes */
+void bts_update_params(struct gprs_rlcmac_bts *bts)
+{
+	struct gprs_rlcmac_bts_params params;
+	unsigned long msecs_t3190, dl_tbf_idle_msec, ul_tbf_ext_msec;
+	struct osmo_tdef *tdef;
+	int i;
+
+	memset(&params, 0, sizeof(params));
+
+	for (i = 0; i < _NUM_BTS_TP; i++) {
+		if (!(tdef = osmo_tdef_get_entry(bts->T_defs_bts, tbf_timer_T[i])))
+			tdef = osmo_tdef_get_entry(bts->T_defs_pcu, tbf_timer_T[i]);
+		OSMO_ASSERT(tdef);
+
+		switch (tdef->unit) {
+		case OSMO_TDEF_MS:
+			params.tbf_timer[i].usec = tdef->val * 1000;
+			break;
+		case OSMO_TDEF_S:
+			params.tbf_timer[i].sec = tdef->val;
+			break;
+		default:
+			/* so far only timers using MS and S */
+			OSMO_ASSERT(false);
+		}
+	}
+
+	msecs_t3190 = osmo_tdef_get(bts->T_defs_pcu, 3190, OSMO_TDEF_MS, -1);
+	dl_tbf_idle_msec = osmo_tdef_get(bts->T_defs_pcu, -2031, OSMO_TDEF_MS, -1);
+	params.dl_tbf_idle_frames = dl_tbf_idle_msec ? msecs_to_frames(dl_tbf_idle_msec) : -1;
+	params.dl_age_low_frames = msecs_to_frames(200);
+	params.dl_age_high_frames = msecs_to_frames(OSMO_MIN(msecs_t3190/2, dl_tbf_idle_msec));
+	ul_tbf_ext_msec = osmo_tdef_get(bts->T_defs_pcu, -2032, OSMO_TDEF_MS, -1);
+	params.ul_tbf_ext_frames = ul_tbf_ext_msec ? msecs_to_frames(ul_tbf_ext_msec) : -1;
+	params.ul_tbf_ext_usf_frames = msecs_to_frames(osmo_tdef_get(bts->T_defs_pcu, -2033, OSMO_TDEF_MS, -1));
+	params.ms_idle_sec = osmo_tdef_get(bts->T_defs_pcu, -2030, OSMO_TDEF_S, -1);
+	params.paging_suppress_ms = osmo_tdef_get(bts->T_defs_pcu, -2040, OSMO_TDEF_MS, -1);
+
+	/* readers never see a half updated set */
+	bts->params = params;
+}
+
 struct rate_ctr_group *bts_main_data_stats()
 {
 	return BTS::main_bts()->rate_counters();
@@ -234,6 +361,10 @@ BTS::BTS()
 	, m_cur_blk_fn(-1)
 	, m_pollController(*this)
 	, m_sba(*this)
+	, m_rach(*this)
+	, m_llc(*this)
+	, m_balancer(*this)
+	, m_pdch_pool(*this)
 	, m_ms_store(this)
 {
 	memset(&m_bts, 0, sizeof(m_bts));
@@ -244,6 +375,31 @@ BTS::BTS()
 	m_bts.T_defs_pcu = T_defs_pcu;
 	osmo_tdefs_reset(m_bts.T_defs_bts);
 	osmo_tdefs_reset(m_bts.T_defs_pcu);
+	bts_update_params(&m_bts);
+	m_bts.paging_queue_depth = 32;
+	m_bts.rach_wait_ind = 20;
+	m_bts.gsmtap_filter_trx = -1;
+	m_bts.gsmtap_filter_ts = -1;
+	m_bts.rebalance_min_gain = 50;
+	m_bts.dyn_pdch_load_high = 80;
+	m_bts.dyn_pdch_load_low = 30;
+	m_bts.rt_cpu = -1;
+	m_bts.rt_heap_mb = 16;
+	m_bts.rt_deadline_us = 1000;
+
+	memset(m_gsmtap_seen, 0, sizeof(m_gsmtap_seen));
+	m_gsmtap_filter_fn = -1;
+	m_gsmtap_filter_trx = -1;
+	m_gsmtap_filter_slots = 0;
+	INIT_LLIST_HEAD(&m_tbf_cursors);
+	memset(m_slot_mask_refs, 0, sizeof(m_slot_mask_refs));
+	memset(m_slot_masks_used, 0, sizeof(m_slot_masks_used));
+	memset(m_paged, 0, sizeof(m_paged));
+	m_paged_next = 0;
+	pcu_hist_reset(&m_published_rts_latency);
+	pcu_hist_reset(&m_published_llc_queue_delay);
+	pcu_hist_reset(&m_published_dl_ack_rtt);
+	m_published_fn = -1;
 
 	/* initialize back pointers */
 	for (size_t trx_no = 0; trx_no < ARRAY_SIZE(m_bts.trx); ++trx_no) {
@@ -278,6 +434,14 @@ void BTS::cleanup()
 	/* this can cause counter updates and must not be left to the
 	 * m_ms_store's destructor */
 	m_ms_store.cleanup();
+	m_rach.clear();
+
+	for (size_t trx_no = 0; trx_no < ARRAY_SIZE(m_bts.trx); ++trx_no) {
+		struct gprs_rlcmac_trx *trx = &m_bts.trx[trx_no];
+
+		for (size_t ts_no = 0; ts_no < ARRAY_SIZE(trx->pdch); ++ts_no)
+			trx->pdch[ts_no].free_stats();
+	}
 
 	if (m_ratectrs) {
 		rate_ctr_group_free(m_ratectrs);
@@ -300,6 +464,43 @@ BTS::~BTS()
 	cleanup();
 }
 
+/* Set the average and 90th percentile of the samples added since the last
+ * call, the stat items keep their value if there were none */
+static void publish_hist(struct osmo_stat_item_group *statg, unsigned int avg_id,
+			 const struct pcu_hist *cur, struct pcu_hist *prev)
+{
+	struct pcu_hist delta;
+	uint32_t p90;
+
+	pcu_hist_delta(&delta, cur, prev);
+	*prev = *cur;
+
+	if (!delta.count)
+		return;
+
+	p90 = pcu_hist_percentile(&delta, 900);
+	osmo_stat_item_set(statg->items[avg_id], delta.sum / delta.count);
+	osmo_stat_item_set(statg->items[avg_id + 1], p90 ? p90 : delta.max);
+}
+
+/* Called from the RTS path, the histograms are exported about once per
+ * second */
+void BTS::publish_latency_stats(uint32_t fn)
+{
+	uint32_t elapsed = (fn + GSM_MAX_FN - m_published_fn) % GSM_MAX_FN;
+
+	if (m_published_fn >= 0 && elapsed < (uint32_t)msecs_to_frames(1000))
+		return;
+	m_published_fn = fn;
+
+	publish_hist(m_statg, STAT_RTS_LATENCY_AVG, &m_bts.rts_latency,
+		     &m_published_rts_latency);
+	publish_hist(m_statg, STAT_LLC_QUEUE_DELAY_AVG, &m_bts.llc_queue_delay,
+		     &m_published_llc_queue_delay);
+	publish_hist(m_statg, STAT_DL_ACK_RTT_AVG, &m_bts.dl_ack_rtt,
+		     &m_published_dl_ack_rtt);
+}
+
 void BTS::set_current_frame_number(int fn)
 {
 	/* The UL frame numbers lag 3 behind the DL frames and the data
@@ -315,6 +516,10 @@ void BTS::set_current_frame_number(int fn)
 
 	m_cur_fn = fn;
 	m_pollController.expireTimedout(m_cur_fn, max_delay);
+	m_rach.flush(m_cur_fn);
+	m_llc.tick(m_cur_fn);
+	m_balancer.tick(m_cur_fn);
+	m_pdch_pool.tick(m_cur_fn);
 }
 
 static inline int delta_fn(int fn, int to)
@@ -355,72 +560,126 @@ void BTS::set_current_block_frame_number(int fn, unsigned max_delay)
 	m_pollController.expireTimedout(fn, max_delay);
 }
 
-int BTS::add_paging(uint8_t chan_needed, const uint8_t *mi, uint8_t mi_len)
+void BTS::tbf_slots_changed(uint8_t trx, uint8_t old_mask, uint8_t new_mask)
 {
-	uint8_t l, trx, ts, any_tbf = 0;
-	struct gprs_rlcmac_tbf *tbf;
-	LListHead<gprs_rlcmac_tbf> *pos;
-	uint8_t slot_mask[8];
-	int8_t first_ts; /* must be signed */
+	if (old_mask) {
+		OSMO_ASSERT(m_slot_mask_refs[trx][old_mask] > 0);
+		if (--m_slot_mask_refs[trx][old_mask] == 0)
+			m_slot_masks_used[trx][old_mask / 64] &= ~(1ULL << (old_mask % 64));
+	}
 
-	LListHead<gprs_rlcmac_tbf> *tbfs_lists[] = {
-		&m_ul_tbfs,
-		&m_dl_tbfs,
-		NULL
-	};
+	if (new_mask) {
+		if (m_slot_mask_refs[trx][new_mask]++ == 0)
+			m_slot_masks_used[trx][new_mask / 64] |= 1ULL << (new_mask % 64);
+	}
+}
 
+/* Collect the slots to page on: every TBF uses at least one of them.
+ * Walk the slot sets in use and mark the first slot of every set that
+ * does not contain a marked slot yet. */
+uint8_t BTS::paging_slot_mask(uint8_t trx) const
+{
+	uint8_t slot_mask = 0;
+	unsigned i;
 
-	LOGP(DRLCMAC, LOGL_INFO, "Add RR paging: chan-needed=%d MI=%s\n",
-		chan_needed, osmo_mi_name(mi, mi_len));
+	for (i = 0; i < ARRAY_SIZE(m_slot_masks_used[trx]); i++) {
+		uint64_t used = m_slot_masks_used[trx][i];
 
-	/* collect slots to page
-	 * Mark slots for every TBF, but only mark one of it.
-	 * Mark only the first slot found.
-	 * Don't mark, if TBF uses a different slot that is already marked. */
-	memset(slot_mask, 0, sizeof(slot_mask));
-	for (l = 0; tbfs_lists[l]; l++) {
-		llist_for_each(pos, tbfs_lists[l]) {
-			tbf = pos->entry();
-			first_ts = -1;
-			for (ts = 0; ts < 8; ts++) {
-				if (tbf->pdch[ts]) {
-					/* remember the first slot found */
-					if (first_ts < 0)
-						first_ts = ts;
-					/* break, if we already marked a slot */
-					if ((slot_mask[tbf->trx->trx_no] & (1 << ts)))
-						break;
-				}
-			}
-			/* mark first slot found, if none is marked already */
-			if (ts == 8 && first_ts >= 0) {
-				LOGPTBF(tbf, LOGL_DEBUG, "uses "
-					"TRX=%d TS=%d, so we mark\n",
-					tbf->trx->trx_no, first_ts);
-				slot_mask[tbf->trx->trx_no] |= (1 << first_ts);
-			} else
-				LOGPTBF(tbf, LOGL_DEBUG, "uses "
-					"already marked TRX=%d TS=%d\n",
-					tbf->trx->trx_no, ts);
+		while (used) {
+			uint8_t mask = i * 64 + __builtin_ctzll(used);
+
+			used &= used - 1;
+			if (!(mask & slot_mask))
+				slot_mask |= mask & -mask;
 		}
 	}
 
-	/* Now we have a list of marked slots. Every TBF uses at least one
-	 * of these slots. */
+	return slot_mask;
+}
+
+/* Return true if the MI was paged less than X2040 ago, remember it
+ * otherwise. */
+bool BTS::paging_suppressed(const uint8_t *mi, uint8_t mi_len)
+{
+	unsigned long ttl_ms = m_bts.params.paging_suppress_ms;
+	struct timespec now;
+	struct paging_record *rec;
+	unsigned i;
+
+	if (!ttl_ms || mi_len > sizeof(rec->identity_lv) - 1)
+		return false;
+
+	osmo_clock_gettime(CLOCK_MONOTONIC, &now);
+
+	for (i = 0; i < ARRAY_SIZE(m_paged); i++) {
+		rec = &m_paged[i];
+		if (rec->identity_lv[0] != mi_len
+		    || memcmp(&rec->identity_lv[1], mi, mi_len) != 0)
+			continue;
+
+		if (now.tv_sec < rec->expires.tv_sec
+		    || (now.tv_sec == rec->expires.tv_sec
+			&& now.tv_nsec < rec->expires.tv_nsec))
+			return true;
+		break;
+	}
+
+	/* not found: replace the oldest record */
+	if (i == ARRAY_SIZE(m_paged)) {
+		rec = &m_paged[m_paged_next];
+		m_paged_next = (m_paged_next + 1) % ARRAY_SIZE(m_paged);
+	}
+
+	rec->identity_lv[0] = mi_len;
+	memcpy(&rec->identity_lv[1], mi, mi_len);
+	rec->expires.tv_sec = now.tv_sec + ttl_ms / 1000;
+	rec->expires.tv_nsec = now.tv_nsec + (ttl_ms % 1000) * 1000000;
+	if (rec->expires.tv_nsec >= 1000000000) {
+		rec->expires.tv_sec += 1;
+		rec->expires.tv_nsec -= 1000000000;
+	}
+
+	return false;
+}
+
+int BTS::add_paging(uint8_t chan_needed, const uint8_t *mi, uint8_t mi_len)
+{
+	uint8_t trx, ts, slot_mask, any_tbf = 0;
+	int rc;
+
+	LOGP(DRLCMAC, LOGL_INFO, "Add RR paging: chan-needed=%d MI=%s\n",
+		chan_needed, osmo_mi_name(mi, mi_len));
 
 	/* schedule paging to all marked slots */
 	for (trx = 0; trx < 8; trx++) {
-		if (slot_mask[trx] == 0)
+		slot_mask = paging_slot_mask(trx);
+		if (slot_mask == 0)
 			continue;
+
+		if (!any_tbf && paging_suppressed(mi, mi_len)) {
+			LOGP(DRLCMAC, LOGL_INFO, "Paging for MI=%s already scheduled recently, "
+				"suppressing it\n", osmo_mi_name(mi, mi_len));
+			do_rate_ctr_inc(CTR_PAGING_SUPPRESSED);
+			return 0;
+		}
+		any_tbf = 1;
+
 		for (ts = 0; ts < 8; ts++) {
-			if ((slot_mask[trx] & (1 << ts))) {
-				/* schedule */
-				if (!m_bts.trx[trx].pdch[ts].add_paging(chan_needed, mi, mi_len))
-					return -ENOMEM;
+			if (!(slot_mask & (1 << ts)))
+				continue;
 
-				LOGP(DRLCMAC, LOGL_INFO, "Paging on PACCH of TRX=%d TS=%d\n", trx, ts);
-				any_tbf = 1;
+			/* -EEXIST: the MI is still queued on this PDCH */
+			rc = m_bts.trx[trx].pdch[ts].add_paging(chan_needed, mi, mi_len);
+			if (rc == -ENOSPC) {
+				LOGP(DRLCMAC, LOGL_NOTICE, "Paging queue of TRX=%d TS=%d full, "
+					"dropping paging\n", trx, ts);
+				do_rate_ctr_inc(CTR_PAGING_DROPPED);
+				continue;
 			}
+			if (rc < 0 && rc != -EEXIST)
+				return rc;
+
+			LOGP(DRLCMAC, LOGL_INFO, "Paging on PACCH of TRX=%d TS=%d\n", trx, ts);
 		}
 	}
 
@@ -470,6 +729,9 @@ void BTS::send_gsmtap_meas(enum pcu_gsmtap_category categ, bool uplink, uint8_t
 	if (!(m_bts.gsmtap_categ_mask & (1 << categ)))
 		return;
 
+	if (!gsmtap_wanted(categ, trx_no, ts_no))
+		return;
+
 	arfcn = m_bts.trx[trx_no].arfcn;
 	if (uplink)
 		arfcn |= GSMTAP_ARFCN_F_UPLINK;
@@ -477,10 +739,68 @@ void BTS::send_gsmtap_meas(enum pcu_gsmtap_category categ, bool uplink, uint8_t
 	/* GSMTAP needs the SNR here, but we only have C/I (meas->link_qual).
 	   Those are not the same, but there is no known way to convert them,
 	   let's pass C/I instead of nothing */
+	if (gsmtap_export_active()) {
+		if (!gsmtap_export_enqueue(arfcn, ts_no, channel, fn,
+					   meas->rssi, meas->link_qual, data, len))
+			do_rate_ctr_inc(CTR_GSMTAP_DROPPED);
+		return;
+	}
+
 	gsmtap_send(m_bts.gsmtap, arfcn, ts_no, channel, 0, fn,
 		    meas->rssi, meas->link_qual, data, len);
 }
 
+/* apply the sampling and the filters of the VTY */
+bool BTS::gsmtap_wanted(enum pcu_gsmtap_category categ, uint8_t trx_no,
+			uint8_t ts_no)
+{
+	if (m_bts.gsmtap_filter_trx >= 0 && m_bts.gsmtap_filter_trx != trx_no)
+		return false;
+	if (m_bts.gsmtap_filter_ts >= 0 && m_bts.gsmtap_filter_ts != ts_no)
+		return false;
+
+	if (m_bts.gsmtap_filter_tlli || m_bts.gsmtap_filter_imsi[0]) {
+		if (!gsmtap_ms_filter(trx_no, ts_no))
+			return false;
+	}
+
+	/* every n-th of the frames that passed the filters, the counter
+	 * restarts at n so that the interval stays even */
+	if (m_bts.gsmtap_sample[categ] > 1) {
+		bool send = m_gsmtap_seen[categ] == 0;
+
+		m_gsmtap_seen[categ] = (m_gsmtap_seen[categ] + 1) % m_bts.gsmtap_sample[categ];
+		return send;
+	}
+
+	return true;
+}
+
+/* only the PDCHs the MS of the GSMTAP filter currently uses */
+bool BTS::gsmtap_ms_filter(uint8_t trx_no, uint8_t ts_no)
+{
+	GprsMs *ms;
+
+	/* looking up the MS once per frame number is enough */
+	if (m_gsmtap_filter_fn != m_cur_fn) {
+		m_gsmtap_filter_fn = m_cur_fn;
+		m_gsmtap_filter_trx = -1;
+		m_gsmtap_filter_slots = 0;
+
+		if (m_bts.gsmtap_filter_tlli)
+			ms = ms_by_tlli(m_bts.gsmtap_filter_tlli);
+		else
+			ms = ms_by_imsi(m_bts.gsmtap_filter_imsi);
+		if (ms && ms->current_trx()) {
+			m_gsmtap_filter_trx = ms->current_trx()->trx_no;
+			m_gsmtap_filter_slots = ms->ul_slots() | ms->dl_slots();
+		}
+	}
+
+	return m_gsmtap_filter_trx == trx_no
+		&& (m_gsmtap_filter_slots & (1 << ts_no));
+}
+
 static inline bool tbf_check(gprs_rlcmac_tbf *tbf, uint32_t fn, uint8_t trx_no, uint8_t ts)
 {
 	if (tbf->state_is_not(GPRS_RLCMAC_RELEASING) && tbf->poll_scheduled()
@@ -542,10 +862,10 @@ gprs_rlcmac_ul_tbf *BTS::ul_tbf_by_tfi(uint8_t tfi, uint8_t trx, uint8_t ts)
  */
 int BTS::tfi_find_free(enum gprs_rlcmac_tbf_direction dir, uint8_t *_trx, int8_t use_trx) const
 {
-	const struct gprs_rlcmac_pdch *pdch;
-	uint32_t free_tfis;
+	const struct gprs_rlcmac_trx *trx;
+	uint32_t free_tfis = 0;
 	bool has_pdch = false;
-	uint8_t trx_from, trx_to, trx, ts, tfi;
+	uint8_t trx_from, trx_to, trx_no, tfi;
 
 	if (use_trx >= 0 && use_trx < 8)
 		trx_from = trx_to = use_trx;
@@ -555,23 +875,15 @@ int BTS::tfi_find_free(enum gprs_rlcmac_tbf_direction dir, uint8_t *_trx, int8_t
 	}
 
 	/* find a TFI that is unused on all PDCH */
-	for (trx = trx_from; trx <= trx_to; trx++) {
-		bool trx_has_pdch = false;
-
-		free_tfis = NO_FREE_TFI;
+	for (trx_no = trx_from; trx_no <= trx_to; trx_no++) {
+		trx = &m_bts.trx[trx_no];
+		if (!trx->pdch_mask)
+			continue;
 
-		for (ts = 0; ts < 8; ts++) {
-			pdch = &m_bts.trx[trx].pdch[ts];
-			if (!pdch->is_enabled())
-				continue;
-			free_tfis &= ~pdch->assigned_tfi(dir);
-			trx_has_pdch = true;
-			has_pdch = true;
-		}
-		if (trx_has_pdch && free_tfis)
+		has_pdch = true;
+		free_tfis = ~trx->assigned_tfi[dir];
+		if (free_tfis)
 			break;
-
-		free_tfis = 0;
 	}
 	if (!has_pdch) {
 		LOGP(DRLCMAC, LOGL_NOTICE, "No PDCH available.\n");
@@ -585,18 +897,13 @@ int BTS::tfi_find_free(enum gprs_rlcmac_tbf_direction dir, uint8_t *_trx, int8_t
 
 
 	LOGP(DRLCMAC, LOGL_DEBUG,
-		"Searching for first unallocated TFI: TRX=%d\n", trx);
+		"Searching for first unallocated TFI: TRX=%d\n", trx_no);
 
 	/* find the first */
-	for (tfi = 0; tfi < 32; tfi++) {
-		if (free_tfis & 1 << tfi)
-			break;
-	}
-
-	OSMO_ASSERT(tfi < 32);
+	tfi = __builtin_ctz(free_tfis);
 
 	LOGP(DRLCMAC, LOGL_DEBUG, " Found TFI=%d.\n", tfi);
-	*_trx = trx;
+	*_trx = trx_no;
 	return tfi;
 }
 
@@ -807,12 +1114,7 @@ static int parse_rach_ind(const struct rach_ind_params *rip,
 int BTS::rcv_rach(const struct rach_ind_params *rip)
 {
 	struct chan_req_params chan_req = { 0 };
-	struct gprs_rlcmac_ul_tbf *tbf = NULL;
-	uint8_t trx_no, ts_no;
-	uint32_t sb_fn = 0;
-	uint8_t usf = 7;
-	uint8_t tsc = 0;
-	int plen, rc;
+	struct rach_req req;
 
 	do_rate_ctr_inc(CTR_RACH_REQUESTS);
 
@@ -829,10 +1131,16 @@ int BTS::rcv_rach(const struct rach_ind_params *rip)
 	     "ra=0x%02x (%d bit) Fn=%u qta=%d\n", rip->ra,
 	     rip->is_11bit ? 11 : 8, Fn, rip->qta);
 
+	req.ra = rip->ra;
+	req.is_11bit = rip->is_11bit;
+	req.burst_type = rip->burst_type;
+	req.fn = Fn;
+	req.ta = ta;
+
 	/* Parse [EGPRS Packet] Channel Request from RACH.ind */
-	rc = parse_rach_ind(rip, &chan_req);
-	if (rc) /* Send RR Immediate Assignment Reject */
-		goto send_imm_ass_rej;
+	req.rc = parse_rach_ind(rip, &chan_req);
+	if (req.rc) /* Send RR Immediate Assignment Reject */
+		goto handle_req;
 
 	if (chan_req.single_block)
 		LOGP(DRLCMAC, LOGL_DEBUG, "MS requests single block allocation\n");
@@ -847,70 +1155,11 @@ int BTS::rcv_rach(const struct rach_ind_params *rip)
 		LOGP(DRLCMAC, LOGL_NOTICE, "EGPRS Packet Channel Request indicates "
 		     "Radio Priority %u, however we ignore it\n", chan_req.priority);
 
-	/* Should we allocate a single block or an Uplink TBF? */
-	if (chan_req.single_block) {
-		rc = sba()->alloc(&trx_no, &ts_no, &sb_fn, ta);
-		if (rc < 0) {
-			LOGP(DRLCMAC, LOGL_NOTICE, "No PDCH resource for "
-			     "single block allocation: rc=%d\n", rc);
-			/* Send RR Immediate Assignment Reject */
-			goto send_imm_ass_rej;
-		}
-
-		tsc = m_bts.trx[trx_no].pdch[ts_no].tsc;
-		LOGP(DRLCMAC, LOGL_DEBUG, "Allocated a single block at "
-		     "SBFn=%u TRX=%u TS=%u\n", sb_fn, trx_no, ts_no);
-	} else {
-		GprsMs *ms = ms_alloc(0, chan_req.egprs_mslot_class);
-		tbf = tbf_alloc_ul_tbf(&m_bts, ms, -1, true);
-		if (!tbf) {
-			LOGP(DRLCMAC, LOGL_NOTICE, "No PDCH resource for Uplink TBF\n");
-			/* Send RR Immediate Assignment Reject */
-			rc = -EBUSY;
-			goto send_imm_ass_rej;
-		}
-
-		/* FIXME: Copy and paste with other routines.. */
-		tbf->set_ta(ta);
-		TBF_SET_STATE(tbf, GPRS_RLCMAC_FLOW);
-		TBF_ASS_TYPE_SET(tbf, GPRS_RLCMAC_FLAG_CCCH);
-		T_START(tbf, T3169, 3169, "RACH (new UL-TBF)", true);
-		trx_no = tbf->trx->trx_no;
-		ts_no = tbf->first_ts;
-		usf = tbf->m_usf[ts_no];
-		tsc = tbf->tsc();
-	}
-
-send_imm_ass_rej:
-	/* Allocate a bit-vector for RR Immediate Assignment [Reject] */
-	struct bitvec *bv = bitvec_alloc(22, tall_pcu_ctx); /* without plen */
-	bitvec_unhex(bv, "2b2b2b2b2b2b2b2b2b2b2b2b2b2b2b2b2b2b2b2b2b2b");
+handle_req:
+	req.single_block = chan_req.single_block;
+	req.egprs_mslot_class = chan_req.egprs_mslot_class;
 
-	if (rc != 0) {
-		LOGP(DRLCMAC, LOGL_DEBUG, "Tx Immediate Assignment Reject on AGCH\n");
-		plen = Encoding::write_immediate_assignment_reject(
-			bv, rip->ra, Fn, rip->burst_type);
-		do_rate_ctr_inc(CTR_IMMEDIATE_ASSIGN_REJ);
-	} else {
-		LOGP(DRLCMAC, LOGL_DEBUG, "Tx Immediate Assignment on AGCH: "
-		     "TRX=%u (ARFCN %u) TS=%u TA=%u TSC=%u TFI=%d USF=%d\n",
-		     trx_no, m_bts.trx[trx_no].arfcn & ~ARFCN_FLAG_MASK,
-		     ts_no, ta, tsc, tbf ? tbf->tfi() : -1, usf);
-		plen = Encoding::write_immediate_assignment(
-			tbf, bv, false, rip->ra, Fn, ta, m_bts.trx[trx_no].arfcn,
-			ts_no, tsc, usf, false, sb_fn, m_bts.alpha, m_bts.gamma, -1,
-			rip->burst_type);
-		do_rate_ctr_inc(CTR_IMMEDIATE_ASSIGN_UL_TBF);
-	}
-
-	if (plen >= 0)
-		pcu_l1if_tx_agch(bv, plen);
-	else
-		rc = plen;
-
-	bitvec_free(bv);
-
-	return rc;
+	return m_rach.rcv(&req);
 }
 
 /* PTCCH/U sub-slot / frame-number mapping (see 3GPP TS 45.002, table 6) */
@@ -995,13 +1244,52 @@ GprsMs *BTS::ms_alloc(uint8_t ms_class, uint8_t egprs_ms_class)
 	GprsMs *ms;
 	ms = ms_store().create_ms();
 
-	ms->set_timeout(osmo_tdef_get(m_bts.T_defs_pcu, -2030, OSMO_TDEF_S, -1));
+	ms->set_timeout(m_bts.params.ms_idle_sec);
 	ms->set_ms_class(ms_class);
 	ms->set_egprs_ms_class(egprs_ms_class);
 
 	return ms;
 }
 
+void BTS::tbf_cursor_start(TbfCursor *cursor, enum gprs_rlcmac_tbf_direction dir)
+{
+	cursor->head = dir == GPRS_RLCMAC_UL_TBF ? &m_ul_tbfs : &m_dl_tbfs;
+	cursor->pos = cursor->head->next;
+	llist_add(&cursor->list, &m_tbf_cursors);
+}
+
+void BTS::tbf_cursor_stop(TbfCursor *cursor)
+{
+	llist_del(&cursor->list);
+	cursor->pos = NULL;
+}
+
+/* TBFs added or rotated to the head of the list after tbf_cursor_start()
+ * are not returned */
+gprs_rlcmac_tbf *BTS::tbf_cursor_next(TbfCursor *cursor)
+{
+	gprs_rlcmac_tbf *tbf;
+
+	if (cursor->pos == cursor->head)
+		return NULL;
+
+	tbf = cursor->pos->entry();
+	cursor->pos = cursor->pos->next;
+	return tbf;
+}
+
+void BTS::tbf_list_del(gprs_rlcmac_tbf *tbf)
+{
+	TbfCursor *cursor;
+
+	llist_for_each_entry(cursor, &m_tbf_cursors, list) {
+		if (cursor->pos == &tbf->list())
+			cursor->pos = cursor->pos->next;
+	}
+
+	llist_del(&tbf->list());
+}
+
 /* update TA based on TA provided by PH-DATA-IND */
 void update_tbf_ta(struct gprs_rlcmac_ul_tbf *tbf, int8_t ta_delta)
 {
@@ -1078,3 +1366,51 @@ void gprs_rlcmac_trx::unreserve_slots(enum gprs_rlcmac_tbf_direction dir,
 		if (slots & (1 << i))
 			pdch[i].unreserve(dir);
 }
+
+/* The PDCH on the TS was enabled/disabled or its number of TBFs changed */
+void gprs_rlcmac_trx::update_pdch_masks(uint8_t ts)
+{
+	const struct gprs_rlcmac_pdch *p = &pdch[ts];
+	uint8_t bit = 1 << ts;
+
+	pdch_mask &= ~bit;
+	idle_pdch_mask &= ~bit;
+
+	if (!p->is_enabled())
+		return;
+
+	pdch_mask |= bit;
+	if (!p->is_draining() && p->num_tbfs(GPRS_RLCMAC_DL_TBF) <= PDCH_IDLE_TBF_THRESH)
+		idle_pdch_mask |= bit;
+}
+
+/* The TFI was attached to or detached from one of the PDCHs */
+void gprs_rlcmac_trx::update_assigned_tfi(enum gprs_rlcmac_tbf_direction dir,
+	uint8_t tfi)
+{
+	uint32_t bit = 1UL << tfi;
+	unsigned ts;
+
+	assigned_tfi[dir] &= ~bit;
+	for (ts = 0; ts < ARRAY_SIZE(pdch); ts++) {
+		if (pdch[ts].is_enabled() && (pdch[ts].assigned_tfi(dir) & bit)) {
+			assigned_tfi[dir] |= bit;
+			return;
+		}
+	}
+}
+
+/* One of the PDCHs was enabled or disabled */
+void gprs_rlcmac_trx::update_assigned_tfis()
+{
+	unsigned ts;
+
+	assigned_tfi[GPRS_RLCMAC_UL_TBF] = 0;
+	assigned_tfi[GPRS_RLCMAC_DL_TBF] = 0;
+	for (ts = 0; ts < ARRAY_SIZE(pdch); ts++) {
+		if (!pdch[ts].is_enabled())
+			continue;
+		assigned_tfi[GPRS_RLCMAC_UL_TBF] |= pdch[ts].assigned_tfi(GPRS_RLCMAC_UL_TBF);
+		assigned_tfi[GPRS_RLCMAC_DL_TBF] |= pdch[ts].assigned_tfi(GPRS_RLCMAC_DL_TBF);
+	}
+}
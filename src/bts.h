@@ -35,6 +35,8 @@ extern "C" {
 
 #include "poll_controller.h"
 #include "sba.h"
+#include "pdch_balancer.h"
+#include "pdch_pool.h"
 #include "tbf.h"
 #include "gprs_ms_storage.h"
 #include "coding_scheme.h"
@@ -42,8 +44,12 @@ extern "C" {
 #endif
 
 #include <pdch.h>
+#include <rach_ctrl.h>
+#include <pcu_hist.h>
 #include <stdint.h>
 
+#include <osmocom/gsm/protocol/gsm_23_003.h>
+
 #define LLC_CODEL_DISABLE 0
 #define LLC_CODEL_USE_DEFAULT (-1)
 
@@ -73,11 +79,21 @@ enum pcu_gsmtap_category {
 struct BTS;
 struct GprsMs;
 
+/* Consider a PDCH as idle if has at most this number of TBFs assigned to it */
+#define PDCH_IDLE_TBF_THRESH	1
+
 struct gprs_rlcmac_trx {
 	void *fl1h;
 	uint16_t arfcn;
 	struct gprs_rlcmac_pdch pdch[8];
 
+	/* summary of the enabled PDCHs for the allocator, updated by the
+	 * PDCHs when they are enabled/disabled and on attach/detach */
+	uint8_t pdch_mask; /* enabled PDCHs */
+	uint8_t idle_pdch_mask; /* enabled PDCHs with few DL TBFs */
+	uint32_t assigned_tfi[2]; /* TFIs used on any enabled PDCH, bit set */
+	uint8_t dyn_pdch_mask; /* TS the BTS switches to PDCH on request */
+
 	/* back pointers */
 	struct BTS *bts;
 	uint8_t trx_no;
@@ -85,6 +101,10 @@ struct gprs_rlcmac_trx {
 #ifdef __cplusplus
 	void reserve_slots(enum gprs_rlcmac_tbf_direction dir, uint8_t slots);
 	void unreserve_slots(enum gprs_rlcmac_tbf_direction dir, uint8_t slots);
+
+	void update_pdch_masks(uint8_t ts);
+	void update_assigned_tfi(enum gprs_rlcmac_tbf_direction dir, uint8_t tfi);
+	void update_assigned_tfis();
 #endif
 };
 
@@ -96,6 +116,37 @@ void bts_update_tbf_ta(const char *p, uint32_t fn, uint8_t trx_no, uint8_t ts, i
 }
 #endif
 
+/* Timers started by TBFs through T_START() */
+enum bts_tbf_timer_param {
+	BTS_TP_T3169,
+	BTS_TP_T3191,
+	BTS_TP_T3193,
+	BTS_TP_T3195,
+	BTS_TP_X2000,
+	BTS_TP_X2001,
+	BTS_TP_X2002,
+	_NUM_BTS_TP
+};
+
+/**
+ * Timer values as the scheduler, TBF and MS code needs them, so that no
+ * osmo_tdef lookup is done per RTS. Rebuilt by bts_update_params() after
+ * T_defs_bts or T_defs_pcu changed.
+ */
+struct gprs_rlcmac_bts_params {
+	struct {
+		unsigned int sec;
+		unsigned int usec;
+	} tbf_timer[_NUM_BTS_TP];
+	int dl_tbf_idle_frames; /* X2031, -1 if idle DL TBFs are not kept open */
+	int dl_age_low_frames; /* DL TBF age to send dummy blocks on the control TS */
+	int dl_age_high_frames; /* min(T3190 / 2, X2031) */
+	int ul_tbf_ext_frames; /* X2032, -1 if UL TBFs are not kept in extended mode */
+	int ul_tbf_ext_usf_frames; /* X2033 */
+	unsigned long ms_idle_sec; /* X2030 */
+	unsigned long paging_suppress_ms; /* X2040 */
+};
+
 /**
  * This is the data from C. As soon as our minimal compiler is gcc 4.7
  * we can start to compile pcu_vty.c with c++ and remove the split.
@@ -125,11 +176,23 @@ struct gprs_rlcmac_bts {
 	/* Timer defintions */
 	struct osmo_tdef *T_defs_bts; /* timers controlled by BTS, received through PCUIF */
 	struct osmo_tdef *T_defs_pcu; /* timers controlled by PCU */
+	struct gprs_rlcmac_bts_params params;
 	uint8_t n3101;
 	uint8_t n3103;
 	uint8_t n3105;
 	struct gsmtap_inst *gsmtap;
 	uint32_t gsmtap_categ_mask;
+	/* send GSMTAP from a helper thread, optionally also into a file */
+	bool gsmtap_async;
+	char *gsmtap_pcap_path;
+	/* send only every n-th frame of a category, 0 and 1 send all */
+	uint16_t gsmtap_sample[32];
+	/* send only frames on this TRX/TS (-1 for all) and on the PDCHs of
+	 * the MS with this TLLI or IMSI (0 resp. empty for all) */
+	int8_t gsmtap_filter_trx;
+	int8_t gsmtap_filter_ts;
+	uint32_t gsmtap_filter_tlli;
+	char gsmtap_filter_imsi[OSMO_IMSI_BUF_SIZE];
 	struct gprs_rlcmac_trx trx[8];
 	int (*alloc_algorithm)(struct gprs_rlcmac_bts *bts, struct GprsMs *ms, struct gprs_rlcmac_tbf *tbf,
 			       bool single, int8_t use_tbf);
@@ -138,6 +201,22 @@ struct gprs_rlcmac_bts {
 	uint8_t alpha, gamma;
 	uint8_t egprs_enabled;
 	bool dl_tbf_preemptive_retransmission;
+	/* poll DL ack/nack and send UL ack/nack based on window fill and
+	 * the measured poll round trip instead of a fixed block count */
+	bool adaptive_ack_nack;
+	/* always poll with RRBP 0 instead of the earliest free uplink block */
+	bool fixed_rrbp;
+	/* move busy DL TBFs to less loaded PDCHs every this many seconds
+	 * (0 = never), if their share of the PDCHs grows by min_gain % */
+	uint16_t rebalance_interval;
+	uint16_t rebalance_min_gain;
+	/* keep between min and max of the dynamic TS as PDCH, more of them
+	 * while the busy share of the PDCHs is above load_high % or TBFs
+	 * cannot be allocated, fewer while it is below load_low % */
+	uint8_t dyn_pdch_min;
+	uint8_t dyn_pdch_max; /* 0 = leave the dynamic TS to the BTS */
+	uint8_t dyn_pdch_load_high;
+	uint8_t dyn_pdch_load_low;
 	uint8_t si13[GSM_MACBLOCK_LEN];
 	bool si13_is_set;
 	/* 0 to support resegmentation in DL, 1 for no reseg */
@@ -166,10 +245,48 @@ struct gprs_rlcmac_bts {
 
 	/* Path to be used for the pcu-bts socket */
 	char *pcu_sock_path;
+	/* Offer shared memory rings to the BTS on the pcu-bts socket */
+	bool pcu_sock_shm;
 
 	/* Are we talking Gb with IP-SNS (true) or classic Gb? */
 	bool gb_dialect_sns;
 
+	/* Max number of queued Gb UNITDATA PDUs handled per main loop
+	 * iteration, 0 handles them inline from the NS callback */
+	uint8_t gb_queue_budget;
+
+	/* Time spent from receiving an RTS until the DATA.req is sent (us) */
+	struct pcu_hist rts_latency;
+	/* Time an LLC frame waited in the queue until it is segmented (ms) */
+	struct pcu_hist llc_queue_delay;
+	/* Time from polling for a DL Ack/Nack until it is received (ms) */
+	struct pcu_hist dl_ack_rtt;
+
+	/* Lock the memory, prefault rt_heap_mb of heap and pin the RLC/MAC
+	 * loop to rt_cpu (-1 = any), see pcu_rt.h */
+	bool realtime;
+	int16_t rt_cpu;
+	uint16_t rt_heap_mb;
+	/* RTS and DATA.ind taking longer than this are overruns (us) */
+	uint32_t rt_deadline_us;
+	/* abort when the talloc heap grows on the RTS/DATA.ind paths,
+	 * instead of counting it */
+	bool rt_alloc_abort;
+
+	/* Max number of pending paging records per PDCH, 0 = no limit */
+	uint8_t paging_queue_depth;
+
+	/* Max number of queued RACH.ind handled per TDMA frame, 0 handles
+	 * them as they are received */
+	uint8_t rach_queue_budget;
+	/* RACH admission control, see enum rach_bucket_id */
+	struct rach_bucket_params rach_buckets[_RACH_BUCKET_NUM];
+	/* Wait Indication (T3142, s) sent in Immediate Assignment Reject */
+	uint8_t rach_wait_ind;
+
+	/* Max octets queued in the LLC queues of all MS, 0 = unlimited */
+	uint32_t llc_queue_budget;
+
 	/* Packet Application Information (3GPP TS 44.060 11.2.47, usually ETWS primary message). We don't need to store
 	 * more than one message, because they get sent so rarely. */
 	struct msgb *app_info;
@@ -262,10 +379,36 @@ enum {
 	CTR_EGPRS_UL_MCS7,
 	CTR_EGPRS_UL_MCS8,
 	CTR_EGPRS_UL_MCS9,
+	CTR_PAGING_SUPPRESSED,
+	CTR_PAGING_DROPPED,
+	CTR_RACH_QUEUED,
+	CTR_RACH_DUPLICATE,
+	CTR_RACH_DROPPED,
+	CTR_RACH_THROTTLED,
+	CTR_RACH_EARLY_REJECTED,
+	CTR_POLL_DEFERRED_PENDING,
+	CTR_POLL_DEFERRED_NO_BLOCK,
+	CTR_POLL_LATE_RRBP,
+	CTR_LLC_FRAME_EVICTED,
+	CTR_GSMTAP_DROPPED,
+	CTR_TBF_REBALANCED,
+	CTR_TBF_ALLOC_FAILED,
+	CTR_PDCH_DYN_ACTIVATED,
+	CTR_PDCH_DYN_RELEASED,
+	CTR_TBF_UL_EXT_IDLE,
+	CTR_TBF_UL_EXT_RESUMED,
 };
 
 enum {
 	STAT_MS_PRESENT,
+	STAT_RTS_LATENCY_AVG,
+	STAT_RTS_LATENCY_P90,
+	STAT_LLC_QUEUE_DELAY_AVG,
+	STAT_LLC_QUEUE_DELAY_P90,
+	STAT_DL_ACK_RTT_AVG,
+	STAT_DL_ACK_RTT_P90,
+	STAT_LLC_QUEUE_OCTETS,
+	STAT_LLC_QUEUE_FRAMES,
 };
 
 /* RACH.ind parameters (to be parsed) */
@@ -302,6 +445,10 @@ public:
 
 	struct gprs_rlcmac_bts *bts_data();
 	SBAController *sba();
+	RachController *rach();
+	LlcController *llc();
+	PdchBalancer *balancer();
+	PdchPool *pdch_pool();
 
 	/** TODO: change the number to unsigned */
 	void set_current_frame_number(int frame_number);
@@ -310,6 +457,8 @@ public:
 
 	/** add paging to paging queue(s) */
 	int add_paging(uint8_t chan_needed, const uint8_t *mi, uint8_t mi_len);
+	/** a TBF on this TRX changed its set of PDCHs */
+	void tbf_slots_changed(uint8_t trx, uint8_t old_mask, uint8_t new_mask);
 
 	gprs_rlcmac_dl_tbf *dl_tbf_by_poll_fn(uint32_t fn, uint8_t trx, uint8_t ts);
 	gprs_rlcmac_ul_tbf *ul_tbf_by_poll_fn(uint32_t fn, uint8_t trx, uint8_t ts);
@@ -348,24 +497,78 @@ public:
 	void do_rate_ctr_inc(unsigned int ctr_id);
 	void do_rate_ctr_add(unsigned int ctr_id, int inc);
 	void stat_item_add(unsigned int stat_id, int inc);
+	void publish_latency_stats(uint32_t fn);
 
 	LListHead<gprs_rlcmac_tbf>& ul_tbfs();
 	LListHead<gprs_rlcmac_tbf>& dl_tbfs();
+
+	/* Position in the UL or DL TBF list that is moved on when the TBF it
+	 * points to leaves the list, so the list can be walked across main
+	 * loop iterations */
+	struct TbfCursor {
+		struct llist_head list;
+		LListHead<gprs_rlcmac_tbf> *head;
+		LListHead<gprs_rlcmac_tbf> *pos;
+	};
+
+	void tbf_cursor_start(TbfCursor *cursor, enum gprs_rlcmac_tbf_direction dir);
+	void tbf_cursor_stop(TbfCursor *cursor);
+	gprs_rlcmac_tbf *tbf_cursor_next(TbfCursor *cursor);
+	/* take the TBF out of its list, instead of llist_del() */
+	void tbf_list_del(gprs_rlcmac_tbf *tbf);
 private:
 	int m_cur_fn;
 	int m_cur_blk_fn;
 	struct gprs_rlcmac_bts m_bts;
 	PollController m_pollController;
 	SBAController m_sba;
+	RachController m_rach;
+	/* before m_ms_store, the queues of the MS outlive it */
+	LlcController m_llc;
+	PdchBalancer m_balancer;
+	PdchPool m_pdch_pool;
 	struct rate_ctr_group *m_ratectrs;
 	struct osmo_stat_item_group *m_statg;
 
+	/* histograms as of the last publish_latency_stats() */
+	struct pcu_hist m_published_rts_latency;
+	struct pcu_hist m_published_llc_queue_delay;
+	struct pcu_hist m_published_dl_ack_rtt;
+	int32_t m_published_fn;
+
 	GprsMsStorage m_ms_store;
 
 	/* list of uplink TBFs */
 	LListHead<gprs_rlcmac_tbf> m_ul_tbfs;
 	/* list of downlink TBFs */
 	LListHead<gprs_rlcmac_tbf> m_dl_tbfs;
+	/* TbfCursors on the lists above */
+	struct llist_head m_tbf_cursors;
+
+	/* Number of TBFs per TRX and set of PDCHs they use, and a bitmap of
+	 * the sets in use, so paging does not need to walk all TBFs */
+	uint16_t m_slot_mask_refs[8][256];
+	uint64_t m_slot_masks_used[8][256 / 64];
+
+	/* MIs paged recently, to suppress repeated paging during storms */
+	struct paging_record {
+		uint8_t identity_lv[9];
+		struct timespec expires;
+	} m_paged[32];
+	unsigned m_paged_next;
+
+	/* frames seen per GSMTAP category, for sampling */
+	unsigned int m_gsmtap_seen[32];
+	/* PDCHs of the MS of the GSMTAP filter as of m_gsmtap_filter_fn */
+	int32_t m_gsmtap_filter_fn;
+	int8_t m_gsmtap_filter_trx;
+	uint8_t m_gsmtap_filter_slots;
+
+	uint8_t paging_slot_mask(uint8_t trx) const;
+	bool paging_suppressed(const uint8_t *mi, uint8_t mi_len);
+	bool gsmtap_wanted(enum pcu_gsmtap_category categ, uint8_t trx_no,
+			   uint8_t ts_no);
+	bool gsmtap_ms_filter(uint8_t trx_no, uint8_t ts_no);
 
 	/* disable copying to avoid slicing */
 	BTS(const BTS&);
@@ -382,6 +585,26 @@ inline SBAController *BTS::sba()
 	return &m_sba;
 }
 
+inline RachController *BTS::rach()
+{
+	return &m_rach;
+}
+
+inline LlcController *BTS::llc()
+{
+	return &m_llc;
+}
+
+inline PdchBalancer *BTS::balancer()
+{
+	return &m_balancer;
+}
+
+inline PdchPool *BTS::pdch_pool()
+{
+	return &m_pdch_pool;
+}
+
 inline GprsMsStorage &BTS::ms_store()
 {
 	return m_ms_store;
@@ -439,6 +662,10 @@ extern "C" {
 	struct gprs_rlcmac_bts *bts_main_data();
 	struct rate_ctr_group *bts_main_data_stats();
 	struct osmo_stat_item_group *bts_main_data_stat_items();
+	void bts_update_params(struct gprs_rlcmac_bts *bts);
+	int bts_tbf_timer_param(int T);
+	int bts_gsmtap_export_update(struct gprs_rlcmac_bts *bts);
+	int bts_realtime_update(struct gprs_rlcmac_bts *bts);
 #ifdef __cplusplus
 }
 
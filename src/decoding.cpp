@@ -350,47 +350,31 @@ void Decoding::extract_rbb(const struct bitvec *rbb, char *show_rbb)
 	show_rbb[i] = '\0';
 }
 
-int Decoding::rlc_parse_ul_data_header(struct gprs_rlc_data_info *rlc,
-	const uint8_t *data, enum CodingScheme cs)
-{
-	unsigned int cur_bit = 0;
-	switch(mcs_header_type(cs)) {
-	case HEADER_GPRS_DATA :
-		cur_bit = rlc_parse_ul_data_header_gprs(rlc, data, cs);
-		break;
-	case HEADER_EGPRS_DATA_TYPE_3 :
-		cur_bit = rlc_parse_ul_data_header_egprs_type_3(rlc, data, cs);
-		break;
-	case HEADER_EGPRS_DATA_TYPE_2 :
-		cur_bit = rlc_parse_ul_data_header_egprs_type_2(rlc, data, cs);
-		break;
-	case HEADER_EGPRS_DATA_TYPE_1 :
-		cur_bit = rlc_parse_ul_data_header_egprs_type_1(rlc, data, cs);
-		break;
-	default:
-		LOGP(DRLCMACDL, LOGL_ERROR,
-			"Decoding of uplink %s data blocks not yet supported.\n",
-			mcs_name(cs));
-		return -ENOTSUP;
-	};
+typedef int (*ul_data_header_parser)(struct gprs_rlc_data_info *rlc,
+	const uint8_t *data, enum CodingScheme cs);
 
-	return cur_bit;
-}
+/* One parser per header type, the position of the fields is fixed by the
+ * header type and the rest comes from the layout of the coding scheme */
+template <enum HeaderType ht>
+static int parse_ul_data_header(struct gprs_rlc_data_info *rlc,
+	const uint8_t *data, enum CodingScheme cs);
 
-int Decoding::rlc_parse_ul_data_header_egprs_type_3(
+template <>
+int parse_ul_data_header<HEADER_EGPRS_DATA_TYPE_3>(
 	struct gprs_rlc_data_info *rlc,
-	const uint8_t *data,
-	const enum CodingScheme &cs)
+	const uint8_t *data, enum CodingScheme cs)
 {
-	int punct, punct2, with_padding, cps;
-	unsigned int e_ti_header, offs, cur_bit = 0;
 	const struct gprs_rlc_ul_header_egprs_3 *egprs3;
+	const struct gprs_rlc_layout *layout;
+	unsigned int e_ti_header, offs, cps, cur_bit = 0;
+	bool with_padding;
 
-	egprs3 = static_cast < struct gprs_rlc_ul_header_egprs_3 * >
-			((void *)data);
+	egprs3 = static_cast < const struct gprs_rlc_ul_header_egprs_3 * >
+			((const void *)data);
 
 	cps    = (egprs3->cps_hi << 0)  | (egprs3->cps_lo << 2);
-	gprs_rlc_mcs_cps_decode(cps, cs, &punct, &punct2, &with_padding);
+	with_padding = gprs_rlc_mcs_cps_padding(cps, cs);
+	layout = gprs_rlc_layout(cs, true, with_padding);
 	gprs_rlc_data_info_init_ul(rlc, cs, with_padding);
 
 	rlc->r      = egprs3->r;
@@ -414,25 +398,27 @@ int Decoding::rlc_parse_ul_data_header_egprs_type_3(
 	rlc->block_info[0].ti  = !!(e_ti_header & 0x02);
 	cur_bit += 2;
 	/* skip data area */
-	cur_bit += mcs_max_data_block_bytes(cs) * 8;
+	cur_bit += layout->data_bytes * 8;
 
 	return cur_bit;
 }
 
-int Decoding::rlc_parse_ul_data_header_egprs_type_2(
+template <>
+int parse_ul_data_header<HEADER_EGPRS_DATA_TYPE_2>(
 	struct gprs_rlc_data_info *rlc,
-	const uint8_t *data,
-	const enum CodingScheme &cs)
+	const uint8_t *data, enum CodingScheme cs)
 {
 	const struct gprs_rlc_ul_header_egprs_2 *egprs2;
-	unsigned int e_ti_header, offs, cur_bit = 0;
-	int punct, punct2, with_padding, cps;
+	const struct gprs_rlc_layout *layout;
+	unsigned int e_ti_header, offs, cps, cur_bit = 0;
+	bool with_padding;
 
-	egprs2 = static_cast < struct gprs_rlc_ul_header_egprs_2 * >
-			((void *)data);
+	egprs2 = static_cast < const struct gprs_rlc_ul_header_egprs_2 * >
+			((const void *)data);
 
 	cps    = (egprs2->cps_hi << 0)  | (egprs2->cps_lo << 2);
-	gprs_rlc_mcs_cps_decode(cps, cs, &punct, &punct2, &with_padding);
+	with_padding = gprs_rlc_mcs_cps_padding(cps, cs);
+	layout = gprs_rlc_layout(cs, true, with_padding);
 	gprs_rlc_data_info_init_ul(rlc, cs, with_padding);
 
 	rlc->r      = egprs2->r;
@@ -458,23 +444,25 @@ int Decoding::rlc_parse_ul_data_header_egprs_type_2(
 	cur_bit += 2;
 
 	/* skip data area */
-	cur_bit += mcs_max_data_block_bytes(cs) * 8;
+	cur_bit += layout->data_bytes * 8;
 
 	return cur_bit;
 }
 
-int Decoding::rlc_parse_ul_data_header_egprs_type_1(
+template <>
+int parse_ul_data_header<HEADER_EGPRS_DATA_TYPE_1>(
 	struct gprs_rlc_data_info *rlc,
-	const uint8_t *data, const enum CodingScheme &cs)
+	const uint8_t *data, enum CodingScheme cs)
 {
-	struct gprs_rlc_ul_header_egprs_1 *egprs1;
+	const struct gprs_rlc_ul_header_egprs_1 *egprs1;
+	const struct gprs_rlc_layout *layout;
 	unsigned int e_ti_header, cur_bit = 0, offs;
-	int punct, punct2, with_padding;
+	bool with_padding;
 
-	egprs1 = static_cast < struct gprs_rlc_ul_header_egprs_1 * >
-		((void *)data);
-	gprs_rlc_mcs_cps_decode(egprs1->cps, cs, &punct, &punct2,
-		&with_padding);
+	egprs1 = static_cast < const struct gprs_rlc_ul_header_egprs_1 * >
+		((const void *)data);
+	with_padding = gprs_rlc_mcs_cps_padding(egprs1->cps, cs);
+	layout = gprs_rlc_layout(cs, true, with_padding);
 	gprs_rlc_data_info_init_ul(rlc, cs, with_padding);
 
 	rlc->r      = egprs1->r;
@@ -517,20 +505,23 @@ int Decoding::rlc_parse_ul_data_header_egprs_type_1(
 	rlc->block_info[1].ti  = !!(e_ti_header & 0x02);
 	cur_bit += 2;
 	/* skip data area */
-	cur_bit += mcs_max_data_block_bytes(cs) * 8;
+	cur_bit += layout->data_bytes * 8;
 
 	return cur_bit;
 }
 
-int Decoding::rlc_parse_ul_data_header_gprs(struct gprs_rlc_data_info *rlc,
-	const uint8_t *data, const enum CodingScheme &cs)
+template <>
+int parse_ul_data_header<HEADER_GPRS_DATA>(struct gprs_rlc_data_info *rlc,
+	const uint8_t *data, enum CodingScheme cs)
 {
 	const struct rlc_ul_header *gprs;
+	const struct gprs_rlc_layout *layout;
 	unsigned int cur_bit = 0;
 
-	gprs = static_cast < struct rlc_ul_header * >
-		((void *)data);
+	gprs = static_cast < const struct rlc_ul_header * >
+		((const void *)data);
 
+	layout = gprs_rlc_layout(cs, true, false);
 	gprs_rlc_data_info_init_ul(rlc, cs, false);
 
 	rlc->r      = gprs->r;
@@ -547,11 +538,35 @@ int Decoding::rlc_parse_ul_data_header_gprs(struct gprs_rlc_data_info *rlc,
 	rlc->block_info[0].spb = 0;
 	cur_bit += rlc->data_offs_bits[0];
 	/* skip data area */
-	cur_bit += mcs_max_data_block_bytes(cs) * 8;
+	cur_bit += layout->data_bytes * 8;
 
 	return cur_bit;
 }
 
+static const ul_data_header_parser ul_data_header_parsers[NUM_HEADER_TYPES] = {
+	/* [HEADER_INVALID] */		NULL,
+	/* [HEADER_GPRS_CONTROL] */	NULL,
+	/* [HEADER_GPRS_DATA] */	parse_ul_data_header<HEADER_GPRS_DATA>,
+	/* [HEADER_EGPRS_DATA_TYPE_1] */	parse_ul_data_header<HEADER_EGPRS_DATA_TYPE_1>,
+	/* [HEADER_EGPRS_DATA_TYPE_2] */	parse_ul_data_header<HEADER_EGPRS_DATA_TYPE_2>,
+	/* [HEADER_EGPRS_DATA_TYPE_3] */	parse_ul_data_header<HEADER_EGPRS_DATA_TYPE_3>,
+};
+
+int Decoding::rlc_parse_ul_data_header(struct gprs_rlc_data_info *rlc,
+	const uint8_t *data, enum CodingScheme cs)
+{
+	ul_data_header_parser parse = ul_data_header_parsers[mcs_header_type(cs)];
+
+	if (!parse) {
+		LOGP(DRLCMACDL, LOGL_ERROR,
+			"Decoding of uplink %s data blocks not yet supported.\n",
+			mcs_name(cs));
+		return -ENOTSUP;
+	}
+
+	return parse(rlc, data, cs);
+}
+
 /**
  * \brief Copy LSB bitstream RLC data block to byte aligned buffer.
  *
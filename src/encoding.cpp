@@ -362,11 +362,34 @@ static int write_ia_rest_egprs_uplink_sba(const gprs_rlcmac_ul_tbf *tbf, bitvec
 int Encoding::write_immediate_assignment_reject(
 	bitvec *dest, uint16_t ra,
 	uint32_t ref_fn,
-	enum ph_burst_type burst_type)
+	enum ph_burst_type burst_type,
+	uint8_t wait_ind)
+{
+	struct imm_ass_rej_ref ref;
+
+	ref.ra = ra;
+	ref.fn = ref_fn;
+	ref.burst_type = burst_type;
+
+	return write_immediate_assignment_reject(dest, &ref, 1, wait_ind);
+}
+
+static inline bool is_ext_ra(enum ph_burst_type burst_type)
+{
+	return burst_type == GSM_L1_BURST_TYPE_ACCESS_1 ||
+		burst_type == GSM_L1_BURST_TYPE_ACCESS_2;
+}
+
+/* Reject up to four requests with one message */
+int Encoding::write_immediate_assignment_reject(
+	bitvec *dest, const struct imm_ass_rej_ref *refs,
+	unsigned int num_refs, uint8_t wait_ind)
 {
 	unsigned wp = 0;
 	int plen;
-	int i;
+	unsigned i;
+
+	OSMO_ASSERT(num_refs >= 1 && num_refs <= 4);
 
 	bitvec_write_field(dest, &wp, 0x0, 4);  // Skip Indicator
 	bitvec_write_field(dest, &wp, 0x6, 4);  // Protocol Discriminator
@@ -385,25 +408,24 @@ int Encoding::write_immediate_assignment_reject(
 	 * If necessary the request reference information element and the
 	 * wait indication information element should be duplicated to
 	 * fill the message.
-	 * TODO: group rejection for multiple MS
 	*/
 	for (i = 0; i < 4; i++) {
+		const struct imm_ass_rej_ref *ref = &refs[i % num_refs];
+
 		//10.5.2.30 Request Reference
-		if (((burst_type == GSM_L1_BURST_TYPE_ACCESS_1) ||
-			(burst_type == GSM_L1_BURST_TYPE_ACCESS_2))) {
+		if (is_ext_ra(ref->burst_type)) {
 			//9.1.20.2a of 44.018 version 11.7.0 Release 11
 			bitvec_write_field(dest, &wp, 0x7f, 8);  /* RACH value */
 		} else {
-			bitvec_write_field(dest, &wp, ra, 8);	/* RACH value */
+			bitvec_write_field(dest, &wp, ref->ra, 8);	/* RACH value */
 		}
 
 		bitvec_write_field(dest, &wp,
-					(ref_fn / (26 * 51)) % 32, 5); // T1'
-		bitvec_write_field(dest, &wp, ref_fn % 51, 6);          // T3
-		bitvec_write_field(dest, &wp, ref_fn % 26, 5);          // T2
+					(ref->fn / (26 * 51)) % 32, 5); // T1'
+		bitvec_write_field(dest, &wp, ref->fn % 51, 6);          // T3
+		bitvec_write_field(dest, &wp, ref->fn % 26, 5);          // T2
 
-		/* TODO: Make it configurable */
-		bitvec_write_field(dest, &wp, 20, 8); //Wait Indication 1
+		bitvec_write_field(dest, &wp, wait_ind, 8); //Wait Indication
 	}
 
 	plen = wp / 8;
@@ -414,21 +436,18 @@ int Encoding::write_immediate_assignment_reject(
 		return -1;
 	}
 
-	// Extended RA
-	else if (((burst_type == GSM_L1_BURST_TYPE_ACCESS_1) ||
-			(burst_type == GSM_L1_BURST_TYPE_ACCESS_2))) {
-		//9.1.20.2a of 44.018 version 11.7.0 Release 11
-		uint8_t extended_ra = 0;
+	// Extended RA, only for the distinct request references
+	for (i = 0; i < 4; i++) {
+		if (i < num_refs && is_ext_ra(refs[i].burst_type)) {
+			//9.1.20.2a of 44.018 version 11.7.0 Release 11
+			uint8_t extended_ra = (refs[i].ra & 0x1F);
 
-		extended_ra = (ra & 0x1F);
-		bitvec_write_field(dest, &wp, 0x1, 1);
-		bitvec_write_field(dest, &wp, extended_ra, 5); /* Extended RA */
-	} else {
-		bitvec_write_field(dest, &wp, 0x0, 1);
+			bitvec_write_field(dest, &wp, 0x1, 1);
+			bitvec_write_field(dest, &wp, extended_ra, 5); /* Extended RA */
+		} else {
+			bitvec_write_field(dest, &wp, 0x0, 1);
+		}
 	}
-	bitvec_write_field(dest, &wp, 0x0, 1);
-	bitvec_write_field(dest, &wp, 0x0, 1);
-	bitvec_write_field(dest, &wp, 0x0, 1);
 
 	return plen;
 }
@@ -559,7 +578,7 @@ void Encoding::write_packet_uplink_assignment(
 	uint8_t ta_ts = 0; /* FIXME: supply it as parameter from caller */
 
 	bitvec_write_field(dest, &wp,0x1,2);  // Payload Type
-	bitvec_write_field(dest, &wp,0x0,2);  // Uplink block with TDMA framenumber (N+13)
+	bitvec_write_field(dest, &wp,rrbp,2);  // Uplink block with TDMA framenumber
 	bitvec_write_field(dest, &wp,poll,1);  // Suppl/Polling Bit
 	bitvec_write_field(dest, &wp,0x0,3);  // Uplink state flag
 	bitvec_write_field(dest, &wp,0xa,6);  // MESSAGE TYPE
@@ -674,7 +693,7 @@ void Encoding::write_packet_downlink_assignment(RlcMacDownlink_t * block,
 	block->u.Packet_Downlink_Assignment.CONTROL_ACK         = tbf->was_releasing; // NW establishes no new DL TBF for the MS with running timer T3192
 	block->u.Packet_Downlink_Assignment.TIMESLOT_ALLOCATION = 0;   // timeslot(s)
 	for (tn = 0; tn < 8; tn++) {
-		if (tbf->pdch[tn])
+		if (tbf->assigned_dl_slots() & (1 << tn))
 			block->u.Packet_Downlink_Assignment.TIMESLOT_ALLOCATION |= 0x80 >> tn;   // timeslot(s)
 	}
 
@@ -1101,132 +1120,169 @@ unsigned Encoding::write_repeated_page_info(bitvec * dest, unsigned& wp, uint8_t
 	return wp;
 }
 
-int Encoding::rlc_write_dl_data_header(const struct gprs_rlc_data_info *rlc,
+typedef void (*dl_data_header_writer)(const struct gprs_rlc_data_info *rlc,
+	uint8_t *data);
+
+/* One writer per header type, like parse_ul_data_header() */
+template <enum HeaderType ht>
+static void write_dl_data_header(const struct gprs_rlc_data_info *rlc,
+	uint8_t *data);
+
+template <>
+void write_dl_data_header<HEADER_GPRS_DATA>(const struct gprs_rlc_data_info *rlc,
+	uint8_t *data)
+{
+	struct rlc_dl_header *gprs;
+
+	gprs = static_cast<struct rlc_dl_header *>
+		((void *)data);
+
+	gprs->usf   = rlc->usf;
+	gprs->s_p   = rlc->es_p != 0 ? 1 : 0;
+	gprs->rrbp  = rlc->rrbp;
+	gprs->pt    = 0;
+	gprs->tfi   = rlc->tfi;
+	gprs->pr    = rlc->pr;
+
+	gprs->fbi   = rlc->block_info[0].cv == 0;
+	gprs->e     = rlc->block_info[0].e;
+	gprs->bsn   = rlc->block_info[0].bsn;
+}
+
+template <>
+void write_dl_data_header<HEADER_EGPRS_DATA_TYPE_1>(const struct gprs_rlc_data_info *rlc,
 	uint8_t *data)
 {
 	struct gprs_rlc_dl_header_egprs_1 *egprs1;
+	unsigned int e_fbi_header;
+	unsigned int offs;
+	unsigned int bsn_delta;
+
+	egprs1 = static_cast<struct gprs_rlc_dl_header_egprs_1 *>
+		((void *)data);
+
+	egprs1->usf    = rlc->usf;
+	egprs1->es_p   = rlc->es_p;
+	egprs1->rrbp   = rlc->rrbp;
+	egprs1->tfi_hi = rlc->tfi >> 0; /* 1 bit LSB */
+	egprs1->tfi_lo = rlc->tfi >> 1; /* 4 bits */
+	egprs1->pr     = rlc->pr;
+	egprs1->cps    = rlc->cps;
+
+	egprs1->bsn1_hi  = rlc->block_info[0].bsn >> 0; /* 2 bits LSB */
+	egprs1->bsn1_mid = rlc->block_info[0].bsn >> 2; /* 8 bits */
+	egprs1->bsn1_lo  = rlc->block_info[0].bsn >> 10; /* 1 bit */
+
+	bsn_delta = (rlc->block_info[1].bsn - rlc->block_info[0].bsn) &
+		(RLC_EGPRS_SNS - 1);
+
+	egprs1->bsn2_hi = bsn_delta >> 0; /* 7 bits LSB */
+	egprs1->bsn2_lo = bsn_delta >> 7; /* 3 bits */
+
+	/* first FBI/E header */
+	e_fbi_header   = rlc->block_info[0].e       ? 0x01 : 0;
+	e_fbi_header  |= rlc->block_info[0].cv == 0 ? 0x02 : 0; /* FBI */
+	offs = rlc->data_offs_bits[0] / 8;
+	OSMO_ASSERT(rlc->data_offs_bits[0] % 8 == 2);
+	e_fbi_header <<= 0;
+	data[offs] = (data[offs] & 0b11111100) | e_fbi_header;
+
+	/* second FBI/E header */
+	e_fbi_header   = rlc->block_info[1].e       ? 0x01 : 0;
+	e_fbi_header  |= rlc->block_info[1].cv == 0 ? 0x02 : 0; /* FBI */
+	offs = rlc->data_offs_bits[1] / 8;
+	OSMO_ASSERT(rlc->data_offs_bits[1] % 8 == 4);
+	e_fbi_header <<= 2;
+	data[offs] = (data[offs] & 0b11110011) | e_fbi_header;
+}
+
+template <>
+void write_dl_data_header<HEADER_EGPRS_DATA_TYPE_2>(const struct gprs_rlc_data_info *rlc,
+	uint8_t *data)
+{
 	struct gprs_rlc_dl_header_egprs_2 *egprs2;
+	unsigned int e_fbi_header;
+	unsigned int offs;
+
+	egprs2 = static_cast<struct gprs_rlc_dl_header_egprs_2 *>
+		((void *)data);
+
+	egprs2->usf    = rlc->usf;
+	egprs2->es_p   = rlc->es_p;
+	egprs2->rrbp   = rlc->rrbp;
+	egprs2->tfi_hi = rlc->tfi >> 0; /* 1 bit LSB */
+	egprs2->tfi_lo = rlc->tfi >> 1; /* 4 bits */
+	egprs2->pr     = rlc->pr;
+	egprs2->cps    = rlc->cps;
+
+	egprs2->bsn1_hi  = rlc->block_info[0].bsn >> 0; /* 2 bits LSB */
+	egprs2->bsn1_mid = rlc->block_info[0].bsn >> 2; /* 8 bits */
+	egprs2->bsn1_lo  = rlc->block_info[0].bsn >> 10; /* 1 bit */
+
+	e_fbi_header   = rlc->block_info[0].e       ? 0x01 : 0;
+	e_fbi_header  |= rlc->block_info[0].cv == 0 ? 0x02 : 0; /* FBI */
+	offs = rlc->data_offs_bits[0] / 8;
+	OSMO_ASSERT(rlc->data_offs_bits[0] % 8 == 6);
+	e_fbi_header <<= 4;
+	data[offs] = (data[offs] & 0b11001111) | e_fbi_header;
+}
+
+template <>
+void write_dl_data_header<HEADER_EGPRS_DATA_TYPE_3>(const struct gprs_rlc_data_info *rlc,
+	uint8_t *data)
+{
 	struct gprs_rlc_dl_header_egprs_3 *egprs3;
-	struct rlc_dl_header *gprs;
 	unsigned int e_fbi_header;
-	enum CodingScheme cs = rlc->cs;
 	unsigned int offs;
-	unsigned int bsn_delta;
 
-	switch(mcs_header_type(cs)) {
-	case HEADER_GPRS_DATA:
-		gprs = static_cast<struct rlc_dl_header *>
-			((void *)data);
-
-		gprs->usf   = rlc->usf;
-		gprs->s_p   = rlc->es_p != 0 ? 1 : 0;
-		gprs->rrbp  = rlc->rrbp;
-		gprs->pt    = 0;
-		gprs->tfi   = rlc->tfi;
-		gprs->pr    = rlc->pr;
-
-		gprs->fbi   = rlc->block_info[0].cv == 0;
-		gprs->e     = rlc->block_info[0].e;
-		gprs->bsn   = rlc->block_info[0].bsn;
-		break;
-
-	case HEADER_EGPRS_DATA_TYPE_1:
-		egprs1 = static_cast<struct gprs_rlc_dl_header_egprs_1 *>
-			((void *)data);
-
-		egprs1->usf    = rlc->usf;
-		egprs1->es_p   = rlc->es_p;
-		egprs1->rrbp   = rlc->rrbp;
-		egprs1->tfi_hi = rlc->tfi >> 0; /* 1 bit LSB */
-		egprs1->tfi_lo = rlc->tfi >> 1; /* 4 bits */
-		egprs1->pr     = rlc->pr;
-		egprs1->cps    = rlc->cps;
-
-		egprs1->bsn1_hi  = rlc->block_info[0].bsn >> 0; /* 2 bits LSB */
-		egprs1->bsn1_mid = rlc->block_info[0].bsn >> 2; /* 8 bits */
-		egprs1->bsn1_lo  = rlc->block_info[0].bsn >> 10; /* 1 bit */
-
-		bsn_delta = (rlc->block_info[1].bsn - rlc->block_info[0].bsn) &
-			(RLC_EGPRS_SNS - 1);
-
-		egprs1->bsn2_hi = bsn_delta >> 0; /* 7 bits LSB */
-		egprs1->bsn2_lo = bsn_delta >> 7; /* 3 bits */
-
-		/* first FBI/E header */
-		e_fbi_header   = rlc->block_info[0].e       ? 0x01 : 0;
-		e_fbi_header  |= rlc->block_info[0].cv == 0 ? 0x02 : 0; /* FBI */
-		offs = rlc->data_offs_bits[0] / 8;
-		OSMO_ASSERT(rlc->data_offs_bits[0] % 8 == 2);
-		e_fbi_header <<= 0;
-		data[offs] = (data[offs] & 0b11111100) | e_fbi_header;
-
-		/* second FBI/E header */
-		e_fbi_header   = rlc->block_info[1].e       ? 0x01 : 0;
-		e_fbi_header  |= rlc->block_info[1].cv == 0 ? 0x02 : 0; /* FBI */
-		offs = rlc->data_offs_bits[1] / 8;
-		OSMO_ASSERT(rlc->data_offs_bits[1] % 8 == 4);
-		e_fbi_header <<= 2;
-		data[offs] = (data[offs] & 0b11110011) | e_fbi_header;
-		break;
-
-	case HEADER_EGPRS_DATA_TYPE_2:
-		egprs2 = static_cast<struct gprs_rlc_dl_header_egprs_2 *>
-			((void *)data);
-
-		egprs2->usf    = rlc->usf;
-		egprs2->es_p   = rlc->es_p;
-		egprs2->rrbp   = rlc->rrbp;
-		egprs2->tfi_hi = rlc->tfi >> 0; /* 1 bit LSB */
-		egprs2->tfi_lo = rlc->tfi >> 1; /* 4 bits */
-		egprs2->pr     = rlc->pr;
-		egprs2->cps    = rlc->cps;
-
-		egprs2->bsn1_hi  = rlc->block_info[0].bsn >> 0; /* 2 bits LSB */
-		egprs2->bsn1_mid = rlc->block_info[0].bsn >> 2; /* 8 bits */
-		egprs2->bsn1_lo  = rlc->block_info[0].bsn >> 10; /* 1 bit */
-
-		e_fbi_header   = rlc->block_info[0].e       ? 0x01 : 0;
-		e_fbi_header  |= rlc->block_info[0].cv == 0 ? 0x02 : 0; /* FBI */
-		offs = rlc->data_offs_bits[0] / 8;
-		OSMO_ASSERT(rlc->data_offs_bits[0] % 8 == 6);
-		e_fbi_header <<= 4;
-		data[offs] = (data[offs] & 0b11001111) | e_fbi_header;
-		break;
-
-	case HEADER_EGPRS_DATA_TYPE_3:
-		egprs3 = static_cast<struct gprs_rlc_dl_header_egprs_3 *>
-			((void *)data);
-
-		egprs3->usf    = rlc->usf;
-		egprs3->es_p   = rlc->es_p;
-		egprs3->rrbp   = rlc->rrbp;
-		egprs3->tfi_hi = rlc->tfi >> 0; /* 1 bit LSB */
-		egprs3->tfi_lo = rlc->tfi >> 1; /* 4 bits */
-		egprs3->pr     = rlc->pr;
-		egprs3->cps    = rlc->cps;
-
-		egprs3->bsn1_hi  = rlc->block_info[0].bsn >> 0; /* 2 bits LSB */
-		egprs3->bsn1_mid = rlc->block_info[0].bsn >> 2; /* 8 bits */
-		egprs3->bsn1_lo  = rlc->block_info[0].bsn >> 10; /* 1 bit */
-
-		egprs3->spb    = rlc->block_info[0].spb;
-
-		e_fbi_header   = rlc->block_info[0].e       ? 0x01 : 0;
-		e_fbi_header  |= rlc->block_info[0].cv == 0 ? 0x02 : 0; /* FBI */
-		offs = rlc->data_offs_bits[0] / 8;
-		OSMO_ASSERT(rlc->data_offs_bits[0] % 8 == 1);
-		e_fbi_header <<= 7;
-		data[offs-1] = (data[offs-1] & 0b01111111) | (e_fbi_header >> 0);
-		data[offs]   = (data[offs]   & 0b11111110) | (e_fbi_header >> 8);
-		break;
-
-	default:
+	egprs3 = static_cast<struct gprs_rlc_dl_header_egprs_3 *>
+		((void *)data);
+
+	egprs3->usf    = rlc->usf;
+	egprs3->es_p   = rlc->es_p;
+	egprs3->rrbp   = rlc->rrbp;
+	egprs3->tfi_hi = rlc->tfi >> 0; /* 1 bit LSB */
+	egprs3->tfi_lo = rlc->tfi >> 1; /* 4 bits */
+	egprs3->pr     = rlc->pr;
+	egprs3->cps    = rlc->cps;
+
+	egprs3->bsn1_hi  = rlc->block_info[0].bsn >> 0; /* 2 bits LSB */
+	egprs3->bsn1_mid = rlc->block_info[0].bsn >> 2; /* 8 bits */
+	egprs3->bsn1_lo  = rlc->block_info[0].bsn >> 10; /* 1 bit */
+
+	egprs3->spb    = rlc->block_info[0].spb;
+
+	e_fbi_header   = rlc->block_info[0].e       ? 0x01 : 0;
+	e_fbi_header  |= rlc->block_info[0].cv == 0 ? 0x02 : 0; /* FBI */
+	offs = rlc->data_offs_bits[0] / 8;
+	OSMO_ASSERT(rlc->data_offs_bits[0] % 8 == 1);
+	e_fbi_header <<= 7;
+	data[offs-1] = (data[offs-1] & 0b01111111) | (e_fbi_header >> 0);
+	data[offs]   = (data[offs]   & 0b11111110) | (e_fbi_header >> 8);
+}
+
+static const dl_data_header_writer dl_data_header_writers[NUM_HEADER_TYPES] = {
+	/* [HEADER_INVALID] */		NULL,
+	/* [HEADER_GPRS_CONTROL] */	NULL,
+	/* [HEADER_GPRS_DATA] */	write_dl_data_header<HEADER_GPRS_DATA>,
+	/* [HEADER_EGPRS_DATA_TYPE_1] */	write_dl_data_header<HEADER_EGPRS_DATA_TYPE_1>,
+	/* [HEADER_EGPRS_DATA_TYPE_2] */	write_dl_data_header<HEADER_EGPRS_DATA_TYPE_2>,
+	/* [HEADER_EGPRS_DATA_TYPE_3] */	write_dl_data_header<HEADER_EGPRS_DATA_TYPE_3>,
+};
+
+int Encoding::rlc_write_dl_data_header(const struct gprs_rlc_data_info *rlc,
+	uint8_t *data)
+{
+	dl_data_header_writer write = dl_data_header_writers[mcs_header_type(rlc->cs)];
+
+	if (!write) {
 		LOGP(DRLCMACDL, LOGL_ERROR,
 			"Encoding of uplink %s data blocks not yet supported.\n",
-			mcs_name(cs));
+			mcs_name(rlc->cs));
 		return -ENOTSUP;
-	};
+	}
 
+	write(rlc, data);
 	return 0;
 }
 
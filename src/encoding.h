@@ -33,6 +33,13 @@ struct bitvec;
 struct gprs_llc;
 struct gprs_rlc_data_block_info;
 
+/* Request Reference of an Immediate Assignment Reject */
+struct imm_ass_rej_ref {
+	uint16_t ra;
+	uint32_t fn;
+	enum ph_burst_type burst_type;
+};
+
 /**
  * I help with encoding data into CSN1 messages.
  * TODO: Nobody can remember a function signature like this. One should
@@ -53,9 +60,14 @@ public:
 	static int write_immediate_assignment_reject(
 			bitvec *dest, uint16_t ra,
 			uint32_t ref_fn,
-			enum ph_burst_type burst_type
+			enum ph_burst_type burst_type,
+			uint8_t wait_ind
 		);
 
+	static int write_immediate_assignment_reject(
+			bitvec *dest, const struct imm_ass_rej_ref *refs,
+			unsigned int num_refs, uint8_t wait_ind);
+
 	static void write_packet_uplink_assignment(
 			bitvec * dest, uint8_t old_tfi,
 			uint8_t old_downlink, uint32_t tlli, uint8_t use_tlli,
@@ -27,6 +27,8 @@
 #include <coding_scheme.h>
 #include <pdch.h>
 #include <decoding.h>
+#include <spsc_ring.h>
+#include <pcuif_capture.h>
 
 extern "C" {
 	#include <osmocom/gsm/protocol/gsm_23_003.h>
@@ -44,14 +46,42 @@ extern "C" {
 #define FC_MAX_BUCKET_LEAK_RATE (6553500 / 8)	/* Byte/s */
 #define FC_MAX_BUCKET_SIZE 6553500		/* Octets */
 
+/* Number of UNITDATA PDUs that can be queued in each direction while
+ * the Gb queue is enabled (see gb_queue_budget), must be a power of 2 */
+#define GB_QUEUE_SIZE 64
+
+/* DL-UNITDATA parsed on the Gb side, waiting for the RLC/MAC side */
+struct gprs_bssgp_dl_pdu {
+	uint32_t tlli;
+	uint32_t tlli_old;
+	char imsi[OSMO_IMSI_BUF_SIZE];
+	uint8_t ms_class;
+	uint8_t egprs_ms_class;
+	uint16_t delay_csec;
+	uint16_t len;
+	uint8_t data[LLC_MAX_LEN];
+};
+
+/* UL-UNITDATA assembled on the RLC/MAC side, waiting to be sent on Gb */
+struct gprs_bssgp_ul_pdu {
+	uint32_t tlli;
+	uint16_t len;
+	uint8_t data[LLC_MAX_LEN];
+};
+
 static struct gprs_bssgp_pcu the_pcu = { 0, };
 
+static SpscRing<gprs_bssgp_dl_pdu, GB_QUEUE_SIZE> dl_pdu_queue;
+static SpscRing<gprs_bssgp_ul_pdu, GB_QUEUE_SIZE> ul_pdu_queue;
+
 extern void *tall_pcu_ctx;
 extern uint16_t spoof_mcc, spoof_mnc;
 extern bool spoof_mnc_3_digits;
 
 static void bvc_timeout(void *_priv);
 static int gprs_ns_reconnect(struct gprs_nsvc *nsvc);
+static int gprs_bssgp_pcu_send_ul_ud(struct bssgp_bvc_ctx *bctx, uint32_t tlli,
+	const uint8_t *data, uint16_t len);
 
 static int parse_ra_cap(struct tlv_parsed *tp, MS_Radio_Access_capability_t *rac)
 {
@@ -79,6 +109,47 @@ static int parse_ra_cap(struct tlv_parsed *tp, MS_Radio_Access_capability_t *rac
 	return 0;
 }
 
+static unsigned drain_dl(unsigned budget)
+{
+	unsigned i;
+
+	for (i = 0; i < budget; i++) {
+		struct gprs_bssgp_dl_pdu *pdu = dl_pdu_queue.peek();
+
+		if (!pdu)
+			break;
+
+		gprs_rlcmac_dl_tbf::handle(the_pcu.bts, pdu->tlli, pdu->tlli_old,
+			pdu->imsi, pdu->ms_class, pdu->egprs_ms_class,
+			pdu->delay_csec, pdu->data, pdu->len);
+		dl_pdu_queue.consume();
+	}
+
+	return i;
+}
+
+/* UL PDUs stay queued while there is no BVC */
+static unsigned drain_ul(unsigned budget)
+{
+	struct bssgp_bvc_ctx *bctx = gprs_bssgp_pcu_current_bctx();
+	unsigned i;
+
+	if (!bctx)
+		return 0;
+
+	for (i = 0; i < budget; i++) {
+		struct gprs_bssgp_ul_pdu *pdu = ul_pdu_queue.peek();
+
+		if (!pdu)
+			break;
+
+		gprs_bssgp_pcu_send_ul_ud(bctx, pdu->tlli, pdu->data, pdu->len);
+		ul_pdu_queue.consume();
+	}
+
+	return i;
+}
+
 static int gprs_bssgp_pcu_rx_dl_ud(struct msgb *msg, struct tlv_parsed *tp)
 {
 	struct bssgp_ud_hdr *budh;
@@ -162,6 +233,32 @@ static int gprs_bssgp_pcu_rx_dl_ud(struct msgb *msg, struct tlv_parsed *tp)
 
 	LOGP(DBSSGP, LOGL_INFO, "LLC [SGSN -> PCU] = TLLI: 0x%08x IMSI: %s len: %d\n", tlli, imsi, len);
 
+	pcuif_capture_dl_ud(tlli, tlli_old, imsi, ms_class, egprs_ms_class,
+		delay_csec, data, len);
+
+	if (the_pcu.bts->gb_queue_budget) {
+		struct gprs_bssgp_dl_pdu *pdu = dl_pdu_queue.reserve();
+
+		/* handling this PDU inline would overtake the queued ones */
+		if (!pdu) {
+			LOGP(DBSSGP, LOGL_NOTICE, "Gb DL queue full, draining it\n");
+			drain_dl(GB_QUEUE_SIZE);
+			pdu = dl_pdu_queue.reserve();
+			OSMO_ASSERT(pdu);
+		}
+
+		pdu->tlli = tlli;
+		pdu->tlli_old = tlli_old;
+		osmo_strlcpy(pdu->imsi, imsi, sizeof(pdu->imsi));
+		pdu->ms_class = ms_class;
+		pdu->egprs_ms_class = egprs_ms_class;
+		pdu->delay_csec = delay_csec;
+		pdu->len = len;
+		memcpy(pdu->data, data, len);
+		dl_pdu_queue.commit();
+		return 0;
+	}
+
 	return gprs_rlcmac_dl_tbf::handle(the_pcu.bts, tlli, tlli_old, imsi,
 			ms_class, egprs_ms_class, delay_csec, data, len);
 }
@@ -1027,6 +1124,85 @@ struct bssgp_bvc_ctx *gprs_bssgp_pcu_current_bctx(void)
 	return the_pcu.bctx;
 }
 
+static int gprs_bssgp_pcu_send_ul_ud(struct bssgp_bvc_ctx *bctx, uint32_t tlli,
+	const uint8_t *data, uint16_t len)
+{
+	uint8_t qos_profile[3];
+	struct msgb *llc_pdu;
+	unsigned msg_len = NS_HDR_LEN + BSSGP_HDR_LEN + len;
+	uint8_t *buf;
+
+	llc_pdu = msgb_alloc_headroom(msg_len, msg_len, "llc_pdu");
+	if (!llc_pdu)
+		return -ENOMEM;
+
+	buf = msgb_push(llc_pdu, TL16V_GROSS_LEN(sizeof(uint8_t) * len));
+	tl16v_put(buf, BSSGP_IE_LLC_PDU, sizeof(uint8_t) * len, data);
+	qos_profile[0] = QOS_PROFILE >> 16;
+	qos_profile[1] = QOS_PROFILE >> 8;
+	qos_profile[2] = QOS_PROFILE;
+	return bssgp_tx_ul_ud(bctx, tlli, qos_profile, llc_pdu);
+}
+
+/* Send an uplink LLC PDU to the SGSN, either right away or, if the Gb
+ * queue is enabled, from the next gprs_bssgp_pcu_drain() */
+int gprs_bssgp_pcu_tx_ul_ud(uint32_t tlli, const uint8_t *data, uint16_t len)
+{
+	struct bssgp_bvc_ctx *bctx = gprs_bssgp_pcu_current_bctx();
+
+	if (!bctx)
+		return -EIO;
+
+	if (len > LLC_MAX_LEN)
+		return -EINVAL;
+
+	if (bts_main_data()->gb_queue_budget) {
+		struct gprs_bssgp_ul_pdu *pdu = ul_pdu_queue.reserve();
+
+		/* sending this PDU inline would overtake the queued ones */
+		if (!pdu) {
+			LOGP(DBSSGP, LOGL_NOTICE, "Gb UL queue full, draining it\n");
+			drain_ul(GB_QUEUE_SIZE);
+			pdu = ul_pdu_queue.reserve();
+			OSMO_ASSERT(pdu);
+		}
+
+		pdu->tlli = tlli;
+		pdu->len = len;
+		memcpy(pdu->data, data, len);
+		ul_pdu_queue.commit();
+		return 0;
+	}
+
+	return gprs_bssgp_pcu_send_ul_ud(bctx, tlli, data, len);
+}
+
+bool gprs_bssgp_pcu_queue_pending(void)
+{
+	/* UL PDUs wait for the BVC without keeping the main loop busy */
+	return !dl_pdu_queue.empty() ||
+		(!ul_pdu_queue.empty() && gprs_bssgp_pcu_current_bctx());
+}
+
+/* Hand queued UNITDATA over to the other side, at most gb_queue_budget
+ * PDUs per direction so a burst from the SGSN cannot hold off the next
+ * RTS. Returns the number of PDUs handled. */
+unsigned gprs_bssgp_pcu_drain(void)
+{
+	unsigned budget = bts_main_data()->gb_queue_budget;
+
+	/* drain whatever is left if the queue has just been disabled */
+	if (!budget)
+		budget = GB_QUEUE_SIZE;
+
+	return drain_dl(budget) + drain_ul(budget);
+}
+
+unsigned gprs_bssgp_pcu_queue_depth(bool downlink)
+{
+	return downlink ? dl_pdu_queue.size() : ul_pdu_queue.size();
+}
+
 void gprs_bssgp_update_frames_sent()
 {
 	the_pcu.queue_frames_sent += 1;
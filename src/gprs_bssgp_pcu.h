@@ -94,4 +94,9 @@ void gprs_bssgp_update_queue_delay(const struct timespec *tv_recv,
 void gprs_bssgp_update_frames_sent();
 void gprs_bssgp_update_bytes_received(unsigned bytes_recv, unsigned frames_recv);
 
+int gprs_bssgp_pcu_tx_ul_ud(uint32_t tlli, const uint8_t *data, uint16_t len);
+bool gprs_bssgp_pcu_queue_pending(void);
+unsigned gprs_bssgp_pcu_drain(void);
+unsigned gprs_bssgp_pcu_queue_depth(bool downlink);
+
 #endif // GPRS_BSSGP_PCU_H
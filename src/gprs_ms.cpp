@@ -123,7 +123,7 @@ GprsMs::GprsMs(BTS *bts, uint32_t tlli) :
 	m_imsi[0] = '\0';
 	memset(&m_timer, 0, sizeof(m_timer));
 	m_timer.cb = GprsMs::timeout;
-	m_llc_queue.init();
+	m_llc_queue.init(m_bts ? m_bts->llc() : NULL, this);
 
 	set_mode(m_mode);
 
@@ -33,6 +33,7 @@ extern "C" {
 GprsMsStorage::GprsMsStorage(BTS *bts) :
 	m_bts(bts)
 {
+	INIT_LLIST_HEAD(&m_cursors);
 }
 
 GprsMsStorage::~GprsMsStorage()
@@ -53,6 +54,13 @@ void GprsMsStorage::cleanup()
 
 void GprsMsStorage::ms_idle(class GprsMs *ms)
 {
+	Cursor *cursor;
+
+	llist_for_each_entry(cursor, &m_cursors, list) {
+		if (cursor->pos == &ms->list())
+			cursor->pos = cursor->pos->next;
+	}
+
 	llist_del(&ms->list());
 	if (m_bts)
 		m_bts->stat_item_add(STAT_MS_PRESENT, -1);
@@ -106,3 +114,29 @@ GprsMs *GprsMsStorage::create_ms()
 
 	return ms;
 }
+
+void GprsMsStorage::cursor_start(Cursor *cursor)
+{
+	cursor->pos = m_list.next;
+	llist_add(&cursor->list, &m_cursors);
+}
+
+void GprsMsStorage::cursor_stop(Cursor *cursor)
+{
+	llist_del(&cursor->list);
+	cursor->pos = NULL;
+}
+
+/* MS created after cursor_start() are not returned, they are added at the
+ * head of the list */
+GprsMs *GprsMsStorage::cursor_next(Cursor *cursor)
+{
+	GprsMs *ms;
+
+	if (cursor->pos == &m_list)
+		return NULL;
+
+	ms = cursor->pos->entry();
+	cursor->pos = cursor->pos->next;
+	return ms;
+}
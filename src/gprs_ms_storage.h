@@ -42,7 +42,19 @@ public:
 	GprsMs *create_ms();
 
 	const LListHead<GprsMs>& ms_list() const {return m_list;}
+
+	/* Position in the MS list that is moved on when the MS it points to
+	 * is removed, so the list can be walked across main loop iterations */
+	struct Cursor {
+		struct llist_head list;
+		LListHead<GprsMs> *pos;
+	};
+
+	void cursor_start(Cursor *cursor);
+	void cursor_stop(Cursor *cursor);
+	GprsMs *cursor_next(Cursor *cursor);
 private:
 	BTS *m_bts;
 	LListHead<GprsMs> m_list;
+	struct llist_head m_cursors;
 };
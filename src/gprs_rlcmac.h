@@ -69,6 +69,10 @@ struct gprs_rlcmac_cs {
 
 /* TS allocation internal functions */
 int find_multi_slots(struct gprs_rlcmac_trx *trx, uint8_t mslot_class, uint8_t *ul_slots, uint8_t *dl_slots);
+unsigned dl_slots_share(const unsigned *load, uint8_t dl_slots);
+int find_rebalance_slots(const struct gprs_rlcmac_trx *trx, uint8_t mslot_class, uint8_t keep_ts,
+			 const unsigned *load, uint8_t *ul_slots, uint8_t *dl_slots);
+void move_dl_tbf_slots(struct gprs_rlcmac_dl_tbf *dl_tbf, uint8_t ul_slots, uint8_t dl_slots);
 
 int gprs_rlcmac_received_lost(struct gprs_rlcmac_dl_tbf *tbf, uint16_t received,
 	uint16_t lost);
@@ -94,21 +94,30 @@ static uint8_t sched_select_uplink(uint8_t trx, uint8_t ts, uint32_t fn,
 {
 	struct gprs_rlcmac_ul_tbf *tbf;
 	uint8_t usf = 0x07;
-	uint8_t i, tfi;
-
-	/* select uplink resource */
-	for (i = 0, tfi = pdch->next_ul_tfi; i < 32;
-	     i++, tfi = (tfi + 1) & 31) {
+	uint32_t ready;
+	uint8_t tfi;
+
+	/* select uplink resource, only UL TBFs in FLOW are in the ready set,
+	 * we don't need to give resources in FINISHED state, because we have
+	 * received all blocks and only poll for packet control ack. */
+	ready = pdch_tfi_rotate(pdch->ready_tfi(GPRS_RLCMAC_UL_TBF),
+		pdch->next_ul_tfi);
+
+	while (ready) {
+		tfi = (pdch->next_ul_tfi + __builtin_ffs(ready) - 1) & 31;
+		ready &= ready - 1;
 		tbf = pdch->ul_tbf_by_tfi(tfi);
-		/* no TBF for this tfi, go next */
-		if (!tbf)
+		OSMO_ASSERT(tbf);
+
+		/* an idle extended UL TBF is finished after X2032 ... */
+		if (tbf->ext_idle_expired(fn)) {
+			tbf->finish_ext_idle();
 			continue;
-		/* no UL resources needed, go next */
-		/* we don't need to give resources in FINISHED state,
-		 * because we have received all blocks and only poll
-		 * for packet control ack. */
-		if (tbf->state_is_not(GPRS_RLCMAC_FLOW))
+		}
+		/* ... and only gets a USF now and then */
+		if (!tbf->ext_usf_due(fn))
 			continue;
+		tbf->ext_usf_granted(fn);
 
 		/* use this USF */
 		usf = tbf->m_usf[ts];
@@ -248,10 +257,8 @@ static inline enum tbf_dl_prio tbf_compute_priority(const struct gprs_rlcmac_bts
 						    uint8_t ts, uint32_t fn, int age)
 {
 	const gprs_rlc_dl_window *w = tbf->window();
-	unsigned long msecs_t3190 = osmo_tdef_get(bts->T_defs_pcu, 3190, OSMO_TDEF_MS, -1);
-	unsigned long dl_tbf_idle_msec = osmo_tdef_get(bts->T_defs_pcu, -2031, OSMO_TDEF_MS, -1);
-	int age_thresh1 = msecs_to_frames(200);
-	int age_thresh2 = msecs_to_frames(OSMO_MIN(msecs_t3190/2, dl_tbf_idle_msec));
+	int age_thresh1 = bts->params.dl_age_low_frames;
+	int age_thresh2 = bts->params.dl_age_high_frames;
 
 	if (tbf->is_control_ts(ts) && tbf->need_control_ts())
 		return DL_PRIO_CONTROL;
@@ -271,35 +278,28 @@ static inline enum tbf_dl_prio tbf_compute_priority(const struct gprs_rlcmac_bts
 	return DL_PRIO_NONE;
 }
 
-static struct msgb *sched_select_downlink(struct gprs_rlcmac_bts *bts,
+static int sched_select_downlink(struct gprs_rlcmac_bts *bts,
 		    uint8_t trx, uint8_t ts, uint32_t fn,
-		    uint8_t block_nr, struct gprs_rlcmac_pdch *pdch)
+		    uint8_t block_nr, struct gprs_rlcmac_pdch *pdch,
+		    uint8_t *data)
 {
-	struct msgb *msg = NULL;
+	int len = 0;
 	struct gprs_rlcmac_dl_tbf *tbf, *prio_tbf = NULL;
 	enum tbf_dl_prio prio, max_prio = DL_PRIO_NONE;
 
-	uint8_t i, tfi, prio_tfi;
-	int age;
-
-	/* select downlink resource */
-	for (i = 0, tfi = pdch->next_dl_tfi; i < 32;
-	     i++, tfi = (tfi + 1) & 31) {
+	uint32_t ready;
+	uint8_t tfi, prio_tfi;
+	int age, bit;
+
+	/* select downlink resource, walk the TBFs that may send data from
+	 * the round robin cursor on */
+	ready = pdch_tfi_rotate(pdch->ready_tfi(GPRS_RLCMAC_DL_TBF),
+		pdch->next_dl_tfi);
+	while ((bit = __builtin_ffs(ready))) {
+		ready &= ready - 1;
+		tfi = (pdch->next_dl_tfi + bit - 1) & 31;
 		tbf = pdch->dl_tbf_by_tfi(tfi);
-		/* no TBF for this tfi, go next */
-		if (!tbf)
-			continue;
-		/* no DL TBF, go next */
-		if (tbf->direction != GPRS_RLCMAC_DL_TBF)
-			continue;
-		/* no DL resources needed, go next */
-		if (tbf->state_is_not(GPRS_RLCMAC_FLOW)
-		 && tbf->state_is_not(GPRS_RLCMAC_FINISHED))
-			continue;
-
-		/* waiting for CCCH IMM.ASS confirm */
-		if (tbf->m_wait_confirm)
-			continue;
+		OSMO_ASSERT(tbf);
 
 		age = tbf->frames_since_last_poll(fn);
 
@@ -314,6 +314,10 @@ static struct msgb *sched_select_downlink(struct gprs_rlcmac_bts *bts,
 			prio_tbf = tbf;
 			max_prio = prio;
 		}
+
+		/* nothing comes before a control block */
+		if (max_prio == DL_PRIO_CONTROL)
+			break;
 	}
 
 	if (prio_tbf) {
@@ -323,10 +327,10 @@ static struct msgb *sched_select_downlink(struct gprs_rlcmac_bts *bts,
 		/* next TBF to handle resource is the next one */
 		pdch->next_dl_tfi = (prio_tfi + 1) & 31;
 		/* generate DL data block */
-		msg = prio_tbf->create_dl_acked_block(fn, ts);
+		len = prio_tbf->render_dl_acked_block(fn, ts, data);
 	}
 
-	return msg;
+	return len;
 }
 
 static const uint8_t rlcmac_dl_idle[23] = {
@@ -337,40 +341,32 @@ static const uint8_t rlcmac_dl_idle[23] = {
 	0x2b, 0x2b, 0x2b, 0x2b, 0x2b, 0x2b, 0x2b, 0x2b, 0x2b, 0x2b
 };
 
-static struct msgb *sched_dummy(void)
+static int sched_dummy(uint8_t *data)
 {
-	struct msgb *msg;
+	memcpy(data, rlcmac_dl_idle, sizeof(rlcmac_dl_idle));
 
-	msg = msgb_alloc(23, "rlcmac_dl_idle");
-	if (!msg)
-		return NULL;
-	memcpy(msgb_put(msg, 23), rlcmac_dl_idle, 23);
-
-	return msg;
+	return sizeof(rlcmac_dl_idle);
 }
 
-static inline void tap_n_acc(const struct msgb *msg, const struct gprs_rlcmac_bts *bts, uint8_t trx, uint8_t ts,
-			     uint32_t fn, enum pcu_gsmtap_category cat)
+static inline void tap_n_acc(const uint8_t *data, int len, const struct gprs_rlcmac_bts *bts, uint8_t trx,
+			     uint8_t ts, uint32_t fn, enum pcu_gsmtap_category cat)
 {
-	if (!msg)
+	if (!len)
 		return;
 
 	switch(cat) {
 	case PCU_GSMTAP_C_DL_CTRL:
 		bts->bts->do_rate_ctr_inc(CTR_RLC_SENT_CONTROL);
-		bts->bts->send_gsmtap(PCU_GSMTAP_C_DL_CTRL, false, trx, ts, GSMTAP_CHANNEL_PACCH, fn, msg->data,
-				      msg->len);
+		bts->bts->send_gsmtap(PCU_GSMTAP_C_DL_CTRL, false, trx, ts, GSMTAP_CHANNEL_PACCH, fn, data, len);
 		break;
 	case PCU_GSMTAP_C_DL_DATA_GPRS:
 		bts->bts->do_rate_ctr_inc(CTR_RLC_SENT);
 		/* FIXME: distinguish between GPRS and EGPRS */
-		bts->bts->send_gsmtap(PCU_GSMTAP_C_DL_DATA_GPRS, false, trx, ts, GSMTAP_CHANNEL_PDTCH, fn, msg->data,
-				      msg->len);
+		bts->bts->send_gsmtap(PCU_GSMTAP_C_DL_DATA_GPRS, false, trx, ts, GSMTAP_CHANNEL_PDTCH, fn, data, len);
 		break;
 	case PCU_GSMTAP_C_DL_DUMMY:
 		bts->bts->do_rate_ctr_inc(CTR_RLC_SENT_DUMMY);
-		bts->bts->send_gsmtap(PCU_GSMTAP_C_DL_DUMMY, false, trx, ts, GSMTAP_CHANNEL_PACCH, fn, msg->data,
-				      msg->len);
+		bts->bts->send_gsmtap(PCU_GSMTAP_C_DL_DUMMY, false, trx, ts, GSMTAP_CHANNEL_PACCH, fn, data, len);
 		break;
 	default:
 		break;
@@ -386,8 +382,13 @@ int gprs_rlcmac_rcv_rts_block(struct gprs_rlcmac_bts *bts,
 		*ul_ass_tbf = NULL;
 	struct gprs_rlcmac_ul_tbf *ul_ack_tbf = NULL;
 	uint8_t usf = 0x7;
-	struct msgb *msg = NULL;
+	struct msgb *msg;
+	struct pcu_l1if_block blk;
+	uint8_t *data;
+	int len = 0;
 	uint32_t poll_fn, sba_fn;
+	enum pdch_rts_kind kind = PDCH_RTS_CTRL;
+	bool ul_reserved = true;
 
 	if (trx >= 8 || ts >= 8)
 		return -EINVAL;
@@ -420,41 +421,57 @@ int gprs_rlcmac_rcv_rts_block(struct gprs_rlcmac_bts *bts,
 			block_nr, sba_fn);
 		/* use free USF */
 	/* else, we search for uplink resource */
-	else
+	else {
 		usf = sched_select_uplink(trx, ts, fn, block_nr, pdch);
+		if (usf != 0x7)
+			pdch->reserve_ul_block(poll_fn, PDCH_UL_RSV_USF);
+		ul_reserved = false;
+	}
+
+	/* the block is encoded right into the primitive that sends it */
+	data = pcu_l1if_pdtch_block(&blk, trx, ts, bts->trx[trx].arfcn, fn,
+		block_nr);
+	if (!data)
+		return -ENOMEM;
 
 	/* Prio 1: select control message */
 	msg = sched_select_ctrl_msg(trx, ts, fn, block_nr, pdch, ul_ass_tbf,
 		dl_ass_tbf, ul_ack_tbf);
-	tap_n_acc(msg, bts, trx, ts, fn, PCU_GSMTAP_C_DL_CTRL);
+	if (msg) {
+		len = msgb_length(msg);
+		memcpy(data, msg->data, len);
+		msgb_free(msg);
+		tap_n_acc(data, len, bts, trx, ts, fn, PCU_GSMTAP_C_DL_CTRL);
+	}
 
 	/* Prio 2: select data message for downlink */
-	if (!msg) {
-		msg = sched_select_downlink(bts, trx, ts, fn, block_nr, pdch);
-		tap_n_acc(msg, bts, trx, ts, fn, PCU_GSMTAP_C_DL_DATA_GPRS);
+	if (!len) {
+		kind = PDCH_RTS_DATA;
+		len = sched_select_downlink(bts, trx, ts, fn, block_nr, pdch,
+			data);
+		tap_n_acc(data, len, bts, trx, ts, fn, PCU_GSMTAP_C_DL_DATA_GPRS);
 	}
 
 	/* Prio 3: send dummy contol message */
-	if (!msg) {
+	if (!len) {
 		/* increase counter */
-		msg = sched_dummy();
-		tap_n_acc(msg, bts, trx, ts, fn, PCU_GSMTAP_C_DL_DUMMY);
+		kind = PDCH_RTS_DUMMY;
+		len = sched_dummy(data);
+		tap_n_acc(data, len, bts, trx, ts, fn, PCU_GSMTAP_C_DL_DUMMY);
 	}
 
-	if (!msg)
-		return -ENOMEM;
-	/* msg is now available */
-	bts->bts->do_rate_ctr_add(CTR_RLC_DL_BYTES, msg->data_len);
+	bts->bts->do_rate_ctr_add(CTR_RLC_DL_BYTES, len);
 
 	/* set USF */
-	OSMO_ASSERT(msgb_length(msg) > 0);
-	msg->data[0] = (msg->data[0] & 0xf8) | usf;
+	data[0] = (data[0] & 0xf8) | usf;
 
 	/* Used to measure the leak rate, count all blocks */
 	gprs_bssgp_update_frames_sent();
 
+	pdch->count_rts(kind, usf != 0x7, ul_reserved, fn);
+
 	/* send PDTCH/PACCH to L1 */
-	pcu_l1if_tx_pdtch(msg, trx, ts, bts->trx[trx].arfcn, fn, block_nr);
+	pcu_l1if_tx_pdtch_block(&blk, len);
 
 	return 0;
 }
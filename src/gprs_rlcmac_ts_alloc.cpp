@@ -29,6 +29,8 @@
 #include <pcu_utils.h>
 
 #include <errno.h>
+#include <stdlib.h>
+#include <string.h>
 #include <values.h>
 
 extern "C" {
@@ -38,9 +40,6 @@ extern "C" {
 #include <osmocom/core/utils.h>
 }
 
-/* Consider a PDCH as idle if has at most this number of TBFs assigned to it */
-#define PDCH_IDLE_TBF_THRESH	1
-
 #define LOGPSL(tbf, level, fmt, args...) LOGP(DRLCMAC, level, "[%s] " fmt, \
 					      (tbf->direction == GPRS_RLCMAC_DL_TBF) ? "DL" : "UL", ## args)
 
@@ -79,6 +78,12 @@ static uint8_t find_possible_pdchs(const struct gprs_rlcmac_trx *trx, uint8_t ma
 			continue;
 		}
 
+		if (pdch->is_draining()) {
+			LOGP(DRLCMAC, LOGL_DEBUG, "- Skipping TS %d, because "
+				"it is being released\n", ts);
+			continue;
+		}
+
 		if (((1 << ts) & mask) == 0) {
 			if (mask_reason)
 				LOGP(DRLCMAC, LOGL_DEBUG,
@@ -256,7 +261,7 @@ static int find_trx(const struct gprs_rlcmac_bts *bts_data, const GprsMs *ms, in
 		const struct gprs_rlcmac_trx *trx = &bts_data->trx[trx_no];
 		for (ts = 0; ts < ARRAY_SIZE(trx->pdch); ts++) {
 			const struct gprs_rlcmac_pdch *pdch = &trx->pdch[ts];
-			if (!pdch->is_enabled())
+			if (!pdch->is_enabled() || pdch->is_draining())
 				continue;
 
 			if (pdch->assigned_tfi(GPRS_RLCMAC_UL_TBF) == NO_FREE_TFI)
@@ -275,21 +280,11 @@ static int find_trx(const struct gprs_rlcmac_bts *bts_data, const GprsMs *ms, in
 static bool idle_pdch_avail(const struct gprs_rlcmac_bts *bts_data)
 {
 	unsigned trx_no;
-	unsigned ts;
 
 	/* Find the first PDCH with an unused DL TS */
 	for (trx_no = 0; trx_no < ARRAY_SIZE(bts_data->trx); trx_no += 1) {
-		const struct gprs_rlcmac_trx *trx = &bts_data->trx[trx_no];
-		for (ts = 0; ts < ARRAY_SIZE(trx->pdch); ts++) {
-			const struct gprs_rlcmac_pdch *pdch = &trx->pdch[ts];
-			if (!pdch->is_enabled())
-				continue;
-
-			if (pdch->num_tbfs(GPRS_RLCMAC_DL_TBF) > PDCH_IDLE_TBF_THRESH)
-				continue;
-
+		if (bts_data->trx[trx_no].idle_pdch_mask)
 			return true;
-		}
 	}
 
 	return false;
@@ -427,31 +422,60 @@ int alloc_algorithm_a(struct gprs_rlcmac_bts *bts, GprsMs *ms_, struct gprs_rlcm
 	return 0;
 }
 
-/*! Compute capacity of a given TRX
+/* Per TS capacity of a TRX, summed up per nibble of a slot set, so the
+ * capacity of any candidate is four table lookups */
+struct trx_capacity {
+	unsigned dl[2][16];	/* DL capacity of TS 0-3 and TS 4-7 */
+	unsigned ul[2][16];	/* UL capacity of TS 0-3 and TS 4-7 */
+};
+
+/*! Compute the capacity tables of a given TRX
  *
  *  \param[in] trx Pointer to TRX object
- *  \param[in] rx_window Receive window
- *  \param[in] tx_window Transmit window
- *  \returns non-negative capacity
+ *  \param[out] cap Capacity tables
  */
-static inline unsigned compute_capacity(const struct gprs_rlcmac_trx *trx, int rx_window, int tx_window)
+static void compute_capacity_tables(const struct gprs_rlcmac_trx *trx, struct trx_capacity *cap)
 {
 	const struct gprs_rlcmac_pdch *pdch;
-	unsigned ts, capacity = 0;
+	unsigned dl_ts[8], ul_ts[8];
+	unsigned ts, half, bits, i;
 
 	for (ts = 0; ts < ARRAY_SIZE(trx->pdch); ts++) {
 		pdch = &trx->pdch[ts];
-		if (rx_window & (1 << ts))
-			capacity += OSMO_MAX(32 - pdch->num_reserved(GPRS_RLCMAC_DL_TBF), 1);
+		dl_ts[ts] = OSMO_MAX(32 - pdch->num_reserved(GPRS_RLCMAC_DL_TBF), 1);
+		ul_ts[ts] = 0;
+		if (find_free_usf(pdch->assigned_usf()) >= 0)
+			ul_ts[ts] = OSMO_MAX(32 - pdch->num_reserved(GPRS_RLCMAC_UL_TBF), 1);
+	}
 
-		/* Only consider common slots for UL */
-		if (tx_window & rx_window & (1 << ts)) {
-			if (find_free_usf(pdch->assigned_usf()) >= 0)
-				capacity += OSMO_MAX(32 - pdch->num_reserved(GPRS_RLCMAC_UL_TBF), 1);
+	for (half = 0; half < 2; half++) {
+		for (bits = 0; bits < 16; bits++) {
+			cap->dl[half][bits] = 0;
+			cap->ul[half][bits] = 0;
+			for (i = 0; i < 4; i++) {
+				if (!(bits & (1 << i)))
+					continue;
+				cap->dl[half][bits] += dl_ts[half * 4 + i];
+				cap->ul[half][bits] += ul_ts[half * 4 + i];
+			}
 		}
 	}
+}
 
-	return capacity;
+/*! Compute capacity of a slot set
+ *
+ *  \param[in] cap Capacity tables of the TRX
+ *  \param[in] rx_window Receive window
+ *  \param[in] tx_window Transmit window
+ *  \returns non-negative capacity
+ */
+static inline unsigned compute_capacity(const struct trx_capacity *cap, uint8_t rx_window, uint8_t tx_window)
+{
+	/* Only consider common slots for UL */
+	uint8_t common = rx_window & tx_window;
+
+	return cap->dl[0][rx_window & 0xf] + cap->dl[1][rx_window >> 4] +
+		cap->ul[0][common & 0xf] + cap->ul[1][common >> 4];
 }
 
 /*! Decide if a given slot should be skipped by multislot allocator
@@ -506,57 +530,69 @@ static bool skip_slot(uint8_t mslot_class, bool check_tr,
 	return false;
 }
 
-/*! Find set of slots available for allocation while taking MS class into account
+/* Upper bound of slot set candidates: at most 8 TX slot counts times 8
+ * rotations, and per rotation at most 16 distinct RX windows */
+#define MSLOT_CAND_MAX		1024
+/* Cached candidate lists per multislot class */
+#define MSLOT_CACHE_CLASSES	64
+#define MSLOT_CACHE_WAYS	2
+
+/* Slot set candidates of a multislot class for a given set of usable UL
+ * and DL slots, in the order the search evaluates them */
+struct mslot_candidates {
+	uint8_t ul_slots;	/* usable UL slots the list was built for */
+	uint8_t dl_slots;	/* usable DL slots the list was built for */
+	uint16_t num;		/* number of candidates, 0 if unused */
+	uint8_t *ul;		/* TX window of each candidate */
+	uint8_t *dl;		/* RX window of each candidate */
+};
+
+static struct mslot_candidates mslot_cache[MSLOT_CACHE_CLASSES][MSLOT_CACHE_WAYS];
+static unsigned mslot_cache_next[MSLOT_CACHE_CLASSES];
+
+/*! Log the timing parameters of a multislot class
  *
- *  \param[in] trx Pointer to TRX object
  *  \param[in] mslot_class The multislot class
- *  \param[in,out] ul_slots set of UL timeslots
- *  \param[in,out] dl_slots set of DL timeslots
- *  \returns negative error code or 0 on success
  */
-int find_multi_slots(struct gprs_rlcmac_trx *trx, uint8_t mslot_class, uint8_t *ul_slots, uint8_t *dl_slots)
+static void log_mslot_class(uint8_t mslot_class)
+{
+	static const char *digit[10] = { "0","1","2","3","4","5","6","7","8","9" };
+	uint8_t Sum = mslot_class_get_sum(mslot_class),
+		Tta = mslot_class_get_ta(mslot_class);
+
+	LOGP(DRLCMAC, LOGL_DEBUG,
+	     "Rx=%d Tx=%d Sum Rx+Tx=%s, Tta=%s Ttb=%d, Tra=%d Trb=%d, Type=%d\n",
+	     mslot_class_get_rx(mslot_class), mslot_class_get_tx(mslot_class),
+	     (Sum == MS_NA) ? "N/A" : digit[Sum],
+	     (Tta == MS_NA) ? "N/A" : digit[Tta], mslot_class_get_tb(mslot_class),
+	     mslot_class_get_ra(mslot_class, 0), mslot_class_get_rb(mslot_class, 0),
+	     mslot_class_get_type(mslot_class));
+}
+
+/*! Collect all valid slot set candidates of a multislot class
+ *
+ *  The candidates do not depend on the load of the TRX, only on the class
+ *  and the usable slots. They are returned in the order of evaluation, the
+ *  first one with the highest capacity is the one to allocate.
+ *
+ *  \param[in] mslot_class The multislot class
+ *  \param[in] ul_slots set of usable UL timeslots
+ *  \param[in] dl_slots set of usable DL timeslots
+ *  \param[out] ul TX window of each candidate, MSLOT_CAND_MAX entries
+ *  \param[out] dl RX window of each candidate, MSLOT_CAND_MAX entries
+ *  \returns number of candidates
+ */
+static unsigned mslot_collect_candidates(uint8_t mslot_class, uint8_t ul_slots, uint8_t dl_slots,
+					 uint8_t *ul, uint8_t *dl)
 {
 	uint8_t Tx = mslot_class_get_tx(mslot_class),   /* Max number of Tx slots */
 		Sum = mslot_class_get_sum(mslot_class), /* Max number of Tx + Rx slots */
-		max_slots, num_tx, mask_sel, pdch_slots, ul_ts, dl_ts;
+		num_tx, mask_sel, ul_ts, dl_ts;
 	int16_t rx_window, tx_window;
-	char slot_info[9] = {0};
-	int max_capacity = -1;
-	uint8_t max_ul_slots = 0, max_dl_slots = 0;
-
-	if (mslot_class)
-		LOGP(DRLCMAC, LOGL_DEBUG, "Slot Allocation (Algorithm B) for class %d\n",
-		     mslot_class);
-
-	if (Tx == MS_NA) {
-		LOGP(DRLCMAC, LOGL_NOTICE, "Multislot class %d not applicable.\n",
-		     mslot_class);
-		return -EINVAL;
-	}
-
-	max_slots = OSMO_MAX(mslot_class_get_rx(mslot_class), Tx);
-
-	if (*dl_slots == 0)
-		*dl_slots = 0xff;
-
-	if (*ul_slots == 0)
-		*ul_slots = 0xff;
-
-	pdch_slots = find_possible_pdchs(trx, max_slots, 0xff);
-
-	*dl_slots &= pdch_slots;
-	*ul_slots &= pdch_slots;
-
-	LOGP(DRLCMAC, LOGL_DEBUG, "- Possible DL/UL slots: (TS=0)\"%s\"(TS=7)\n",
-		set_flag_chars(set_flag_chars(set_flag_chars(slot_info,
-				*dl_slots, 'D', '.'),
-				*ul_slots, 'U'),
-				*ul_slots & *dl_slots, 'C'));
-
-	/* Check for each UL (TX) slot */
+	unsigned num = 0;
 
 	/* Iterate through possible numbers of TX slots */
-	for (num_tx = 1; num_tx <= mslot_class_get_tx(mslot_class); num_tx += 1) {
+	for (num_tx = 1; num_tx <= Tx; num_tx += 1) {
 		uint16_t tx_valid_win = (1 << num_tx) - 1;
 		uint8_t rx_mask[MASK_TR + 1];
 
@@ -573,7 +609,7 @@ int find_multi_slots(struct gprs_rlcmac_trx *trx, uint8_t mslot_class, uint8_t *
 		tx_window = tx_valid_win;
 
 		/* Filter out unavailable slots */
-		tx_window &= *ul_slots;
+		tx_window &= ul_slots;
 
 		/* Skip if the the first TS (ul_ts) is not in the set */
 		if ((tx_window & (1 << ul_ts)) == 0)
@@ -592,28 +628,141 @@ int find_multi_slots(struct gprs_rlcmac_trx *trx, uint8_t mslot_class, uint8_t *
 
 	/* Validate with both Tta/Ttb/Trb and Ttb/Tra/Trb */
 	for (mask_sel = MASK_TT; mask_sel <= MASK_TR; mask_sel += 1) {
-		int capacity;
-
-		rx_window = mslot_filter_bad(rx_mask[mask_sel], ul_ts, *dl_slots, rx_valid_win);
+		rx_window = mslot_filter_bad(rx_mask[mask_sel], ul_ts, dl_slots, rx_valid_win);
 		if (rx_window < 0)
 			continue;
 
 		if (skip_slot(mslot_class, mask_sel != MASK_TT, rx_window, tx_window, checked_rx))
- 			continue;
+			continue;
 
-		/* Compute capacity */
-		capacity = compute_capacity(trx, rx_window, tx_window);
+		OSMO_ASSERT(num < MSLOT_CAND_MAX);
+		ul[num] = tx_window;
+		dl[num] = rx_window;
+		num += 1;
+	}
+	}
+	}
+	}
+
+	return num;
+}
+
+/*! Look up the slot set candidates of a multislot class, collect them on a cache miss
+ *
+ *  \param[in] mslot_class The multislot class
+ *  \param[in] ul_slots set of usable UL timeslots
+ *  \param[in] dl_slots set of usable DL timeslots
+ *  \param[out] cand Candidate list, stays valid until the next call
+ */
+static void mslot_get_candidates(uint8_t mslot_class, uint8_t ul_slots, uint8_t dl_slots,
+				 struct mslot_candidates *cand)
+{
+	static uint8_t ul[MSLOT_CAND_MAX], dl[MSLOT_CAND_MAX];
+	struct mslot_candidates *entry;
+	unsigned way;
+
+	if (mslot_class < MSLOT_CACHE_CLASSES) {
+		for (way = 0; way < MSLOT_CACHE_WAYS; way++) {
+			entry = &mslot_cache[mslot_class][way];
+			if (entry->ul && entry->ul_slots == ul_slots && entry->dl_slots == dl_slots) {
+				*cand = *entry;
+				return;
+			}
+		}
+	}
+
+	cand->ul_slots = ul_slots;
+	cand->dl_slots = dl_slots;
+	cand->num = mslot_collect_candidates(mslot_class, ul_slots, dl_slots, ul, dl);
+	cand->ul = ul;
+	cand->dl = dl;
+
+	if (mslot_class >= MSLOT_CACHE_CLASSES)
+		return;
+
+	/* The cache is shared by all BTS and never freed, keep it out of
+	 * tall_pcu_ctx so it does not show up as a leak */
+	way = mslot_cache_next[mslot_class];
+	mslot_cache_next[mslot_class] = (way + 1) % MSLOT_CACHE_WAYS;
+	entry = &mslot_cache[mslot_class][way];
+
+	entry->ul = (uint8_t *)realloc(entry->ul, OSMO_MAX(cand->num, 1) * 2);
+	if (!entry->ul)
+		return;
+	entry->dl = entry->ul + OSMO_MAX(cand->num, 1);
+	memcpy(entry->ul, ul, cand->num);
+	memcpy(entry->dl, dl, cand->num);
+	entry->ul_slots = ul_slots;
+	entry->dl_slots = dl_slots;
+	entry->num = cand->num;
+	*cand = *entry;
+}
+
+/*! Find set of slots available for allocation while taking MS class into account
+ *
+ *  \param[in] trx Pointer to TRX object
+ *  \param[in] mslot_class The multislot class
+ *  \param[in,out] ul_slots set of UL timeslots
+ *  \param[in,out] dl_slots set of DL timeslots
+ *  \returns negative error code or 0 on success
+ */
+int find_multi_slots(struct gprs_rlcmac_trx *trx, uint8_t mslot_class, uint8_t *ul_slots, uint8_t *dl_slots)
+{
+	uint8_t Tx = mslot_class_get_tx(mslot_class),   /* Max number of Tx slots */
+		max_slots, pdch_slots;
+	char slot_info[9] = {0};
+	int max_capacity = -1;
+	uint8_t max_ul_slots = 0, max_dl_slots = 0;
+	struct mslot_candidates cand;
+	struct trx_capacity cap;
+	unsigned i;
+
+	if (mslot_class)
+		LOGP(DRLCMAC, LOGL_DEBUG, "Slot Allocation (Algorithm B) for class %d\n",
+		     mslot_class);
+
+	if (Tx == MS_NA) {
+		LOGP(DRLCMAC, LOGL_NOTICE, "Multislot class %d not applicable.\n",
+		     mslot_class);
+		return -EINVAL;
+	}
+
+	max_slots = OSMO_MAX(mslot_class_get_rx(mslot_class), Tx);
+
+	if (*dl_slots == 0)
+		*dl_slots = 0xff;
+
+	if (*ul_slots == 0)
+		*ul_slots = 0xff;
+
+	pdch_slots = find_possible_pdchs(trx, max_slots, 0xff);
+
+	*dl_slots &= pdch_slots;
+	*ul_slots &= pdch_slots;
+
+	LOGP(DRLCMAC, LOGL_DEBUG, "- Possible DL/UL slots: (TS=0)\"%s\"(TS=7)\n",
+		set_flag_chars(set_flag_chars(set_flag_chars(slot_info,
+				*dl_slots, 'D', '.'),
+				*ul_slots, 'U'),
+				*ul_slots & *dl_slots, 'C'));
+
+	log_mslot_class(mslot_class);
+
+	mslot_get_candidates(mslot_class, *ul_slots, *dl_slots, &cand);
+	compute_capacity_tables(trx, &cap);
+
+	for (i = 0; i < cand.num; i++) {
+		int capacity = compute_capacity(&cap, cand.dl[i], cand.ul[i]);
 
 #ifdef ENABLE_TS_ALLOC_DEBUG
 		LOGP(DRLCMAC, LOGL_DEBUG,
 			"- Considering DL/UL slots: (TS=0)\"%s\"(TS=7), "
 			"capacity = %d\n",
-			set_flag_chars(set_flag_chars(set_flag_chars(set_flag_chars(
+			set_flag_chars(set_flag_chars(set_flag_chars(
 					slot_info,
-					rx_bad, 'x', '.'),
-					rx_window, 'D'),
-					tx_window, 'U'),
-					rx_window & tx_window, 'C'),
+					cand.dl[i], 'D', '.'),
+					cand.ul[i], 'U'),
+					cand.dl[i] & cand.ul[i], 'C'),
 			capacity);
 #endif
 
@@ -621,11 +770,8 @@ int find_multi_slots(struct gprs_rlcmac_trx *trx, uint8_t mslot_class, uint8_t *
 			continue;
 
 		max_capacity = capacity;
-		max_ul_slots = tx_window;
-		max_dl_slots = rx_window;
-	}
-	}
-	}
+		max_ul_slots = cand.ul[i];
+		max_dl_slots = cand.dl[i];
 	}
 
 	if (!max_ul_slots || !max_dl_slots) {
@@ -995,6 +1141,112 @@ int alloc_algorithm_dynamic(struct gprs_rlcmac_bts *bts, GprsMs *ms_, struct gpr
 	return alloc_algorithm_a(bts, ms_, tbf_, single, use_trx);
 }
 
+/*! Share of the PDCHs a DL TBF gets on a slot set
+ *
+ *  \param[in] load Number of other active DL TBFs per TS
+ *  \param[in] dl_slots set of DL timeslots
+ *  \returns share in units of 1/840 PDCH (840 is divisible by 1 to 8)
+ */
+unsigned dl_slots_share(const unsigned *load, uint8_t dl_slots)
+{
+	unsigned ts, share = 0;
+
+	for (ts = 0; ts < 8; ts++) {
+		if (dl_slots & (1 << ts))
+			share += 840 / (load[ts] + 1);
+	}
+
+	return share;
+}
+
+/*! Find the DL slot set with the largest share of the PDCHs for a DL TBF that is already flowing
+ *
+ * The candidates are the slot sets of the multislot class as for algorithm B, but only those that
+ * keep the given TS as common TS, so the MS stays reachable on its PACCH while being moved.
+ *
+ *  \param[in] trx Pointer to TRX object
+ *  \param[in] mslot_class The multislot class
+ *  \param[in] keep_ts TS that has to remain a common TS
+ *  \param[in] load Number of other active DL TBFs per TS
+ *  \param[out] ul_slots set of UL timeslots of the best candidate
+ *  \param[out] dl_slots set of DL timeslots of the best candidate
+ *  \returns share of the best candidate (see dl_slots_share()) or negative error code
+ */
+int find_rebalance_slots(const struct gprs_rlcmac_trx *trx, uint8_t mslot_class, uint8_t keep_ts,
+			 const unsigned *load, uint8_t *ul_slots, uint8_t *dl_slots)
+{
+	uint8_t Tx = mslot_class_get_tx(mslot_class), max_slots, pdch_slots;
+	struct mslot_candidates cand;
+	int best_share = -1, share;
+	unsigned i;
+
+	if (Tx == MS_NA)
+		return -EINVAL;
+
+	max_slots = OSMO_MAX(mslot_class_get_rx(mslot_class), Tx);
+	pdch_slots = find_possible_pdchs(trx, max_slots, 0xff);
+	if (!(pdch_slots & (1 << keep_ts)))
+		return -EINVAL;
+
+	mslot_get_candidates(mslot_class, pdch_slots, pdch_slots, &cand);
+
+	for (i = 0; i < cand.num; i++) {
+		if (!(cand.dl[i] & cand.ul[i] & (1 << keep_ts)))
+			continue;
+
+		share = dl_slots_share(load, cand.dl[i]);
+		if (share < best_share)
+			continue;
+		/* on a tie, the smaller set leaves more to the others */
+		if (share == best_share && pcu_bitcount(cand.dl[i]) >= pcu_bitcount(*dl_slots))
+			continue;
+
+		best_share = share;
+		*ul_slots = cand.ul[i];
+		*dl_slots = cand.dl[i];
+	}
+
+	if (best_share < 0)
+		return -EINVAL;
+
+	return best_share;
+}
+
+/*! Move a DL TBF to another set of DL timeslots on its TRX
+ *
+ * The TFI and the first common TS are kept, so the MS can be told with a Packet Downlink
+ * Assignment on its PACCH.
+ *
+ *  \param[in,out] dl_tbf Pointer to DL TBF struct
+ *  \param[in] ul_slots New reserved UL timeslots of the MS
+ *  \param[in] dl_slots New DL timeslots, reserved for the MS as well
+ */
+void move_dl_tbf_slots(struct gprs_rlcmac_dl_tbf *dl_tbf, uint8_t ul_slots, uint8_t dl_slots)
+{
+	gprs_rlcmac_trx *trx = dl_tbf->trx;
+	uint8_t ts;
+
+	for (ts = 0; ts < 8; ts++) {
+		if (!dl_tbf->pdch[ts] || (dl_slots & (1 << ts)))
+			continue;
+
+		LOGP(DRLCMAC, LOGL_DEBUG, "- Releasing DL TS %u\n", ts);
+		dl_tbf->pdch[ts]->detach_tbf(dl_tbf);
+		dl_tbf->pdch[ts] = NULL;
+	}
+
+	for (ts = 0; ts < 8; ts++) {
+		if (dl_tbf->pdch[ts] || !(dl_slots & (1 << ts)))
+			continue;
+
+		LOGP(DRLCMAC, LOGL_DEBUG, "- Assigning DL TS %u\n", ts);
+		assign_dlink_tbf(&trx->pdch[ts], dl_tbf, dl_tbf->tfi());
+	}
+
+	dl_tbf->first_ts = ffs(dl_slots) - 1;
+	update_ms_reserved_slots(trx, dl_tbf->ms(), ul_slots, dl_slots, ul_slots, dl_slots);
+}
+
 int gprs_alloc_max_dl_slots_per_ms(const struct gprs_rlcmac_bts *bts, uint8_t ms_class)
 {
 	int rx = mslot_class_get_rx(ms_class);
@@ -0,0 +1,338 @@
+/* gsmtap_export.cpp
+ *
+ * Send GSMTAP from a helper thread, optionally into a pcap file
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <arpa/inet.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include <gsmtap_export.h>
+#include <gprs_debug.h>
+#include <spsc_ring.h>
+
+extern "C" {
+#include <osmocom/core/gsmtap.h>
+#include <osmocom/core/logging.h>
+#include <osmocom/core/talloc.h>
+}
+
+extern void *tall_pcu_ctx;
+
+/* frames sent with one sendmmsg() */
+#define GSMTAP_EXPORT_BATCH	32
+/* the pcap file is written in large chunks, flushed when idle */
+#define GSMTAP_EXPORT_PCAP_BUF_SIZE (1024 * 1024)
+
+#define PCAP_MAGIC		0xa1b2c3d4
+#define PCAP_LINKTYPE_IPV4	228
+
+struct gsmtap_export_frame {
+	struct gsmtap_hdr hdr;
+	uint16_t len;
+	struct timeval tv;	/* only set for the pcap file */
+	uint8_t data[GSMTAP_EXPORT_MAX_LEN];
+};
+
+struct pcap_file_hdr {
+	uint32_t magic;
+	uint16_t version_major;
+	uint16_t version_minor;
+	int32_t thiszone;
+	uint32_t sigfigs;
+	uint32_t snaplen;
+	uint32_t linktype;
+} __attribute__((packed));
+
+struct pcap_rec_hdr {
+	uint32_t ts_sec;
+	uint32_t ts_usec;
+	uint32_t incl_len;
+	uint32_t orig_len;
+	struct iphdr ip;
+	struct udphdr udp;
+} __attribute__((packed));
+
+static SpscRing<gsmtap_export_frame, GSMTAP_EXPORT_RING_SIZE> export_ring;
+
+/* owned by the RLC/MAC thread */
+static bool export_running;
+static pthread_t export_thread;
+
+/* owned by the RLC/MAC thread while the helper thread is not running, only
+ * the helper thread touches them while it runs */
+static int export_fd = -1;
+static FILE *export_pcap;
+static char *export_pcap_buf;
+
+/* the RLC/MAC thread timestamps the frames for the pcap file, as long as
+ * the helper thread runs even if it gave up the file */
+static bool export_pcap_tv;
+
+/* set by the RLC/MAC thread to end the helper thread */
+static bool export_stop;
+
+static uint16_t ip_checksum(const void *data, size_t len)
+{
+	const uint16_t *p = (const uint16_t *)data;
+	uint32_t sum = 0;
+
+	for (; len > 1; len -= 2)
+		sum += *p++;
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+
+	return ~sum;
+}
+
+/* runs in the helper thread, which gives up the file on errors */
+static void pcap_write(const struct gsmtap_export_frame *frame)
+{
+	struct pcap_rec_hdr rec;
+	unsigned int len = sizeof(rec.ip) + sizeof(rec.udp) +
+		sizeof(frame->hdr) + frame->len;
+
+	memset(&rec, 0, sizeof(rec));
+	rec.ts_sec = frame->tv.tv_sec;
+	rec.ts_usec = frame->tv.tv_usec;
+	rec.incl_len = len;
+	rec.orig_len = len;
+
+	rec.ip.version = 4;
+	rec.ip.ihl = sizeof(rec.ip) / 4;
+	rec.ip.tot_len = htons(len);
+	rec.ip.ttl = 64;
+	rec.ip.protocol = IPPROTO_UDP;
+	rec.ip.saddr = htonl(INADDR_LOOPBACK);
+	rec.ip.daddr = htonl(INADDR_LOOPBACK);
+	rec.ip.check = ip_checksum(&rec.ip, sizeof(rec.ip));
+
+	rec.udp.source = htons(GSMTAP_UDP_PORT);
+	rec.udp.dest = htons(GSMTAP_UDP_PORT);
+	rec.udp.len = htons(len - sizeof(rec.ip));
+
+	if (fwrite(&rec, sizeof(rec), 1, export_pcap) != 1
+	    || fwrite(&frame->hdr, sizeof(frame->hdr), 1, export_pcap) != 1
+	    || (frame->len && fwrite(frame->data, frame->len, 1, export_pcap) != 1)) {
+		fclose(export_pcap);
+		export_pcap = NULL;
+	}
+}
+
+/* Send what is in the ring, at most one batch. Returns the number of
+ * frames taken from the ring. */
+static unsigned int export_drain(void)
+{
+	static struct gsmtap_export_frame batch[GSMTAP_EXPORT_BATCH];
+	struct mmsghdr msgs[GSMTAP_EXPORT_BATCH];
+	struct iovec iov[GSMTAP_EXPORT_BATCH][2];
+	struct gsmtap_export_frame *frame;
+	unsigned int num = 0, i;
+
+	while (num < GSMTAP_EXPORT_BATCH && (frame = export_ring.peek())) {
+		memcpy(&batch[num], frame, sizeof(*frame));
+		export_ring.consume();
+		num += 1;
+	}
+	if (!num)
+		return 0;
+
+	memset(msgs, 0, sizeof(msgs[0]) * num);
+	for (i = 0; i < num; i++) {
+		iov[i][0].iov_base = &batch[i].hdr;
+		iov[i][0].iov_len = sizeof(batch[i].hdr);
+		iov[i][1].iov_base = batch[i].data;
+		iov[i][1].iov_len = batch[i].len;
+		msgs[i].msg_hdr.msg_iov = iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 2;
+	}
+
+	/* nobody listening is not an error, the frames are gone either way */
+	if (export_fd >= 0)
+		sendmmsg(export_fd, msgs, num, MSG_DONTWAIT);
+
+	if (export_pcap) {
+		for (i = 0; i < num && export_pcap; i++)
+			pcap_write(&batch[i]);
+	}
+
+	return num;
+}
+
+static void *export_main(void *arg)
+{
+	struct timespec poll = { 0, GSMTAP_EXPORT_POLL_MS * 1000000 };
+	time_t last_flush = time(NULL);
+
+	while (!__atomic_load_n(&export_stop, __ATOMIC_ACQUIRE)) {
+		if (export_drain())
+			continue;
+
+		if (export_pcap && time(NULL) != last_flush) {
+			fflush(export_pcap);
+			last_flush = time(NULL);
+		}
+		nanosleep(&poll, NULL);
+	}
+
+	while (export_drain())
+		;
+
+	return NULL;
+}
+
+static void pcap_close(void)
+{
+	if (export_pcap) {
+		fclose(export_pcap);
+		export_pcap = NULL;
+	}
+	talloc_free(export_pcap_buf);
+	export_pcap_buf = NULL;
+}
+
+static int pcap_open(const char *path)
+{
+	struct pcap_file_hdr hdr;
+
+	export_pcap = fopen(path, "wb");
+	if (!export_pcap) {
+		LOGP(DL1IF, LOGL_ERROR, "Failed to open GSMTAP pcap %s: %s\n",
+			path, strerror(errno));
+		return -errno;
+	}
+
+	export_pcap_buf = (char *)talloc_size(tall_pcu_ctx,
+		GSMTAP_EXPORT_PCAP_BUF_SIZE);
+	if (export_pcap_buf)
+		setvbuf(export_pcap, export_pcap_buf, _IOFBF,
+			GSMTAP_EXPORT_PCAP_BUF_SIZE);
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = PCAP_MAGIC;
+	hdr.version_major = 2;
+	hdr.version_minor = 4;
+	hdr.snaplen = 65535;
+	hdr.linktype = PCAP_LINKTYPE_IPV4;
+
+	if (fwrite(&hdr, sizeof(hdr), 1, export_pcap) != 1) {
+		LOGP(DL1IF, LOGL_ERROR, "Failed to write GSMTAP pcap %s\n", path);
+		pcap_close();
+		return -EIO;
+	}
+
+	return 0;
+}
+
+int gsmtap_export_start(int fd, const char *pcap_path)
+{
+	struct sched_param param;
+	pthread_attr_t attr;
+	int rc;
+
+	if (export_running)
+		gsmtap_export_stop();
+
+	memset(&param, 0, sizeof(param));
+	export_fd = fd;
+	if (pcap_path) {
+		rc = pcap_open(pcap_path);
+		if (rc < 0)
+			return rc;
+	}
+
+	/* not the realtime priority the RLC/MAC loop may have */
+	pthread_attr_init(&attr);
+	pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(&attr, SCHED_OTHER);
+	pthread_attr_setschedparam(&attr, &param);
+
+	__atomic_store_n(&export_stop, false, __ATOMIC_RELEASE);
+	rc = pthread_create(&export_thread, &attr, export_main, NULL);
+	pthread_attr_destroy(&attr);
+	if (rc) {
+		LOGP(DL1IF, LOGL_ERROR, "Failed to start the GSMTAP thread: %s\n",
+			strerror(rc));
+		pcap_close();
+		return -rc;
+	}
+	export_running = true;
+	export_pcap_tv = pcap_path != NULL;
+
+	LOGP(DL1IF, LOGL_NOTICE, "Sending GSMTAP from a helper thread%s%s\n",
+		pcap_path ? ", pcap file " : "", pcap_path ? pcap_path : "");
+	return 0;
+}
+
+void gsmtap_export_stop(void)
+{
+	if (!export_running)
+		return;
+
+	__atomic_store_n(&export_stop, true, __ATOMIC_RELEASE);
+	pthread_join(export_thread, NULL);
+	export_running = false;
+	export_fd = -1;
+	export_pcap_tv = false;
+	pcap_close();
+}
+
+bool gsmtap_export_active(void)
+{
+	return export_running;
+}
+
+bool gsmtap_export_enqueue(uint16_t arfcn, uint8_t ts, uint8_t chan_type,
+	uint32_t fn, int8_t signal_dbm, int8_t snr, const uint8_t *data,
+	unsigned int len)
+{
+	struct gsmtap_export_frame *frame;
+
+	frame = export_ring.reserve();
+	if (!frame)
+		return false;
+
+	if (len > sizeof(frame->data))
+		len = sizeof(frame->data);
+
+	memset(&frame->hdr, 0, sizeof(frame->hdr));
+	frame->hdr.version = GSMTAP_VERSION;
+	frame->hdr.hdr_len = sizeof(frame->hdr) / 4;
+	frame->hdr.type = GSMTAP_TYPE_UM;
+	frame->hdr.timeslot = ts;
+	frame->hdr.arfcn = htons(arfcn);
+	frame->hdr.signal_dbm = signal_dbm;
+	frame->hdr.snr_db = snr;
+	frame->hdr.frame_number = htonl(fn);
+	frame->hdr.sub_type = chan_type;
+
+	memcpy(frame->data, data, len);
+	frame->len = len;
+	if (export_pcap_tv)
+		gettimeofday(&frame->tv, NULL);
+
+	export_ring.commit();
+	return true;
+}
@@ -0,0 +1,54 @@
+/* gsmtap_export.h
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * GSMTAP export from a helper thread. The RLC/MAC thread copies each frame
+ * into a ring and returns, the helper thread drains the ring every
+ * GSMTAP_EXPORT_POLL_MS and sends the frames in batches to the GSMTAP
+ * socket, and optionally appends them to a pcap file (IPv4/UDP to the
+ * GSMTAP port, so Wireshark dissects them as usual). Frames that do not fit
+ * into the ring are dropped and counted by the caller.
+ */
+
+/* Frames that can be waiting for the helper thread, a power of 2 */
+#define GSMTAP_EXPORT_RING_SIZE	1024
+/* Largest payload, an MCS-9 block fits */
+#define GSMTAP_EXPORT_MAX_LEN	162
+#define GSMTAP_EXPORT_POLL_MS	10
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* fd is a connected GSMTAP socket, pcap_path may be NULL */
+int gsmtap_export_start(int fd, const char *pcap_path);
+void gsmtap_export_stop(void);
+bool gsmtap_export_active(void);
+
+/* Returns false if the ring is full and the frame was dropped */
+bool gsmtap_export_enqueue(uint16_t arfcn, uint8_t ts, uint8_t chan_type,
+	uint32_t fn, int8_t signal_dbm, int8_t snr, const uint8_t *data,
+	unsigned int len);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,180 @@
+/* l1if_pdch_ring.c
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <osmocom/core/rate_ctr.h>
+#include <osmocom/core/select.h>
+#include <osmocom/core/stats.h>
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/utils.h>
+#include <osmocom/core/write_queue.h>
+
+#include <l1if_pdch_ring.h>
+#include <gprs_debug.h>
+
+static const struct rate_ctr_desc l1if_pdch_ctr_description[] = {
+	[L1IF_PDCH_CTR_PRIMS]		= { "pdch:prims",	"PDTCH/PTCCH primitives submitted to the PHY" },
+	[L1IF_PDCH_CTR_SYSCALLS]	= { "pdch:syscalls",	"Send calls for these primitives" },
+	[L1IF_PDCH_CTR_COPIES]		= { "pdch:copies",	"Payload copies into primitives" },
+	[L1IF_PDCH_CTR_DROPPED]		= { "pdch:dropped",	"Primitives dropped, ring full or write error" },
+};
+
+static const struct rate_ctr_group_desc l1if_pdch_ctrg_desc = {
+	"l1if",
+	"Direct PHY interface",
+	OSMO_STATS_CLASS_GLOBAL,
+	ARRAY_SIZE(l1if_pdch_ctr_description),
+	l1if_pdch_ctr_description,
+};
+
+int l1if_pdch_ring_init(struct l1if_pdch_ring *ring, void *ctx,
+	size_t prim_size, uint8_t trx_no)
+{
+	memset(ring, 0, sizeof(*ring));
+
+	ring->prim = talloc_zero_size(ctx, L1IF_PDCH_RING_SIZE * prim_size);
+	if (!ring->prim)
+		return -ENOMEM;
+
+	ring->ctrs = rate_ctr_group_alloc(ctx, &l1if_pdch_ctrg_desc, trx_no);
+	if (!ring->ctrs) {
+		talloc_free(ring->prim);
+		ring->prim = NULL;
+		return -ENOMEM;
+	}
+
+	ring->prim_size = prim_size;
+	ring->flush = l1if_pdch_ring_write;
+
+	return 0;
+}
+
+void l1if_pdch_ring_free(struct l1if_pdch_ring *ring)
+{
+	rate_ctr_group_free(ring->ctrs);
+	talloc_free(ring->prim);
+	ring->ctrs = NULL;
+	ring->prim = NULL;
+}
+
+void *l1if_pdch_ring_head(struct l1if_pdch_ring *ring)
+{
+	if (l1if_pdch_ring_pending(ring) >= L1IF_PDCH_RING_SIZE) {
+		LOGP(DL1IF, LOGL_ERROR, "PDTCH queue full. dropping message.\n");
+		rate_ctr_inc(&ring->ctrs->ctr[L1IF_PDCH_CTR_DROPPED]);
+		return NULL;
+	}
+
+	return ring->prim + (ring->head % L1IF_PDCH_RING_SIZE) * ring->prim_size;
+}
+
+/* transmit once the queue is writable, together with the other TS */
+void l1if_pdch_ring_push(struct l1if_pdch_ring *ring, struct osmo_fd *ofd)
+{
+	rate_ctr_inc(&ring->ctrs->ctr[L1IF_PDCH_CTR_COPIES]);
+	ring->head++;
+	ofd->when |= OSMO_FD_WRITE;
+}
+
+int l1if_pdch_ring_write(struct l1if_pdch_ring *ring, int fd)
+{
+	int rc;
+
+	while (l1if_pdch_ring_pending(ring)) {
+		rc = write(fd, l1if_pdch_ring_tail(ring, 0), ring->prim_size);
+		if (rc < 0 && errno == EAGAIN)
+			break;
+
+		rate_ctr_inc(&ring->ctrs->ctr[L1IF_PDCH_CTR_SYSCALLS]);
+		ring->tail++;
+		if (rc < 0) {
+			LOGP(DL1IF, LOGL_ERROR, "error writing to L1 msg_queue: %s\n",
+				strerror(errno));
+			rate_ctr_inc(&ring->ctrs->ctr[L1IF_PDCH_CTR_DROPPED]);
+			continue;
+		} else if (rc < (int)ring->prim_size) {
+			LOGP(DL1IF, LOGL_ERROR, "short write to L1 msg_queue: "
+				"%d < %d\n", rc, (int)ring->prim_size);
+			rate_ctr_inc(&ring->ctrs->ctr[L1IF_PDCH_CTR_DROPPED]);
+			continue;
+		}
+		rate_ctr_inc(&ring->ctrs->ctr[L1IF_PDCH_CTR_PRIMS]);
+	}
+
+	return 0;
+}
+
+int l1if_pdch_ring_sendmmsg(struct l1if_pdch_ring *ring, int fd)
+{
+	struct mmsghdr msgs[L1IF_PDCH_RING_SIZE];
+	struct iovec iov[L1IF_PDCH_RING_SIZE];
+	unsigned int i, num = l1if_pdch_ring_pending(ring);
+	int rc;
+
+	if (!num)
+		return 0;
+
+	memset(msgs, 0, num * sizeof(msgs[0]));
+	for (i = 0; i < num; i++) {
+		iov[i].iov_base = l1if_pdch_ring_tail(ring, i);
+		iov[i].iov_len = ring->prim_size;
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	rc = sendmmsg(fd, msgs, num, MSG_DONTWAIT);
+	if (rc < 0) {
+		if (errno == EAGAIN)
+			return 0;
+		LOGP(DL1IF, LOGL_ERROR, "error forwarding %u PDTCH primitives: %s\n",
+			num, strerror(errno));
+		rate_ctr_add(&ring->ctrs->ctr[L1IF_PDCH_CTR_DROPPED], num);
+		ring->tail += num;
+		return rc;
+	}
+
+	rate_ctr_inc(&ring->ctrs->ctr[L1IF_PDCH_CTR_SYSCALLS]);
+	rate_ctr_add(&ring->ctrs->ctr[L1IF_PDCH_CTR_PRIMS], rc);
+	ring->tail += rc;
+
+	return rc;
+}
+
+/* the write queue still carries the other primitives, the PDCH ring is
+ * flushed after them */
+int l1if_pdch_ring_fd_cb(struct l1if_pdch_ring *ring, struct osmo_fd *ofd,
+	unsigned int what)
+{
+	int rc;
+
+	rc = osmo_wqueue_bfd_cb(ofd, what);
+	if (rc == -EBADF)
+		return rc;
+
+	if (what & OSMO_FD_WRITE)
+		ring->flush(ring, ofd->fd);
+	if (l1if_pdch_ring_pending(ring))
+		ofd->when |= OSMO_FD_WRITE;
+
+	return rc;
+}
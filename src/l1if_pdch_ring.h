@@ -0,0 +1,91 @@
+/* l1if_pdch_ring.h
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Preallocated PH-DATA.req primitives for PDTCH/PTCCH of the direct PHY
+ * interfaces (sysmo, lc15, oc2g). l1if_pdch_req() fills them in place and
+ * the transport submits all pending ones together once the PDTCH write
+ * queue is writable, usually the blocks of all TS of a frame. The ring
+ * does not know the primitive type of the PHY, only its size.
+ */
+#define L1IF_PDCH_RING_SIZE	32
+
+enum l1if_pdch_ctr {
+	L1IF_PDCH_CTR_PRIMS,		/* primitives submitted */
+	L1IF_PDCH_CTR_SYSCALLS,		/* write()/sendmmsg() calls for them */
+	L1IF_PDCH_CTR_COPIES,		/* payload copies into primitives */
+	L1IF_PDCH_CTR_DROPPED,		/* ring full or write error */
+};
+
+struct osmo_fd;
+struct rate_ctr_group;
+struct l1if_pdch_ring;
+
+/* submit the pending primitives to fd */
+typedef int l1if_pdch_flush_cb(struct l1if_pdch_ring *ring, int fd);
+
+struct l1if_pdch_ring {
+	uint8_t *prim;				/* L1IF_PDCH_RING_SIZE primitives */
+	size_t prim_size;
+	unsigned int head;			/* next primitive to fill */
+	unsigned int tail;			/* next primitive to submit */
+	l1if_pdch_flush_cb *flush;
+	struct rate_ctr_group *ctrs;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int l1if_pdch_ring_init(struct l1if_pdch_ring *ring, void *ctx,
+	size_t prim_size, uint8_t trx_no);
+void l1if_pdch_ring_free(struct l1if_pdch_ring *ring);
+
+/* Returns the primitive to fill, NULL if the ring is full */
+void *l1if_pdch_ring_head(struct l1if_pdch_ring *ring);
+/* Queue the filled head primitive for ofd, the PDTCH write queue fd */
+void l1if_pdch_ring_push(struct l1if_pdch_ring *ring, struct osmo_fd *ofd);
+
+/* one write() per primitive, for the msg_queue devices (the default) */
+int l1if_pdch_ring_write(struct l1if_pdch_ring *ring, int fd);
+/* all pending primitives in one sendmmsg(), one datagram each */
+int l1if_pdch_ring_sendmmsg(struct l1if_pdch_ring *ring, int fd);
+
+/* To be called from the fd callback of the PDTCH write queue */
+int l1if_pdch_ring_fd_cb(struct l1if_pdch_ring *ring, struct osmo_fd *ofd,
+	unsigned int what);
+
+#ifdef __cplusplus
+}
+#endif
+
+static inline unsigned int l1if_pdch_ring_pending(const struct l1if_pdch_ring *ring)
+{
+	return ring->head - ring->tail;
+}
+
+static inline void *l1if_pdch_ring_tail(struct l1if_pdch_ring *ring,
+	unsigned int offset)
+{
+	return ring->prim +
+		((ring->tail + offset) % L1IF_PDCH_RING_SIZE) * ring->prim_size;
+}
@@ -20,11 +20,15 @@
  */
 
 #include <bts.h>
+#include <gprs_bssgp_pcu.h>
+#include <gprs_debug.h>
+#include <gprs_ms.h>
 
 #include <stdio.h>
 
 extern "C" {
 #include <osmocom/core/msgb.h>
+#include <osmocom/core/stat_item.h>
 }
 
 #include "pcu_utils.h"
@@ -97,12 +101,38 @@ bool gprs_llc::is_user_data_frame(uint8_t *data, size_t len)
 	return true;
 }
 
-void gprs_llc_queue::init()
+gprs_llc_queue::gprs_llc_queue()
+	: m_avg_queue_delay(0)
+	, m_queue_size(0)
+	, m_queue_octets(0)
+	, m_ctrl(NULL)
+	, m_ms(NULL)
+{
+	/* the destructor clears the queue, also when init() was never called */
+	INIT_LLIST_HEAD(&m_queue);
+	INIT_LLIST_HEAD(&m_index_entry.list);
+	m_index_entry.queue = this;
+	memset(&m_index_key, 0, sizeof(m_index_key));
+}
+
+gprs_llc_queue::~gprs_llc_queue()
+{
+	/* frees what is left and takes the queue out of the expiry index */
+	clear(NULL);
+}
+
+void gprs_llc_queue::init(LlcController *ctrl, GprsMs *ms)
 {
 	INIT_LLIST_HEAD(&m_queue);
 	m_queue_size = 0;
 	m_queue_octets = 0;
 	m_avg_queue_delay = 0;
+
+	m_ctrl = ctrl;
+	m_ms = ms;
+	INIT_LLIST_HEAD(&m_index_entry.list);
+	m_index_entry.queue = this;
+	memset(&m_index_key, 0, sizeof(m_index_key));
 }
 
 
@@ -120,11 +150,17 @@ void gprs_llc_queue::enqueue(struct msgb *llc_msg, const struct timespec *expire
 	meta_storage->expire_time = *expire_time;
 
 	msgb_enqueue(&m_queue, llc_msg);
+
+	/* this may evict frames, llc_msg included */
+	if (m_ctrl)
+		m_ctrl->enqueued(this, 1, msgb_length(llc_msg));
 }
 
 void gprs_llc_queue::clear(BTS *bts)
 {
 	struct msgb *msg;
+	size_t frames = m_queue_size;
+	size_t octets = m_queue_octets;
 
 	while ((msg = msgb_dequeue(&m_queue))) {
 		if (bts)
@@ -132,8 +168,12 @@ void gprs_llc_queue::clear(BTS *bts)
 		msgb_free(msg);
 	}
 
+	/* empty before notifying, so the controller unindexes the queue */
 	m_queue_size = 0;
 	m_queue_octets = 0;
+
+	if (m_ctrl)
+		m_ctrl->dequeued(this, frames, octets);
 }
 
 void gprs_llc_queue::move_and_merge(gprs_llc_queue *o)
@@ -142,6 +182,8 @@ void gprs_llc_queue::move_and_merge(gprs_llc_queue *o)
 	struct llist_head new_queue;
 	size_t queue_size = 0;
 	size_t queue_octets = 0;
+	size_t o_size = o->m_queue_size;
+	size_t o_octets = o->m_queue_octets;
 	INIT_LLIST_HEAD(&new_queue);
 
 	while (1) {
@@ -187,6 +229,14 @@ void gprs_llc_queue::move_and_merge(gprs_llc_queue *o)
 	llist_splice_init(&new_queue, &m_queue);
 	m_queue_size = queue_size;
 	m_queue_octets = queue_octets;
+
+	if (o->m_ctrl)
+		o->m_ctrl->dequeued(o, o_size, o_octets);
+	if (m_ctrl) {
+		/* the merged frames may be older than our head */
+		m_ctrl->reindex(this);
+		m_ctrl->enqueued(this, o_size, o_octets);
+	}
 }
 
 #define ALPHA 0.5f
@@ -210,6 +260,9 @@ struct msgb *gprs_llc_queue::dequeue(const MetaInfo **info)
 	m_queue_size -= 1;
 	m_queue_octets -= msgb_length(msg);
 
+	if (m_ctrl)
+		m_ctrl->dequeued(this, 1, msgb_length(msg));
+
 	/* take the second time */
 	osmo_clock_gettime(CLOCK_MONOTONIC, &tv_now);
 	tv = (struct timespec *)&msg->data[sizeof(*tv)];
@@ -221,6 +274,33 @@ struct msgb *gprs_llc_queue::dequeue(const MetaInfo **info)
 	return msg;
 }
 
+const gprs_llc_queue::MetaInfo *gprs_llc_queue::head_info() const
+{
+	struct msgb *msg;
+
+	if (llist_empty(&m_queue))
+		return NULL;
+
+	msg = llist_entry(m_queue.next, struct msgb, list);
+	return (const MetaInfo *)&msg->cb[0];
+}
+
+/* Remove the oldest frame without accounting it as sent, the caller
+ * updates the LlcController */
+struct msgb *gprs_llc_queue::drop_head()
+{
+	struct msgb *msg;
+
+	msg = msgb_dequeue(&m_queue);
+	if (!msg)
+		return NULL;
+
+	m_queue_size -= 1;
+	m_queue_octets -= msgb_length(msg);
+
+	return msg;
+}
+
 void gprs_llc_queue::calc_pdu_lifetime(BTS *bts, const uint16_t pdu_delay_csec, struct timespec *tv)
 {
 	uint16_t delay_csec;
@@ -252,3 +332,223 @@ bool gprs_llc_queue::is_frame_expired(const struct timespec *tv_now,
 
 	return timespeccmp(tv_now, tv, >);
 }
+
+LlcController::LlcController(BTS &bts)
+	: m_bts(bts)
+	, m_frames(0)
+	, m_octets(0)
+	, m_queues(0)
+	, m_last_sweep_fn(-1)
+{
+	INIT_LLIST_HEAD(&m_index);
+}
+
+/* An infinite expire time sorts after all others */
+static bool index_key_before(const struct timespec *a, const struct timespec *b)
+{
+	if (a->tv_sec == 0 && a->tv_nsec == 0)
+		return false;
+	if (b->tv_sec == 0 && b->tv_nsec == 0)
+		return true;
+
+	return timespeccmp(a, b, <);
+}
+
+static uint32_t ms_tlli(const GprsMs *ms)
+{
+	return ms ? ms->tlli() : 0;
+}
+
+void LlcController::unindex(gprs_llc_queue *queue)
+{
+	if (llist_empty(&queue->m_index_entry.list))
+		return;
+
+	llist_del_init(&queue->m_index_entry.list);
+	m_queues -= 1;
+}
+
+/* (Re)insert a queue with the expire time of its head frame, searching
+ * from the tail where new keys usually belong */
+void LlcController::reindex(gprs_llc_queue *queue)
+{
+	const gprs_llc_queue::MetaInfo *info = queue->head_info();
+	struct llist_head *pos;
+
+	unindex(queue);
+	if (!info)
+		return;
+
+	queue->m_index_key = info->expire_time;
+	for (pos = m_index.prev; pos != &m_index; pos = pos->prev) {
+		const struct gprs_llc_index_entry *entry =
+			llist_entry(pos, struct gprs_llc_index_entry, list);
+
+		if (!index_key_before(&queue->m_index_key, &entry->queue->m_index_key))
+			break;
+	}
+	llist_add(&queue->m_index_entry.list, pos);
+	m_queues += 1;
+}
+
+void LlcController::enqueued(gprs_llc_queue *queue, size_t frames,
+	size_t octets)
+{
+	uint32_t budget = m_bts.bts_data()->llc_queue_budget;
+
+	m_frames += frames;
+	m_octets += octets;
+
+	if (llist_empty(&queue->m_index_entry.list))
+		reindex(queue);
+
+	/* leave some headroom, so not every frame causes an eviction */
+	if (budget && m_octets > budget)
+		evict(budget - budget / 16);
+}
+
+void LlcController::dequeued(gprs_llc_queue *queue, size_t frames,
+	size_t octets)
+{
+	m_frames -= frames;
+	m_octets -= octets;
+
+	if (queue->size() == 0)
+		unindex(queue);
+}
+
+/* Drop the oldest frames of the longest queue until it is no longer the
+ * longest, until the octets of all queues are within the target */
+void LlcController::evict(size_t target)
+{
+	struct gprs_llc_index_entry *entry;
+	gprs_llc_queue *longest;
+	struct msgb *msg;
+	size_t second, octets;
+	unsigned frames;
+
+	while (m_octets > target) {
+		longest = NULL;
+		second = 0;
+		llist_for_each_entry(entry, &m_index, list) {
+			if (!longest || entry->queue->octets() > longest->octets()) {
+				if (longest)
+					second = longest->octets();
+				longest = entry->queue;
+			} else if (entry->queue->octets() > second) {
+				second = entry->queue->octets();
+			}
+		}
+		if (!longest)
+			break;
+
+		frames = 0;
+		octets = 0;
+		do {
+			msg = longest->drop_head();
+			frames += 1;
+			octets += msgb_length(msg);
+			m_frames -= 1;
+			m_octets -= msgb_length(msg);
+			msgb_free(msg);
+			m_bts.do_rate_ctr_inc(CTR_LLC_FRAME_EVICTED);
+			m_bts.do_rate_ctr_inc(CTR_LLC_FRAME_DROPPED);
+		} while (m_octets > target && longest->size() > 0 &&
+			 longest->octets() >= second);
+
+		LOGP(DRLCMACDL, LOGL_NOTICE, "LLC queue budget exceeded, "
+			"evicted %u frames (%zu octets) of TLLI 0x%08x, "
+			"new_queue_size=%zu\n", frames, octets,
+			ms_tlli(longest->m_ms), longest->size());
+
+		report_discarded(longest, frames, octets);
+		reindex(longest);
+	}
+}
+
+void LlcController::report_discarded(gprs_llc_queue *queue, unsigned frames,
+	size_t octets)
+{
+	struct bssgp_bvc_ctx *bctx = gprs_bssgp_pcu_current_bctx();
+
+	if (!bctx || !queue->m_ms)
+		return;
+
+	if (frames > 0xff)
+		frames = 0xff;
+	if (octets > 0xffffff)
+		octets = 0xffffff;
+	bssgp_tx_llc_discarded(bctx, queue->m_ms->tlli(), frames, octets);
+}
+
+/* Drop the expired frames of all queues whose head frame expired, one
+ * LLC-DISCARDED per MS. Returns the number of dropped frames. */
+unsigned LlcController::sweep(const struct timespec *now)
+{
+	struct gprs_llc_index_entry *entry;
+	const gprs_llc_queue::MetaInfo *info;
+	gprs_llc_queue *queue;
+	struct msgb *msg;
+	unsigned frames, dropped = 0;
+	size_t octets;
+
+	while (!llist_empty(&m_index)) {
+		entry = llist_entry(m_index.next, struct gprs_llc_index_entry, list);
+		queue = entry->queue;
+
+		/* the index is ordered, so are the keys after this one */
+		if (!gprs_llc_queue::is_frame_expired(now, &queue->m_index_key))
+			break;
+
+		/* the key may be stale if the head has been sent since */
+		frames = 0;
+		octets = 0;
+		while ((info = queue->head_info()) &&
+		       gprs_llc_queue::is_frame_expired(now, &info->expire_time)) {
+			msg = queue->drop_head();
+			frames += 1;
+			octets += msgb_length(msg);
+			msgb_free(msg);
+			m_bts.do_rate_ctr_inc(CTR_LLC_FRAME_TIMEDOUT);
+			m_bts.do_rate_ctr_inc(CTR_LLC_FRAME_DROPPED);
+		}
+		m_frames -= frames;
+		m_octets -= octets;
+
+		if (frames) {
+			LOGP(DRLCMACDL, LOGL_NOTICE, "Discarding LLC PDU of "
+				"TLLI 0x%08x because lifetime limit reached, "
+				"count=%u new_queue_size=%zu\n",
+				ms_tlli(queue->m_ms), frames,
+				queue->size());
+			report_discarded(queue, frames, octets);
+			dropped += frames;
+		}
+
+		reindex(queue);
+	}
+
+	return dropped;
+}
+
+/* Called for every TDMA frame, sweeps every LLC_SWEEP_INTERVAL_MS */
+void LlcController::tick(uint32_t fn)
+{
+	uint32_t elapsed = (fn + GSM_MAX_FN - m_last_sweep_fn) % GSM_MAX_FN;
+	struct osmo_stat_item_group *statg;
+	struct timespec now;
+
+	if (m_last_sweep_fn >= 0 &&
+	    elapsed < (uint32_t)msecs_to_frames(LLC_SWEEP_INTERVAL_MS))
+		return;
+	m_last_sweep_fn = fn;
+
+	osmo_clock_gettime(CLOCK_MONOTONIC, &now);
+	sweep(&now);
+
+	statg = m_bts.stat_items();
+	if (statg) {
+		osmo_stat_item_set(statg->items[STAT_LLC_QUEUE_OCTETS], m_octets);
+		osmo_stat_item_set(statg->items[STAT_LLC_QUEUE_FRAMES], m_frames);
+	}
+}
@@ -28,7 +28,20 @@ extern "C" {
 
 #define LLC_MAX_LEN 1543
 
+/* Interval in which expired LLC frames are dropped from the queues of all
+ * MS, whether they are scheduled or not */
+#define LLC_SWEEP_INTERVAL_MS	200
+
 struct BTS;
+struct GprsMs;
+struct gprs_llc_queue;
+class LlcController;
+
+/* Entry of a queue in the expiry index of the LlcController */
+struct gprs_llc_index_entry {
+	struct llist_head list;
+	gprs_llc_queue *queue;
+};
 
 /**
  * I represent the LLC data to a MS
@@ -73,7 +86,10 @@ struct gprs_llc_queue {
 		const struct timespec *tv);
 	static bool is_user_data_frame(uint8_t *data, size_t len);
 
-	void init();
+	gprs_llc_queue();
+	~gprs_llc_queue();
+
+	void init(LlcController *ctrl = NULL, GprsMs *ms = NULL);
 
 	void enqueue(struct msgb *llc_msg, const struct timespec *expire_time);
 	struct msgb *dequeue(const MetaInfo **info = 0);
@@ -83,11 +99,66 @@ struct gprs_llc_queue {
 	size_t octets() const;
 
 private:
+	friend class LlcController;
+
+	const MetaInfo *head_info() const;
+	struct msgb *drop_head();
+
 	uint32_t m_avg_queue_delay; /* Average delay of data going through the queue */
 	size_t m_queue_size;
 	size_t m_queue_octets;
 	struct llist_head m_queue; /* queued LLC DL data */
 
+	/* accounting of the BTS, NULL for a stand-alone queue */
+	LlcController *m_ctrl;
+	GprsMs *m_ms;
+	/* entry in the expiry index of the controller while not empty, the
+	 * key is the expire time of the head frame when it was (re)indexed */
+	struct gprs_llc_index_entry m_index_entry;
+	struct timespec m_index_key;
+};
+
+/**
+ * I keep the LLC frames queued for all MS of a BTS within the memory
+ * budget, evicting the oldest frames of the longest queues first, and I
+ * drop expired frames without waiting for their MS to be scheduled. The
+ * queues are indexed by the expire time of their head frame. Frames are
+ * queued in arrival order with mostly the same lifetime, so a queue that
+ * becomes non-empty is usually appended to the index, and the keys of
+ * queues whose head was dequeued are only updated by the sweep.
+ */
+class LlcController {
+public:
+	LlcController(BTS &bts);
+
+	void tick(uint32_t fn);
+	unsigned sweep(const struct timespec *now);
+
+	size_t frames() const;
+	size_t octets() const;
+	unsigned queues() const;
+
+private:
+	friend struct gprs_llc_queue;
+
+	void enqueued(gprs_llc_queue *queue, size_t frames, size_t octets);
+	void dequeued(gprs_llc_queue *queue, size_t frames, size_t octets);
+	void reindex(gprs_llc_queue *queue);
+	void unindex(gprs_llc_queue *queue);
+	void evict(size_t target);
+	void report_discarded(gprs_llc_queue *queue, unsigned frames,
+		size_t octets);
+
+	BTS &m_bts;
+	size_t m_frames;
+	size_t m_octets;
+	unsigned m_queues; /* non-empty queues in the index */
+	struct llist_head m_index;
+	int32_t m_last_sweep_fn;
+
+	/* LLC controllers are not copied */
+	LlcController(const LlcController&);
+	LlcController& operator=(const LlcController&);
 };
 
 
@@ -132,3 +203,18 @@ inline size_t gprs_llc_queue::octets() const
 {
 	return m_queue_octets;
 }
+
+inline size_t LlcController::frames() const
+{
+	return m_frames;
+}
+
+inline size_t LlcController::octets() const
+{
+	return m_octets;
+}
+
+inline unsigned LlcController::queues() const
+{
+	return m_queues;
+}
@@ -181,10 +181,7 @@ uint8_t mslot_class_get_type(uint8_t ms_cl)
  */
 void mslot_fill_rx_mask(uint8_t mslot_class, uint8_t num_tx, uint8_t *rx_mask)
 {
-	static const char *digit[10] = { "0","1","2","3","4","5","6","7","8","9" };
-	uint8_t Tx = mslot_class_get_tx(mslot_class),     /* Max number of Tx slots */
-		Sum = mslot_class_get_sum(mslot_class),	  /* Max number of Tx + Rx slots */
-		Type = mslot_class_get_type(mslot_class), /* Type of Mobile */
+	uint8_t Type = mslot_class_get_type(mslot_class), /* Type of Mobile */
 		Tta = mslot_class_get_ta(mslot_class),    /* Minimum number of slots */
 		Ttb = mslot_class_get_tb(mslot_class),
 		/* FIXME: use actual TA offset for computation - make sure to adjust "1 + MS_TO" accordingly
@@ -192,13 +189,6 @@ void mslot_fill_rx_mask(uint8_t mslot_class, uint8_t num_tx, uint8_t *rx_mask)
 		Tra = mslot_class_get_ra(mslot_class, 0),
 		Trb = mslot_class_get_rb(mslot_class, 0);
 
-	if (num_tx == 1) /* it's enough to log this once per TX slot set iteration */
-		LOGP(DRLCMAC, LOGL_DEBUG,
-		     "Rx=%d Tx=%d Sum Rx+Tx=%s, Tta=%s Ttb=%d, Tra=%d Trb=%d, Type=%d\n",
-		     mslot_class_get_rx(mslot_class), Tx,
-		     (Sum == MS_NA) ? "N/A" : digit[Sum],
-		     (Tta == MS_NA) ? "N/A" : digit[Tta], Ttb, Tra, Trb, Type);
-
 	if (Type == 1) {
 		rx_mask[MASK_TT] = (0x100 >> OSMO_MAX(Ttb, Tta)) - 1;
 		rx_mask[MASK_TT] &= ~((1 << (Trb + num_tx)) - 1);
@@ -217,33 +207,21 @@ void mslot_fill_rx_mask(uint8_t mslot_class, uint8_t num_tx, uint8_t *rx_mask)
 /* look for USF, don't use USF=7 */
 int8_t find_free_usf(uint8_t usf_map)
 {
-	uint8_t usf;
+	uint8_t free_usf = ~usf_map & ((1 << 7) - 1);
 
-	if (usf_map == (1 << 7) - 1)
+	if (!free_usf)
 		return -1;
 
-	for (usf = 0; usf < 7; usf++) {
-		if (!(usf_map & (1 << usf)))
-			return usf;
-	}
-
-	return -1;
+	return __builtin_ctz(free_usf);
 }
 
 /* look for USF, don't use USF=7 */
 int8_t find_free_tfi(uint32_t tfi_map)
 {
-	int8_t tfi;
-
 	if (tfi_map == NO_FREE_TFI)
 		return -1;
 
-	for (tfi = 0; tfi < 32; tfi++) {
-		if (!(tfi_map & (((uint32_t)1) << tfi)))
-			return tfi;
-	}
-
-	return -1;
+	return __builtin_ctz(~tfi_map);
 }
 
 void masked_override_with(char *buf, uint8_t mask, char set_char)
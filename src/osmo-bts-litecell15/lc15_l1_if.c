@@ -314,7 +314,6 @@ int l1if_pdch_req(void *obj, uint8_t ts, int is_ptcch, uint32_t fn,
 	uint16_t arfcn, uint8_t block_nr, uint8_t *data, uint8_t len)
 {
 	struct lc15l1_hdl *fl1h = obj;
-	struct msgb *msg;
 	GsmL1_Prim_t *l1p;
 	GsmL1_PhDataReq_t *data_req;
 	GsmL1_MsgUnitParam_t *msu_param;
@@ -326,8 +325,10 @@ int l1if_pdch_req(void *obj, uint8_t ts, int is_ptcch, uint32_t fn,
 		"block_nr=%d, arfcn=%d, len=%d\n", g_time.t1, g_time.t2,
 		g_time.t3, is_ptcch, ts, block_nr, arfcn, len);
 
-	msg = l1p_msgb_alloc();
-	l1p = msgb_l1prim(msg);
+	/* fill the primitive in place, the payload is the only copy */
+	l1p = l1if_pdch_ring_head(&fl1h->pdch_ring);
+	if (!l1p)
+		return 0;
 	l1p->id = GsmL1_PrimId_PhDataReq;
 	data_req = &l1p->u.phDataReq;
 	data_req->hLayer1 = (HANDLE)fl1h->hLayer1;
@@ -340,15 +341,19 @@ int l1if_pdch_req(void *obj, uint8_t ts, int is_ptcch, uint32_t fn,
 	msu_param->u8Size = len;
 	memcpy(msu_param->u8Buffer, data, len);
 
-	/* transmit */
-	if (osmo_wqueue_enqueue(&fl1h->write_q[MQ_PDTCH_WRITE], msg) != 0) {
-		LOGP(DL1IF, LOGL_ERROR, "PDTCH queue full. dropping message.\n");
-		msgb_free(msg);
-	}
+	/* transmit once the queue is writable, together with the other TS */
+	l1if_pdch_ring_push(&fl1h->pdch_ring, &fl1h->write_q[MQ_PDTCH_WRITE].bfd);
 
 	return 0;
 }
 
+static int l1if_pdch_fd_cb(struct osmo_fd *ofd, unsigned int what)
+{
+	struct lc15l1_hdl *fl1h = ofd->data;
+
+	return l1if_pdch_ring_fd_cb(&fl1h->pdch_ring, ofd, what);
+}
+
 void *l1if_open_pdch(uint8_t trx_no, uint32_t hlayer1)
 {
 	struct lc15l1_hdl *fl1h;
@@ -365,11 +370,20 @@ void *l1if_open_pdch(uint8_t trx_no, uint32_t hlayer1)
 
 	DEBUGP(DL1IF, "PCU: Using TRX HW#%u\n", fl1h->hw_info.trx_nr);
 
+	rc = l1if_pdch_ring_init(&fl1h->pdch_ring, fl1h, sizeof(GsmL1_Prim_t),
+		trx_no);
+	if (rc < 0) {
+		talloc_free(fl1h);
+		return NULL;
+	}
+
 	rc = l1if_transport_open(MQ_PDTCH_WRITE, fl1h);
 	if (rc < 0) {
+		l1if_pdch_ring_free(&fl1h->pdch_ring);
 		talloc_free(fl1h);
 		return NULL;
 	}
+	fl1h->write_q[MQ_PDTCH_WRITE].bfd.cb = l1if_pdch_fd_cb;
 
 	fl1h->gsmtap = gsmtap_source_init("localhost", GSMTAP_UDP_PORT, 1);
 	if (fl1h->gsmtap)
@@ -381,8 +395,10 @@ void *l1if_open_pdch(uint8_t trx_no, uint32_t hlayer1)
 int l1if_close_pdch(void *obj)
 {
 	struct lc15l1_hdl *fl1h = obj;
-	if (fl1h)
+	if (fl1h) {
 		l1if_transport_close(MQ_PDTCH_WRITE, fl1h);
+		l1if_pdch_ring_free(&fl1h->pdch_ring);
+	}
 	talloc_free(fl1h);
 	return 0;
 }
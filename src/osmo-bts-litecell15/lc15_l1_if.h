@@ -26,6 +26,7 @@
 #include <osmocom/core/write_queue.h>
 #include <osmocom/core/gsmtap_util.h>
 #include <osmocom/gsm/gsm_utils.h>
+#include <l1if_pdch_ring.h>
 #include "lc15bts.h"
 
 enum {
@@ -61,6 +62,8 @@ struct lc15l1_hdl {
 	struct osmo_fd read_ofd[_NUM_MQ_READ];	/* osmo file descriptors */
 	struct osmo_wqueue write_q[_NUM_MQ_WRITE];
 
+	struct l1if_pdch_ring pdch_ring;
+
 	struct {
 		int trx_nr;	/* <1-2> */
 	} hw_info;
@@ -27,6 +27,7 @@
 #include <osmocom/core/gsmtap_util.h>
 #include <osmocom/core/timer.h>
 #include <osmocom/gsm/gsm_utils.h>
+#include <l1if_pdch_ring.h>
 
 #include "oc2gbts.h"
 
@@ -63,6 +64,8 @@ struct oc2gl1_hdl {
 	struct osmo_fd read_ofd[_NUM_MQ_READ];	/* osmo file descriptors */
 	struct osmo_wqueue write_q[_NUM_MQ_WRITE];
 
+	struct l1if_pdch_ring pdch_ring;
+
 	struct {
 		int trx_nr;	/* <1-2> */
 	} hw_info;
@@ -129,6 +129,10 @@ int l1if_transport_open(int q, struct femtol1_hdl *fl1h)
 	if (rc < 0)
 		return rc;
 
+	/* datagrams keep the boundaries, all pending PDCH blocks go in one call */
+	if (q == MQ_PDTCH_WRITE)
+		fl1h->pdch_ring.flush = l1if_pdch_ring_sendmmsg;
+
 	return 0;
 }
 
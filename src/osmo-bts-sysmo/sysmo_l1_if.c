@@ -303,7 +303,6 @@ int l1if_pdch_req(void *obj, uint8_t ts, int is_ptcch, uint32_t fn,
 	uint16_t arfcn, uint8_t block_nr, uint8_t *data, uint8_t len)
 {
 	struct femtol1_hdl *fl1h = obj;
-	struct msgb *msg;
 	GsmL1_Prim_t *l1p;
 	GsmL1_PhDataReq_t *data_req;
 	GsmL1_MsgUnitParam_t *msu_param;
@@ -315,8 +314,10 @@ int l1if_pdch_req(void *obj, uint8_t ts, int is_ptcch, uint32_t fn,
 		"block_nr=%d, arfcn=%d, len=%d\n", g_time.t1, g_time.t2,
 		g_time.t3, is_ptcch, ts, block_nr, arfcn, len);
 
-	msg = l1p_msgb_alloc();
-	l1p = msgb_l1prim(msg);
+	/* fill the primitive in place, the payload is the only copy */
+	l1p = l1if_pdch_ring_head(&fl1h->pdch_ring);
+	if (!l1p)
+		return 0;
 	l1p->id = GsmL1_PrimId_PhDataReq;
 	data_req = &l1p->u.phDataReq;
 	data_req->hLayer1 = fl1h->hLayer1;
@@ -329,15 +330,19 @@ int l1if_pdch_req(void *obj, uint8_t ts, int is_ptcch, uint32_t fn,
 	msu_param->u8Size = len;
 	memcpy(msu_param->u8Buffer, data, len);
 
-	/* transmit */
-	if (osmo_wqueue_enqueue(&fl1h->write_q[MQ_PDTCH_WRITE], msg) != 0) {
-		LOGP(DL1IF, LOGL_ERROR, "PDTCH queue full. dropping message.\n");
-		msgb_free(msg);
-	}
+	/* transmit once the queue is writable, together with the other TS */
+	l1if_pdch_ring_push(&fl1h->pdch_ring, &fl1h->write_q[MQ_PDTCH_WRITE].bfd);
 
 	return 0;
 }
 
+static int l1if_pdch_fd_cb(struct osmo_fd *ofd, unsigned int what)
+{
+	struct femtol1_hdl *fl1h = ofd->data;
+
+	return l1if_pdch_ring_fd_cb(&fl1h->pdch_ring, ofd, what);
+}
+
 void *l1if_open_pdch(uint8_t trx_no, uint32_t hlayer1, struct gsmtap_inst *gsmtap)
 {
 	struct femtol1_hdl *fl1h;
@@ -353,11 +358,20 @@ void *l1if_open_pdch(uint8_t trx_no, uint32_t hlayer1, struct gsmtap_inst *gsmta
 	/* default clock source: OCXO */
 	fl1h->clk_src = SuperFemto_ClkSrcId_Ocxo;
 
+	rc = l1if_pdch_ring_init(&fl1h->pdch_ring, fl1h, sizeof(GsmL1_Prim_t),
+		trx_no);
+	if (rc < 0) {
+		talloc_free(fl1h);
+		return NULL;
+	}
+
 	rc = l1if_transport_open(MQ_PDTCH_WRITE, fl1h);
 	if (rc < 0) {
+		l1if_pdch_ring_free(&fl1h->pdch_ring);
 		talloc_free(fl1h);
 		return NULL;
 	}
+	fl1h->write_q[MQ_PDTCH_WRITE].bfd.cb = l1if_pdch_fd_cb;
 
 	fl1h->gsmtap = gsmtap;
 
@@ -367,8 +381,10 @@ void *l1if_open_pdch(uint8_t trx_no, uint32_t hlayer1, struct gsmtap_inst *gsmta
 int l1if_close_pdch(void *obj)
 {
 	struct femtol1_hdl *fl1h = obj;
-	if (fl1h)
+	if (fl1h) {
 		l1if_transport_close(MQ_PDTCH_WRITE, fl1h);
+		l1if_pdch_ring_free(&fl1h->pdch_ring);
+	}
 	talloc_free(fl1h);
 	return 0;
 }
@@ -5,6 +5,8 @@
 #include <osmocom/core/write_queue.h>
 #include <osmocom/core/gsmtap_util.h>
 #include <osmocom/gsm/gsm_utils.h>
+#include <sysmocom/femtobts/gsml1prim.h>
+#include <l1if_pdch_ring.h>
 #include "femtobts.h"
 
 enum {
@@ -46,6 +48,8 @@ struct femtol1_hdl {
 	struct osmo_fd read_ofd[_NUM_MQ_READ];	/* osmo file descriptors */
 	struct osmo_wqueue write_q[_NUM_MQ_WRITE];
 
+	struct l1if_pdch_ring pdch_ring;
+
 	struct {
 		uint8_t dsp_version[3];
 		uint8_t fpga_version[3];
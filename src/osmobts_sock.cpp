@@ -34,6 +34,7 @@ extern "C" {
 }
 
 #include <pcu_l1_if.h>
+#include <pcuif_shm.h>
 #include <gprs_debug.h>
 #include <gprs_bssgp_pcu.h>
 #include <osmocom/pcu/pcuif_proto.h>
@@ -53,6 +54,9 @@ static struct {
 	struct osmo_fd conn_bfd;	/* fd for connection to the BTS */
 	struct osmo_timer_list timer;	/* socket connect retry timer */
 	struct llist_head upqueue;	/* queue for sending messages */
+	struct pcuif_shm shm;		/* rings offered to the BTS */
+	struct osmo_fd shm_bfd;		/* our doorbell, once confirmed */
+	bool shm_active;		/* the BTS uses the rings */
 } pcu_sock_state;
 
 static void pcu_sock_timeout(void *_priv)
@@ -82,7 +86,10 @@ int pcu_sock_send(struct msgb *msg)
 		return -EIO;
 	}
 	msgb_enqueue(&pcu_sock_state.upqueue, msg);
-	conn_bfd->when |= OSMO_FD_WRITE;
+	if (pcu_sock_state.shm_active)
+		pcu_sock_state.shm_bfd.when |= OSMO_FD_WRITE;
+	else
+		conn_bfd->when |= OSMO_FD_WRITE;
 
 	return 0;
 }
@@ -100,6 +107,13 @@ static void pcu_sock_close(int lost)
 	bfd->fd = -1;
 	osmo_fd_unregister(bfd);
 
+	if (pcu_sock_state.shm_active) {
+		osmo_fd_unregister(&pcu_sock_state.shm_bfd);
+		pcu_sock_state.shm_active = false;
+	}
+	if (pcu_sock_state.shm.seg)
+		pcuif_shm_free(&pcu_sock_state.shm);
+
 	/* flush the queue */
 	while (!llist_empty(&pcu_sock_state.upqueue)) {
 		struct msgb *msg = msgb_dequeue(&pcu_sock_state.upqueue);
@@ -125,6 +139,145 @@ for the reset. */
 	exit(0);
 }
 
+/*
+ * Shared memory rings, see PCU_IF_MSG_SHM_REQ
+ */
+
+static int pcu_shm_write(struct osmo_fd *bfd)
+{
+	struct gsm_pcu_if *slot;
+	unsigned num = 0;
+	int rc;
+
+	bfd->when &= ~OSMO_FD_WRITE;
+
+	/* if the ring is full the rest is written when the BTS rings us */
+	while (!llist_empty(&pcu_sock_state.upqueue)) {
+		struct msgb *msg;
+
+		slot = pcuif_shm_tx_reserve(&pcu_sock_state.shm);
+		if (!slot)
+			break;
+
+		msg = msgb_dequeue(&pcu_sock_state.upqueue);
+		if (!msgb_length(msg)) {
+			LOGP(DL1IF, LOGL_ERROR, "message type (%d) with ZERO "
+				"bytes!\n", ((struct gsm_pcu_if *)msg->data)->msg_type);
+			msgb_free(msg);
+			continue;
+		}
+
+		memcpy(slot, msgb_data(msg),
+			OSMO_MIN(msgb_length(msg), sizeof(*slot)));
+		pcuif_shm_tx_commit(&pcu_sock_state.shm);
+		msgb_free(msg);
+		num += 1;
+	}
+
+	/* one doorbell for the whole batch */
+	if (num) {
+		rc = pcuif_shm_kick(&pcu_sock_state.shm);
+		if (rc < 0) {
+			pcu_sock_close(1);
+			return rc;
+		}
+	}
+
+	return 0;
+}
+
+static int pcu_shm_read(struct osmo_fd *bfd)
+{
+	struct gsm_pcu_if *pcu_prim;
+
+	pcuif_shm_ack(&pcu_sock_state.shm);
+
+	/* handle the primitives in place, no copy */
+	while ((pcu_prim = pcuif_shm_rx_peek(&pcu_sock_state.shm))) {
+		pcu_rx(pcu_prim->msg_type, pcu_prim);
+		pcuif_shm_rx_consume(&pcu_sock_state.shm);
+	}
+
+	/* retry what did not fit into the ring before */
+	if (!llist_empty(&pcu_sock_state.upqueue))
+		bfd->when |= OSMO_FD_WRITE;
+
+	return 0;
+}
+
+static int pcu_shm_cb(struct osmo_fd *bfd, unsigned int flags)
+{
+	int rc = 0;
+
+	if (flags & OSMO_FD_READ)
+		rc = pcu_shm_read(bfd);
+	if (rc < 0)
+		return rc;
+
+	if (flags & OSMO_FD_WRITE)
+		rc = pcu_shm_write(bfd);
+
+	return rc;
+}
+
+static void pcu_shm_offer(void)
+{
+	int rc;
+
+	rc = pcuif_shm_create(&pcu_sock_state.shm);
+	if (rc < 0) {
+		LOGP(DL1IF, LOGL_ERROR, "Cannot create the PCU socket shared "
+			"memory (%s), using the socket\n", strerror(-rc));
+		return;
+	}
+
+	rc = pcuif_shm_send_req(&pcu_sock_state.shm, pcu_sock_state.conn_bfd.fd);
+	if (rc < 0) {
+		LOGP(DL1IF, LOGL_ERROR, "Cannot offer the PCU socket shared "
+			"memory (%s), using the socket\n", strerror(-rc));
+		pcuif_shm_free(&pcu_sock_state.shm);
+		return;
+	}
+
+	LOGP(DL1IF, LOGL_INFO, "Offered shared memory rings to the BTS\n");
+}
+
+/* The BTS mapped the rings, it reads whatever is still in the socket before
+ * the rings. From now on everything queued goes through the rings. */
+static int pcu_shm_activate(void)
+{
+	struct osmo_fd *bfd = &pcu_sock_state.shm_bfd;
+
+	if (!pcu_sock_state.shm.seg || pcu_sock_state.shm_active) {
+		LOGP(DL1IF, LOGL_ERROR, "Unexpected shared memory confirmation "
+			"from the BTS\n");
+		return -EINVAL;
+	}
+
+	bfd->fd = pcu_sock_state.shm.rx_efd;
+	bfd->when = OSMO_FD_READ;
+	bfd->cb = pcu_shm_cb;
+	bfd->data = NULL;
+	bfd->priv_nr = 0;
+	if (osmo_fd_register(bfd) < 0) {
+		/* the BTS already switched, there is no way back */
+		LOGP(DL1IF, LOGL_ERROR, "Cannot register the shared memory "
+			"doorbell\n");
+		pcu_sock_close(1);
+		return -EIO;
+	}
+
+	pcu_sock_state.shm_active = true;
+	pcu_sock_state.conn_bfd.when &= ~OSMO_FD_WRITE;
+	if (!llist_empty(&pcu_sock_state.upqueue))
+		bfd->when |= OSMO_FD_WRITE;
+
+	LOGP(DL1IF, LOGL_NOTICE, "osmo-bts PCU socket uses shared memory "
+		"rings\n");
+
+	return 0;
+}
+
 static int pcu_sock_read(struct osmo_fd *bfd)
 {
 	struct gsm_pcu_if pcu_prim;
@@ -138,6 +291,9 @@ static int pcu_sock_read(struct osmo_fd *bfd)
 		return -EIO;
 	}
 
+	if (pcu_prim.msg_type == PCU_IF_MSG_SHM_CNF)
+		return pcu_shm_activate();
+
 	return pcu_rx(pcu_prim.msg_type, &pcu_prim);
 }
 
@@ -229,6 +385,9 @@ int pcu_l1if_open(void)
 	LOGP(DL1IF, LOGL_NOTICE, "osmo-bts PCU socket %s has been connected\n",
 	     bts->pcu_sock_path);
 
+	if (bts->pcu_sock_shm)
+		pcu_shm_offer();
+
 	pcu_tx_txt_ind(PCU_VERSION, "%s", PACKAGE_VERSION);
 
 	/* Schedule a timer so we keep trying until the BTS becomes active. */
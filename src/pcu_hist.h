@@ -0,0 +1,141 @@
+/* pcu_hist.h
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/* Bucket i counts samples below (PCU_HIST_BASE << i), the last bucket
+ * counts everything above. With a base of 16 the buckets span 16us..16ms
+ * when fed with microseconds. */
+#define PCU_HIST_BUCKETS 12
+#define PCU_HIST_BASE 16
+
+struct pcu_hist {
+	uint64_t count;
+	uint64_t sum;
+	uint32_t max;
+	uint64_t buckets[PCU_HIST_BUCKETS];
+};
+
+static inline void pcu_hist_reset(struct pcu_hist *h)
+{
+	memset(h, 0, sizeof(*h));
+}
+
+static inline void pcu_hist_add(struct pcu_hist *h, uint32_t val)
+{
+	unsigned int i;
+
+	for (i = 0; i < PCU_HIST_BUCKETS - 1; i++) {
+		if (val < ((uint32_t)PCU_HIST_BASE << i))
+			break;
+	}
+
+	h->buckets[i] += 1;
+	h->count += 1;
+	h->sum += val;
+	if (val > h->max)
+		h->max = val;
+}
+
+/* upper bound of bucket i, 0 for the open-ended last bucket */
+static inline uint32_t pcu_hist_bucket_limit(unsigned int i)
+{
+	if (i >= PCU_HIST_BUCKETS - 1)
+		return 0;
+	return (uint32_t)PCU_HIST_BASE << i;
+}
+
+/* first bucket up to which at least permille/1000 of the samples fall */
+static inline unsigned int pcu_hist_percentile_bucket(const struct pcu_hist *h,
+						      unsigned int permille)
+{
+	uint64_t seen = 0;
+	unsigned int i;
+
+	for (i = 0; i < PCU_HIST_BUCKETS - 1; i++) {
+		seen += h->buckets[i];
+		if (seen * 1000 >= h->count * permille)
+			break;
+	}
+	return i;
+}
+
+/* smallest bucket limit below which at least permille/1000 of the samples
+ * fall, 0 if that is only the case for the open-ended last bucket */
+static inline uint32_t pcu_hist_percentile(const struct pcu_hist *h, unsigned int permille)
+{
+	if (!h->count)
+		return 0;
+	return pcu_hist_bucket_limit(pcu_hist_percentile_bucket(h, permille));
+}
+
+/* "<limit" of bucket i, ">=limit" of the one before for the last bucket */
+static inline const char *pcu_hist_bucket_str(char *buf, size_t len, unsigned int i,
+					      const char *unit)
+{
+	if (i < PCU_HIST_BUCKETS - 1)
+		snprintf(buf, len, "<%u%s", pcu_hist_bucket_limit(i), unit);
+	else
+		snprintf(buf, len, ">=%u%s", pcu_hist_bucket_limit(i - 1), unit);
+	return buf;
+}
+
+/* "count N avg A max M p50 <X p99 <Y", the percentiles are bucket bounds */
+static inline const char *pcu_hist_summary(char *buf, size_t len,
+					   const struct pcu_hist *h, const char *unit)
+{
+	char p50[16] = "-", p99[16] = "-";
+
+	if (h->count) {
+		pcu_hist_bucket_str(p50, sizeof(p50), pcu_hist_percentile_bucket(h, 500), unit);
+		pcu_hist_bucket_str(p99, sizeof(p99), pcu_hist_percentile_bucket(h, 990), unit);
+	}
+
+	snprintf(buf, len, "count %llu avg %llu%s max %u%s p50 %s p99 %s",
+		 (unsigned long long)h->count,
+		 (unsigned long long)(h->count ? h->sum / h->count : 0), unit,
+		 h->max, unit, p50, p99);
+	return buf;
+}
+
+/* samples added to cur since it was copied to prev, the maximum can not be
+ * split and is taken over from cur */
+static inline void pcu_hist_delta(struct pcu_hist *delta, const struct pcu_hist *cur,
+				  const struct pcu_hist *prev)
+{
+	unsigned int i;
+
+	delta->count = cur->count - prev->count;
+	delta->sum = cur->sum - prev->sum;
+	delta->max = cur->max;
+	for (i = 0; i < PCU_HIST_BUCKETS; i++)
+		delta->buckets[i] = cur->buckets[i] - prev->buckets[i];
+}
+
+static inline uint32_t pcu_timespec_diff_us(const struct timespec *start,
+					    const struct timespec *end)
+{
+	int64_t us = (int64_t)(end->tv_sec - start->tv_sec) * 1000000 +
+		(end->tv_nsec - start->tv_nsec) / 1000;
+
+	return us < 0 ? 0 : (uint32_t)us;
+}
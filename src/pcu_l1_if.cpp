@@ -28,6 +28,7 @@
 #include <sys/un.h>
 #include <arpa/inet.h>
 #include <ctype.h>
+#include <time.h>
 
 extern "C" {
 #include <osmocom/core/talloc.h>
@@ -49,6 +50,8 @@ extern "C" {
 #include <osmocom/pcu/pcuif_proto.h>
 #include <bts.h>
 #include <pdch.h>
+#include <pcuif_capture.h>
+#include <pcu_rt.h>
 
 // FIXME: move this, when changed from c++ to c.
 extern "C" {
@@ -140,7 +143,7 @@ int pcu_tx_txt_ind(enum gsm_pcu_if_text_type t, const char *fmt, ...)
 	return pcu_sock_send(msg);
 }
 
-static int pcu_tx_act_req(uint8_t trx, uint8_t ts, uint8_t activate)
+int pcu_tx_act_req(uint8_t trx, uint8_t ts, uint8_t activate)
 {
 	struct msgb *msg;
 	struct gsm_pcu_if *pcu_prim;
@@ -161,53 +164,105 @@ static int pcu_tx_act_req(uint8_t trx, uint8_t ts, uint8_t activate)
 	return pcu_sock_send(msg);
 }
 
+static struct msgb *pcu_data_req_alloc(uint8_t trx, uint8_t ts, uint8_t sapi,
+	uint16_t arfcn, uint32_t fn, uint8_t block_nr,
+	struct gsm_pcu_if_data **data_req)
+{
+	struct msgb *msg;
+	struct gsm_pcu_if *pcu_prim;
+
+	msg = pcu_msgb_alloc(PCU_IF_MSG_DATA_REQ, 0);
+	if (!msg)
+		return NULL;
+	pcu_prim = (struct gsm_pcu_if *) msg->data;
+	*data_req = &pcu_prim->u.data_req;
+
+	(*data_req)->sapi = sapi;
+	(*data_req)->fn = fn;
+	(*data_req)->arfcn = arfcn;
+	(*data_req)->trx_nr = trx;
+	(*data_req)->ts_nr = ts;
+	(*data_req)->block_nr = block_nr;
+
+	return msg;
+}
+
+static void pcu_log_data_req(const struct gsm_pcu_if_data *data_req)
+{
+	LOGP(DL1IF, LOGL_DEBUG, "Sending data request: trx=%d ts=%d sapi=%d "
+		"arfcn=%d fn=%d cur_fn=%d block=%d data=%s\n",
+		data_req->trx_nr, data_req->ts_nr, data_req->sapi,
+		data_req->arfcn, data_req->fn, get_current_fn(),
+		data_req->block_nr, osmo_hexdump(data_req->data, data_req->len));
+}
+
 static int pcu_tx_data_req(uint8_t trx, uint8_t ts, uint8_t sapi,
 	uint16_t arfcn, uint32_t fn, uint8_t block_nr, uint8_t *data,
 	uint8_t len)
 {
 	struct msgb *msg;
-	struct gsm_pcu_if *pcu_prim;
 	struct gsm_pcu_if_data *data_req;
-	int current_fn = get_current_fn();
-
-	LOGP(DL1IF, LOGL_DEBUG, "Sending data request: trx=%d ts=%d sapi=%d "
-		"arfcn=%d fn=%d cur_fn=%d block=%d data=%s\n", trx, ts, sapi, arfcn, fn, current_fn,
-		block_nr, osmo_hexdump(data, len));
 
-	msg = pcu_msgb_alloc(PCU_IF_MSG_DATA_REQ, 0);
+	msg = pcu_data_req_alloc(trx, ts, sapi, arfcn, fn, block_nr, &data_req);
 	if (!msg)
 		return -ENOMEM;
-	pcu_prim = (struct gsm_pcu_if *) msg->data;
-	data_req = &pcu_prim->u.data_req;
-
-	data_req->sapi = sapi;
-	data_req->fn = fn;
-	data_req->arfcn = arfcn;
-	data_req->trx_nr = trx;
-	data_req->ts_nr = ts;
-	data_req->block_nr = block_nr;
+
 	memcpy(data_req->data, data, len);
 	data_req->len = len;
+	pcu_log_data_req(data_req);
 
 	return pcu_sock_send(msg);
 }
 
-void pcu_l1if_tx_pdtch(msgb *msg, uint8_t trx, uint8_t ts, uint16_t arfcn,
-	uint32_t fn, uint8_t block_nr)
+/* Get the buffer to encode the next PDTCH/PACCH block into, that is the
+ * DATA.req itself on the PCU socket. Returns NULL if there is no memory. */
+uint8_t *pcu_l1if_pdtch_block(struct pcu_l1if_block *blk, uint8_t trx,
+	uint8_t ts, uint16_t arfcn, uint32_t fn, uint8_t block_nr)
 {
+	struct gsm_pcu_if_data *data_req;
+
+	blk->trx = trx;
+	blk->ts = ts;
+	blk->arfcn = arfcn;
+	blk->fn = fn;
+	blk->block_nr = block_nr;
+	blk->msg = NULL;
+	blk->data = blk->direct;
+
 #ifdef ENABLE_DIRECT_PHY
-	struct gprs_rlcmac_bts *bts = bts_main_data();
+	if (bts_main_data()->trx[trx].fl1h)
+		return blk->data;
+#endif
+	blk->msg = pcu_data_req_alloc(trx, ts, PCU_IF_SAPI_PDTCH, arfcn, fn,
+		block_nr, &data_req);
+	if (!blk->msg)
+		return NULL;
 
-	if (bts->trx[trx].fl1h) {
-		l1if_pdch_req(bts->trx[trx].fl1h, ts, 0, fn, arfcn, block_nr,
-			msg->data, msg->len);
-		msgb_free(msg);
+	blk->data = data_req->data;
+	return blk->data;
+}
+
+void pcu_l1if_tx_pdtch_block(struct pcu_l1if_block *blk, uint8_t len)
+{
+	struct gsm_pcu_if_data *data_req;
+
+	OSMO_ASSERT(len <= PCU_L1IF_BLOCK_MAX_LEN);
+
+#ifdef ENABLE_DIRECT_PHY
+	if (!blk->msg) {
+		struct gprs_rlcmac_bts *bts = bts_main_data();
+
+		l1if_pdch_req(bts->trx[blk->trx].fl1h, blk->ts, 0, blk->fn,
+			blk->arfcn, blk->block_nr, blk->data, len);
 		return;
 	}
 #endif
-	pcu_tx_data_req(trx, ts, PCU_IF_SAPI_PDTCH, arfcn, fn, block_nr,
-			msg->data, msg->len);
-	msgb_free(msg);
+	data_req = &((struct gsm_pcu_if *) blk->msg->data)->u.data_req;
+	data_req->len = len;
+	pcu_log_data_req(data_req);
+
+	pcu_sock_send(blk->msg);
+	blk->msg = NULL;
 }
 
 void pcu_l1if_tx_ptcch(uint8_t trx, uint8_t ts, uint16_t arfcn,
@@ -283,9 +338,16 @@ extern "C" int pcu_rx_data_ind_pdtch(uint8_t trx_no, uint8_t ts_no, uint8_t *dat
 	uint8_t len, uint32_t fn, struct pcu_l1_meas *meas)
 {
 	struct gprs_rlcmac_pdch *pdch;
+	struct pcu_rt_section section;
+	int rc;
 
 	pdch = &bts_main_data()->trx[trx_no].pdch[ts_no];
-	return pdch->rcv_block(data, len, fn, meas);
+
+	pcu_rt_enter(&section);
+	rc = pdch->rcv_block(data, len, fn, meas);
+	pcu_rt_leave(&section, PCU_RT_DATA_IND, trx_no, ts_no, fn, 0);
+
+	return rc;
 }
 
 static int pcu_rx_data_ind_bcch(uint8_t *data, uint8_t len)
@@ -383,8 +445,19 @@ static int pcu_rx_data_cnf(struct gsm_pcu_if_data *data_cnf)
 extern "C" int pcu_rx_rts_req_pdtch(uint8_t trx, uint8_t ts,
 	uint32_t fn, uint8_t block_nr)
 {
-	return gprs_rlcmac_rcv_rts_block(bts_main_data(),
-					trx, ts, fn, block_nr);
+	struct gprs_rlcmac_bts *bts = bts_main_data();
+	struct pcu_rt_section section;
+	uint32_t us;
+	int rc;
+
+	pcu_rt_enter(&section);
+	rc = gprs_rlcmac_rcv_rts_block(bts, trx, ts, fn, block_nr);
+	us = pcu_rt_leave(&section, PCU_RT_RTS, trx, ts, fn, block_nr);
+
+	if (rc == 0)
+		pcu_hist_add(&bts->rts_latency, us);
+
+	return rc;
 }
 extern "C" int pcu_rx_rts_req_ptcch(uint8_t trx, uint8_t ts,
 	uint32_t fn, uint8_t block_nr)
@@ -488,9 +561,11 @@ static int pcu_rx_rach_ind(const struct gsm_pcu_if_rach_ind *rach_ind)
 static int pcu_rx_info_ind(struct gsm_pcu_if_info_ind *info_ind)
 {
 	struct gprs_rlcmac_bts *bts = bts_main_data();
+	PdchPool *pool = BTS::main_bts()->pdch_pool();
 	struct gprs_bssgp_pcu *pcu;
 	struct gprs_rlcmac_pdch *pdch;
 	struct in_addr ia;
+	bool pdch_on;
 	int rc = 0;
 	unsigned int trx, ts;
 	int i;
@@ -593,6 +668,7 @@ bssgp_failed:
 		osmo_tdef_set(bts->T_defs_bts, 3191, info_ind->t3191, OSMO_TDEF_S);
 		osmo_tdef_set(bts->T_defs_bts, 3193, info_ind->t3193_10ms * 10, OSMO_TDEF_MS);
 		osmo_tdef_set(bts->T_defs_bts, 3195, info_ind->t3195, OSMO_TDEF_S);
+		bts_update_params(bts);
 		bts->n3101 = info_ind->n3101;
 		bts->n3103 = info_ind->n3103;
 		bts->n3105 = info_ind->n3105;
@@ -630,10 +706,12 @@ bssgp_failed:
 #endif
 		}
 
+		bts->trx[trx].dyn_pdch_mask = info_ind->trx[trx].dyn_pdch_mask;
 		for (ts = 0; ts < ARRAY_SIZE(bts->trx[0].pdch); ts++) {
 			pdch = &bts->trx[trx].pdch[ts];
-			if ((info_ind->trx[trx].pdch_mask & (1 << ts))) {
-				/* FIXME: activate dynamically at RLCMAC */
+			pdch_on = info_ind->trx[trx].pdch_mask & (1 << ts);
+			/* a PDCH we gave back is gone, whatever the BTS says */
+			if (pdch_on && !pool->release_pending(trx, ts)) {
 				if (!pdch->is_enabled()) {
 #ifdef ENABLE_DIRECT_PHY
 					if ((info_ind->flags &
@@ -641,7 +719,9 @@ bssgp_failed:
 						l1if_connect_pdch(
 							bts->trx[trx].fl1h, ts);
 #endif
-					pcu_tx_act_req(trx, ts, 1);
+					/* no need to confirm what we asked for */
+					if (!pool->activation_pending(trx, ts))
+						pcu_tx_act_req(trx, ts, 1);
 					pdch->enable();
 				}
 				pdch->tsc = info_ind->trx[trx].tsc[ts];
@@ -654,6 +734,7 @@ bssgp_failed:
 					pdch->disable();
 				}
 			}
+			pool->info_ind(trx, ts, pdch_on);
 		}
 	}
 
@@ -747,6 +828,8 @@ int pcu_rx(uint8_t msg_type, struct gsm_pcu_if *pcu_prim)
 {
 	int rc = 0;
 
+	pcuif_capture_pcuif(pcu_prim);
+
 	switch (msg_type) {
 	case PCU_IF_MSG_DATA_IND:
 		rc = pcu_rx_data_ind(&pcu_prim->u.data_ind);
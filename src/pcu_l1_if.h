@@ -152,8 +152,24 @@ struct pcu_l1_meas {
 };
 
 #ifdef __cplusplus
-void pcu_l1if_tx_pdtch(msgb *msg, uint8_t trx, uint8_t ts, uint16_t arfcn, 
-        uint32_t fn, uint8_t block_nr);
+/* Room for any PDTCH/PACCH block, the size of a PCUIF DATA.req */
+#define PCU_L1IF_BLOCK_MAX_LEN	162
+
+/* A PDTCH/PACCH block encoded in place into the primitive that sends it */
+struct pcu_l1if_block {
+	uint8_t trx;
+	uint8_t ts;
+	uint16_t arfcn;
+	uint32_t fn;
+	uint8_t block_nr;
+	struct msgb *msg;	/* PCUIF DATA.req, NULL for the direct PHY */
+	uint8_t *data;		/* where the block goes */
+	uint8_t direct[PCU_L1IF_BLOCK_MAX_LEN];
+};
+
+uint8_t *pcu_l1if_pdtch_block(struct pcu_l1if_block *blk, uint8_t trx,
+	uint8_t ts, uint16_t arfcn, uint32_t fn, uint8_t block_nr);
+void pcu_l1if_tx_pdtch_block(struct pcu_l1if_block *blk, uint8_t len);
 void pcu_l1if_tx_ptcch(uint8_t trx, uint8_t ts, uint16_t arfcn,
 		       uint32_t fn, uint8_t block_nr,
 		       uint8_t *data, size_t data_len);
@@ -162,6 +178,7 @@ void pcu_l1if_tx_agch(bitvec * block, int len);
 void pcu_l1if_tx_pch(bitvec * block, int plen, uint16_t pgroup);
 
 int pcu_tx_txt_ind(enum gsm_pcu_if_text_type t, const char *fmt, ...);
+int pcu_tx_act_req(uint8_t trx, uint8_t ts, uint8_t activate);
 
 int pcu_l1if_open(void);
 void pcu_l1if_close(void);
@@ -33,6 +33,8 @@
 #include <bts.h>
 #include <osmocom/pcu/pcuif_proto.h>
 #include "gprs_bssgp_pcu.h"
+#include "pcuif_capture.h"
+#include "gsmtap_export.h"
 
 extern "C" {
 #include "pcu_vty.h"
@@ -64,6 +66,7 @@ static int quit = 0;
 static int rt_prio = -1;
 static bool daemonize = false;
 static const char *gsmtap_addr = "localhost"; // FIXME: use gengetopt's default value instead
+static const char *record_file = NULL;
 
 static void print_help()
 {
@@ -81,6 +84,8 @@ static void print_help()
 		"  -D	--daemonize	Fork the process into a background "
 			"daemon\n"
 		"  -i	--gsmtap-ip	The destination IP used for GSMTAP\n"
+		"  -R	--record FILE	Record PCUIF and Gb input to FILE "
+			"for tests/replay\n"
 		);
 }
 
@@ -99,10 +104,11 @@ static void handle_options(int argc, char **argv)
 			{ "daemonize", 0, 0, 'D' },
 			{ "exit", 0, 0, 'e' },
 			{ "gsmtap-ip", 1, 0, 'i' },
+			{ "record", 1, 0, 'R' },
 			{ 0, 0, 0, 0 }
 		};
 
-		c = getopt_long(argc, argv, "hc:m:n:Vr:De:i:",
+		c = getopt_long(argc, argv, "hc:m:n:Vr:De:i:R:",
 				long_options, &option_idx);
 		if (c == -1)
 			break;
@@ -139,6 +145,9 @@ static void handle_options(int argc, char **argv)
 		case 'D':
 			daemonize = true;
 			break;
+		case 'R':
+			record_file = optarg;
+			break;
 		case 'e':
 			fprintf(stderr, "Warning: Option '-e' is deprecated!\n");
 			break;
@@ -314,6 +323,14 @@ int main(int argc, char *argv[])
 	if (!bts->alloc_algorithm)
 		bts->alloc_algorithm = alloc_algorithm_dynamic;
 
+	if (record_file) {
+		rc = pcuif_capture_open(record_file);
+		if (rc < 0) {
+			fprintf(stderr, "Error opening capture file %s\n", record_file);
+			exit(1);
+		}
+	}
+
 	rc = pcu_l1if_open();
 
 	if (rc < 0)
@@ -347,17 +364,33 @@ int main(int argc, char *argv[])
 		}
 	}
 
+	/* after osmo_daemonize(), a fork() would lose the thread */
+	if (bts_gsmtap_export_update(bts) < 0) {
+		fprintf(stderr, "Error starting the GSMTAP helper thread\n");
+		exit(1);
+	}
+
+	/* after the helper thread was started, which is not pinned */
+	if (bts->realtime && bts_realtime_update(bts) < 0) {
+		fprintf(stderr, "Error entering the realtime mode\n");
+		exit(1);
+	}
+
 	while (!quit) {
 		osmo_gsm_timers_check();
 		osmo_gsm_timers_prepare();
 		osmo_gsm_timers_update();
 
-		osmo_select_main(0);
+		/* don't block in select() while Gb PDUs are still queued */
+		osmo_select_main(gprs_bssgp_pcu_queue_pending() ? 1 : 0);
+		gprs_bssgp_pcu_drain();
 	}
 
 	telnet_exit();
 
 	pcu_l1if_close();
+	pcuif_capture_close();
+	gsmtap_export_stop();
 
 	bts_cleanup();
 	talloc_report_full(tall_pcu_ctx, stderr);
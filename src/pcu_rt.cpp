@@ -0,0 +1,271 @@
+/* pcu_rt.cpp
+ *
+ * Realtime mode of the RLC/MAC loop
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <malloc.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include <pcu_rt.h>
+#include <gprs_debug.h>
+
+extern "C" {
+#include <osmocom/core/logging.h>
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/utils.h>
+}
+
+extern void *tall_pcu_ctx;
+
+static const struct value_string pcu_rt_path_names[] = {
+	{ PCU_RT_RTS,		"RTS" },
+	{ PCU_RT_DATA_IND,	"DATA.ind" },
+	{ 0, NULL }
+};
+
+static bool rt_active;
+static uint32_t rt_deadline_us;
+static bool rt_alloc_abort;
+static struct pcu_rt_stats rt_stats;
+/* affinity of the RLC/MAC thread before it was pinned */
+static cpu_set_t rt_saved_cpus;
+static bool rt_cpu_pinned;
+
+const char *pcu_rt_path_name(enum pcu_rt_path path)
+{
+	return get_value_string(pcu_rt_path_names, path);
+}
+
+static void prefault_stack(void)
+{
+	volatile uint8_t stack[PCU_RT_STACK_PREFAULT];
+	long page = sysconf(_SC_PAGESIZE);
+	size_t i;
+
+	for (i = 0; i < sizeof(stack); i += page)
+		stack[i] = 0;
+}
+
+/* Grow the heap by heap_mb and touch it. With trimming and mmap()ed
+ * chunks disabled the pages stay mapped after the free() and serve the
+ * TBFs, MS and msgbs allocated later. */
+static int prefault_heap(unsigned int heap_mb)
+{
+	size_t len = (size_t)heap_mb << 20;
+	long page = sysconf(_SC_PAGESIZE);
+	uint8_t *buf;
+	size_t i;
+
+	mallopt(M_TRIM_THRESHOLD, -1);
+	mallopt(M_MMAP_MAX, 0);
+
+	if (!len)
+		return 0;
+
+	buf = (uint8_t *)malloc(len);
+	if (!buf)
+		return -ENOMEM;
+
+	for (i = 0; i < len; i += page)
+		buf[i] = 0;
+	free(buf);
+
+	return 0;
+}
+
+/* Pin only this thread, helper threads keep running elsewhere. The
+ * affinity it had is restored by unpin_cpu(). */
+static int pin_cpu(int cpu)
+{
+	cpu_set_t set;
+
+	if (cpu < 0)
+		return 0;
+
+	if (sched_getaffinity(0, sizeof(rt_saved_cpus), &rt_saved_cpus) < 0)
+		return -errno;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if (sched_setaffinity(0, sizeof(set), &set) < 0)
+		return -errno;
+
+	rt_cpu_pinned = true;
+	return 0;
+}
+
+static void unpin_cpu(void)
+{
+	if (!rt_cpu_pinned)
+		return;
+
+	rt_cpu_pinned = false;
+	if (sched_setaffinity(0, sizeof(rt_saved_cpus), &rt_saved_cpus) < 0)
+		LOGP(DPCU, LOGL_ERROR, "Failed to restore the CPU affinity: %s\n",
+			strerror(errno));
+}
+
+int pcu_rt_start(int cpu, unsigned int heap_mb, uint32_t deadline_us,
+	bool alloc_abort)
+{
+	int rc;
+
+	if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+		rc = -errno;
+		LOGP(DPCU, LOGL_ERROR, "Failed to lock the memory: %s\n",
+			strerror(-rc));
+		return rc;
+	}
+
+	rc = prefault_heap(heap_mb);
+	if (rc < 0) {
+		LOGP(DPCU, LOGL_ERROR, "Failed to prefault %u MiB of heap\n",
+			heap_mb);
+		return rc;
+	}
+	prefault_stack();
+
+	rc = pin_cpu(cpu);
+	if (rc < 0) {
+		LOGP(DPCU, LOGL_ERROR, "Failed to pin the RLC/MAC loop to CPU %d: %s\n",
+			cpu, strerror(-rc));
+		return rc;
+	}
+
+	rt_deadline_us = deadline_us;
+	rt_alloc_abort = alloc_abort;
+	rt_active = true;
+
+	LOGP(DPCU, LOGL_NOTICE, "Realtime mode on CPU %d, %u MiB heap, "
+		"deadline %u us\n", cpu, heap_mb, deadline_us);
+
+	return 0;
+}
+
+void pcu_rt_stop(void)
+{
+	if (!rt_active)
+		return;
+
+	rt_active = false;
+	munlockall();
+	unpin_cpu();
+
+	LOGP(DPCU, LOGL_NOTICE, "Realtime mode stopped\n");
+}
+
+bool pcu_rt_active(void)
+{
+	return rt_active;
+}
+
+/* The msgb context is below tall_pcu_ctx, see main(). This walks the
+ * whole tree, so it is only done in realtime mode. */
+static size_t heap_size(void)
+{
+	return talloc_total_size(tall_pcu_ctx);
+}
+
+void pcu_rt_enter(struct pcu_rt_section *s)
+{
+	s->heap_size = rt_active ? heap_size() : 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &s->start);
+}
+
+/* insert into the slowest sections, which are sorted slowest first */
+static void add_offender(const struct pcu_rt_offender *o)
+{
+	struct pcu_rt_stats *st = &rt_stats;
+	unsigned int i;
+
+	if (st->num_worst == PCU_RT_WORST && o->us <= st->worst[PCU_RT_WORST - 1].us)
+		return;
+
+	if (st->num_worst < PCU_RT_WORST)
+		st->num_worst += 1;
+
+	for (i = st->num_worst - 1; i > 0 && st->worst[i - 1].us < o->us; i--)
+		st->worst[i] = st->worst[i - 1];
+	st->worst[i] = *o;
+}
+
+uint32_t pcu_rt_leave(const struct pcu_rt_section *s, enum pcu_rt_path path,
+	uint8_t trx, uint8_t ts, uint32_t fn, uint8_t block_nr)
+{
+	struct pcu_rt_stats *st = &rt_stats;
+	struct pcu_rt_offender o;
+	struct timespec end;
+	uint32_t us, alloc_bytes = 0;
+	size_t size;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	us = pcu_timespec_diff_us(&s->start, &end);
+
+	/* not timed when the mode was started within the section */
+	if (!rt_active || !s->heap_size)
+		return us;
+
+	size = heap_size();
+	if (size > s->heap_size)
+		alloc_bytes = size - s->heap_size;
+
+	pcu_hist_add(&st->hist[path], us);
+	if (us > rt_deadline_us)
+		st->overruns[path] += 1;
+	if (alloc_bytes) {
+		st->alloc_bytes[path] += alloc_bytes;
+		st->alloc_sections[path] += 1;
+		if (rt_alloc_abort) {
+			LOGP(DPCU, LOGL_FATAL, "%s TRX=%u TS=%u FN=%u grew the "
+				"talloc heap by %u bytes in realtime mode\n",
+				pcu_rt_path_name(path), trx, ts, fn, alloc_bytes);
+			talloc_report_full(tall_pcu_ctx, stderr);
+			abort();
+		}
+	}
+
+	if (st->num_worst < PCU_RT_WORST || us > st->worst[PCU_RT_WORST - 1].us) {
+		o.us = us;
+		o.alloc_bytes = alloc_bytes;
+		o.fn = fn;
+		o.when = time(NULL);
+		o.path = path;
+		o.trx = trx;
+		o.ts = ts;
+		o.block_nr = block_nr;
+		add_offender(&o);
+	}
+
+	return us;
+}
+
+const struct pcu_rt_stats *pcu_rt_get_stats(void)
+{
+	return &rt_stats;
+}
+
+void pcu_rt_reset_stats(void)
+{
+	memset(&rt_stats, 0, sizeof(rt_stats));
+}
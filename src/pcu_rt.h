@@ -0,0 +1,100 @@
+/* pcu_rt.h
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include <pcu_hist.h>
+
+/*
+ * Realtime mode of the RLC/MAC loop. When started, all memory is locked,
+ * the heap is prefaulted and kept mapped, so that TBFs and msgbs allocated
+ * later do not page fault, and the loop is pinned to one CPU. The RTS and
+ * DATA.ind handling is then timed as sections: every section goes into a
+ * histogram per path, sections longer than the deadline are counted and
+ * the slowest ones are kept with their FN/TRX/TS. The talloc heap of the
+ * PCU, msgbs included, is sampled before and after every section: when
+ * it grew, the bytes are counted, or abort the PCU. What is allocated and
+ * freed again within the same section is not seen.
+ */
+
+/* slowest sections kept */
+#define PCU_RT_WORST		8
+/* stack touched at start */
+#define PCU_RT_STACK_PREFAULT	(256 * 1024)
+
+enum pcu_rt_path {
+	PCU_RT_RTS,
+	PCU_RT_DATA_IND,
+	_PCU_RT_NUM_PATH
+};
+
+struct pcu_rt_section {
+	struct timespec start;
+	size_t heap_size;
+};
+
+struct pcu_rt_offender {
+	uint32_t us;
+	uint32_t alloc_bytes;	/* talloc heap growth */
+	uint32_t fn;
+	time_t when;
+	uint8_t path; /* enum pcu_rt_path */
+	uint8_t trx;
+	uint8_t ts;
+	uint8_t block_nr;
+};
+
+struct pcu_rt_stats {
+	/* processing time (us) */
+	struct pcu_hist hist[_PCU_RT_NUM_PATH];
+	uint64_t overruns[_PCU_RT_NUM_PATH];
+	/* talloc heap growth (bytes) */
+	uint64_t alloc_bytes[_PCU_RT_NUM_PATH];
+	/* sections the talloc heap grew in */
+	uint64_t alloc_sections[_PCU_RT_NUM_PATH];
+	/* slowest first */
+	struct pcu_rt_offender worst[PCU_RT_WORST];
+	unsigned int num_worst;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+const char *pcu_rt_path_name(enum pcu_rt_path path);
+
+/* cpu -1 leaves the affinity alone, heap_mb of the heap are prefaulted */
+int pcu_rt_start(int cpu, unsigned int heap_mb, uint32_t deadline_us,
+	bool alloc_abort);
+void pcu_rt_stop(void);
+bool pcu_rt_active(void);
+
+void pcu_rt_enter(struct pcu_rt_section *s);
+/* Returns the time since pcu_rt_enter() in us, also when not active */
+uint32_t pcu_rt_leave(const struct pcu_rt_section *s, enum pcu_rt_path path,
+	uint8_t trx, uint8_t ts, uint32_t fn, uint8_t block_nr);
+
+const struct pcu_rt_stats *pcu_rt_get_stats(void);
+void pcu_rt_reset_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -4,6 +4,8 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <osmocom/core/talloc.h>
 #include <osmocom/core/tdef.h>
 #include <osmocom/core/utils.h>
 #include <osmocom/vty/tdef_vty.h>
@@ -19,6 +21,7 @@
 #include "bts.h"
 #include "tbf.h"
 #include "pcu_vty_functions.h"
+#include "pcu_rt.h"
 
 extern void *tall_pcu_ctx;
 
@@ -64,6 +67,13 @@ static const struct value_string pcu_gsmtap_categ_help[] = {
 	{ 0, NULL }
 };
 
+static const struct value_string rach_bucket_names[] = {
+	{ RACH_BUCKET_CELL,		"cell" },
+	{ RACH_BUCKET_SIGNALLING,	"signalling" },
+	{ RACH_BUCKET_ONE_PHASE,	"one-phase" },
+	{ 0, NULL }
+};
+
 
 DEFUN(cfg_pcu_gsmtap_categ, cfg_pcu_gsmtap_categ_cmd, "HIDDEN", "HIDDEN")
 {
@@ -93,6 +103,181 @@ DEFUN(cfg_pcu_no_gsmtap_categ, cfg_pcu_no_gsmtap_categ_cmd, "HIDDEN", "HIDDEN")
 	return CMD_SUCCESS;
 }
 
+DEFUN(cfg_pcu_gsmtap_sample, cfg_pcu_gsmtap_sample_cmd, "HIDDEN", "HIDDEN")
+{
+	struct gprs_rlcmac_bts *bts = bts_main_data();
+	int categ;
+
+	categ = get_string_value(pcu_gsmtap_categ_names, argv[0]);
+	if (categ < 0)
+		return CMD_WARNING;
+
+	bts->gsmtap_sample[categ] = atoi(argv[1]);
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_pcu_no_gsmtap_sample, cfg_pcu_no_gsmtap_sample_cmd, "HIDDEN", "HIDDEN")
+{
+	struct gprs_rlcmac_bts *bts = bts_main_data();
+	int categ;
+
+	categ = get_string_value(pcu_gsmtap_categ_names, argv[0]);
+	if (categ < 0)
+		return CMD_WARNING;
+
+	bts->gsmtap_sample[categ] = 0;
+
+	return CMD_SUCCESS;
+}
+
+static int gsmtap_export_update(struct vty *vty, struct gprs_rlcmac_bts *bts)
+{
+	/* at startup pcu_main does this once the config has been read */
+	if (vty->type == VTY_FILE)
+		return CMD_SUCCESS;
+
+	if (bts_gsmtap_export_update(bts) < 0) {
+		vty_out(vty, "%% Failed to start the GSMTAP helper thread%s", VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+
+	return CMD_SUCCESS;
+}
+
+#define GSMTAP_ASYNC_STR "Send GSMTAP from a helper thread instead of the RLC/MAC loop\n"
+
+DEFUN(cfg_pcu_gsmtap_async,
+      cfg_pcu_gsmtap_async_cmd,
+      "gsmtap-async",
+      GSMTAP_ASYNC_STR)
+{
+	struct gprs_rlcmac_bts *bts = bts_main_data();
+
+	bts->gsmtap_async = true;
+
+	return gsmtap_export_update(vty, bts);
+}
+
+DEFUN(cfg_pcu_no_gsmtap_async,
+      cfg_pcu_no_gsmtap_async_cmd,
+      "no gsmtap-async",
+      NO_STR GSMTAP_ASYNC_STR)
+{
+	struct gprs_rlcmac_bts *bts = bts_main_data();
+
+	bts->gsmtap_async = false;
+
+	return gsmtap_export_update(vty, bts);
+}
+
+#define GSMTAP_PCAP_STR "Also write GSMTAP into a pcap file, from the helper thread\n"
+
+DEFUN(cfg_pcu_gsmtap_pcap,
+      cfg_pcu_gsmtap_pcap_cmd,
+      "gsmtap-pcap FILE",
+      GSMTAP_PCAP_STR "Path of the file, it is overwritten\n")
+{
+	struct gprs_rlcmac_bts *bts = bts_main_data();
+
+	osmo_talloc_replace_string(tall_pcu_ctx, &bts->gsmtap_pcap_path, argv[0]);
+
+	return gsmtap_export_update(vty, bts);
+}
+
+DEFUN(cfg_pcu_no_gsmtap_pcap,
+      cfg_pcu_no_gsmtap_pcap_cmd,
+      "no gsmtap-pcap",
+      NO_STR GSMTAP_PCAP_STR)
+{
+	struct gprs_rlcmac_bts *bts = bts_main_data();
+
+	talloc_free(bts->gsmtap_pcap_path);
+	bts->gsmtap_pcap_path = NULL;
+
+	return gsmtap_export_update(vty, bts);
+}
+
+#define GSMTAP_FILTER_STR "Only send GSMTAP frames that match all filters\n"
+
+DEFUN(cfg_pcu_gsmtap_filter_trx,
+      cfg_pcu_gsmtap_filter_trx_cmd,
+      "gsmtap-filter trx <0-7>",
+      GSMTAP_FILTER_STR "Frames on this TRX\n" "TRX number\n")
+{
+	struct gprs_rlcmac_bts *bts = bts_main_data();
+
+	bts->gsmtap_filter_trx = atoi(argv[0]);
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_pcu_gsmtap_filter_ts,
+      cfg_pcu_gsmtap_filter_ts_cmd,
+      "gsmtap-filter ts <0-7>",
+      GSMTAP_FILTER_STR "Frames on this timeslot\n" "Timeslot number\n")
+{
+	struct gprs_rlcmac_bts *bts = bts_main_data();
+
+	bts->gsmtap_filter_ts = atoi(argv[0]);
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_pcu_gsmtap_filter_tlli,
+      cfg_pcu_gsmtap_filter_tlli_cmd,
+      "gsmtap-filter tlli TLLI",
+      GSMTAP_FILTER_STR "Frames on the PDCHs the MS with this TLLI uses\n"
+      "TLLI as hex\n")
+{
+	struct gprs_rlcmac_bts *bts = bts_main_data();
+	char *endp = NULL;
+	unsigned long long tlli = strtoll(argv[0], &endp, 16);
+	if ((endp != NULL && *endp != 0) || tlli == 0 || tlli > 0xffffffffULL) {
+		vty_out(vty, "Invalid TLLI.%s", VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+
+	bts->gsmtap_filter_tlli = tlli;
+	bts->gsmtap_filter_imsi[0] = '\0';
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_pcu_gsmtap_filter_imsi,
+      cfg_pcu_gsmtap_filter_imsi_cmd,
+      "gsmtap-filter imsi IMSI",
+      GSMTAP_FILTER_STR "Frames on the PDCHs the MS with this IMSI uses\n"
+      "IMSI\n")
+{
+	struct gprs_rlcmac_bts *bts = bts_main_data();
+
+	if (strlen(argv[0]) >= sizeof(bts->gsmtap_filter_imsi)) {
+		vty_out(vty, "Invalid IMSI.%s", VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+
+	osmo_strlcpy(bts->gsmtap_filter_imsi, argv[0], sizeof(bts->gsmtap_filter_imsi));
+	bts->gsmtap_filter_tlli = 0;
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_pcu_no_gsmtap_filter,
+      cfg_pcu_no_gsmtap_filter_cmd,
+      "no gsmtap-filter",
+      NO_STR GSMTAP_FILTER_STR)
+{
+	struct gprs_rlcmac_bts *bts = bts_main_data();
+
+	bts->gsmtap_filter_trx = -1;
+	bts->gsmtap_filter_ts = -1;
+	bts->gsmtap_filter_tlli = 0;
+	bts->gsmtap_filter_imsi[0] = '\0';
+
+	return CMD_SUCCESS;
+}
+
 static struct cmd_node pcu_node = {
 	(enum node_type) PCU_NODE,
 	"%s(config-pcu)# ",
@@ -212,6 +397,9 @@ static int config_write_pcu(struct vty *vty)
 	if (bts->llc_discard_csec)
 		vty_out(vty, " queue hysteresis %d%s", bts->llc_discard_csec,
 			VTY_NEWLINE);
+	if (bts->llc_queue_budget)
+		vty_out(vty, " queue memory-budget %u%s",
+			bts->llc_queue_budget / 1024, VTY_NEWLINE);
 	if (bts->llc_idle_ack_csec)
 		vty_out(vty, " queue idle-ack-delay %d%s", bts->llc_idle_ack_csec,
 			VTY_NEWLINE);
@@ -235,8 +423,23 @@ static int config_write_pcu(struct vty *vty)
 	vty_out(vty, " gamma %d%s", bts->gamma * 2, VTY_NEWLINE);
 	if (!bts->dl_tbf_preemptive_retransmission)
 		vty_out(vty, " no dl-tbf-preemptive-retransmission%s", VTY_NEWLINE);
+	if (bts->adaptive_ack_nack)
+		vty_out(vty, " adaptive-ack-nack%s", VTY_NEWLINE);
+	if (bts->fixed_rrbp)
+		vty_out(vty, " fixed-rrbp%s", VTY_NEWLINE);
+	if (bts->rebalance_interval)
+		vty_out(vty, " rebalance interval %u min-gain %u%s",
+			bts->rebalance_interval, bts->rebalance_min_gain, VTY_NEWLINE);
+	if (bts->dyn_pdch_max)
+		vty_out(vty, " dynamic-pdch min %u max %u%s",
+			bts->dyn_pdch_min, bts->dyn_pdch_max, VTY_NEWLINE);
+	if (bts->dyn_pdch_load_high != 80 || bts->dyn_pdch_load_low != 30)
+		vty_out(vty, " dynamic-pdch load high %u low %u%s",
+			bts->dyn_pdch_load_high, bts->dyn_pdch_load_low, VTY_NEWLINE);
 	if (strcmp(bts->pcu_sock_path, PCU_SOCK_DEFAULT))
 		vty_out(vty, " pcu-socket %s%s", bts->pcu_sock_path, VTY_NEWLINE);
+	if (bts->pcu_sock_shm)
+		vty_out(vty, " pcu-socket-shm%s", VTY_NEWLINE);
 
 	for (i = 0; i < 32; i++) {
 		unsigned int cs = (1 << i);
@@ -245,11 +448,57 @@ static int config_write_pcu(struct vty *vty)
 				get_value_string(pcu_gsmtap_categ_names, i), VTY_NEWLINE);
 		}
 	}
+	for (i = 0; i < 32; i++) {
+		if (bts->gsmtap_sample[i] > 1)
+			vty_out(vty, " gsmtap-sample %s %u%s",
+				get_value_string(pcu_gsmtap_categ_names, i),
+				bts->gsmtap_sample[i], VTY_NEWLINE);
+	}
+	if (bts->gsmtap_async)
+		vty_out(vty, " gsmtap-async%s", VTY_NEWLINE);
+	if (bts->gsmtap_pcap_path)
+		vty_out(vty, " gsmtap-pcap %s%s", bts->gsmtap_pcap_path, VTY_NEWLINE);
+	if (bts->gsmtap_filter_trx >= 0)
+		vty_out(vty, " gsmtap-filter trx %d%s", bts->gsmtap_filter_trx, VTY_NEWLINE);
+	if (bts->gsmtap_filter_ts >= 0)
+		vty_out(vty, " gsmtap-filter ts %d%s", bts->gsmtap_filter_ts, VTY_NEWLINE);
+	if (bts->gsmtap_filter_tlli)
+		vty_out(vty, " gsmtap-filter tlli %08x%s", bts->gsmtap_filter_tlli, VTY_NEWLINE);
+	if (bts->gsmtap_filter_imsi[0])
+		vty_out(vty, " gsmtap-filter imsi %s%s", bts->gsmtap_filter_imsi, VTY_NEWLINE);
 
 	if (bts->gb_dialect_sns)
 		vty_out(vty, " gb-dialect ip-sns%s", VTY_NEWLINE);
 	else
 		vty_out(vty, " gb-dialect classic%s", VTY_NEWLINE);
+	if (bts->gb_queue_budget)
+		vty_out(vty, " gb-queue budget %u%s", bts->gb_queue_budget, VTY_NEWLINE);
+	if (!bts->paging_queue_depth)
+		vty_out(vty, " no paging queue-depth%s", VTY_NEWLINE);
+	else if (bts->paging_queue_depth != 32)
+		vty_out(vty, " paging queue-depth %u%s", bts->paging_queue_depth, VTY_NEWLINE);
+	if (bts->rach_queue_budget)
+		vty_out(vty, " rach-queue budget %u%s", bts->rach_queue_budget, VTY_NEWLINE);
+	for (i = 0; i < _RACH_BUCKET_NUM; i++) {
+		if (!bts->rach_buckets[i].rate)
+			continue;
+		vty_out(vty, " rach-admission %s rate %u burst %u%s",
+			get_value_string(rach_bucket_names, i),
+			bts->rach_buckets[i].rate, bts->rach_buckets[i].depth,
+			VTY_NEWLINE);
+	}
+	if (bts->rach_wait_ind != 20)
+		vty_out(vty, " rach-wait-indication %u%s", bts->rach_wait_ind, VTY_NEWLINE);
+	if (bts->realtime)
+		vty_out(vty, " realtime%s", VTY_NEWLINE);
+	if (bts->rt_cpu >= 0)
+		vty_out(vty, " realtime cpu %d%s", bts->rt_cpu, VTY_NEWLINE);
+	if (bts->rt_heap_mb != 16)
+		vty_out(vty, " realtime prefault-heap %u%s", bts->rt_heap_mb, VTY_NEWLINE);
+	if (bts->rt_deadline_us != 1000)
+		vty_out(vty, " realtime deadline %u%s", bts->rt_deadline_us, VTY_NEWLINE);
+	if (bts->rt_alloc_abort)
+		vty_out(vty, " realtime heap-alloc abort%s", VTY_NEWLINE);
 
 	osmo_tdef_vty_write(vty, bts->T_defs_pcu, " timer ");
 
@@ -741,6 +990,33 @@ DEFUN(cfg_pcu_no_queue_idle_ack_delay,
 	return CMD_SUCCESS;
 }
 
+#define QUEUE_BUDGET_STR "Limit the LLC frames queued for all MS, the longest " \
+	"queues lose their oldest frames first\n"
+
+DEFUN(cfg_pcu_queue_memory_budget,
+      cfg_pcu_queue_memory_budget_cmd,
+      "queue memory-budget <1-1048576>",
+      QUEUE_STR QUEUE_BUDGET_STR "Budget in KiB")
+{
+	struct gprs_rlcmac_bts *bts = bts_main_data();
+
+	bts->llc_queue_budget = atoi(argv[0]) * 1024;
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_pcu_no_queue_memory_budget,
+      cfg_pcu_no_queue_memory_budget_cmd,
+      "no queue memory-budget",
+      NO_STR QUEUE_STR QUEUE_BUDGET_STR)
+{
+	struct gprs_rlcmac_bts *bts = bts_main_data();
+
+	bts->llc_queue_budget = 0;
+
+	return CMD_SUCCESS;
+}
+
 
 DEFUN(cfg_pcu_alloc,
       cfg_pcu_alloc_cmd,
@@ -840,6 +1116,7 @@ DEFUN_DEPRECATED(cfg_pcu_dl_tbf_idle_time,
 
 	if (osmo_tdef_set(bts->T_defs_pcu, -2031, atoi(argv[0]), OSMO_TDEF_MS) < 0)
 		return CMD_WARNING;
+	bts_update_params(bts);
 	return CMD_SUCCESS;
 }
 
@@ -854,6 +1131,7 @@ DEFUN_DEPRECATED(cfg_pcu_no_dl_tbf_idle_time,
 
 	if (osmo_tdef_set(bts->T_defs_pcu, -2031, 0, OSMO_TDEF_MS) < 0)
 		return CMD_WARNING;
+	bts_update_params(bts);
 	return CMD_SUCCESS;
 }
 
@@ -883,6 +1161,152 @@ DEFUN(cfg_pcu_no_dl_tbf_preemptive_retransmission,
 	return CMD_SUCCESS;
 }
 
+#define ADAPTIVE_ACK_NACK_STR "request and send Ack/Nack depending on the RLC window fill and " \
+			      "the measured round trip"
+DEFUN(cfg_pcu_adaptive_ack_nack,
+      cfg_pcu_adaptive_ack_nack_cmd,
+      "adaptive-ack-nack",
+      ADAPTIVE_ACK_NACK_STR " (disabled by default)")
+{
+	struct gprs_rlcmac_bts *bts = bts_main_data();
+
+	bts->adaptive_ack_nack = true;
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_pcu_no_adaptive_ack_nack,
+      cfg_pcu_no_adaptive_ack_nack_cmd,
+      "no adaptive-ack-nack",
+      NO_STR ADAPTIVE_ACK_NACK_STR)
+{
+	struct gprs_rlcmac_bts *bts = bts_main_data();
+
+	bts->adaptive_ack_nack = false;
+
+	return CMD_SUCCESS;
+}
+
+#define FIXED_RRBP_STR "always poll for the uplink block 3 blocks ahead (RRBP 0) instead of " \
+		       "the earliest one that is not reserved yet"
+DEFUN(cfg_pcu_fixed_rrbp,
+      cfg_pcu_fixed_rrbp_cmd,
+      "fixed-rrbp",
+      FIXED_RRBP_STR " (disabled by default)")
+{
+	struct gprs_rlcmac_bts *bts = bts_main_data();
+
+	bts->fixed_rrbp = true;
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_pcu_no_fixed_rrbp,
+      cfg_pcu_no_fixed_rrbp_cmd,
+      "no fixed-rrbp",
+      NO_STR FIXED_RRBP_STR)
+{
+	struct gprs_rlcmac_bts *bts = bts_main_data();
+
+	bts->fixed_rrbp = false;
+
+	return CMD_SUCCESS;
+}
+
+#define REBALANCE_STR "Move busy downlink TBFs to PDCHs that became less loaded\n"
+DEFUN(cfg_pcu_rebalance,
+      cfg_pcu_rebalance_cmd,
+      "rebalance interval <1-3600> [min-gain] [<10-1000>]",
+      REBALANCE_STR
+      "Look for a TBF to move on each TRX at this interval\n"
+      "Interval in seconds\n"
+      "Only move a TBF if its share of the PDCHs grows by at least\n"
+      "Percent (default 50)\n")
+{
+	struct gprs_rlcmac_bts *bts = bts_main_data();
+
+	bts->rebalance_interval = atoi(argv[0]);
+	if (argc > 2)
+		bts->rebalance_min_gain = atoi(argv[2]);
+	else
+		bts->rebalance_min_gain = 50;
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_pcu_no_rebalance,
+      cfg_pcu_no_rebalance_cmd,
+      "no rebalance",
+      NO_STR REBALANCE_STR)
+{
+	struct gprs_rlcmac_bts *bts = bts_main_data();
+
+	bts->rebalance_interval = 0;
+
+	return CMD_SUCCESS;
+}
+
+#define DYN_PDCH_STR "Ask the BTS for dynamic TS as PDCH depending on the load\n"
+DEFUN(cfg_pcu_dyn_pdch,
+      cfg_pcu_dyn_pdch_cmd,
+      "dynamic-pdch min <0-64> max <1-64>",
+      DYN_PDCH_STR
+      "Dynamic TS always kept as PDCH\n"
+      "Number of dynamic TS\n"
+      "Dynamic TS used as PDCH at most\n"
+      "Number of dynamic TS\n")
+{
+	struct gprs_rlcmac_bts *bts = bts_main_data();
+	int min = atoi(argv[0]), max = atoi(argv[1]);
+
+	if (min > max) {
+		vty_out(vty, "%% min must not be larger than max%s", VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+
+	bts->dyn_pdch_min = min;
+	bts->dyn_pdch_max = max;
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_pcu_dyn_pdch_load,
+      cfg_pcu_dyn_pdch_load_cmd,
+      "dynamic-pdch load high <1-100> low <0-99>",
+      DYN_PDCH_STR
+      "Busy share of the PDCH blocks\n"
+      "Ask for another PDCH at this load\n"
+      "Percent (default 80)\n"
+      "Give a PDCH back when the load stays below\n"
+      "Percent (default 30)\n")
+{
+	struct gprs_rlcmac_bts *bts = bts_main_data();
+	int high = atoi(argv[0]), low = atoi(argv[1]);
+
+	if (low >= high) {
+		vty_out(vty, "%% low must be below high%s", VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+
+	bts->dyn_pdch_load_high = high;
+	bts->dyn_pdch_load_low = low;
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_pcu_no_dyn_pdch,
+      cfg_pcu_no_dyn_pdch_cmd,
+      "no dynamic-pdch",
+      NO_STR DYN_PDCH_STR)
+{
+	struct gprs_rlcmac_bts *bts = bts_main_data();
+
+	bts->dyn_pdch_min = 0;
+	bts->dyn_pdch_max = 0;
+
+	return CMD_SUCCESS;
+}
+
 #define MS_IDLE_TIME_STR "keep an idle MS object alive for the time given\n"
 DEFUN_DEPRECATED(cfg_pcu_ms_idle_time,
       cfg_pcu_ms_idle_time_cmd,
@@ -895,6 +1319,7 @@ DEFUN_DEPRECATED(cfg_pcu_ms_idle_time,
 
 	if (osmo_tdef_set(bts->T_defs_pcu, -2030, atoi(argv[0]), OSMO_TDEF_S) < 0)
 		return CMD_WARNING;
+	bts_update_params(bts);
 	return CMD_SUCCESS;
 }
 
@@ -909,6 +1334,7 @@ DEFUN_DEPRECATED(cfg_pcu_no_ms_idle_time,
 
 	if (osmo_tdef_set(bts->T_defs_pcu, -2030, 0, OSMO_TDEF_S) < 0)
 		return CMD_WARNING;
+	bts_update_params(bts);
 	return CMD_SUCCESS;
 }
 
@@ -1079,6 +1505,44 @@ DEFUN(cfg_pcu_sock,
 	return CMD_SUCCESS;
 }
 
+#define PCU_SOCK_SHM_STR "offer shared memory rings to the BTS on the PCU socket, " \
+			 "the socket is used if the BTS does not support them"
+DEFUN(cfg_pcu_sock_shm,
+      cfg_pcu_sock_shm_cmd,
+      "pcu-socket-shm",
+      PCU_SOCK_SHM_STR " (disabled by default)")
+{
+	struct gprs_rlcmac_bts *bts = bts_main_data();
+
+#ifndef HAVE_MEMFD_CREATE
+	vty_out(vty, "%% Built without memfd_create(), the PCU socket shared memory is not available%s",
+		VTY_NEWLINE);
+	return CMD_WARNING;
+#endif
+
+	if (vty->type != VTY_FILE)
+		vty_out(vty, "Changing the PCU socket transport at run-time has no effect%s", VTY_NEWLINE);
+
+	bts->pcu_sock_shm = true;
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_pcu_no_sock_shm,
+      cfg_pcu_no_sock_shm_cmd,
+      "no pcu-socket-shm",
+      NO_STR PCU_SOCK_SHM_STR)
+{
+	struct gprs_rlcmac_bts *bts = bts_main_data();
+
+	if (vty->type != VTY_FILE)
+		vty_out(vty, "Changing the PCU socket transport at run-time has no effect%s", VTY_NEWLINE);
+
+	bts->pcu_sock_shm = false;
+
+	return CMD_SUCCESS;
+}
+
 DEFUN(cfg_pcu_gb_dialect,
       cfg_pcu_gb_dialect_cmd,
       "gb-dialect (classic|ip-sns)",
@@ -1096,6 +1560,403 @@ DEFUN(cfg_pcu_gb_dialect,
 	return CMD_SUCCESS;
 }
 
+#define GB_QUEUE_STR "Decouple Gb UNITDATA handling from the RLC/MAC scheduler\n"
+DEFUN(cfg_pcu_gb_queue,
+      cfg_pcu_gb_queue_cmd,
+      "gb-queue budget <1-64>",
+      GB_QUEUE_STR
+      "Queue UNITDATA in both directions and handle it between RTS processing\n"
+      "Maximum number of PDUs handled per direction and main loop iteration\n")
+{
+	struct gprs_rlcmac_bts *bts = bts_main_data();
+
+	bts->gb_queue_budget = atoi(argv[0]);
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_pcu_no_gb_queue,
+      cfg_pcu_no_gb_queue_cmd,
+      "no gb-queue",
+      NO_STR GB_QUEUE_STR)
+{
+	struct gprs_rlcmac_bts *bts = bts_main_data();
+
+	bts->gb_queue_budget = 0;
+
+	return CMD_SUCCESS;
+}
+
+#define PAGING_QUEUE_DEPTH_STR "Paging on PACCH\n" \
+	"Maximum number of pending paging records per PDCH, more are dropped\n"
+DEFUN(cfg_pcu_paging_queue_depth,
+      cfg_pcu_paging_queue_depth_cmd,
+      "paging queue-depth <1-255>",
+      PAGING_QUEUE_DEPTH_STR
+      "Number of records (default 32)\n")
+{
+	struct gprs_rlcmac_bts *bts = bts_main_data();
+
+	bts->paging_queue_depth = atoi(argv[0]);
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_pcu_no_paging_queue_depth,
+      cfg_pcu_no_paging_queue_depth_cmd,
+      "no paging queue-depth",
+      NO_STR PAGING_QUEUE_DEPTH_STR)
+{
+	struct gprs_rlcmac_bts *bts = bts_main_data();
+
+	bts->paging_queue_depth = 0;
+
+	return CMD_SUCCESS;
+}
+
+#define RACH_QUEUE_STR "Decouple RACH handling from the reception of RACH.ind\n"
+DEFUN(cfg_pcu_rach_queue,
+      cfg_pcu_rach_queue_cmd,
+      "rach-queue budget <1-64>",
+      RACH_QUEUE_STR
+      "Queue RACH.ind, drop duplicates and handle them once per TDMA frame\n"
+      "Maximum number of requests handled per TDMA frame\n")
+{
+	struct gprs_rlcmac_bts *bts = bts_main_data();
+
+	bts->rach_queue_budget = atoi(argv[0]);
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_pcu_no_rach_queue,
+      cfg_pcu_no_rach_queue_cmd,
+      "no rach-queue",
+      NO_STR RACH_QUEUE_STR)
+{
+	struct gprs_rlcmac_bts *bts = bts_main_data();
+
+	bts->rach_queue_budget = 0;
+
+	return CMD_SUCCESS;
+}
+
+#define RACH_ADMISSION_STR "Limit the rate of channel requests that get resources\n" \
+			   "All requests of the cell\n" \
+			   "Single block and two phase access, signalling\n" \
+			   "One phase access\n"
+DEFUN(cfg_pcu_rach_admission,
+      cfg_pcu_rach_admission_cmd,
+      "rach-admission (cell|signalling|one-phase) rate <1-1000> burst <1-1000>",
+      RACH_ADMISSION_STR
+      "Requests admitted per second, more are rejected\n"
+      "Requests per second\n"
+      "Requests admitted in a burst\n"
+      "Number of requests\n")
+{
+	struct gprs_rlcmac_bts *bts = bts_main_data();
+	int i = get_string_value(rach_bucket_names, argv[0]);
+
+	bts->rach_buckets[i].rate = atoi(argv[1]);
+	bts->rach_buckets[i].depth = atoi(argv[2]);
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_pcu_no_rach_admission,
+      cfg_pcu_no_rach_admission_cmd,
+      "no rach-admission (cell|signalling|one-phase)",
+      NO_STR RACH_ADMISSION_STR)
+{
+	struct gprs_rlcmac_bts *bts = bts_main_data();
+	int i = get_string_value(rach_bucket_names, argv[0]);
+
+	bts->rach_buckets[i].rate = 0;
+	bts->rach_buckets[i].depth = 0;
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_pcu_rach_wait_ind,
+      cfg_pcu_rach_wait_ind_cmd,
+      "rach-wait-indication <0-255>",
+      "Wait Indication (T3142) sent in Immediate Assignment Reject\n"
+      "Seconds the MS waits before it requests again (default 20)\n")
+{
+	struct gprs_rlcmac_bts *bts = bts_main_data();
+
+	bts->rach_wait_ind = atoi(argv[0]);
+
+	return CMD_SUCCESS;
+}
+
+static int realtime_update(struct vty *vty, struct gprs_rlcmac_bts *bts)
+{
+	/* at startup pcu_main does this once the config has been read */
+	if (vty->type == VTY_FILE)
+		return CMD_SUCCESS;
+
+	if (bts_realtime_update(bts) < 0) {
+		vty_out(vty, "%% Failed to enter the realtime mode, see the log%s",
+			VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+
+	return CMD_SUCCESS;
+}
+
+#define REALTIME_STR "Lock and prefault the memory, pin the RLC/MAC loop and time the RTS/DATA.ind handling\n"
+
+DEFUN(cfg_pcu_realtime,
+      cfg_pcu_realtime_cmd,
+      "realtime",
+      REALTIME_STR)
+{
+	struct gprs_rlcmac_bts *bts = bts_main_data();
+
+	bts->realtime = true;
+
+	return realtime_update(vty, bts);
+}
+
+DEFUN(cfg_pcu_no_realtime,
+      cfg_pcu_no_realtime_cmd,
+      "no realtime",
+      NO_STR REALTIME_STR)
+{
+	struct gprs_rlcmac_bts *bts = bts_main_data();
+
+	bts->realtime = false;
+
+	return realtime_update(vty, bts);
+}
+
+DEFUN(cfg_pcu_realtime_cpu,
+      cfg_pcu_realtime_cpu_cmd,
+      "realtime cpu <0-1023>",
+      REALTIME_STR "Pin the RLC/MAC loop to a CPU\n" "Number of the CPU\n")
+{
+	struct gprs_rlcmac_bts *bts = bts_main_data();
+
+	bts->rt_cpu = atoi(argv[0]);
+
+	return bts->realtime ? realtime_update(vty, bts) : CMD_SUCCESS;
+}
+
+DEFUN(cfg_pcu_no_realtime_cpu,
+      cfg_pcu_no_realtime_cpu_cmd,
+      "no realtime cpu",
+      NO_STR REALTIME_STR "Let the RLC/MAC loop run on any CPU\n")
+{
+	struct gprs_rlcmac_bts *bts = bts_main_data();
+
+	bts->rt_cpu = -1;
+
+	return bts->realtime ? realtime_update(vty, bts) : CMD_SUCCESS;
+}
+
+DEFUN(cfg_pcu_realtime_heap,
+      cfg_pcu_realtime_heap_cmd,
+      "realtime prefault-heap <0-1024>",
+      REALTIME_STR "Heap to prefault and keep mapped\n" "MiB (default 16)\n")
+{
+	struct gprs_rlcmac_bts *bts = bts_main_data();
+
+	bts->rt_heap_mb = atoi(argv[0]);
+
+	return bts->realtime ? realtime_update(vty, bts) : CMD_SUCCESS;
+}
+
+DEFUN(cfg_pcu_realtime_deadline,
+      cfg_pcu_realtime_deadline_cmd,
+      "realtime deadline <1-100000>",
+      REALTIME_STR "RTS and DATA.ind taking longer are counted as overrun\n"
+      "Microseconds (default 1000)\n")
+{
+	struct gprs_rlcmac_bts *bts = bts_main_data();
+
+	bts->rt_deadline_us = atoi(argv[0]);
+
+	return bts->realtime ? realtime_update(vty, bts) : CMD_SUCCESS;
+}
+
+DEFUN(cfg_pcu_realtime_heap_alloc,
+      cfg_pcu_realtime_heap_alloc_cmd,
+      "realtime heap-alloc (count|abort)",
+      REALTIME_STR "Growth of the talloc heap on the RTS/DATA.ind paths\n"
+      "Count it (default)\n" "Abort the PCU, to get a core dump and a talloc report\n")
+{
+	struct gprs_rlcmac_bts *bts = bts_main_data();
+
+	bts->rt_alloc_abort = !strcmp(argv[0], "abort");
+
+	return bts->realtime ? realtime_update(vty, bts) : CMD_SUCCESS;
+}
+
+static void vty_out_pcu_hist(struct vty *vty, const char *name, const char *unit,
+			     const struct pcu_hist *h)
+{
+	char buf[128];
+	unsigned int i;
+
+	vty_out(vty, "%s: %s%s", name, pcu_hist_summary(buf, sizeof(buf), h, unit),
+		VTY_NEWLINE);
+
+	for (i = 0; i < PCU_HIST_BUCKETS; i++) {
+		if (!h->buckets[i])
+			continue;
+		vty_out(vty, "  %9s: %llu%s", pcu_hist_bucket_str(buf, sizeof(buf), i, unit),
+			(unsigned long long)h->buckets[i], VTY_NEWLINE);
+	}
+}
+
+/* the latency histograms of the BTS */
+static void vty_out_bts_hists(struct vty *vty, const struct gprs_rlcmac_bts *bts)
+{
+	vty_out_pcu_hist(vty, "RTS to DATA.req", "us", &bts->rts_latency);
+	vty_out_pcu_hist(vty, "LLC queue delay", "ms", &bts->llc_queue_delay);
+	vty_out_pcu_hist(vty, "DL Ack/Nack RTT", "ms", &bts->dl_ack_rtt);
+}
+
+DEFUN(show_bts_histograms,
+      show_bts_histograms_cmd,
+      "show bts histograms",
+      SHOW_STR "BTS related functionality\nLatency histograms\n")
+{
+	struct gprs_rlcmac_bts *bts = bts_main_data();
+
+	vty_out_bts_hists(vty, bts);
+	vty_out(vty, "Gb queue: budget %u, %u DL / %u UL PDUs pending%s",
+		bts->gb_queue_budget, pcu_vty_gb_queue_depth(1),
+		pcu_vty_gb_queue_depth(0), VTY_NEWLINE);
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(show_bts_realtime,
+      show_bts_realtime_cmd,
+      "show bts realtime",
+      SHOW_STR "BTS related functionality\nRTS/DATA.ind processing times of the realtime mode\n")
+{
+	struct gprs_rlcmac_bts *bts = bts_main_data();
+	const struct pcu_rt_stats *st = pcu_rt_get_stats();
+	unsigned int i;
+
+	vty_out(vty, "Realtime mode %s, CPU %d, deadline %uus, talloc heap growth %s%s",
+		pcu_rt_active() ? "active" : "inactive", bts->rt_cpu,
+		bts->rt_deadline_us, bts->rt_alloc_abort ? "abort" : "counted",
+		VTY_NEWLINE);
+
+	for (i = 0; i < _PCU_RT_NUM_PATH; i++) {
+		vty_out_pcu_hist(vty, pcu_rt_path_name(i), "us", &st->hist[i]);
+		vty_out(vty, "  over deadline: %llu, talloc heap growth: %llu bytes in %llu%s",
+			(unsigned long long)st->overruns[i],
+			(unsigned long long)st->alloc_bytes[i],
+			(unsigned long long)st->alloc_sections[i], VTY_NEWLINE);
+	}
+
+	if (st->num_worst)
+		vty_out(vty, "Slowest:%s", VTY_NEWLINE);
+	for (i = 0; i < st->num_worst; i++) {
+		const struct pcu_rt_offender *o = &st->worst[i];
+		char when[32];
+		struct tm tm;
+
+		strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S",
+			 localtime_r(&o->when, &tm));
+		vty_out(vty, "  %6uus %s TRX=%u TS=%u FN=%u block=%u, "
+			"talloc heap +%u bytes, at %s%s",
+			o->us, pcu_rt_path_name(o->path), o->trx, o->ts, o->fn,
+			o->block_nr, o->alloc_bytes, when, VTY_NEWLINE);
+	}
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(reset_bts_realtime,
+      reset_bts_realtime_cmd,
+      "reset bts realtime",
+      "Reset statistics\n" "BTS related functionality\n"
+      "RTS/DATA.ind processing times of the realtime mode\n")
+{
+	pcu_rt_reset_stats();
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(show_bts_llc_queue,
+      show_bts_llc_queue_cmd,
+      "show bts llc-queue",
+      SHOW_STR "BTS related functionality\nLLC frames queued for all MS\n")
+{
+	struct gprs_rlcmac_bts *bts = bts_main_data();
+
+	return pcu_vty_show_llc_queue(vty, bts);
+}
+
+DEFUN(show_bts_sba,
+      show_bts_sba_cmd,
+      "show bts sba",
+      SHOW_STR "BTS related functionality\nSingle block allocations per PDCH\n")
+{
+	struct gprs_rlcmac_bts *bts = bts_main_data();
+	unsigned trx_no, ts_no;
+
+	for (trx_no = 0; trx_no < ARRAY_SIZE(bts->trx); trx_no++) {
+		for (ts_no = 0; ts_no < ARRAY_SIZE(bts->trx[trx_no].pdch); ts_no++) {
+			struct gprs_rlcmac_pdch *pdch = &bts->trx[trx_no].pdch[ts_no];
+
+			if (!pdch->m_is_enabled && !pdch->sba_allocated)
+				continue;
+			vty_out(vty, "TRX=%u TS=%u: %u allocated, %u pending%s",
+				trx_no, ts_no, pdch->sba_allocated, pdch->num_sba,
+				VTY_NEWLINE);
+		}
+	}
+
+	return CMD_SUCCESS;
+}
+
+static unsigned int pcu_vty_pct(uint64_t part, uint64_t total)
+{
+	return total ? part * 100 / total : 0;
+}
+
+DEFUN(show_pdch_stats,
+      show_pdch_stats_cmd,
+      "show pdch stats",
+      SHOW_STR "PDCH related functionality\nUtilisation of the enabled PDCHs\n")
+{
+	struct gprs_rlcmac_bts *bts = bts_main_data();
+	unsigned trx_no, ts_no;
+
+	for (trx_no = 0; trx_no < ARRAY_SIZE(bts->trx); trx_no++) {
+		for (ts_no = 0; ts_no < ARRAY_SIZE(bts->trx[trx_no].pdch); ts_no++) {
+			struct gprs_rlcmac_pdch *pdch = &bts->trx[trx_no].pdch[ts_no];
+			const struct gprs_rlcmac_pdch_stats *st = &pdch->stats;
+			uint64_t rts = st->rts[PDCH_RTS_CTRL] + st->rts[PDCH_RTS_DATA] +
+				st->rts[PDCH_RTS_DUMMY];
+
+			if (!pdch->m_is_enabled)
+				continue;
+			vty_out(vty, "TRX=%u TS=%u: %llu RTS, ctrl %u%% data %u%% dummy %u%%, "
+				"UL usf %u%% reserved %u%%, TBFs %u UL %u DL%s",
+				trx_no, ts_no, (unsigned long long)rts,
+				pcu_vty_pct(st->rts[PDCH_RTS_CTRL], rts),
+				pcu_vty_pct(st->rts[PDCH_RTS_DATA], rts),
+				pcu_vty_pct(st->rts[PDCH_RTS_DUMMY], rts),
+				pcu_vty_pct(st->usf_granted, rts),
+				pcu_vty_pct(st->ul_reserved, rts),
+				pdch->m_num_tbfs[GPRS_RLCMAC_UL_TBF],
+				pdch->m_num_tbfs[GPRS_RLCMAC_DL_TBF], VTY_NEWLINE);
+		}
+	}
+
+	vty_out_bts_hists(vty, bts);
+
+	return CMD_SUCCESS;
+}
+
 DEFUN(show_bts_timer, show_bts_timer_cmd,
       "show bts-timer " OSMO_TDEF_VTY_ARG_T_OPTIONAL,
       SHOW_STR "Show BTS controlled timers\n"
@@ -1122,29 +1983,54 @@ DEFUN(cfg_pcu_timer, cfg_pcu_timer_cmd,
       OSMO_TDEF_VTY_DOC_SET)
 {
 	struct gprs_rlcmac_bts *bts = bts_main_data();
+	int rc;
+
 	/* If any arguments are missing, redirect to 'show' */
 	if (argc < 2)
 		return show_timer(self, vty, argc, argv);
-	return osmo_tdef_vty_set_cmd(vty, bts->T_defs_pcu, argv);
+	rc = osmo_tdef_vty_set_cmd(vty, bts->T_defs_pcu, argv);
+	if (rc == CMD_SUCCESS)
+		bts_update_params(bts);
+	return rc;
+}
+
+#define SHOW_TBF_STR \
+      SHOW_STR "information about TBFs\n" \
+      "All TBFs\n" \
+      "TBFs allocated via CCCH\n" \
+      "TBFs allocated via PACCH\n"
+#define SHOW_FILTER_STR \
+      "Filter by pairs of: trx <0-7>, ts <0-7>, imsi PREFIX, " \
+      "state (null|assign|flow|finished|wait-release|releasing), limit <1-n>\n"
+
+static uint32_t show_tbf_flags(const char *arg)
+{
+	if (arg[0] == 'c')
+		return (1 << GPRS_RLCMAC_FLAG_CCCH);
+	else if (arg[0] == 'p')
+		return (1 << GPRS_RLCMAC_FLAG_PACCH);
+	return UINT32_MAX;
 }
 
 DEFUN(show_tbf,
       show_tbf_cmd,
       "show tbf (all|ccch|pacch)",
-      SHOW_STR "information about TBFs\n"
-      "All TBFs\n"
-      "TBFs allocated via CCCH\n"
-      "TBFs allocated via PACCH\n")
+      SHOW_TBF_STR)
 {
 	struct gprs_rlcmac_bts *bts = bts_main_data();
-	uint32_t flags = UINT32_MAX;
 
-	if (argv[0][0] == 'c')
-		flags = (1 << GPRS_RLCMAC_FLAG_CCCH);
-	else if (argv[0][0] == 'p')
-		flags = (1 << GPRS_RLCMAC_FLAG_PACCH);
+	return pcu_vty_show_tbf_all(vty, bts, show_tbf_flags(argv[0]), 0, NULL);
+}
 
-	return pcu_vty_show_tbf_all(vty, bts, flags);
+DEFUN(show_tbf_filter,
+      show_tbf_filter_cmd,
+      "show tbf (all|ccch|pacch) .FILTER",
+      SHOW_TBF_STR SHOW_FILTER_STR)
+{
+	struct gprs_rlcmac_bts *bts = bts_main_data();
+
+	return pcu_vty_show_tbf_all(vty, bts, show_tbf_flags(argv[0]),
+				    argc - 1, argv + 1);
 }
 
 DEFUN(show_ms_all,
@@ -1156,6 +2042,24 @@ DEFUN(show_ms_all,
 	return pcu_vty_show_ms_all(vty, bts);
 }
 
+DEFUN(show_ms_summary,
+      show_ms_summary_cmd,
+      "show ms summary",
+      SHOW_STR "information about MSs\n" "One line per MS\n")
+{
+	struct gprs_rlcmac_bts *bts = bts_main_data();
+	return pcu_vty_show_ms_summary(vty, bts, 0, NULL);
+}
+
+DEFUN(show_ms_summary_filter,
+      show_ms_summary_filter_cmd,
+      "show ms summary .FILTER",
+      SHOW_STR "information about MSs\n" "One line per MS\n" SHOW_FILTER_STR)
+{
+	struct gprs_rlcmac_bts *bts = bts_main_data();
+	return pcu_vty_show_ms_summary(vty, bts, argc, argv);
+}
+
 DEFUN(show_ms_tlli,
       show_ms_tlli_cmd,
       "show ms tlli TLLI",
@@ -1209,6 +2113,18 @@ int pcu_vty_init(void)
 	cfg_pcu_no_gsmtap_categ_cmd.doc = vty_cmd_string_from_valstr(tall_pcu_ctx, pcu_gsmtap_categ_help,
 						NO_STR "GSMTAP Category\n",
 						"\n", "", 0);
+	cfg_pcu_gsmtap_sample_cmd.string = vty_cmd_string_from_valstr(tall_pcu_ctx, pcu_gsmtap_categ_names,
+						"gsmtap-sample (",
+						"|",") <1-65535>", VTY_DO_LOWER);
+	cfg_pcu_gsmtap_sample_cmd.doc = vty_cmd_string_from_valstr(tall_pcu_ctx, pcu_gsmtap_categ_help,
+						"Send only one in n GSMTAP frames of a category\n",
+						"\n", "\nn, 1 sends all frames\n", 0);
+	cfg_pcu_no_gsmtap_sample_cmd.string = vty_cmd_string_from_valstr(tall_pcu_ctx, pcu_gsmtap_categ_names,
+						"no gsmtap-sample (",
+						"|",")", VTY_DO_LOWER);
+	cfg_pcu_no_gsmtap_sample_cmd.doc = vty_cmd_string_from_valstr(tall_pcu_ctx, pcu_gsmtap_categ_help,
+						NO_STR "Send only one in n GSMTAP frames of a category\n",
+						"\n", "", 0);
 
 	logging_vty_add_cmds();
 	osmo_stats_vty_add_cmds();
@@ -1245,6 +2161,8 @@ int pcu_vty_init(void)
 	install_element(PCU_NODE, &cfg_pcu_no_queue_codel_cmd);
 	install_element(PCU_NODE, &cfg_pcu_queue_idle_ack_delay_cmd);
 	install_element(PCU_NODE, &cfg_pcu_no_queue_idle_ack_delay_cmd);
+	install_element(PCU_NODE, &cfg_pcu_queue_memory_budget_cmd);
+	install_element(PCU_NODE, &cfg_pcu_no_queue_memory_budget_cmd);
 	install_element(PCU_NODE, &cfg_pcu_alloc_cmd);
 	install_element(PCU_NODE, &cfg_pcu_two_phase_cmd);
 	install_element(PCU_NODE, &cfg_pcu_fc_interval_cmd);
@@ -1264,21 +2182,69 @@ int pcu_vty_init(void)
 	install_element(PCU_NODE, &cfg_pcu_no_dl_tbf_idle_time_cmd);
 	install_element(PCU_NODE, &cfg_pcu_dl_tbf_preemptive_retransmission_cmd);
 	install_element(PCU_NODE, &cfg_pcu_no_dl_tbf_preemptive_retransmission_cmd);
+	install_element(PCU_NODE, &cfg_pcu_adaptive_ack_nack_cmd);
+	install_element(PCU_NODE, &cfg_pcu_no_adaptive_ack_nack_cmd);
+	install_element(PCU_NODE, &cfg_pcu_fixed_rrbp_cmd);
+	install_element(PCU_NODE, &cfg_pcu_no_fixed_rrbp_cmd);
+	install_element(PCU_NODE, &cfg_pcu_rebalance_cmd);
+	install_element(PCU_NODE, &cfg_pcu_no_rebalance_cmd);
+	install_element(PCU_NODE, &cfg_pcu_dyn_pdch_cmd);
+	install_element(PCU_NODE, &cfg_pcu_dyn_pdch_load_cmd);
+	install_element(PCU_NODE, &cfg_pcu_no_dyn_pdch_cmd);
 	install_element(PCU_NODE, &cfg_pcu_ms_idle_time_cmd);
 	install_element(PCU_NODE, &cfg_pcu_no_ms_idle_time_cmd);
 	install_element(PCU_NODE, &cfg_pcu_gsmtap_categ_cmd);
 	install_element(PCU_NODE, &cfg_pcu_no_gsmtap_categ_cmd);
+	install_element(PCU_NODE, &cfg_pcu_gsmtap_sample_cmd);
+	install_element(PCU_NODE, &cfg_pcu_no_gsmtap_sample_cmd);
+	install_element(PCU_NODE, &cfg_pcu_gsmtap_async_cmd);
+	install_element(PCU_NODE, &cfg_pcu_no_gsmtap_async_cmd);
+	install_element(PCU_NODE, &cfg_pcu_gsmtap_pcap_cmd);
+	install_element(PCU_NODE, &cfg_pcu_no_gsmtap_pcap_cmd);
+	install_element(PCU_NODE, &cfg_pcu_gsmtap_filter_trx_cmd);
+	install_element(PCU_NODE, &cfg_pcu_gsmtap_filter_ts_cmd);
+	install_element(PCU_NODE, &cfg_pcu_gsmtap_filter_tlli_cmd);
+	install_element(PCU_NODE, &cfg_pcu_gsmtap_filter_imsi_cmd);
+	install_element(PCU_NODE, &cfg_pcu_no_gsmtap_filter_cmd);
 	install_element(PCU_NODE, &cfg_pcu_sock_cmd);
+	install_element(PCU_NODE, &cfg_pcu_sock_shm_cmd);
+	install_element(PCU_NODE, &cfg_pcu_no_sock_shm_cmd);
 	install_element(PCU_NODE, &cfg_pcu_gb_dialect_cmd);
+	install_element(PCU_NODE, &cfg_pcu_gb_queue_cmd);
+	install_element(PCU_NODE, &cfg_pcu_no_gb_queue_cmd);
+	install_element(PCU_NODE, &cfg_pcu_paging_queue_depth_cmd);
+	install_element(PCU_NODE, &cfg_pcu_no_paging_queue_depth_cmd);
+	install_element(PCU_NODE, &cfg_pcu_rach_queue_cmd);
+	install_element(PCU_NODE, &cfg_pcu_no_rach_queue_cmd);
+	install_element(PCU_NODE, &cfg_pcu_rach_admission_cmd);
+	install_element(PCU_NODE, &cfg_pcu_no_rach_admission_cmd);
+	install_element(PCU_NODE, &cfg_pcu_rach_wait_ind_cmd);
+	install_element(PCU_NODE, &cfg_pcu_realtime_cmd);
+	install_element(PCU_NODE, &cfg_pcu_no_realtime_cmd);
+	install_element(PCU_NODE, &cfg_pcu_realtime_cpu_cmd);
+	install_element(PCU_NODE, &cfg_pcu_no_realtime_cpu_cmd);
+	install_element(PCU_NODE, &cfg_pcu_realtime_heap_cmd);
+	install_element(PCU_NODE, &cfg_pcu_realtime_deadline_cmd);
+	install_element(PCU_NODE, &cfg_pcu_realtime_heap_alloc_cmd);
 	install_element(PCU_NODE, &cfg_pcu_timer_cmd);
 
 	install_element_ve(&show_bts_stats_cmd);
+	install_element_ve(&show_bts_histograms_cmd);
+	install_element_ve(&show_bts_llc_queue_cmd);
+	install_element_ve(&show_bts_realtime_cmd);
+	install_element_ve(&show_bts_sba_cmd);
+	install_element_ve(&show_pdch_stats_cmd);
 	install_element_ve(&show_tbf_cmd);
+	install_element_ve(&show_tbf_filter_cmd);
 	install_element_ve(&show_ms_all_cmd);
+	install_element_ve(&show_ms_summary_cmd);
+	install_element_ve(&show_ms_summary_filter_cmd);
 	install_element_ve(&show_ms_tlli_cmd);
 	install_element_ve(&show_ms_imsi_cmd);
 	install_element_ve(&show_bts_timer_cmd);
 	install_element_ve(&show_timer_cmd);
 
+	install_element(ENABLE_NODE, &reset_bts_realtime_cmd);
+
 	return 0;
 }
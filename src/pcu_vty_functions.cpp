@@ -33,17 +33,75 @@
 #include <tbf.h>
 #include <tbf_ul.h>
 #include <pdch.h>
+#include <gprs_bssgp_pcu.h>
 
 extern "C" {
 #include <osmocom/vty/command.h>
 #include <osmocom/vty/logging.h>
 #include <osmocom/vty/misc.h>
 	#include <osmocom/core/linuxlist.h>
+	#include <osmocom/core/signal.h>
+	#include <osmocom/core/talloc.h>
+	#include <osmocom/core/timer.h>
 	#include <osmocom/core/utils.h>
 	#include <osmocom/vty/vty.h>
 	#include "coding_scheme.h"
 }
 
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+extern void *tall_pcu_ctx;
+
+/* Longest time a listing may keep the main loop busy before it continues
+ * in the next iteration, so RTS processing is not held up */
+#define VTY_WALK_SLICE_US	1000
+
+enum vty_walk_kind {
+	VTY_WALK_MS_ALL,
+	VTY_WALK_MS_SUMMARY,
+	VTY_WALK_TBF,
+};
+
+struct vty_walk_filter {
+	int trx; /* -1 for any */
+	int ts; /* -1 for any */
+	int state; /* enum gprs_rlcmac_tbf_state, -1 for any */
+	char imsi_prefix[OSMO_IMSI_BUF_SIZE];
+	unsigned limit; /* 0 for no limit */
+};
+
+/* A listing of the MS or TBFs that match the filter, printed in slices of
+ * at most VTY_WALK_SLICE_US and PCU_VTY_WALK_SLICE_ENTRIES */
+struct vty_walk {
+	struct llist_head list;
+	struct vty *vty;
+	BTS *bts;
+	enum vty_walk_kind kind;
+	struct vty_walk_filter filter;
+	uint32_t tbf_flags;
+	GprsMsStorage::Cursor ms_cursor;
+	BTS::TbfCursor tbf_cursor;
+	enum gprs_rlcmac_tbf_direction dir; /* current list of VTY_WALK_TBF */
+	struct osmo_timer_list timer;
+	unsigned walked;
+	unsigned shown;
+};
+
+static LLIST_HEAD(vty_walks);
+
+static const struct value_string vty_walk_state_names[] = {
+	{ GPRS_RLCMAC_NULL,		"null" },
+	{ GPRS_RLCMAC_ASSIGN,		"assign" },
+	{ GPRS_RLCMAC_FLOW,		"flow" },
+	{ GPRS_RLCMAC_FINISHED,		"finished" },
+	{ GPRS_RLCMAC_WAIT_RELEASE,	"wait-release" },
+	{ GPRS_RLCMAC_RELEASING,	"releasing" },
+	{ 0, NULL }
+};
+
 static void tbf_print_vty_info(struct vty *vty, gprs_rlcmac_tbf *tbf)
 {
 	gprs_rlcmac_ul_tbf *ul_tbf = as_ul_tbf(tbf);
@@ -101,26 +159,6 @@ static void tbf_print_vty_info(struct vty *vty, gprs_rlcmac_tbf *tbf)
 	vty_out(vty, "%s%s", VTY_NEWLINE, VTY_NEWLINE);
 }
 
-int pcu_vty_show_tbf_all(struct vty *vty, struct gprs_rlcmac_bts *bts_data, uint32_t flags)
-{
-	BTS *bts = bts_data->bts;
-	LListHead<gprs_rlcmac_tbf> *iter;
-
-	vty_out(vty, "UL TBFs%s", VTY_NEWLINE);
-	llist_for_each(iter, &bts->ul_tbfs()) {
-		if (iter->entry()->state_flags & flags)
-			tbf_print_vty_info(vty, iter->entry());
-	}
-
-	vty_out(vty, "%sDL TBFs%s", VTY_NEWLINE, VTY_NEWLINE);
-	llist_for_each(iter, &bts->dl_tbfs()) {
-		if (iter->entry()->state_flags & flags)
-			tbf_print_vty_info(vty, iter->entry());
-	}
-
-	return CMD_SUCCESS;
-}
-
 static int show_ms(struct vty *vty, GprsMs *ms)
 {
 	unsigned i;
@@ -203,17 +241,321 @@ static int show_ms(struct vty *vty, GprsMs *ms)
 	return CMD_SUCCESS;
 }
 
-int pcu_vty_show_ms_all(struct vty *vty, struct gprs_rlcmac_bts *bts_data)
+static void show_ms_summary(struct vty *vty, GprsMs *ms)
 {
-	BTS *bts = bts_data->bts;
-	LListHead<GprsMs> *ms_iter;
+	char ul[16] = "-", dl[16] = "-";
+
+	if (ms->ul_tbf())
+		snprintf(ul, sizeof(ul), "%d:%s", ms->ul_tbf()->tfi(),
+			 ms->ul_tbf()->state_name());
+	if (ms->dl_tbf())
+		snprintf(dl, sizeof(dl), "%d:%s", ms->dl_tbf()->tfi(),
+			 ms->dl_tbf()->state_name());
+
+	vty_out(vty, "%08x %-15s %3d %-6s %-6s %-15s %-15s %5zd%s",
+		ms->tlli(), ms->imsi(), ms->ta(),
+		mcs_name(ms->current_cs_ul()), mcs_name(ms->current_cs_dl()),
+		ul, dl, ms->llc_queue()->size(), VTY_NEWLINE);
+}
+
+static bool vty_walk_tbf_matches(const struct vty_walk_filter *f,
+	gprs_rlcmac_tbf *tbf)
+{
+	if (f->trx >= 0 && (!tbf->trx || tbf->trx->trx_no != f->trx))
+		return false;
+	if (f->ts >= 0 && !tbf->pdch[f->ts])
+		return false;
+	if (f->state >= 0 && !tbf->state_is((enum gprs_rlcmac_tbf_state)f->state))
+		return false;
+
+	return true;
+}
+
+static bool vty_walk_imsi_matches(const struct vty_walk_filter *f,
+	const char *imsi)
+{
+	return !f->imsi_prefix[0] ||
+		strncmp(imsi, f->imsi_prefix, strlen(f->imsi_prefix)) == 0;
+}
+
+static bool vty_walk_ms_matches(const struct vty_walk_filter *f, GprsMs *ms)
+{
+	LListHead<gprs_rlcmac_tbf> *pos;
 
-	llist_for_each(ms_iter, &bts->ms_store().ms_list())
-		show_ms(vty, ms_iter->entry());
+	if (!vty_walk_imsi_matches(f, ms->imsi()))
+		return false;
+
+	if (f->trx < 0 && f->ts < 0 && f->state < 0)
+		return true;
+
+	if (ms->ul_tbf() && vty_walk_tbf_matches(f, ms->ul_tbf()))
+		return true;
+	if (ms->dl_tbf() && vty_walk_tbf_matches(f, ms->dl_tbf()))
+		return true;
+	llist_for_each(pos, &ms->old_tbfs()) {
+		if (vty_walk_tbf_matches(f, pos->entry()))
+			return true;
+	}
+
+	return false;
+}
+
+static bool vty_walk_limit_reached(const struct vty_walk *walk)
+{
+	return walk->filter.limit && walk->shown >= walk->filter.limit;
+}
+
+static void vty_walk_show_tbf(struct vty_walk *walk, gprs_rlcmac_tbf *tbf)
+{
+	if (!(tbf->state_flags & walk->tbf_flags) ||
+	    !vty_walk_tbf_matches(&walk->filter, tbf) ||
+	    !vty_walk_imsi_matches(&walk->filter, tbf->imsi()))
+		return;
+
+	tbf_print_vty_info(walk->vty, tbf);
+	walk->shown += 1;
+}
+
+static void vty_walk_show_ms(struct vty_walk *walk, GprsMs *ms)
+{
+	walk->walked += 1;
+	if (!vty_walk_ms_matches(&walk->filter, ms))
+		return;
+
+	if (walk->kind == VTY_WALK_MS_ALL)
+		show_ms(walk->vty, ms);
+	else
+		show_ms_summary(walk->vty, ms);
+	walk->shown += 1;
+}
+
+/* Print the next entry. Returns false when the listing is complete. */
+static bool vty_walk_step(struct vty_walk *walk)
+{
+	gprs_rlcmac_tbf *tbf;
+	GprsMs *ms;
+
+	if (vty_walk_limit_reached(walk))
+		return false;
+
+	if (walk->kind != VTY_WALK_TBF) {
+		ms = walk->bts->ms_store().cursor_next(&walk->ms_cursor);
+		if (!ms)
+			return false;
+		vty_walk_show_ms(walk, ms);
+		return true;
+	}
+
+	tbf = walk->bts->tbf_cursor_next(&walk->tbf_cursor);
+	if (tbf) {
+		vty_walk_show_tbf(walk, tbf);
+		return true;
+	}
+
+	/* the UL TBFs are done, the limit applies to both lists */
+	if (walk->dir != GPRS_RLCMAC_UL_TBF)
+		return false;
+	vty_out(walk->vty, "%sDL TBFs%s", VTY_NEWLINE, VTY_NEWLINE);
+	walk->dir = GPRS_RLCMAC_DL_TBF;
+	walk->bts->tbf_cursor_stop(&walk->tbf_cursor);
+	walk->bts->tbf_cursor_start(&walk->tbf_cursor, walk->dir);
+	return true;
+}
+
+static void vty_walk_free(struct vty_walk *walk)
+{
+	osmo_timer_del(&walk->timer);
+	if (walk->kind == VTY_WALK_TBF)
+		walk->bts->tbf_cursor_stop(&walk->tbf_cursor);
+	else
+		walk->bts->ms_store().cursor_stop(&walk->ms_cursor);
+	llist_del(&walk->list);
+	talloc_free(walk);
+}
+
+static void vty_walk_slice(void *data)
+{
+	struct vty_walk *walk = (struct vty_walk *)data;
+	struct timespec start, now;
+	unsigned i;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (i = 0; i < PCU_VTY_WALK_SLICE_ENTRIES; i++) {
+		if (!vty_walk_step(walk)) {
+			if (walk->kind == VTY_WALK_MS_SUMMARY)
+				vty_out(walk->vty, "%u of %u MS shown%s",
+					walk->shown, walk->walked, VTY_NEWLINE);
+			vty_walk_free(walk);
+			return;
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (pcu_timespec_diff_us(&start, &now) >= VTY_WALK_SLICE_US)
+			break;
+	}
+
+	/* continue in the next main loop iteration */
+	osmo_timer_schedule(&walk->timer, 0, 0);
+}
+
+static int vty_walk_signal_cb(unsigned int subsys, unsigned int signal,
+	void *handler_data, void *signal_data)
+{
+	struct vty_signal_data *sig_data = (struct vty_signal_data *)signal_data;
+	struct vty_walk *walk, *tmp;
+
+	if (subsys != SS_L_VTY || signal != S_VTY_EVENT ||
+	    sig_data->event != VTY_CLOSED)
+		return 0;
+
+	llist_for_each_entry_safe(walk, tmp, &vty_walks, list) {
+		if (walk->vty == sig_data->vty)
+			vty_walk_free(walk);
+	}
+
+	return 0;
+}
+
+/* The first slice runs before the command returns, so short listings are
+ * complete when the prompt is printed. A longer one continues after the
+ * prompt, one slice per main loop iteration. */
+static int vty_walk_start(struct vty *vty, BTS *bts,
+	enum vty_walk_kind kind, const struct vty_walk_filter *filter,
+	uint32_t tbf_flags)
+{
+	static bool signal_registered = false;
+	struct vty_walk *walk, *tmp;
+
+	if (!signal_registered) {
+		osmo_signal_register_handler(SS_L_VTY, vty_walk_signal_cb, NULL);
+		signal_registered = true;
+	}
+
+	/* a new listing replaces the one still running on this VTY */
+	llist_for_each_entry_safe(walk, tmp, &vty_walks, list) {
+		if (walk->vty == vty)
+			vty_walk_free(walk);
+	}
+
+	walk = talloc_zero(tall_pcu_ctx, struct vty_walk);
+	if (!walk)
+		return CMD_WARNING;
+
+	walk->vty = vty;
+	walk->bts = bts;
+	walk->kind = kind;
+	walk->filter = *filter;
+	walk->tbf_flags = tbf_flags;
+	walk->dir = GPRS_RLCMAC_UL_TBF;
+	osmo_timer_setup(&walk->timer, vty_walk_slice, walk);
+	if (kind == VTY_WALK_TBF)
+		bts->tbf_cursor_start(&walk->tbf_cursor, walk->dir);
+	else
+		bts->ms_store().cursor_start(&walk->ms_cursor);
+	llist_add_tail(&walk->list, &vty_walks);
+
+	vty_walk_slice(walk);
 
 	return CMD_SUCCESS;
 }
 
+static void vty_walk_filter_init(struct vty_walk_filter *filter)
+{
+	memset(filter, 0, sizeof(*filter));
+	filter->trx = -1;
+	filter->ts = -1;
+	filter->state = -1;
+}
+
+/* Parse pairs of "trx N", "ts N", "imsi PREFIX", "state NAME", "limit N" */
+static int vty_walk_filter_parse(struct vty *vty, struct vty_walk_filter *filter,
+	int argc, const char **argv)
+{
+	int i;
+
+	vty_walk_filter_init(filter);
+
+	for (i = 0; i < argc; i += 2) {
+		const char *key = argv[i];
+		const char *val = i + 1 < argc ? argv[i + 1] : NULL;
+
+		if (!val) {
+			vty_out(vty, "%% Missing value for '%s'%s", key, VTY_NEWLINE);
+			return -EINVAL;
+		}
+
+		if (!strcmp(key, "trx")) {
+			filter->trx = atoi(val);
+			if (filter->trx < 0 || filter->trx > 7)
+				goto invalid;
+		} else if (!strcmp(key, "ts")) {
+			filter->ts = atoi(val);
+			if (filter->ts < 0 || filter->ts > 7)
+				goto invalid;
+		} else if (!strcmp(key, "imsi")) {
+			if (strlen(val) >= sizeof(filter->imsi_prefix))
+				goto invalid;
+			osmo_strlcpy(filter->imsi_prefix, val, sizeof(filter->imsi_prefix));
+		} else if (!strcmp(key, "state")) {
+			filter->state = get_string_value(vty_walk_state_names, val);
+			if (filter->state < 0)
+				goto invalid;
+		} else if (!strcmp(key, "limit")) {
+			if (atoi(val) <= 0)
+				goto invalid;
+			filter->limit = atoi(val);
+		} else {
+			vty_out(vty, "%% Unknown filter '%s'%s", key, VTY_NEWLINE);
+			return -EINVAL;
+		}
+		continue;
+invalid:
+		vty_out(vty, "%% Invalid value '%s' for '%s'%s", val, key, VTY_NEWLINE);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+int pcu_vty_show_tbf_all(struct vty *vty, struct gprs_rlcmac_bts *bts_data, uint32_t flags,
+	int argc, const char **argv)
+{
+	struct vty_walk_filter filter;
+
+	if (vty_walk_filter_parse(vty, &filter, argc, argv) < 0)
+		return CMD_WARNING;
+
+	vty_out(vty, "UL TBFs%s", VTY_NEWLINE);
+	return vty_walk_start(vty, bts_data->bts, VTY_WALK_TBF, &filter, flags);
+}
+
+int pcu_vty_show_ms_all(struct vty *vty, struct gprs_rlcmac_bts *bts_data)
+{
+	struct vty_walk_filter filter;
+
+	vty_walk_filter_init(&filter);
+	return vty_walk_start(vty, bts_data->bts, VTY_WALK_MS_ALL, &filter, UINT32_MAX);
+}
+
+int pcu_vty_show_ms_summary(struct vty *vty, struct gprs_rlcmac_bts *bts_data,
+	int argc, const char **argv)
+{
+	struct vty_walk_filter filter;
+
+	if (vty_walk_filter_parse(vty, &filter, argc, argv) < 0)
+		return CMD_WARNING;
+
+	vty_out(vty, "TLLI     IMSI             TA CS UL CS DL UL TBF          DL TBF            LLC%s",
+		VTY_NEWLINE);
+	return vty_walk_start(vty, bts_data->bts, VTY_WALK_MS_SUMMARY, &filter, UINT32_MAX);
+}
+
+unsigned pcu_vty_walks_pending(void)
+{
+	return llist_count(&vty_walks);
+}
+
 int pcu_vty_show_ms_by_tlli(struct vty *vty, struct gprs_rlcmac_bts *bts_data,
 	uint32_t tlli)
 {
@@ -239,3 +581,25 @@ int pcu_vty_show_ms_by_imsi(struct vty *vty, struct gprs_rlcmac_bts *bts_data,
 
 	return show_ms(vty, ms);
 }
+
+int pcu_vty_show_llc_queue(struct vty *vty, struct gprs_rlcmac_bts *bts_data)
+{
+	const LlcController *llc = bts_data->bts->llc();
+
+	vty_out(vty, "LLC queues: %zu frames, %zu octets in %u queues%s",
+		llc->frames(), llc->octets(), llc->queues(), VTY_NEWLINE);
+	if (bts_data->llc_queue_budget)
+		vty_out(vty, "Budget: %u octets, %u%% used%s",
+			bts_data->llc_queue_budget,
+			(unsigned)(llc->octets() * 100 / bts_data->llc_queue_budget),
+			VTY_NEWLINE);
+	else
+		vty_out(vty, "Budget: unlimited%s", VTY_NEWLINE);
+
+	return CMD_SUCCESS;
+}
+
+unsigned pcu_vty_gb_queue_depth(int downlink)
+{
+	return gprs_bssgp_pcu_queue_depth(downlink);
+}
@@ -27,12 +27,24 @@ extern "C" {
 struct vty;
 struct gprs_rlcmac_bts;
 
-int pcu_vty_show_tbf_all(struct vty *vty, struct gprs_rlcmac_bts *bts_data, uint32_t flags);
+/* 'show ms' and 'show tbf' print at most this many entries before they give
+ * up the main loop, a listing that is longer continues in the next main
+ * loop iteration */
+#define PCU_VTY_WALK_SLICE_ENTRIES	64
+
+int pcu_vty_show_tbf_all(struct vty *vty, struct gprs_rlcmac_bts *bts_data, uint32_t flags,
+	int argc, const char **argv);
 int pcu_vty_show_ms_all(struct vty *vty, struct gprs_rlcmac_bts *bts_data);
+int pcu_vty_show_ms_summary(struct vty *vty, struct gprs_rlcmac_bts *bts_data,
+	int argc, const char **argv);
 int pcu_vty_show_ms_by_tlli(struct vty *vty, struct gprs_rlcmac_bts *bts_data,
 	uint32_t tlli);
 int pcu_vty_show_ms_by_imsi(struct vty *vty, struct gprs_rlcmac_bts *bts_data,
 	const char *imsi);
+int pcu_vty_show_llc_queue(struct vty *vty, struct gprs_rlcmac_bts *bts_data);
+unsigned pcu_vty_gb_queue_depth(int downlink);
+/* number of listings that are still being printed in slices */
+unsigned pcu_vty_walks_pending(void);
 
 #ifdef __cplusplus
 }
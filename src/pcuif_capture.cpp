@@ -0,0 +1,159 @@
+/* pcuif_capture.cpp
+ *
+ * Record the PCUIF and Gb input of a running PCU for later replay
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include <pcuif_capture.h>
+#include <gprs_debug.h>
+#include <bts.h>
+
+extern "C" {
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/logging.h>
+#include <osmocom/core/utils.h>
+}
+
+extern void *tall_pcu_ctx;
+
+/* the capture is written from the RTS path, keep syscalls out of it */
+#define PCUIF_CAPTURE_BUF_SIZE (1024 * 1024)
+
+static FILE *capture_file;
+static char *capture_buf;
+
+static void capture_write(uint8_t type, const void *data1, size_t len1,
+	const void *data2, size_t len2)
+{
+	struct pcuif_capture_rec_hdr hdr;
+
+	hdr.type = type;
+	hdr.spare = 0;
+	hdr.len = len1 + len2;
+	hdr.fn = BTS::main_bts()->current_frame_number();
+
+	if (fwrite(&hdr, sizeof(hdr), 1, capture_file) != 1
+	    || fwrite(data1, len1, 1, capture_file) != 1
+	    || (len2 && fwrite(data2, len2, 1, capture_file) != 1)) {
+		LOGP(DL1IF, LOGL_ERROR, "Writing PCUIF capture failed, "
+			"stopping capture\n");
+		pcuif_capture_close();
+	}
+}
+
+int pcuif_capture_open(const char *path)
+{
+	struct pcuif_capture_file_hdr hdr;
+
+	if (capture_file)
+		pcuif_capture_close();
+
+	capture_file = fopen(path, "wb");
+	if (!capture_file) {
+		LOGP(DL1IF, LOGL_ERROR, "Failed to open PCUIF capture %s: %s\n",
+			path, strerror(errno));
+		return -errno;
+	}
+
+	capture_buf = (char *)talloc_size(tall_pcu_ctx, PCUIF_CAPTURE_BUF_SIZE);
+	if (capture_buf)
+		setvbuf(capture_file, capture_buf, _IOFBF, PCUIF_CAPTURE_BUF_SIZE);
+
+	hdr.magic = PCUIF_CAPTURE_MAGIC;
+	hdr.version = PCUIF_CAPTURE_VERSION;
+	hdr.pcu_if_version = PCU_IF_VERSION;
+	if (fwrite(&hdr, sizeof(hdr), 1, capture_file) != 1) {
+		pcuif_capture_close();
+		return -EIO;
+	}
+
+	LOGP(DL1IF, LOGL_NOTICE, "Recording PCUIF capture to %s\n", path);
+	return 0;
+}
+
+void pcuif_capture_close(void)
+{
+	if (!capture_file)
+		return;
+
+	fclose(capture_file);
+	capture_file = NULL;
+	talloc_free(capture_buf);
+	capture_buf = NULL;
+}
+
+int pcuif_capture_active(void)
+{
+	return capture_file != NULL;
+}
+
+void pcuif_capture_pcuif(const struct gsm_pcu_if *pcu_prim)
+{
+	if (!capture_file)
+		return;
+
+	capture_write(PCUIF_CAPTURE_T_PCUIF, pcu_prim, sizeof(*pcu_prim), NULL, 0);
+}
+
+void pcuif_capture_dl_ud(uint32_t tlli, uint32_t tlli_old, const char *imsi,
+	uint8_t ms_class, uint8_t egprs_ms_class, uint16_t delay_csec,
+	const uint8_t *data, uint16_t len)
+{
+	struct pcuif_capture_dl_ud ud;
+
+	if (!capture_file)
+		return;
+
+	memset(&ud, 0, sizeof(ud));
+	ud.tlli = tlli;
+	ud.tlli_old = tlli_old;
+	osmo_strlcpy(ud.imsi, imsi, sizeof(ud.imsi));
+	ud.ms_class = ms_class;
+	ud.egprs_ms_class = egprs_ms_class;
+	ud.delay_csec = delay_csec;
+	ud.len = len;
+
+	capture_write(PCUIF_CAPTURE_T_GB_DL_UD, &ud, sizeof(ud), data, len);
+}
+
+int pcuif_capture_read_file_hdr(FILE *f)
+{
+	struct pcuif_capture_file_hdr hdr;
+
+	if (fread(&hdr, sizeof(hdr), 1, f) != 1)
+		return -EIO;
+	if (hdr.magic != PCUIF_CAPTURE_MAGIC || hdr.version != PCUIF_CAPTURE_VERSION)
+		return -EINVAL;
+	if (hdr.pcu_if_version != PCU_IF_VERSION)
+		return -EPROTO;
+	return 0;
+}
+
+int pcuif_capture_read_rec(FILE *f, struct pcuif_capture_rec_hdr *hdr,
+	uint8_t *buf, size_t buf_len)
+{
+	if (fread(hdr, sizeof(*hdr), 1, f) != 1)
+		return feof(f) ? 0 : -EIO;
+	if (hdr->len == 0 || hdr->len > buf_len)
+		return -EINVAL;
+	if (fread(buf, hdr->len, 1, f) != 1)
+		return -EIO;
+	return hdr->len;
+}
@@ -0,0 +1,87 @@
+/* pcuif_capture.h
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <osmocom/pcu/pcuif_proto.h>
+
+/*
+ * Capture of everything that drives the RLC/MAC layer from the outside:
+ * the PCUIF primitives received from the BTS and the DL-UNITDATA received
+ * from the SGSN. A capture file starts with a pcuif_capture_file_hdr and
+ * is followed by records, each consisting of a pcuif_capture_rec_hdr and
+ * 'len' bytes of payload. All fields are in host byte order, captures are
+ * meant to be replayed on the machine that recorded them.
+ */
+
+#define PCUIF_CAPTURE_MAGIC	0x50435543	/* "PCUC" */
+#define PCUIF_CAPTURE_VERSION	1
+
+enum pcuif_capture_rec_type {
+	PCUIF_CAPTURE_T_PCUIF		= 1,	/* struct gsm_pcu_if */
+	PCUIF_CAPTURE_T_GB_DL_UD	= 2,	/* struct pcuif_capture_dl_ud + LLC PDU */
+};
+
+struct pcuif_capture_file_hdr {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t pcu_if_version;
+} __attribute__((packed));
+
+struct pcuif_capture_rec_hdr {
+	uint8_t type;
+	uint8_t spare;
+	uint16_t len;
+	uint32_t fn;		/* BTS frame number when the record was taken */
+} __attribute__((packed));
+
+struct pcuif_capture_dl_ud {
+	uint32_t tlli;
+	uint32_t tlli_old;
+	char imsi[16];
+	uint8_t ms_class;
+	uint8_t egprs_ms_class;
+	uint16_t delay_csec;
+	uint16_t len;
+	uint8_t data[0];
+} __attribute__((packed));
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int pcuif_capture_open(const char *path);
+void pcuif_capture_close(void);
+int pcuif_capture_active(void);
+
+void pcuif_capture_pcuif(const struct gsm_pcu_if *pcu_prim);
+void pcuif_capture_dl_ud(uint32_t tlli, uint32_t tlli_old, const char *imsi,
+	uint8_t ms_class, uint8_t egprs_ms_class, uint16_t delay_csec,
+	const uint8_t *data, uint16_t len);
+
+/* Reading side, returns the payload length, 0 at the end of the file
+ * and a negative errno on a truncated or otherwise broken file. */
+int pcuif_capture_read_file_hdr(FILE *f);
+int pcuif_capture_read_rec(FILE *f, struct pcuif_capture_rec_hdr *hdr,
+	uint8_t *buf, size_t buf_len);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,224 @@
+/* pcuif_shm.cpp
+ *
+ * Shared memory rings between the PCU and the BTS
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+#include <pcuif_shm.h>
+
+/* fails to compile unless the ring size is a power of two */
+typedef char pcuif_shm_ring_size_is_power_of_two[
+	(PCU_IF_SHM_RING_SIZE & (PCU_IF_SHM_RING_SIZE - 1)) ? -1 : 1];
+
+static void shm_init(struct pcuif_shm *shm)
+{
+	memset(shm, 0, sizeof(*shm));
+	shm->memfd = -1;
+	shm->to_pcu_efd = -1;
+	shm->from_pcu_efd = -1;
+	shm->rx_efd = -1;
+	shm->tx_efd = -1;
+}
+
+int pcuif_shm_create(struct pcuif_shm *shm)
+{
+	void *seg;
+	int rc;
+
+	shm_init(shm);
+
+#ifdef HAVE_MEMFD_CREATE
+	shm->memfd = memfd_create("pcuif_shm", MFD_CLOEXEC);
+#else
+	errno = ENOTSUP;
+#endif
+	if (shm->memfd < 0)
+		goto err;
+	if (ftruncate(shm->memfd, sizeof(*shm->seg)) < 0)
+		goto err;
+
+	seg = mmap(NULL, sizeof(*shm->seg), PROT_READ | PROT_WRITE,
+		MAP_SHARED, shm->memfd, 0);
+	if (seg == MAP_FAILED)
+		goto err;
+	shm->seg = (struct gsm_pcu_if_shm *)seg;
+
+	shm->to_pcu_efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (shm->to_pcu_efd < 0)
+		goto err;
+	shm->from_pcu_efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (shm->from_pcu_efd < 0)
+		goto err;
+
+	/* the new segment is all zero, that is two empty rings */
+	shm->seg->magic = PCU_IF_SHM_MAGIC;
+	shm->seg->ring_size = PCU_IF_SHM_RING_SIZE;
+	shm->seg->slot_size = sizeof(struct gsm_pcu_if);
+
+	shm->rx = &shm->seg->to_pcu;
+	shm->tx = &shm->seg->from_pcu;
+	shm->rx_efd = shm->to_pcu_efd;
+	shm->tx_efd = shm->from_pcu_efd;
+
+	return 0;
+
+err:
+	rc = -errno;
+	pcuif_shm_free(shm);
+	return rc;
+}
+
+int pcuif_shm_attach(struct pcuif_shm *shm, int memfd, int to_pcu_efd,
+	int from_pcu_efd)
+{
+	void *seg;
+	int rc;
+
+	shm_init(shm);
+	shm->memfd = memfd;
+	shm->to_pcu_efd = to_pcu_efd;
+	shm->from_pcu_efd = from_pcu_efd;
+
+	seg = mmap(NULL, sizeof(*shm->seg), PROT_READ | PROT_WRITE,
+		MAP_SHARED, memfd, 0);
+	if (seg == MAP_FAILED) {
+		rc = -errno;
+		pcuif_shm_free(shm);
+		return rc;
+	}
+	shm->seg = (struct gsm_pcu_if_shm *)seg;
+
+	if (shm->seg->magic != PCU_IF_SHM_MAGIC
+	    || shm->seg->ring_size != PCU_IF_SHM_RING_SIZE
+	    || shm->seg->slot_size != sizeof(struct gsm_pcu_if)) {
+		pcuif_shm_free(shm);
+		return -EPROTO;
+	}
+
+	shm->rx = &shm->seg->from_pcu;
+	shm->tx = &shm->seg->to_pcu;
+	shm->rx_efd = from_pcu_efd;
+	shm->tx_efd = to_pcu_efd;
+
+	return 0;
+}
+
+void pcuif_shm_free(struct pcuif_shm *shm)
+{
+	if (shm->seg)
+		munmap(shm->seg, sizeof(*shm->seg));
+	if (shm->memfd >= 0)
+		close(shm->memfd);
+	if (shm->to_pcu_efd >= 0)
+		close(shm->to_pcu_efd);
+	if (shm->from_pcu_efd >= 0)
+		close(shm->from_pcu_efd);
+	shm_init(shm);
+}
+
+int pcuif_shm_send_req(const struct pcuif_shm *shm, int sock_fd)
+{
+	struct gsm_pcu_if pcu_prim;
+	int fds[3] = { shm->memfd, shm->to_pcu_efd, shm->from_pcu_efd };
+	char cbuf[CMSG_SPACE(sizeof(fds))];
+	struct iovec iov;
+	struct msghdr mh;
+	struct cmsghdr *cmsg;
+
+	memset(&pcu_prim, 0, sizeof(pcu_prim));
+	pcu_prim.msg_type = PCU_IF_MSG_SHM_REQ;
+	pcu_prim.u.shm_req.size = sizeof(*shm->seg);
+	pcu_prim.u.shm_req.ring_size = PCU_IF_SHM_RING_SIZE;
+	pcu_prim.u.shm_req.slot_size = sizeof(struct gsm_pcu_if);
+
+	iov.iov_base = &pcu_prim;
+	iov.iov_len = sizeof(pcu_prim);
+
+	memset(&mh, 0, sizeof(mh));
+	memset(cbuf, 0, sizeof(cbuf));
+	mh.msg_iov = &iov;
+	mh.msg_iovlen = 1;
+	mh.msg_control = cbuf;
+	mh.msg_controllen = sizeof(cbuf);
+
+	cmsg = CMSG_FIRSTHDR(&mh);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+	if (sendmsg(sock_fd, &mh, 0) < 0)
+		return -errno;
+	return 0;
+}
+
+struct gsm_pcu_if *pcuif_shm_tx_reserve(struct pcuif_shm *shm)
+{
+	uint32_t head = __atomic_load_n(&shm->tx->head, __ATOMIC_RELAXED);
+	uint32_t tail = __atomic_load_n(&shm->tx->tail, __ATOMIC_ACQUIRE);
+
+	if (head - tail >= PCU_IF_SHM_RING_SIZE)
+		return NULL;
+	return &shm->tx->slots[head & (PCU_IF_SHM_RING_SIZE - 1)];
+}
+
+void pcuif_shm_tx_commit(struct pcuif_shm *shm)
+{
+	uint32_t head = __atomic_load_n(&shm->tx->head, __ATOMIC_RELAXED);
+	__atomic_store_n(&shm->tx->head, head + 1, __ATOMIC_RELEASE);
+}
+
+struct gsm_pcu_if *pcuif_shm_rx_peek(struct pcuif_shm *shm)
+{
+	uint32_t tail = __atomic_load_n(&shm->rx->tail, __ATOMIC_RELAXED);
+	uint32_t head = __atomic_load_n(&shm->rx->head, __ATOMIC_ACQUIRE);
+
+	if (head == tail)
+		return NULL;
+	return &shm->rx->slots[tail & (PCU_IF_SHM_RING_SIZE - 1)];
+}
+
+void pcuif_shm_rx_consume(struct pcuif_shm *shm)
+{
+	uint32_t tail = __atomic_load_n(&shm->rx->tail, __ATOMIC_RELAXED);
+	__atomic_store_n(&shm->rx->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+int pcuif_shm_kick(struct pcuif_shm *shm)
+{
+	uint64_t one = 1;
+
+	/* EAGAIN means the counter is saturated, the peer will wake up */
+	if (write(shm->tx_efd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+		return -errno;
+	return 0;
+}
+
+int pcuif_shm_ack(struct pcuif_shm *shm)
+{
+	uint64_t cnt;
+
+	if (read(shm->rx_efd, &cnt, sizeof(cnt)) < 0 && errno != EAGAIN)
+		return -errno;
+	return 0;
+}
@@ -0,0 +1,68 @@
+/* pcuif_shm.h
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <osmocom/pcu/pcuif_proto.h>
+
+/*
+ * Shared memory transport of the PCU socket, see PCU_IF_MSG_SHM_REQ. The
+ * same code is used on both ends: the PCU creates the segment and the
+ * doorbells, the BTS attaches to what it received. Each side fills its tx
+ * ring in place, rings the doorbell of the peer once per batch and drains
+ * its rx ring in place when its own doorbell rang.
+ */
+struct pcuif_shm {
+	struct gsm_pcu_if_shm *seg;
+	struct gsm_pcu_if_shm_ring *rx;	/* ring we consume */
+	struct gsm_pcu_if_shm_ring *tx;	/* ring we produce */
+	int memfd;
+	int to_pcu_efd;			/* doorbell of the PCU */
+	int from_pcu_efd;		/* doorbell of the BTS */
+	int rx_efd;			/* our doorbell, one of the above */
+	int tx_efd;			/* doorbell of the peer */
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* PCU side: create the segment and both doorbells */
+int pcuif_shm_create(struct pcuif_shm *shm);
+/* BTS side: map the segment received with PCU_IF_MSG_SHM_REQ, takes over
+ * the descriptors (also on failure) */
+int pcuif_shm_attach(struct pcuif_shm *shm, int memfd, int to_pcu_efd,
+	int from_pcu_efd);
+void pcuif_shm_free(struct pcuif_shm *shm);
+
+/* PCU side: offer the segment on the PCU socket */
+int pcuif_shm_send_req(const struct pcuif_shm *shm, int sock_fd);
+
+struct gsm_pcu_if *pcuif_shm_tx_reserve(struct pcuif_shm *shm);
+void pcuif_shm_tx_commit(struct pcuif_shm *shm);
+struct gsm_pcu_if *pcuif_shm_rx_peek(struct pcuif_shm *shm);
+void pcuif_shm_rx_consume(struct pcuif_shm *shm);
+
+/* ring the doorbell of the peer, resp. clear our own */
+int pcuif_shm_kick(struct pcuif_shm *shm);
+int pcuif_shm_ack(struct pcuif_shm *shm);
+
+#ifdef __cplusplus
+}
+#endif
@@ -44,6 +44,7 @@ extern "C" {
 #include <osmocom/core/gsmtap.h>
 #include <osmocom/core/logging.h>
 #include <osmocom/core/utils.h>
+#include <osmocom/core/stat_item.h>
 
 #include "coding_scheme.h"
 #include "gsm_rlcmac.h"
@@ -55,6 +56,31 @@ extern "C" {
 
 extern void *tall_pcu_ctx;
 
+static const struct osmo_stat_item_desc pdch_stat_item_description[] = {
+	{ "rts.ctrl",		"RTS with control block ",
+		"%", 4, 0},
+	{ "rts.data",		"RTS with data block    ",
+		"%", 4, 0},
+	{ "rts.dummy",		"RTS with dummy block   ",
+		"%", 4, 0},
+	{ "ul.usf",		"UL blocks granted (USF)",
+		"%", 4, 0},
+	{ "ul.reserved",	"UL blocks reserved     ",
+		"%", 4, 0},
+	{ "tbf.ul",		"UL TBFs attached       ",
+		OSMO_STAT_ITEM_NO_UNIT, 4, 0},
+	{ "tbf.dl",		"DL TBFs attached       ",
+		OSMO_STAT_ITEM_NO_UNIT, 4, 0},
+};
+
+static const struct osmo_stat_item_group_desc pdch_statg_desc = {
+	"pdch",
+	"PDCH Statistics",
+	OSMO_STATS_CLASS_GLOBAL,
+	ARRAY_SIZE(pdch_stat_item_description),
+	pdch_stat_item_description,
+};
+
 static void get_rx_qual_meas(struct pcu_l1_meas *meas, uint8_t rx_qual_enc)
 {
 	static const int16_t rx_qual_map[] = {
@@ -134,13 +160,71 @@ void gprs_rlcmac_pdch::enable()
 {
 	/* TODO: Check if there are still allocated resources.. */
 	INIT_LLIST_HEAD(&paging_list);
+	num_paging = 0;
+	memset(ul_rsv_tbl, 0, sizeof(ul_rsv_tbl));
 	m_is_enabled = 1;
+	m_is_draining = 0;
+	trx->update_pdch_masks(ts_no);
+	trx->update_assigned_tfis();
+
+	free_stats();
+	stats.statg = osmo_stat_item_group_alloc(tall_pcu_ctx, &pdch_statg_desc,
+						 trx_no() * 8 + ts_no);
 }
 
 void gprs_rlcmac_pdch::disable()
 {
 	/* TODO.. kick free_resources once we know the TRX/TS we are on */
 	m_is_enabled = 0;
+	m_is_draining = 0;
+	trx->update_pdch_masks(ts_no);
+	trx->update_assigned_tfis();
+	free_stats();
+}
+
+/* Whether the uplink block at fn is still free for a poll */
+bool gprs_rlcmac_pdch::ul_block_free(uint32_t fn) const
+{
+	const struct gprs_rlcmac_pdch_ul_rsv *rsv =
+		&ul_rsv_tbl[pdch_fn2bn(fn) % PDCH_UL_RSV_TBL_SIZE];
+
+	if (rsv->kind != PDCH_UL_RSV_NONE && rsv->fn == fn)
+		return false;
+	return !bts()->sba()->find(this, fn);
+}
+
+void gprs_rlcmac_pdch::free_stats()
+{
+	if (stats.statg)
+		osmo_stat_item_group_free(stats.statg);
+	memset(&stats, 0, sizeof(stats));
+}
+
+void gprs_rlcmac_pdch::publish_stats(uint32_t fn)
+{
+	struct gprs_rlcmac_pdch_stats *s = &stats;
+	unsigned i;
+
+	if (s->statg) {
+		for (i = 0; i < _PDCH_RTS_NUM; i++)
+			osmo_stat_item_set(s->statg->items[PDCH_STAT_RTS_CTRL + i],
+				(s->rts[i] - s->win_rts[i]) * 100 / s->win_len);
+		osmo_stat_item_set(s->statg->items[PDCH_STAT_USF_GRANTED],
+			(s->usf_granted - s->win_usf_granted) * 100 / s->win_len);
+		osmo_stat_item_set(s->statg->items[PDCH_STAT_UL_RESERVED],
+			(s->ul_reserved - s->win_ul_reserved) * 100 / s->win_len);
+		osmo_stat_item_set(s->statg->items[PDCH_STAT_TBF_UL],
+			num_tbfs(GPRS_RLCMAC_UL_TBF));
+		osmo_stat_item_set(s->statg->items[PDCH_STAT_TBF_DL],
+			num_tbfs(GPRS_RLCMAC_DL_TBF));
+	}
+
+	memcpy(s->win_rts, s->rts, sizeof(s->win_rts));
+	s->win_usf_granted = s->usf_granted;
+	s->win_ul_reserved = s->ul_reserved;
+	s->win_len = 0;
+
+	bts()->publish_latency_stats(fn);
 }
 
 void gprs_rlcmac_pdch::free_resources()
@@ -169,13 +253,39 @@ struct gprs_rlcmac_paging *gprs_rlcmac_pdch::dequeue_paging()
 		return NULL;
 	pag = llist_entry(paging_list.next, struct gprs_rlcmac_paging, list);
 	llist_del(&pag->list);
+	num_paging -= 1;
 
 	return pag;
 }
 
+/* Repeated Page Info with a TMSI, the shortest possible element */
+#define PAGING_TMSI_LEN (1 + 1 + 1 + 32 + 2 + 1)
+
+/* Size of a Repeated Page Info element in bits, 0 if the MI cannot be paged */
+static unsigned paging_record_len(const struct gprs_rlcmac_paging *pag)
+{
+	if ((pag->identity_lv[1] & GSM_MI_TYPE_MASK) == GSM_MI_TYPE_TMSI) {
+		/* TMSI */
+		if (pag->identity_lv[0] != 5) {
+			LOGP(DRLCMAC, LOGL_ERROR, "TMSI paging with "
+				"MI != 5 octets!\n");
+			return 0;
+		}
+		return PAGING_TMSI_LEN;
+	}
+
+	/* MI */
+	if (pag->identity_lv[0] > 8) {
+		LOGP(DRLCMAC, LOGL_ERROR, "Paging with "
+			"MI > 8 octets!\n");
+		return 0;
+	}
+	return 1 + 1 + 1 + 4 + (pag->identity_lv[0]<<3) + 2 + 1;
+}
+
 struct msgb *gprs_rlcmac_pdch::packet_paging_request()
 {
-	struct gprs_rlcmac_paging *pag;
+	struct gprs_rlcmac_paging *pag, *pag2;
 	RlcMacDownlink_t *mac_control_block;
 	bitvec *pag_vec;
 	struct msgb *msg;
@@ -183,62 +293,42 @@ struct msgb *gprs_rlcmac_pdch::packet_paging_request()
 	int rc;
 
 	/* no paging, no message */
-	pag = dequeue_paging();
-	if (!pag)
+	if (llist_empty(&paging_list))
 		return NULL;
 
 	LOGP(DRLCMAC, LOGL_DEBUG, "Scheduling paging\n");
 
 	/* alloc message */
 	msg = msgb_alloc(23, "pag ctrl block");
-	if (!msg) {
-		talloc_free(pag);
+	if (!msg)
 		return NULL;
-	}
 	pag_vec = bitvec_alloc(23, tall_pcu_ctx);
 	if (!pag_vec) {
 		msgb_free(msg);
-		talloc_free(pag);
 		return NULL;
 	}
 	wp = Encoding::write_packet_paging_request(pag_vec);
 
-	/* loop until message is full */
-	while (pag) {
-		LOGP(DRLCMAC, LOGL_DEBUG, "Paging MI - %s\n",
-		     osmo_mi_name(pag->identity_lv + 1, pag->identity_lv[0]));
-
-		/* try to add paging */
-		if ((pag->identity_lv[1] & GSM_MI_TYPE_MASK) == GSM_MI_TYPE_TMSI) {
-			/* TMSI */
-			len = 1 + 1 + 1 + 32 + 2 + 1;
-			if (pag->identity_lv[0] != 5) {
-				LOGP(DRLCMAC, LOGL_ERROR, "TMSI paging with "
-					"MI != 5 octets!\n");
-				goto continue_next;
-			}
-		} else {
-			/* MI */
-			len = 1 + 1 + 1 + 4 + (pag->identity_lv[0]<<3) + 2 + 1;
-			if (pag->identity_lv[0] > 8) {
-				LOGP(DRLCMAC, LOGL_ERROR, "Paging with "
-					"MI > 8 octets!\n");
-				goto continue_next;
-			}
-		}
-		if (wp + len > 184) {
+	/* Fill the block in queue order. The first record that does not fit
+	 * anymore stays at the head of the queue for the next block. */
+	llist_for_each_entry_safe(pag, pag2, &paging_list, list) {
+		len = paging_record_len(pag);
+		if (len && wp + len > 184) {
 			LOGP(DRLCMAC, LOGL_DEBUG, "- Does not fit, so schedule "
 				"next time\n");
-			/* put back paging record, because does not fit */
-			llist_add_tail(&pag->list, &paging_list);
 			break;
 		}
-		Encoding::write_repeated_page_info(pag_vec, wp, pag->identity_lv[0],
-			pag->identity_lv + 1, pag->chan_needed);
 
-continue_next:
+		if (len) {
+			LOGP(DRLCMAC, LOGL_DEBUG, "Paging MI - %s\n",
+			     osmo_mi_name(pag->identity_lv + 1, pag->identity_lv[0]));
+			Encoding::write_repeated_page_info(pag_vec, wp, pag->identity_lv[0],
+				pag->identity_lv + 1, pag->chan_needed);
+		}
+
+		llist_del(&pag->list);
+		num_paging -= 1;
 		talloc_free(pag);
-		pag = dequeue_paging();
 	}
 
 	bitvec_pack(pag_vec, msgb_put(msg, 23));
@@ -261,19 +351,37 @@ free_ret:
 	return NULL;
 }
 
-bool gprs_rlcmac_pdch::add_paging(uint8_t chan_needed, const uint8_t *mi, uint8_t mi_len)
+/* Queue a paging record. Returns -EEXIST if the MI is already queued and
+ * -ENOSPC if the queue is full. */
+int gprs_rlcmac_pdch::add_paging(uint8_t chan_needed, const uint8_t *mi, uint8_t mi_len)
 {
-	struct gprs_rlcmac_paging *pag = talloc_zero(tall_pcu_ctx, struct gprs_rlcmac_paging);
+	struct gprs_rlcmac_paging *pag;
+
+	if (mi_len > sizeof(pag->identity_lv) - 1)
+		return -EINVAL;
+
+	llist_for_each_entry(pag, &paging_list, list) {
+		if (pag->identity_lv[0] == mi_len
+		    && memcmp(&pag->identity_lv[1], mi, mi_len) == 0)
+			return -EEXIST;
+	}
+
+	if (bts_data()->paging_queue_depth
+	    && num_paging >= bts_data()->paging_queue_depth)
+		return -ENOSPC;
+
+	pag = talloc_zero(tall_pcu_ctx, struct gprs_rlcmac_paging);
 	if (!pag)
-		return false;
+		return -ENOMEM;
 
 	pag->chan_needed = chan_needed;
 	pag->identity_lv[0] = mi_len;
 	memcpy(&pag->identity_lv[1], mi, mi_len);
 
-	llist_add(&pag->list, &paging_list);
+	llist_add_tail(&pag->list, &paging_list);
+	num_paging += 1;
 
-	return true;
+	return 0;
 }
 
 void gprs_rlcmac_pdch::rcv_control_ack(Packet_Control_Acknowledgement_t *packet, uint32_t fn)
@@ -350,6 +458,7 @@ void gprs_rlcmac_pdch::rcv_control_ack(Packet_Control_Acknowledgement_t *packet,
 		if (new_tbf->check_n_clear(GPRS_RLCMAC_FLAG_TO_DL_ASS))
 			LOGPTBF(new_tbf, LOGL_NOTICE, "Recovered downlink assignment\n");
 
+		as_dl_tbf(new_tbf)->rebalance_acked();
 		tbf_assign_control_ts(new_tbf);
 		return;
 	}
@@ -686,6 +795,21 @@ void gprs_rlcmac_pdch::rcv_measurement_report(Packet_Measurement_Report_t *repor
 	gprs_rlcmac_meas_rep(report);
 }
 
+/* An idle extended UL TBF answers its USF with dummy blocks while the MS
+ * has nothing to send, these keep the TBF from timing out. */
+void gprs_rlcmac_pdch::rcv_uplink_dummy(Packet_Uplink_Dummy_Control_Block_t *dummy, uint32_t fn)
+{
+	GprsMs *ms = bts()->ms_by_tlli(dummy->TLLI);
+	gprs_rlcmac_ul_tbf *ul_tbf = ms ? ms->ul_tbf() : NULL;
+
+	if (!ul_tbf || !ul_tbf->ext_idle())
+		return;
+
+	LOGPTBFUL(ul_tbf, LOGL_DEBUG, "Uplink dummy block at FN=%u, still idle\n", fn);
+	ul_tbf->n_reset(N3101);
+	T_START_LAZY(ul_tbf, T3169, 3169, "acked (dummy)");
+}
+
 /* Received Uplink RLC control block. */
 int gprs_rlcmac_pdch::rcv_control_block(const uint8_t *data, uint8_t data_len,
 					uint32_t fn, struct pcu_l1_meas *meas, enum CodingScheme cs)
@@ -733,7 +857,7 @@ int gprs_rlcmac_pdch::rcv_control_block(const uint8_t *data, uint8_t data_len,
 		rcv_measurement_report(&ul_control_block->u.Packet_Measurement_Report, fn);
 		break;
 	case MT_PACKET_UPLINK_DUMMY_CONTROL_BLOCK:
-		/* ignoring it. change the SI to not force sending these? */
+		rcv_uplink_dummy(&ul_control_block->u.Packet_Uplink_Dummy_Control_Block, fn);
 		break;
 	default:
 		bts()->do_rate_ctr_inc(CTR_DECODE_ERRORS);
@@ -910,9 +1034,22 @@ gprs_rlcmac_tbf *gprs_rlcmac_pdch::tbf_by_tfi(uint8_t tfi,
 	return NULL;
 }
 
+static uint8_t tbf_slot_mask(const gprs_rlcmac_tbf *tbf)
+{
+	uint8_t mask = 0;
+	unsigned ts;
+
+	for (ts = 0; ts < 8; ts++) {
+		if (tbf->pdch[ts])
+			mask |= 1 << ts;
+	}
+	return mask;
+}
+
 void gprs_rlcmac_pdch::attach_tbf(gprs_rlcmac_tbf *tbf)
 {
 	gprs_rlcmac_ul_tbf *ul_tbf;
+	uint8_t slots = tbf_slot_mask(tbf) | (1 << ts_no);
 
 	if (m_tbfs[tbf->direction][tbf->tfi()])
 		LOGP(DRLCMAC, LOGL_ERROR, "PDCH(TS %d, TRX %d): "
@@ -927,6 +1064,10 @@ void gprs_rlcmac_pdch::attach_tbf(gprs_rlcmac_tbf *tbf)
 	}
 	m_assigned_tfi[tbf->direction] |= 1UL << tbf->tfi();
 	m_tbfs[tbf->direction][tbf->tfi()] = tbf;
+	update_ready(tbf);
+	trx->update_assigned_tfi(tbf->direction, tbf->tfi());
+	trx->update_pdch_masks(ts_no);
+	bts()->tbf_slots_changed(trx_no(), slots & ~(1 << ts_no), slots);
 
 	LOGP(DRLCMAC, LOGL_INFO, "PDCH(TS %d, TRX %d): Attaching %s, %d TBFs, "
 		"USFs = %02x, TFIs = %08x.\n",
@@ -937,6 +1078,7 @@ void gprs_rlcmac_pdch::attach_tbf(gprs_rlcmac_tbf *tbf)
 void gprs_rlcmac_pdch::detach_tbf(gprs_rlcmac_tbf *tbf)
 {
 	gprs_rlcmac_ul_tbf *ul_tbf;
+	uint8_t slots = tbf_slot_mask(tbf) | (1 << ts_no);
 
 	OSMO_ASSERT(m_num_tbfs[tbf->direction] > 0);
 
@@ -946,7 +1088,11 @@ void gprs_rlcmac_pdch::detach_tbf(gprs_rlcmac_tbf *tbf)
 		m_assigned_usf &= ~(1 << ul_tbf->m_usf[ts_no]);
 	}
 	m_assigned_tfi[tbf->direction] &= ~(1UL << tbf->tfi());
+	m_ready_tfi[tbf->direction] &= ~(1UL << tbf->tfi());
 	m_tbfs[tbf->direction][tbf->tfi()] = NULL;
+	trx->update_assigned_tfi(tbf->direction, tbf->tfi());
+	trx->update_pdch_masks(ts_no);
+	bts()->tbf_slots_changed(trx_no(), slots, slots & ~(1 << ts_no));
 
 	LOGP(DRLCMAC, LOGL_INFO, "PDCH(TS %d, TRX %d): Detaching %s, %d TBFs, "
 		"USFs = %02x, TFIs = %08x.\n",
@@ -954,6 +1100,34 @@ void gprs_rlcmac_pdch::detach_tbf(gprs_rlcmac_tbf *tbf)
 		m_assigned_usf, m_assigned_tfi[tbf->direction]);
 }
 
+/* Whether the scheduler has to consider the TBF at all: DL TBFs in FLOW or
+ * FINISHED that do not wait for the IMM.ASS confirmation on CCCH, UL TBFs
+ * in FLOW. Which block to send is still decided at the RTS. */
+static bool tbf_is_ready(const gprs_rlcmac_tbf *tbf)
+{
+	if (tbf->direction == GPRS_RLCMAC_UL_TBF)
+		return tbf->state_is(GPRS_RLCMAC_FLOW);
+
+	if (static_cast<const gprs_rlcmac_dl_tbf *>(tbf)->m_wait_confirm)
+		return false;
+	return tbf->state_is(GPRS_RLCMAC_FLOW) ||
+		tbf->state_is(GPRS_RLCMAC_FINISHED);
+}
+
+/* Called by the TBF whenever its state or m_wait_confirm changes */
+void gprs_rlcmac_pdch::update_ready(gprs_rlcmac_tbf *tbf)
+{
+	uint32_t bit = 1UL << tbf->tfi();
+
+	if (m_tbfs[tbf->direction][tbf->tfi()] != tbf)
+		return;
+
+	if (tbf_is_ready(tbf))
+		m_ready_tfi[tbf->direction] |= bit;
+	else
+		m_ready_tfi[tbf->direction] &= ~bit;
+}
+
 void gprs_rlcmac_pdch::reserve(enum gprs_rlcmac_tbf_direction dir)
 {
 	m_num_reserved[dir] += 1;
@@ -40,6 +40,63 @@ extern "C" {
 #define PTCCH_TAI_NUM		16	/*!< Number of PTCCH/U slots and thus TA Indexes */
 #define PTCCH_PADDING		0x2b	/*!< PTCCH/D messages need to be padded to 23 octets */
 
+/* Number of slots of the per-PDCH SBA table, indexed by block number */
+#define PDCH_SBA_TBL_SIZE	16
+
+/* Number of slots of the per-PDCH uplink block reservation table, indexed
+ * by block number. Polls are placed at most 6 blocks (RRBP 3) ahead. */
+#define PDCH_UL_RSV_TBL_SIZE	8
+
+/* Who an uplink block has been given to, single block allocations are kept
+ * in the SBA table */
+enum pdch_ul_rsv_kind {
+	PDCH_UL_RSV_NONE,
+	PDCH_UL_RSV_POLL,	/* control block polled with RRBP */
+	PDCH_UL_RSV_USF,	/* data block granted by USF */
+};
+
+struct gprs_rlcmac_pdch_ul_rsv {
+	uint32_t fn;
+	uint8_t kind; /* enum pdch_ul_rsv_kind */
+};
+
+/* Number of RTS after which the per-PDCH stat items are updated */
+#define PDCH_STATS_WINDOW	256
+
+/* What an RTS was answered with, in order of scheduling priority */
+enum pdch_rts_kind {
+	PDCH_RTS_CTRL,
+	PDCH_RTS_DATA,
+	PDCH_RTS_DUMMY,
+	_PDCH_RTS_NUM
+};
+
+/* Per-PDCH stat items, the RTS ratios in the order of pdch_rts_kind */
+enum {
+	PDCH_STAT_RTS_CTRL,
+	PDCH_STAT_RTS_DATA,
+	PDCH_STAT_RTS_DUMMY,
+	PDCH_STAT_USF_GRANTED,
+	PDCH_STAT_UL_RESERVED,
+	PDCH_STAT_TBF_UL,
+	PDCH_STAT_TBF_DL,
+};
+
+struct gprs_rlcmac_pdch_stats {
+	/* counted since the PDCH was enabled */
+	uint64_t rts[_PDCH_RTS_NUM]; /* RTS answered, by kind */
+	uint64_t usf_granted; /* UL blocks given to a TBF by USF */
+	uint64_t ul_reserved; /* UL blocks reserved for polls and SBAs */
+
+	/* the counters above at the start of the current window */
+	uint64_t win_rts[_PDCH_RTS_NUM];
+	uint64_t win_usf_granted;
+	uint64_t win_ul_reserved;
+	uint16_t win_len; /* RTS in the current window */
+
+	struct osmo_stat_item_group *statg;
+};
+
 /*
  * PDCH instance
  */
@@ -48,11 +105,12 @@ struct gprs_rlcmac_pdch {
 	struct gprs_rlcmac_paging *dequeue_paging();
 	struct msgb *packet_paging_request();
 
-	bool add_paging(uint8_t chan_needed, const uint8_t *mi, uint8_t mi_len);
+	int add_paging(uint8_t chan_needed, const uint8_t *mi, uint8_t mi_len);
 
 	void free_resources();
 
 	bool is_enabled() const;
+	bool is_draining() const;
 
 	void enable();
 	void disable();
@@ -74,6 +132,8 @@ struct gprs_rlcmac_pdch {
 
 	void attach_tbf(gprs_rlcmac_tbf *tbf);
 	void detach_tbf(gprs_rlcmac_tbf *tbf);
+	void update_ready(gprs_rlcmac_tbf *tbf);
+	uint32_t ready_tfi(enum gprs_rlcmac_tbf_direction dir) const;
 
 	unsigned num_tbfs(enum gprs_rlcmac_tbf_direction dir) const;
 
@@ -83,16 +143,37 @@ struct gprs_rlcmac_pdch {
 
 	uint8_t assigned_usf() const;
 	uint32_t assigned_tfi(enum gprs_rlcmac_tbf_direction dir) const;
+
+	bool ul_block_free(uint32_t fn) const;
+	void reserve_ul_block(uint32_t fn, enum pdch_ul_rsv_kind kind);
+	void release_ul_block(uint32_t fn);
+
+	void count_rts(enum pdch_rts_kind kind, bool usf_granted,
+		bool ul_reserved, uint32_t fn);
+	void free_stats();
 #endif
 
 	uint8_t m_is_enabled; /* TS is enabled */
+	uint8_t m_is_draining; /* TS is to be released, no new TBFs */
 	uint8_t tsc; /* TSC of this slot */
 	uint8_t next_ul_tfi; /* next uplink TBF/TFI to schedule (0..31) */
 	uint8_t next_dl_tfi; /* next downlink TBF/TFI to schedule (0..31) */
 	uint8_t next_ctrl_prio; /* next kind of ctrl message to schedule */
 	struct llist_head paging_list; /* list of paging messages */
+	uint8_t num_paging; /* number of entries in paging_list */
 	uint32_t last_rts_fn; /* store last frame number of RTS */
 
+	/* single block allocations pending on this PDCH */
+	struct gprs_rlcmac_sba *sba_tbl[PDCH_SBA_TBL_SIZE];
+	uint8_t num_sba; /* number of pending single block allocations */
+	uint32_t sba_allocated; /* single block allocations placed here */
+
+	/* uplink blocks given away by polls and USF over the RRBP horizon */
+	struct gprs_rlcmac_pdch_ul_rsv ul_rsv_tbl[PDCH_UL_RSV_TBL_SIZE];
+
+	/* utilisation of the RTS on this PDCH */
+	struct gprs_rlcmac_pdch_stats stats;
+
 	/* PTCCH (Packet Timing Advance Control Channel) */
 	uint8_t ptcch_msg[GSM_MACBLOCK_LEN]; /* 'ready to use' PTCCH/D message */
 #ifdef __cplusplus
@@ -120,17 +201,22 @@ private:
 	void rcv_control_egprs_dl_ack_nack(EGPRS_PD_AckNack_t *, uint32_t fn, struct pcu_l1_meas *meas);
 	void rcv_resource_request(Packet_Resource_Request_t *t, uint32_t fn, struct pcu_l1_meas *meas);
 	void rcv_measurement_report(Packet_Measurement_Report_t *t, uint32_t fn);
+	void rcv_uplink_dummy(Packet_Uplink_Dummy_Control_Block_t *t, uint32_t fn);
 	gprs_rlcmac_tbf *tbf_from_list_by_tfi(
 		LListHead<gprs_rlcmac_tbf> *tbf_list, uint8_t tfi,
 		enum gprs_rlcmac_tbf_direction dir);
 	gprs_rlcmac_tbf *tbf_by_tfi(uint8_t tfi,
 		enum gprs_rlcmac_tbf_direction dir);
+	void publish_stats(uint32_t fn);
 #endif
 
 	uint8_t m_num_tbfs[2];
 	uint8_t m_num_reserved[2];
 	uint8_t m_assigned_usf; /* bit set */
 	uint32_t m_assigned_tfi[2]; /* bit set */
+	/* TFIs the scheduler has to look at, updated by the TBFs: DL TBFs
+	 * that may send data blocks, UL TBFs that may get a USF */
+	uint32_t m_ready_tfi[2]; /* bit set */
 	struct gprs_rlcmac_tbf *m_tbfs[2][32];
 };
 
@@ -158,9 +244,72 @@ inline uint32_t gprs_rlcmac_pdch::assigned_tfi(
 	return m_assigned_tfi[dir];
 }
 
+inline uint32_t gprs_rlcmac_pdch::ready_tfi(
+	enum gprs_rlcmac_tbf_direction dir) const
+{
+	return m_ready_tfi[dir];
+}
+
+/* Rotate a TFI bit set so that bit 0 is the TFI start, the scheduler walks
+ * the set bits from its round robin cursor with __builtin_ffs() on the result */
+inline uint32_t pdch_tfi_rotate(uint32_t tfis, uint8_t start)
+{
+	start &= 31;
+	if (!start)
+		return tfis;
+	return (tfis >> start) | (tfis << (32 - start));
+}
+
+/* Block number of a frame number, counting the 12 radio blocks of every
+ * 52-multiframe. Frames 12, 25, 38 and 51 are idle/PTCCH frames. */
+inline unsigned pdch_fn2bn(uint32_t fn)
+{
+	unsigned fn52 = fn % 52;
+
+	return (fn / 52) * 12 + (fn52 - fn52 / 13) / 4;
+}
+
+inline void gprs_rlcmac_pdch::reserve_ul_block(uint32_t fn,
+	enum pdch_ul_rsv_kind kind)
+{
+	struct gprs_rlcmac_pdch_ul_rsv *rsv =
+		&ul_rsv_tbl[pdch_fn2bn(fn) % PDCH_UL_RSV_TBL_SIZE];
+
+	rsv->fn = fn;
+	rsv->kind = kind;
+}
+
+inline void gprs_rlcmac_pdch::release_ul_block(uint32_t fn)
+{
+	struct gprs_rlcmac_pdch_ul_rsv *rsv =
+		&ul_rsv_tbl[pdch_fn2bn(fn) % PDCH_UL_RSV_TBL_SIZE];
+
+	/* the slot may have been taken over by a later block already */
+	if (rsv->fn == fn)
+		rsv->kind = PDCH_UL_RSV_NONE;
+}
+
 inline bool gprs_rlcmac_pdch::is_enabled() const
 {
 	return m_is_enabled;
 }
 
+inline bool gprs_rlcmac_pdch::is_draining() const
+{
+	return m_is_draining;
+}
+
+/* Called for every RTS answered, kept cheap: the ratios are only computed
+ * once per PDCH_STATS_WINDOW RTS */
+inline void gprs_rlcmac_pdch::count_rts(enum pdch_rts_kind kind,
+	bool usf_granted, bool ul_reserved, uint32_t fn)
+{
+	stats.rts[kind] += 1;
+	stats.usf_granted += usf_granted;
+	stats.ul_reserved += ul_reserved;
+
+	if (++stats.win_len >= PDCH_STATS_WINDOW)
+		publish_stats(fn);
+}
+
 #endif /* __cplusplus */
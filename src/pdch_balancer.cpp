@@ -0,0 +1,179 @@
+/* pdch_balancer.cpp
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include <pdch_balancer.h>
+#include <bts.h>
+#include <tbf.h>
+#include <tbf_dl.h>
+#include <gprs_debug.h>
+#include <gprs_rlcmac.h>
+#include <pcu_utils.h>
+
+extern "C" {
+#include <osmocom/core/logging.h>
+#include <osmocom/core/utils.h>
+}
+
+#include <limits.h>
+
+PdchBalancer::PdchBalancer(BTS &bts)
+	: m_bts(bts)
+	, m_last_fn(-1)
+{
+}
+
+void PdchBalancer::tick(uint32_t fn)
+{
+	struct gprs_rlcmac_bts *bts_data = m_bts.bts_data();
+	uint32_t elapsed = (fn + GSM_MAX_FN - m_last_fn) % GSM_MAX_FN;
+
+	if (!bts_data->rebalance_interval)
+		return;
+
+	if (m_last_fn >= 0 &&
+	    elapsed < (uint32_t)msecs_to_frames(bts_data->rebalance_interval * 1000))
+		return;
+	m_last_fn = fn;
+
+	rebalance(fn);
+}
+
+unsigned PdchBalancer::rebalance(uint32_t fn)
+{
+	struct gprs_rlcmac_bts *bts_data = m_bts.bts_data();
+	unsigned trx_no, moved = 0;
+
+	for (trx_no = 0; trx_no < ARRAY_SIZE(bts_data->trx); trx_no++)
+		moved += rebalance_trx(&bts_data->trx[trx_no], fn);
+
+	return moved;
+}
+
+/* Only a TBF that is busy and not in the middle of anything else, whose MS
+ * has its PACCH on the first common TS, and that was not moved recently */
+bool PdchBalancer::may_move(const gprs_rlcmac_dl_tbf *tbf, uint32_t fn) const
+{
+	const struct gprs_rlcmac_bts *bts_data = m_bts.bts_data();
+	uint32_t hold = msecs_to_frames(bts_data->rebalance_interval * 1000) *
+		PDCH_BALANCER_HOLD_INTERVALS;
+
+	if (!tbf->state_is(GPRS_RLCMAC_FLOW) || !tbf->have_data() || !tbf->ms())
+		return false;
+
+	if (!tbf->dl_ass_state_is(GPRS_RLCMAC_DL_ASS_NONE)
+	    || !tbf->ul_ass_state_is(GPRS_RLCMAC_UL_ASS_NONE)
+	    || tbf->poll_scheduled())
+		return false;
+
+	if (tbf->control_ts != tbf->first_common_ts)
+		return false;
+
+	if (tbf->m_last_rebalance_fn >= 0 &&
+	    (fn + GSM_MAX_FN - tbf->m_last_rebalance_fn) % GSM_MAX_FN < hold)
+		return false;
+
+	return true;
+}
+
+bool PdchBalancer::rebalance_trx(struct gprs_rlcmac_trx *trx, uint32_t fn)
+{
+	struct gprs_rlcmac_bts *bts_data = m_bts.bts_data();
+	LListHead<gprs_rlcmac_tbf> *pos;
+	gprs_rlcmac_dl_tbf *tbf, *best = NULL;
+	unsigned load[8] = { 0 }, other[8];
+	unsigned ts, max_load = 0, min_load = UINT_MAX;
+	unsigned cur, best_cur = 0, best_gain = 0;
+	uint8_t slots, ul_slots, dl_slots, best_ul = 0, best_dl = 0;
+	int share;
+
+	/* active DL TBFs per PDCH */
+	llist_for_each(pos, &m_bts.dl_tbfs()) {
+		tbf = as_dl_tbf(pos->entry());
+		if (tbf->trx != trx || !tbf->have_data())
+			continue;
+		if (!tbf->state_is(GPRS_RLCMAC_FLOW) && !tbf->state_is(GPRS_RLCMAC_ASSIGN))
+			continue;
+
+		slots = tbf->dl_slots();
+		for (ts = 0; ts < 8; ts++)
+			load[ts] += !!(slots & (1 << ts));
+	}
+
+	for (ts = 0; ts < 8; ts++) {
+		if (!trx->pdch[ts].is_enabled())
+			continue;
+		max_load = OSMO_MAX(max_load, load[ts]);
+		min_load = OSMO_MIN(min_load, load[ts]);
+	}
+
+	if (min_load == UINT_MAX || max_load < min_load + 2)
+		return false;
+
+	llist_for_each(pos, &m_bts.dl_tbfs()) {
+		tbf = as_dl_tbf(pos->entry());
+		if (tbf->trx != trx || !may_move(tbf, fn))
+			continue;
+
+		slots = tbf->dl_slots();
+		for (ts = 0; ts < 8; ts++)
+			other[ts] = load[ts] - !!(slots & (1 << ts));
+
+		cur = dl_slots_share(other, slots);
+		dl_slots = 0;
+		share = find_rebalance_slots(trx, tbf->ms_class(), tbf->first_common_ts,
+					     other, &ul_slots, &dl_slots);
+		if (share < 0 || dl_slots == slots)
+			continue;
+
+		/* a reassignment stops the TBF for a poll round trip, only
+		 * move it if that is clearly worth it */
+		if ((unsigned)share * 100 < cur * (100 + bts_data->rebalance_min_gain))
+			continue;
+
+		if ((unsigned)share - cur <= best_gain)
+			continue;
+
+		best = tbf;
+		best_cur = cur;
+		best_gain = share - cur;
+		best_ul = ul_slots;
+		best_dl = dl_slots;
+	}
+
+	if (!best)
+		return false;
+
+	slots = best->dl_slots();
+	LOGPTBFDL(best, LOGL_INFO, "Rebalancing DL slots %02x -> %02x, "
+		  "share of the PDCHs %u -> %u/840\n",
+		  slots, best_dl, best_cur, best_cur + best_gain);
+
+	/* The TBF stays on its slots until the MS acked the assignment, see
+	 * gprs_rlcmac_dl_tbf::rebalance_acked(). The window may grow with
+	 * the slots but never shrink. It is announced in the assignment, no
+	 * new blocks are sent until the ack. */
+	best->m_rebalance_ul_slots = best_ul;
+	best->m_rebalance_dl_slots = best_dl;
+	if (best->is_egprs_enabled() && pcu_bitcount(best_dl) > pcu_bitcount(slots))
+		best->set_window_size();
+
+	best->m_last_rebalance_fn = fn;
+	best->trigger_ass(best);
+	m_bts.do_rate_ctr_inc(CTR_TBF_REBALANCED);
+
+	return true;
+}
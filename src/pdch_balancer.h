@@ -0,0 +1,56 @@
+/* pdch_balancer.h
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+#pragma once
+
+#include <stdint.h>
+
+struct BTS;
+struct gprs_rlcmac_trx;
+struct gprs_rlcmac_dl_tbf;
+
+/* A moved TBF stays where it is for this many rebalance intervals */
+#define PDCH_BALANCER_HOLD_INTERVALS	4
+
+/**
+ * I move long lived DL TBFs to PDCHs that became less loaded since they
+ * were allocated. Every rebalance interval I look at the active DL TBFs
+ * per PDCH of each TRX. If the most and the least loaded PDCH differ by
+ * two TBFs or more, I move the one TBF of that TRX whose share of the
+ * PDCHs grows the most, by at least the minimum gain, within the
+ * multislot class of its MS. The MS is told with a Packet Downlink
+ * Assignment on its PACCH, like after the upgrade to multislot. The TBF
+ * keeps its old slots until the MS acked the assignment.
+ */
+class PdchBalancer {
+public:
+	PdchBalancer(BTS &bts);
+
+	void tick(uint32_t fn);
+	/* one pass over all TRX, returns the number of TBFs moved */
+	unsigned rebalance(uint32_t fn);
+
+private:
+	bool rebalance_trx(struct gprs_rlcmac_trx *trx, uint32_t fn);
+	bool may_move(const gprs_rlcmac_dl_tbf *tbf, uint32_t fn) const;
+
+	BTS &m_bts;
+	int32_t m_last_fn;
+
+	/* disable copying to avoid slicing */
+	PdchBalancer(const PdchBalancer&);
+	PdchBalancer& operator=(const PdchBalancer&);
+};
@@ -0,0 +1,374 @@
+/* pdch_pool.cpp
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include <pdch_pool.h>
+#include <bts.h>
+#include <pdch.h>
+#include <gprs_debug.h>
+#include <pcu_l1_if.h>
+#include <pcu_utils.h>
+
+extern "C" {
+#include "mslot_class.h"
+#include <osmocom/core/logging.h>
+#include <osmocom/core/rate_ctr.h>
+#include <osmocom/core/utils.h>
+}
+
+#include <string.h>
+
+PdchPool::PdchPool(BTS &bts)
+	: m_bts(bts)
+	, m_last_fn(-1)
+	, m_idle_intervals(0)
+	, m_draining(0)
+	, m_last_failed(0)
+{
+	memset(m_state, 0, sizeof(m_state));
+	memset(m_state_fn, 0, sizeof(m_state_fn));
+	memset(m_last_rts, 0, sizeof(m_last_rts));
+	memset(m_last_dummy, 0, sizeof(m_last_dummy));
+	memset(m_last_usf, 0, sizeof(m_last_usf));
+}
+
+void PdchPool::tick(uint32_t fn)
+{
+	struct gprs_rlcmac_bts *bts_data = m_bts.bts_data();
+	uint32_t elapsed = (fn + GSM_MAX_FN - m_last_fn) % GSM_MAX_FN;
+
+	if (!bts_data->dyn_pdch_max) {
+		/* switched off, keep what we have */
+		if (m_draining)
+			stop_draining(true);
+		m_last_fn = -1;
+		return;
+	}
+
+	if (m_draining)
+		release_drained(fn);
+
+	if (m_last_fn >= 0 &&
+	    elapsed < (uint32_t)msecs_to_frames(PDCH_POOL_INTERVAL_MS))
+		return;
+	m_last_fn = fn;
+
+	evaluate(fn);
+}
+
+void PdchPool::evaluate(uint32_t fn)
+{
+	struct gprs_rlcmac_bts *bts_data = m_bts.bts_data();
+	struct rate_ctr_group *ctrs = m_bts.rate_counters();
+	struct gprs_rlcmac_trx *trx;
+	struct gprs_rlcmac_pdch *pdch;
+	uint64_t rts, dummy, usf, failed, total = 0, busy = 0;
+	unsigned trx_no, ts, i, active = 0, pending = 0, usable = 0, load;
+	bool exhausted = true, pressure;
+
+	expire(fn);
+
+	for (trx_no = 0; trx_no < ARRAY_SIZE(bts_data->trx); trx_no++) {
+		trx = &bts_data->trx[trx_no];
+		for (ts = 0; ts < ARRAY_SIZE(trx->pdch); ts++) {
+			pdch = &trx->pdch[ts];
+			if (m_state[trx_no][ts] == PDCH_POOL_TS_ACTIVATING)
+				pending += 1;
+			if (!pdch->is_enabled())
+				continue;
+
+			for (i = 0, rts = 0; i < _PDCH_RTS_NUM; i++)
+				rts += pdch->stats.rts[i];
+			dummy = pdch->stats.rts[PDCH_RTS_DUMMY];
+			usf = pdch->stats.usf_granted;
+			/* the counters restart when the PDCH is enabled */
+			if (rts < m_last_rts[trx_no][ts]) {
+				m_last_rts[trx_no][ts] = 0;
+				m_last_dummy[trx_no][ts] = 0;
+				m_last_usf[trx_no][ts] = 0;
+			}
+			rts -= m_last_rts[trx_no][ts];
+			dummy -= m_last_dummy[trx_no][ts];
+			usf -= m_last_usf[trx_no][ts];
+			m_last_rts[trx_no][ts] += rts;
+			m_last_dummy[trx_no][ts] += dummy;
+			m_last_usf[trx_no][ts] += usf;
+
+			if (pdch->is_draining())
+				continue;
+
+			usable += 1;
+			total += rts;
+			/* busy in either direction */
+			busy += OSMO_MAX(rts - dummy, usf);
+			if (trx->dyn_pdch_mask & (1 << ts))
+				active += 1;
+
+			if (pdch->assigned_tfi(GPRS_RLCMAC_UL_TBF) != NO_FREE_TFI
+			    && pdch->assigned_tfi(GPRS_RLCMAC_DL_TBF) != NO_FREE_TFI
+			    && find_free_usf(pdch->assigned_usf()) >= 0)
+				exhausted = false;
+		}
+	}
+
+	failed = ctrs->ctr[CTR_TBF_ALLOC_FAILED].current +
+		ctrs->ctr[CTR_IMMEDIATE_ASSIGN_REJ].current;
+	load = total ? busy * 100 / total : 0;
+	pressure = exhausted || failed != m_last_failed ||
+		load >= bts_data->dyn_pdch_load_high;
+	m_last_failed = failed;
+
+	if (active + pending < bts_data->dyn_pdch_min ||
+	    (pressure && active + pending < bts_data->dyn_pdch_max)) {
+		m_idle_intervals = 0;
+		/* a PDCH we are about to give back is the cheapest one */
+		if (m_draining && stop_draining(false))
+			return;
+		/* one activation at a time, unless below the minimum */
+		if (!pending || active + pending < bts_data->dyn_pdch_min)
+			activate(fn);
+		return;
+	}
+
+	if (active > bts_data->dyn_pdch_max) {
+		drain(usable);
+		return;
+	}
+
+	if (pressure || load >= bts_data->dyn_pdch_load_low ||
+	    active <= bts_data->dyn_pdch_min || m_draining) {
+		m_idle_intervals = 0;
+		return;
+	}
+
+	if (++m_idle_intervals < PDCH_POOL_IDLE_INTERVALS)
+		return;
+	m_idle_intervals = 0;
+
+	LOGP(DRLCMAC, LOGL_INFO, "PDCH load %u%% for %u s, releasing a "
+		"dynamic PDCH\n", load,
+		PDCH_POOL_IDLE_INTERVALS * PDCH_POOL_INTERVAL_MS / 1000);
+	drain(usable);
+}
+
+/* Ask for a dynamic TS, preferably next to a PDCH of the same TRX so that
+ * it is of use for multislot MS */
+bool PdchPool::activate(uint32_t fn)
+{
+	struct gprs_rlcmac_bts *bts_data = m_bts.bts_data();
+	struct gprs_rlcmac_trx *trx;
+	unsigned trx_no, ts;
+	int best_trx = -1, best_ts = -1;
+	bool best_near = false;
+	uint8_t free_ts, near;
+
+	for (trx_no = 0; trx_no < ARRAY_SIZE(bts_data->trx); trx_no++) {
+		trx = &bts_data->trx[trx_no];
+		free_ts = trx->dyn_pdch_mask & ~trx->pdch_mask;
+		if (!free_ts)
+			continue;
+
+		near = (trx->pdch_mask << 1) | (trx->pdch_mask >> 1);
+		for (ts = 0; ts < ARRAY_SIZE(trx->pdch); ts++) {
+			if (!(free_ts & (1 << ts)) ||
+			    m_state[trx_no][ts] != PDCH_POOL_TS_IDLE)
+				continue;
+
+			if (best_trx < 0 || (!best_near && (near & (1 << ts)))) {
+				best_trx = trx_no;
+				best_ts = ts;
+				best_near = near & (1 << ts);
+			}
+		}
+	}
+
+	if (best_trx < 0)
+		return false;
+
+	LOGP(DRLCMAC, LOGL_INFO, "Asking for dynamic PDCH trx=%d ts=%d\n",
+		best_trx, best_ts);
+	m_state[best_trx][best_ts] = PDCH_POOL_TS_ACTIVATING;
+	m_state_fn[best_trx][best_ts] = fn;
+	pcu_tx_act_req(best_trx, best_ts, 1);
+
+	return true;
+}
+
+/* Stop allocating on the least used dynamic PDCH, but never on the last
+ * PDCH of the BTS */
+bool PdchPool::drain(unsigned usable)
+{
+	struct gprs_rlcmac_bts *bts_data = m_bts.bts_data();
+	struct gprs_rlcmac_trx *trx;
+	struct gprs_rlcmac_pdch *pdch, *best = NULL;
+	unsigned trx_no, ts, tbfs, best_tbfs = 0;
+
+	if (usable <= 1)
+		return false;
+
+	for (trx_no = 0; trx_no < ARRAY_SIZE(bts_data->trx); trx_no++) {
+		trx = &bts_data->trx[trx_no];
+		for (ts = 0; ts < ARRAY_SIZE(trx->pdch); ts++) {
+			pdch = &trx->pdch[ts];
+			if (!(trx->dyn_pdch_mask & (1 << ts)) ||
+			    !pdch->is_enabled() || pdch->is_draining())
+				continue;
+
+			tbfs = pdch->num_tbfs(GPRS_RLCMAC_UL_TBF) +
+				pdch->num_tbfs(GPRS_RLCMAC_DL_TBF);
+			if (!best || tbfs <= best_tbfs) {
+				best = pdch;
+				best_tbfs = tbfs;
+			}
+		}
+	}
+
+	if (!best)
+		return false;
+
+	LOGP(DRLCMAC, LOGL_INFO, "Draining dynamic PDCH trx=%d ts=%d, %u TBFs "
+		"left\n", best->trx_no(), best->ts_no, best_tbfs);
+	best->m_is_draining = 1;
+	best->trx->update_pdch_masks(best->ts_no);
+	m_draining += 1;
+
+	return true;
+}
+
+/* Use a draining PDCH again, or all of them */
+bool PdchPool::stop_draining(bool all)
+{
+	struct gprs_rlcmac_bts *bts_data = m_bts.bts_data();
+	struct gprs_rlcmac_pdch *pdch;
+	unsigned trx_no, ts;
+	bool stopped = false;
+
+	for (trx_no = 0; trx_no < ARRAY_SIZE(bts_data->trx); trx_no++) {
+		for (ts = 0; ts < ARRAY_SIZE(bts_data->trx[0].pdch); ts++) {
+			pdch = &bts_data->trx[trx_no].pdch[ts];
+			if (!pdch->is_draining())
+				continue;
+
+			LOGP(DRLCMAC, LOGL_INFO, "Keeping dynamic PDCH trx=%d "
+				"ts=%d\n", trx_no, ts);
+			pdch->m_is_draining = 0;
+			pdch->trx->update_pdch_masks(ts);
+			m_draining -= 1;
+			stopped = true;
+			if (!all)
+				return true;
+		}
+	}
+
+	m_draining = 0;
+	return stopped;
+}
+
+/* Give the drained PDCHs back to the BTS, but only those it still lists
+ * as dynamic */
+void PdchPool::release_drained(uint32_t fn)
+{
+	struct gprs_rlcmac_bts *bts_data = m_bts.bts_data();
+	struct gprs_rlcmac_trx *trx;
+	struct gprs_rlcmac_pdch *pdch;
+	unsigned trx_no, ts, draining = 0;
+
+	for (trx_no = 0; trx_no < ARRAY_SIZE(bts_data->trx); trx_no++) {
+		trx = &bts_data->trx[trx_no];
+		for (ts = 0; ts < ARRAY_SIZE(trx->pdch); ts++) {
+			pdch = &trx->pdch[ts];
+			if (!pdch->is_draining())
+				continue;
+
+			if (!(trx->dyn_pdch_mask & (1 << ts))) {
+				LOGP(DRLCMAC, LOGL_INFO, "Keeping PDCH trx=%d ts=%d, "
+					"it is no dynamic TS anymore\n", trx_no, ts);
+				pdch->m_is_draining = 0;
+				trx->update_pdch_masks(ts);
+				continue;
+			}
+
+			if (pdch->num_tbfs(GPRS_RLCMAC_UL_TBF) ||
+			    pdch->num_tbfs(GPRS_RLCMAC_DL_TBF) || pdch->num_sba) {
+				draining += 1;
+				continue;
+			}
+
+			LOGP(DRLCMAC, LOGL_INFO, "Releasing dynamic PDCH trx=%d "
+				"ts=%d\n", trx_no, ts);
+			m_state[trx_no][ts] = PDCH_POOL_TS_RELEASING;
+			m_state_fn[trx_no][ts] = fn;
+			pcu_tx_act_req(trx_no, ts, 0);
+			pdch->free_resources();
+			pdch->disable();
+			m_bts.do_rate_ctr_inc(CTR_PDCH_DYN_RELEASED);
+		}
+	}
+
+	/* the BTS may have taken some of them away meanwhile */
+	m_draining = draining;
+}
+
+/* Forget requests the BTS never answered */
+void PdchPool::expire(uint32_t fn)
+{
+	uint32_t timeout = msecs_to_frames(PDCH_POOL_ANSWER_TIMEOUT_MS);
+	unsigned trx_no, ts;
+
+	for (trx_no = 0; trx_no < 8; trx_no++) {
+		for (ts = 0; ts < 8; ts++) {
+			if (m_state[trx_no][ts] == PDCH_POOL_TS_IDLE ||
+			    (fn + GSM_MAX_FN - m_state_fn[trx_no][ts]) % GSM_MAX_FN < timeout)
+				continue;
+
+			LOGP(DRLCMAC, LOGL_NOTICE, "BTS did not %s PDCH trx=%d "
+				"ts=%d\n", m_state[trx_no][ts] == PDCH_POOL_TS_ACTIVATING ?
+				"activate" : "release", trx_no, ts);
+			m_state[trx_no][ts] = PDCH_POOL_TS_IDLE;
+		}
+	}
+}
+
+void PdchPool::info_ind(uint8_t trx_no, uint8_t ts, bool pdch)
+{
+	switch (m_state[trx_no][ts]) {
+	case PDCH_POOL_TS_ACTIVATING:
+		if (!pdch)
+			return;
+		LOGP(DRLCMAC, LOGL_INFO, "Dynamic PDCH trx=%d ts=%d activated\n",
+			trx_no, ts);
+		m_bts.do_rate_ctr_inc(CTR_PDCH_DYN_ACTIVATED);
+		break;
+	case PDCH_POOL_TS_RELEASING:
+		if (pdch)
+			return;
+		break;
+	default:
+		return;
+	}
+
+	m_state[trx_no][ts] = PDCH_POOL_TS_IDLE;
+}
+
+bool PdchPool::activation_pending(uint8_t trx_no, uint8_t ts) const
+{
+	return m_state[trx_no][ts] == PDCH_POOL_TS_ACTIVATING;
+}
+
+bool PdchPool::release_pending(uint8_t trx_no, uint8_t ts) const
+{
+	return m_state[trx_no][ts] == PDCH_POOL_TS_RELEASING;
+}
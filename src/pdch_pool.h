@@ -0,0 +1,81 @@
+/* pdch_pool.h
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+#pragma once
+
+#include <stdint.h>
+
+struct BTS;
+
+/* How often the load is looked at */
+#define PDCH_POOL_INTERVAL_MS		1000
+/* Intervals of low load before a dynamic PDCH is given back */
+#define PDCH_POOL_IDLE_INTERVALS	10
+/* How long the BTS may take to answer an activation or release */
+#define PDCH_POOL_ANSWER_TIMEOUT_MS	5000
+
+enum pdch_pool_ts_state {
+	PDCH_POOL_TS_IDLE,
+	PDCH_POOL_TS_ACTIVATING,	/* asked the BTS for the PDCH */
+	PDCH_POOL_TS_RELEASING,		/* gave the PDCH back to the BTS */
+};
+
+/**
+ * I ask the BTS for the dynamic TS of its INFO.ind as PDCH when the PDCHs
+ * are busy, when TBFs cannot be allocated or when the TFIs or USFs run
+ * out, and give them back after the load stayed low for a while. A PDCH
+ * to be given back is drained first: the allocator skips it and I release
+ * it once its last TBF is gone. I keep the number of dynamic PDCHs
+ * between the configured minimum and maximum, and do nothing while the
+ * maximum is 0.
+ */
+class PdchPool {
+public:
+	PdchPool(BTS &bts);
+
+	void tick(uint32_t fn);
+	/* one look at the load, see tick() */
+	void evaluate(uint32_t fn);
+
+	/* the INFO.ind said whether the TS is a PDCH now */
+	void info_ind(uint8_t trx_no, uint8_t ts, bool pdch);
+	bool activation_pending(uint8_t trx_no, uint8_t ts) const;
+	bool release_pending(uint8_t trx_no, uint8_t ts) const;
+
+private:
+	bool activate(uint32_t fn);
+	bool drain(unsigned usable);
+	bool stop_draining(bool all);
+	void release_drained(uint32_t fn);
+	void expire(uint32_t fn);
+
+	BTS &m_bts;
+	int32_t m_last_fn;
+	unsigned m_idle_intervals;
+	unsigned m_draining;
+	uint64_t m_last_failed;
+
+	uint8_t m_state[8][8]; /* enum pdch_pool_ts_state */
+	uint32_t m_state_fn[8][8];
+	/* RTS counters of the PDCHs at the last evaluation */
+	uint64_t m_last_rts[8][8];
+	uint64_t m_last_dummy[8][8];
+	uint64_t m_last_usf[8][8];
+
+	/* disable copying to avoid slicing */
+	PdchPool(const PdchPool&);
+	PdchPool& operator=(const PdchPool&);
+};
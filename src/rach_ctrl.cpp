@@ -0,0 +1,365 @@
+/* rach_ctrl.cpp
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include <rach_ctrl.h>
+#include <bts.h>
+#include <tbf.h>
+#include <tbf_ul.h>
+#include <encoding.h>
+#include <gprs_debug.h>
+#include <gprs_ms.h>
+#include <pcu_l1_if.h>
+
+extern "C" {
+#include <osmocom/core/bitvec.h>
+#include <osmocom/core/logging.h>
+#include <osmocom/core/utils.h>
+#include <osmocom/gsm/gsm_utils.h>
+}
+
+#include <errno.h>
+#include <string.h>
+
+/* duration of a TDMA frame in us (120 ms / 26) */
+#define FRAME_US		4615
+/* bucket credit of one request */
+#define RACH_CREDIT		1000000U
+
+/* Resources allocated for a channel request */
+struct rach_alloc {
+	struct gprs_rlcmac_ul_tbf *tbf;
+	uint8_t trx_no;
+	uint8_t ts_no;
+	uint32_t sb_fn;
+	uint8_t usf;
+	uint8_t tsc;
+};
+
+RachController::RachController(BTS &bts)
+	: m_bts(bts)
+	, m_head(0)
+	, m_tail(0)
+	, m_num_rej(0)
+{
+	unsigned i;
+
+	/* RR Immediate Assignment [Reject] without plen */
+	memset(&m_bv, 0, sizeof(m_bv));
+	m_bv.data = m_bv_data;
+	m_bv.data_len = sizeof(m_bv_data);
+
+	memset(m_queue, 0, sizeof(m_queue));
+	for (i = 0; i < ARRAY_SIZE(m_buckets); i++) {
+		m_buckets[i].credit = 0;
+		m_buckets[i].last_fn = -1;
+	}
+}
+
+struct bitvec *RachController::agch_bv()
+{
+	m_bv.cur_bit = 0;
+	bitvec_unhex(&m_bv, "2b2b2b2b2b2b2b2b2b2b2b2b2b2b2b2b2b2b2b2b2b2b");
+	return &m_bv;
+}
+
+/* Frames since the access burst, RACH.ind slightly ahead count as 0 */
+static unsigned rach_age(uint32_t fn, uint32_t rach_fn)
+{
+	unsigned age = (fn + GSM_MAX_FN - rach_fn) % GSM_MAX_FN;
+
+	return age > GSM_MAX_FN / 2 ? 0 : age;
+}
+
+void RachController::refill(uint32_t fn)
+{
+	const struct rach_bucket_params *params = m_bts.bts_data()->rach_buckets;
+	unsigned i;
+
+	for (i = 0; i < ARRAY_SIZE(m_buckets); i++) {
+		struct rach_bucket *b = &m_buckets[i];
+		uint32_t max = params[i].depth * RACH_CREDIT;
+		uint64_t credit;
+
+		if (!params[i].rate) {
+			b->last_fn = -1;
+			continue;
+		}
+
+		/* a bucket starts full */
+		if (b->last_fn < 0) {
+			credit = max;
+		} else {
+			credit = b->credit + (uint64_t)rach_age(fn, b->last_fn) *
+				params[i].rate * FRAME_US;
+		}
+
+		b->credit = OSMO_MIN(credit, (uint64_t)max);
+		b->last_fn = fn;
+	}
+}
+
+/* Take a token from the cell bucket and the one of the request's access
+ * type, if both have one */
+bool RachController::admit(const struct rach_req *req, uint32_t fn)
+{
+	const struct rach_bucket_params *params = m_bts.bts_data()->rach_buckets;
+	enum rach_bucket_id id = req->single_block ?
+		RACH_BUCKET_SIGNALLING : RACH_BUCKET_ONE_PHASE;
+
+	refill(fn);
+
+	if (params[RACH_BUCKET_CELL].rate &&
+	    m_buckets[RACH_BUCKET_CELL].credit < RACH_CREDIT)
+		return false;
+	if (params[id].rate && m_buckets[id].credit < RACH_CREDIT)
+		return false;
+
+	if (params[RACH_BUCKET_CELL].rate)
+		m_buckets[RACH_BUCKET_CELL].credit -= RACH_CREDIT;
+	if (params[id].rate)
+		m_buckets[id].credit -= RACH_CREDIT;
+
+	return true;
+}
+
+int RachController::assign(const struct rach_req *req, struct rach_alloc *alloc)
+{
+	struct gprs_rlcmac_bts *bts = m_bts.bts_data();
+	int rc;
+
+	alloc->tbf = NULL;
+	alloc->sb_fn = 0;
+	alloc->usf = 7;
+	alloc->tsc = 0;
+
+	/* Should we allocate a single block or an Uplink TBF? */
+	if (req->single_block) {
+		rc = m_bts.sba()->alloc(&alloc->trx_no, &alloc->ts_no,
+			&alloc->sb_fn, req->ta);
+		if (rc < 0) {
+			LOGP(DRLCMAC, LOGL_NOTICE, "No PDCH resource for "
+			     "single block allocation: rc=%d\n", rc);
+			return rc;
+		}
+
+		alloc->tsc = bts->trx[alloc->trx_no].pdch[alloc->ts_no].tsc;
+		LOGP(DRLCMAC, LOGL_DEBUG, "Allocated a single block at "
+		     "SBFn=%u TRX=%u TS=%u\n", alloc->sb_fn, alloc->trx_no,
+		     alloc->ts_no);
+	} else {
+		GprsMs *ms = m_bts.ms_alloc(0, req->egprs_mslot_class);
+		struct gprs_rlcmac_ul_tbf *tbf = tbf_alloc_ul_tbf(bts, ms, -1, true);
+
+		if (!tbf) {
+			LOGP(DRLCMAC, LOGL_NOTICE, "No PDCH resource for Uplink TBF\n");
+			return -EBUSY;
+		}
+
+		/* FIXME: Copy and paste with other routines.. */
+		tbf->set_ta(req->ta);
+		TBF_SET_STATE(tbf, GPRS_RLCMAC_FLOW);
+		TBF_ASS_TYPE_SET(tbf, GPRS_RLCMAC_FLAG_CCCH);
+		T_START(tbf, T3169, 3169, "RACH (new UL-TBF)", true);
+		alloc->tbf = tbf;
+		alloc->trx_no = tbf->trx->trx_no;
+		alloc->ts_no = tbf->first_ts;
+		alloc->usf = tbf->m_usf[alloc->ts_no];
+		alloc->tsc = tbf->tsc();
+	}
+
+	return 0;
+}
+
+int RachController::send_assignment(const struct rach_req *req,
+	const struct rach_alloc *alloc)
+{
+	struct gprs_rlcmac_bts *bts = m_bts.bts_data();
+	struct bitvec *bv = agch_bv();
+	int plen;
+
+	LOGP(DRLCMAC, LOGL_DEBUG, "Tx Immediate Assignment on AGCH: "
+	     "TRX=%u (ARFCN %u) TS=%u TA=%u TSC=%u TFI=%d USF=%d\n",
+	     alloc->trx_no, bts->trx[alloc->trx_no].arfcn & ~ARFCN_FLAG_MASK,
+	     alloc->ts_no, req->ta, alloc->tsc,
+	     alloc->tbf ? alloc->tbf->tfi() : -1, alloc->usf);
+	plen = Encoding::write_immediate_assignment(
+		alloc->tbf, bv, false, req->ra, req->fn, req->ta,
+		bts->trx[alloc->trx_no].arfcn, alloc->ts_no, alloc->tsc,
+		alloc->usf, false, alloc->sb_fn, bts->alpha, bts->gamma, -1,
+		req->burst_type);
+	m_bts.do_rate_ctr_inc(CTR_IMMEDIATE_ASSIGN_UL_TBF);
+
+	if (plen < 0)
+		return plen;
+
+	pcu_l1if_tx_agch(bv, plen);
+	return 0;
+}
+
+void RachController::reject(const struct rach_req *req)
+{
+	struct imm_ass_rej_ref *ref = &m_rej[m_num_rej++];
+
+	ref->ra = req->ra;
+	ref->fn = req->fn;
+	ref->burst_type = req->burst_type;
+
+	if (m_num_rej == ARRAY_SIZE(m_rej))
+		send_rejects();
+}
+
+/* One RR Immediate Assignment Reject for all pending rejects */
+int RachController::send_rejects()
+{
+	struct bitvec *bv;
+	unsigned num = m_num_rej;
+	int plen;
+
+	if (!num)
+		return 0;
+	m_num_rej = 0;
+
+	bv = agch_bv();
+	if (num == 1)
+		LOGP(DRLCMAC, LOGL_DEBUG, "Tx Immediate Assignment Reject on AGCH\n");
+	else
+		LOGP(DRLCMAC, LOGL_DEBUG, "Tx Immediate Assignment Reject on AGCH "
+		     "for %u requests\n", num);
+	plen = Encoding::write_immediate_assignment_reject(bv, m_rej, num,
+		m_bts.bts_data()->rach_wait_ind);
+	m_bts.do_rate_ctr_add(CTR_IMMEDIATE_ASSIGN_REJ, num);
+
+	if (plen < 0)
+		return plen;
+
+	pcu_l1if_tx_agch(bv, plen);
+	return 0;
+}
+
+/* Handle a parsed channel request, right away or from the next flush() */
+int RachController::rcv(const struct rach_req *req)
+{
+	struct rach_alloc alloc;
+	unsigned i;
+	int rc, plen;
+
+	if (!m_bts.bts_data()->rach_queue_budget) {
+		rc = req->rc;
+		if (!rc && !admit(req, m_bts.current_frame_number())) {
+			LOGP(DRLCMAC, LOGL_INFO, "RACH ra=0x%02x Fn=%u not admitted\n",
+			     req->ra, req->fn);
+			m_bts.do_rate_ctr_inc(CTR_RACH_THROTTLED);
+			rc = -EBUSY;
+		}
+
+		if (!rc) {
+			rc = assign(req, &alloc);
+			if (!rc)
+				return send_assignment(req, &alloc);
+		}
+
+		/* Send RR Immediate Assignment Reject */
+		reject(req);
+		plen = send_rejects();
+		return plen < 0 ? plen : rc;
+	}
+
+	/* the same access burst received twice, e.g. on two TRX */
+	for (i = m_tail; i != m_head; i++) {
+		const struct rach_req *queued = &m_queue[i % RACH_QUEUE_SIZE];
+
+		if (queued->ra == req->ra && queued->is_11bit == req->is_11bit &&
+		    queued->fn == req->fn) {
+			LOGP(DRLCMAC, LOGL_DEBUG, "RACH ra=0x%02x Fn=%u is queued "
+			     "already\n", req->ra, req->fn);
+			m_bts.do_rate_ctr_inc(CTR_RACH_DUPLICATE);
+			return 0;
+		}
+	}
+
+	if (queued() >= RACH_QUEUE_SIZE) {
+		LOGP(DRLCMAC, LOGL_NOTICE, "RACH queue full, dropping ra=0x%02x "
+		     "Fn=%u\n", req->ra, req->fn);
+		m_bts.do_rate_ctr_inc(CTR_RACH_DROPPED);
+		return -ENOSPC;
+	}
+
+	m_queue[m_head % RACH_QUEUE_SIZE] = *req;
+	m_head += 1;
+	m_bts.do_rate_ctr_inc(CTR_RACH_QUEUED);
+
+	return 0;
+}
+
+/* Handle at most rach_queue_budget queued requests, called once per TDMA
+ * frame. Requests that do not get a token, or that need a resource of a
+ * kind that could not be allocated earlier in this frame, are rejected
+ * without trying. Returns the number of requests handled. */
+unsigned RachController::flush(uint32_t fn)
+{
+	unsigned budget = m_bts.bts_data()->rach_queue_budget;
+	bool tbf_failed = false, sba_failed = false;
+	unsigned handled = 0;
+
+	/* handle whatever is left if the queue has just been disabled */
+	if (!budget)
+		budget = RACH_QUEUE_SIZE;
+
+	while (handled < budget && queued()) {
+		const struct rach_req *req = &m_queue[m_tail % RACH_QUEUE_SIZE];
+		bool *failed = req->single_block ? &sba_failed : &tbf_failed;
+		struct rach_alloc alloc;
+		int rc = req->rc;
+
+		m_tail += 1;
+
+		if (rach_age(fn, req->fn) > RACH_QUEUE_MAX_AGE) {
+			LOGP(DRLCMAC, LOGL_INFO, "RACH ra=0x%02x Fn=%u queued "
+			     "for too long, dropping\n", req->ra, req->fn);
+			m_bts.do_rate_ctr_inc(CTR_RACH_DROPPED);
+			continue;
+		}
+		handled += 1;
+
+		if (!rc && !admit(req, fn)) {
+			m_bts.do_rate_ctr_inc(CTR_RACH_THROTTLED);
+			rc = -EBUSY;
+		} else if (!rc && *failed) {
+			m_bts.do_rate_ctr_inc(CTR_RACH_EARLY_REJECTED);
+			rc = -EBUSY;
+		} else if (!rc) {
+			rc = assign(req, &alloc);
+			if (!rc)
+				send_assignment(req, &alloc);
+			else
+				*failed = true;
+		}
+
+		if (rc)
+			reject(req);
+	}
+
+	send_rejects();
+
+	return handled;
+}
+
+void RachController::clear()
+{
+	m_tail = m_head;
+	m_num_rej = 0;
+}
@@ -0,0 +1,126 @@
+/* rach_ctrl.h
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#include <osmocom/core/bitvec.h>
+#include <osmocom/gsm/l1sap.h>
+}
+
+#include "encoding.h"
+#endif
+
+/* Number of RACH.ind that can be queued while the RACH queue is enabled
+ * (see rach_queue_budget) */
+#define RACH_QUEUE_SIZE		64
+
+/* Queued RACH.ind older than this (in frames) are dropped, the MS has
+ * sent its next access burst long ago and only accepts an assignment for
+ * one of its last three requests */
+#define RACH_QUEUE_MAX_AGE	204
+
+/* Token buckets of the RACH admission control */
+enum rach_bucket_id {
+	RACH_BUCKET_CELL,		/* every admitted request */
+	RACH_BUCKET_SIGNALLING,		/* single block and two phase access */
+	RACH_BUCKET_ONE_PHASE,		/* one phase access (UL TBF) */
+	_RACH_BUCKET_NUM
+};
+
+struct rach_bucket_params {
+	uint16_t rate;			/* requests per second, 0 = unlimited */
+	uint16_t depth;			/* requests admitted in a burst */
+};
+
+#ifdef __cplusplus
+struct BTS;
+struct rach_alloc;
+
+/* A parsed [EGPRS Packet] Channel Request waiting for resources */
+struct rach_req {
+	uint16_t ra;
+	bool is_11bit;
+	enum ph_burst_type burst_type;
+	uint32_t fn;			/* full frame number of the access burst */
+	uint8_t ta;
+	bool single_block;
+	uint8_t egprs_mslot_class;
+	int rc;				/* parsing result, != 0 is rejected */
+};
+
+struct rach_bucket {
+	uint32_t credit;		/* in 1/1000000 requests */
+	int32_t last_fn;		/* -1 = not refilled yet */
+};
+
+/**
+ * I decide which channel requests get resources. Without a queue budget
+ * I handle each RACH.ind right away. With one I queue them, drop
+ * duplicates and handle at most the budget per TDMA frame, rejecting
+ * early what the token buckets do not admit or what cannot be allocated
+ * in this frame anyway. The Immediate Assignment Rejects of a frame are
+ * grouped, up to four requests per message.
+ */
+class RachController {
+public:
+	RachController(BTS &bts);
+
+	int rcv(const struct rach_req *req);
+	unsigned flush(uint32_t fn);
+	unsigned queued() const;
+	void clear();
+
+private:
+	struct bitvec *agch_bv();
+	bool admit(const struct rach_req *req, uint32_t fn);
+	void refill(uint32_t fn);
+	int assign(const struct rach_req *req, struct rach_alloc *alloc);
+	int send_assignment(const struct rach_req *req,
+		const struct rach_alloc *alloc);
+	void reject(const struct rach_req *req);
+	int send_rejects();
+
+	BTS &m_bts;
+
+	/* RR Immediate Assignment [Reject] being encoded */
+	struct bitvec m_bv;
+	uint8_t m_bv_data[22];
+
+	struct rach_req m_queue[RACH_QUEUE_SIZE];
+	unsigned m_head;
+	unsigned m_tail;
+
+	struct rach_bucket m_buckets[_RACH_BUCKET_NUM];
+
+	/* rejects of the current frame, not sent yet */
+	struct imm_ass_rej_ref m_rej[4];
+	unsigned m_num_rej;
+
+	/* RACH controllers are not copied */
+	RachController(const RachController&);
+	RachController& operator=(const RachController&);
+};
+
+inline unsigned RachController::queued() const
+{
+	return m_head - m_tail;
+}
+#endif
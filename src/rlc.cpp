@@ -314,12 +314,85 @@ bool gprs_rlc_ul_window::invalidate_bsn(const uint16_t bsn)
 	return was_valid;
 }
 
+/* The layouts and the padding of a CPS only depend on the coding scheme,
+ * so they are taken from mcs_info[] once instead of for every block */
+static struct gprs_rlc_layout rlc_layouts[NUM_SCHEMES][2][2];
+/* CPS fields have at most 5 bits */
+static uint8_t rlc_cps_padding[NUM_SCHEMES][32];
+static bool rlc_layouts_ready;
+
+static void gprs_rlc_layout_init(struct gprs_rlc_layout *layout,
+	enum CodingScheme cs, bool ul, bool with_padding)
+{
+	enum HeaderType ht = mcs_header_type(cs);
+	unsigned int padding_bits = with_padding ? mcs_opt_padding_bits(cs) : 0;
+	unsigned int header_bits = ul ? num_data_header_bits_UL(ht) :
+		num_data_header_bits_DL(ht);
+	unsigned int i;
+
+	layout->header_type = ht;
+	layout->num_data_blocks = num_data_blocks(ht);
+	layout->data_bytes = mcs_max_data_block_bytes(cs);
+	layout->data_len = mcs_max_data_block_bytes(cs);
+	if (with_padding)
+		layout->data_len -= mcs_opt_padding_bits(cs) / 8;
+
+	OSMO_ASSERT(layout->num_data_blocks <= ARRAY_SIZE(layout->data_offs_bits));
+
+	for (i = 0; i < layout->num_data_blocks; i++)
+		layout->data_offs_bits[i] =
+			header_bits + padding_bits +
+			(i+1) * num_data_block_header_bits(ht) +
+			i * 8 * layout->data_len;
+}
+
+/* Filled on first use, static constructors of other units may already
+ * set up RLC blocks */
+static void gprs_rlc_layouts_init(void)
+{
+	unsigned int cs, ul, with_padding, cps;
+	int punct, punct2, padding;
+
+	for (cs = 0; cs < NUM_SCHEMES; cs++) {
+		for (ul = 0; ul < 2; ul++)
+			for (with_padding = 0; with_padding < 2; with_padding++)
+				gprs_rlc_layout_init(&rlc_layouts[cs][ul][with_padding],
+					(enum CodingScheme) cs, ul, with_padding);
+
+		for (cps = 0; cps < ARRAY_SIZE(rlc_cps_padding[cs]); cps++) {
+			gprs_rlc_mcs_cps_decode(cps, (enum CodingScheme) cs,
+				&punct, &punct2, &padding);
+			rlc_cps_padding[cs][cps] = padding;
+		}
+	}
+
+	rlc_layouts_ready = true;
+}
+
+const struct gprs_rlc_layout *gprs_rlc_layout(enum CodingScheme cs, bool ul,
+	bool with_padding)
+{
+	if (!rlc_layouts_ready)
+		gprs_rlc_layouts_init();
+
+	return &rlc_layouts[cs][ul][with_padding];
+}
+
+/* The with_padding of gprs_rlc_mcs_cps_decode() */
+bool gprs_rlc_mcs_cps_padding(unsigned int cps, enum CodingScheme cs)
+{
+	if (!rlc_layouts_ready)
+		gprs_rlc_layouts_init();
+
+	return rlc_cps_padding[cs][cps & 0x1f];
+}
+
 static void gprs_rlc_data_header_init(struct gprs_rlc_data_info *rlc,
-	enum CodingScheme cs, bool with_padding, unsigned int header_bits,
+	enum CodingScheme cs, bool with_padding, bool ul,
 	const unsigned int spb)
 {
+	const struct gprs_rlc_layout *layout = gprs_rlc_layout(cs, ul, with_padding);
 	unsigned int i;
-	unsigned int padding_bits = with_padding ? mcs_opt_padding_bits(cs) : 0;
 
 	rlc->cs = cs;
 	rlc->r = 0;
@@ -331,27 +404,28 @@ static void gprs_rlc_data_header_init(struct gprs_rlc_data_info *rlc,
 	rlc->es_p = 0;
 	rlc->rrbp = 0;
 	rlc->pr = 0;
-	rlc->num_data_blocks = num_data_blocks(mcs_header_type(cs));
+	rlc->num_data_blocks = layout->num_data_blocks;
 	rlc->with_padding = with_padding;
 
-	OSMO_ASSERT(rlc->num_data_blocks <= ARRAY_SIZE(rlc->block_info));
-
 	for (i = 0; i < rlc->num_data_blocks; i++) {
-		gprs_rlc_data_block_info_init(&rlc->block_info[i], cs,
-			with_padding, spb);
+		struct gprs_rlc_data_block_info *rdbi = &rlc->block_info[i];
 
-		rlc->data_offs_bits[i] =
-			header_bits + padding_bits +
-			(i+1) * num_data_block_header_bits(mcs_header_type(cs)) +
-			i * 8 * rlc->block_info[0].data_len;
+		rdbi->data_len = layout->data_len;
+		rdbi->bsn = 0;
+		rdbi->ti  = 0;
+		rdbi->e   = 1;
+		rdbi->cv  = 15;
+		rdbi->pi  = 0;
+		rdbi->spb = spb;
+
+		rlc->data_offs_bits[i] = layout->data_offs_bits[i];
 	}
 }
 
 void gprs_rlc_data_info_init_dl(struct gprs_rlc_data_info *rlc,
 	enum CodingScheme cs, bool with_padding, const unsigned int spb)
 {
-	return gprs_rlc_data_header_init(rlc, cs, with_padding,
-					 num_data_header_bits_DL(mcs_header_type(cs)), spb);
+	return gprs_rlc_data_header_init(rlc, cs, with_padding, false, spb);
 }
 
 void gprs_rlc_data_info_init_ul(struct gprs_rlc_data_info *rlc,
@@ -361,18 +435,13 @@ void gprs_rlc_data_info_init_ul(struct gprs_rlc_data_info *rlc,
 	 * last parameter is sent as 0 since common function used
 	 * for both DL and UL
 	 */
-	return gprs_rlc_data_header_init(rlc, cs, with_padding,
-					 num_data_header_bits_UL(mcs_header_type(cs)), 0);
+	return gprs_rlc_data_header_init(rlc, cs, with_padding, true, 0);
 }
 
 void gprs_rlc_data_block_info_init(struct gprs_rlc_data_block_info *rdbi,
 	enum CodingScheme cs, bool with_padding, const unsigned int spb)
 {
-	unsigned int data_len = mcs_max_data_block_bytes(cs);
-	if (with_padding)
-		data_len -= mcs_opt_padding_bits(cs) / 8;
-
-	rdbi->data_len = data_len;
+	rdbi->data_len = gprs_rlc_layout(cs, false, with_padding)->data_len;
 	rdbi->bsn = 0;
 	rdbi->ti  = 0;
 	rdbi->e   = 1;
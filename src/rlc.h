@@ -213,6 +213,19 @@ struct gprs_rlc_data {
 
 uint8_t *prepare(struct gprs_rlc_data *rlc, size_t block_data_length);
 
+/* Where the data blocks of a coding scheme are, per direction and with or
+ * without the optional padding. See gprs_rlc_layout(). */
+struct gprs_rlc_layout {
+	enum HeaderType header_type;
+	uint8_t num_data_blocks;
+	uint8_t data_bytes;	/* mcs_max_data_block_bytes() */
+	uint8_t data_len;	/* without the padding */
+	uint16_t data_offs_bits[2];
+};
+
+const struct gprs_rlc_layout *gprs_rlc_layout(enum CodingScheme cs, bool ul,
+	bool with_padding);
+
 void gprs_rlc_data_info_init_dl(struct gprs_rlc_data_info *rlc,
 	enum CodingScheme cs, bool with_padding, const unsigned int spb);
 void gprs_rlc_data_info_init_ul(struct gprs_rlc_data_info *rlc,
@@ -223,6 +236,7 @@ unsigned int gprs_rlc_mcs_cps(enum CodingScheme cs, enum egprs_puncturing_values
 	punct, enum egprs_puncturing_values punct2, bool with_padding);
 void gprs_rlc_mcs_cps_decode(unsigned int cps, enum CodingScheme cs,
 	int *punct, int *punct2, int *with_padding);
+bool gprs_rlc_mcs_cps_padding(unsigned int cps, enum CodingScheme cs);
 enum egprs_puncturing_values gprs_get_punct_scheme(enum egprs_puncturing_values
 	punct, const enum CodingScheme &cs,
 	const enum CodingScheme &cs_current_trans,
@@ -46,69 +46,106 @@ SBAController::SBAController(BTS &bts)
 	INIT_LLIST_HEAD(&m_sbas);
 }
 
-int SBAController::alloc(
-		uint8_t *_trx, uint8_t *_ts, uint32_t *_fn, uint8_t ta)
+/* First frame number of the radio block following the one at fn */
+static inline uint32_t next_block_fn(uint32_t fn)
 {
+	fn = next_fn(fn, 4);
+	if (fn % 13 == 12)
+		fn = next_fn(fn, 1);
+	return fn;
+}
 
-	struct gprs_rlcmac_pdch *pdch;
-	struct gprs_rlcmac_sba *sba;
-	int8_t trx, ts;
-	uint32_t fn;
-
-	if (!gsm48_ta_is_valid(ta))
-		return -EINVAL;
+static inline struct gprs_rlcmac_sba **sba_slot(struct gprs_rlcmac_pdch *pdch,
+	uint32_t fn)
+{
+	return &pdch->sba_tbl[pdch_fn2bn(fn) % PDCH_SBA_TBL_SIZE];
+}
 
-	sba = talloc_zero(tall_pcu_ctx, struct gprs_rlcmac_sba);
-	if (!sba)
-		return -ENOMEM;
+/* Find the enabled PDCH with the fewest uplink TBFs and pending single
+ * blocks. On a tie the highest TS of the lowest TRX wins, which keeps
+ * the placement of an idle cell unchanged. */
+struct gprs_rlcmac_pdch *SBAController::least_loaded_pdch()
+{
+	struct gprs_rlcmac_pdch *pdch, *best = NULL;
+	unsigned load, best_load = 0;
+	int8_t trx, ts;
 
 	for (trx = 0; trx < 8; trx++) {
 		for (ts = 7; ts >= 0; ts--) {
 			pdch = &m_bts.bts_data()->trx[trx].pdch[ts];
-			if (!pdch->is_enabled())
+			if (!pdch->is_enabled() || pdch->is_draining())
 				continue;
-			break;
+
+			load = pdch->num_tbfs(GPRS_RLCMAC_UL_TBF) + pdch->num_sba;
+			if (!best || load < best_load) {
+				best = pdch;
+				best_load = load;
+			}
 		}
-		if (ts >= 0)
-			break;
 	}
-	if (trx == 8) {
+
+	return best;
+}
+
+int SBAController::alloc(
+		uint8_t *_trx, uint8_t *_ts, uint32_t *_fn, uint8_t ta)
+{
+
+	struct gprs_rlcmac_pdch *pdch;
+	struct gprs_rlcmac_sba *sba, **slot;
+	uint32_t fn;
+
+	if (!gsm48_ta_is_valid(ta))
+		return -EINVAL;
+
+	pdch = least_loaded_pdch();
+	if (!pdch) {
 		LOGP(DRLCMAC, LOGL_NOTICE, "No PDCH available.\n");
-		talloc_free(sba);
 		return -EINVAL;
 	}
 
+	sba = talloc_zero(tall_pcu_ctx, struct gprs_rlcmac_sba);
+	if (!sba)
+		return -ENOMEM;
+
+	/* don't let two MS send their single block at the same time */
 	fn = next_fn(pdch->last_rts_fn, AGCH_START_OFFSET);
+	while (find(pdch, fn))
+		fn = next_block_fn(fn);
 
-	sba->trx_no = trx;
-	sba->ts_no = ts;
+	sba->trx_no = pdch->trx_no();
+	sba->ts_no = pdch->ts_no;
 	sba->fn = fn;
 	sba->ta = ta;
 
 	llist_add(&sba->list, &m_sbas);
+	slot = sba_slot(pdch, fn);
+	sba->next_in_slot = *slot;
+	*slot = sba;
+	pdch->num_sba += 1;
+	pdch->sba_allocated += 1;
 	m_bts.do_rate_ctr_inc(CTR_SBA_ALLOCATED);
 
-	*_trx = trx;
-	*_ts = ts;
+	*_trx = sba->trx_no;
+	*_ts = sba->ts_no;
 	*_fn = fn;
 	return 0;
 }
 
 gprs_rlcmac_sba *SBAController::find(uint8_t trx, uint8_t ts, uint32_t fn)
 {
-	struct gprs_rlcmac_sba *sba;
-
-	llist_for_each_entry(sba, &m_sbas, list) {
-		if (sba->trx_no == trx && sba->ts_no == ts && sba->fn == fn)
-			return sba;
-	}
-
-	return NULL;
+	return find(&m_bts.bts_data()->trx[trx].pdch[ts], fn);
 }
 
 gprs_rlcmac_sba *SBAController::find(const gprs_rlcmac_pdch *pdch, uint32_t fn)
 {
-	return find(pdch->trx_no(), pdch->ts_no, fn);
+	struct gprs_rlcmac_sba *sba;
+
+	sba = pdch->sba_tbl[pdch_fn2bn(fn) % PDCH_SBA_TBL_SIZE];
+	while (sba && sba->fn != fn)
+		sba = sba->next_in_slot;
+
+	return sba;
 }
 
 uint32_t SBAController::sched(uint8_t trx, uint8_t ts, uint32_t fn, uint8_t block_nr)
@@ -139,6 +176,14 @@ int SBAController::timeout(struct gprs_rlcmac_sba *sba)
 
 void SBAController::free_sba(gprs_rlcmac_sba *sba)
 {
+	struct gprs_rlcmac_pdch *pdch = &m_bts.bts_data()->trx[sba->trx_no].pdch[sba->ts_no];
+	struct gprs_rlcmac_sba **slot = sba_slot(pdch, sba->fn);
+
+	while (*slot != sba)
+		slot = &(*slot)->next_in_slot;
+	*slot = sba->next_in_slot;
+	pdch->num_sba -= 1;
+
 	m_bts.do_rate_ctr_inc(CTR_SBA_FREED);
 	llist_del(&sba->list);
 	talloc_free(sba);
@@ -146,12 +191,10 @@ void SBAController::free_sba(gprs_rlcmac_sba *sba)
 
 void SBAController::free_resources(struct gprs_rlcmac_pdch *pdch)
 {
-	struct gprs_rlcmac_sba *sba, *sba2;
-	const uint8_t trx_no = pdch->trx->trx_no;
-	const uint8_t ts_no = pdch->ts_no;
+	unsigned i;
 
-	llist_for_each_entry_safe(sba, sba2, &m_sbas, list) {
-		if (sba->trx_no == trx_no && sba->ts_no == ts_no)
-			free_sba(sba);
+	for (i = 0; i < ARRAY_SIZE(pdch->sba_tbl); i++) {
+		while (pdch->sba_tbl[i])
+			free_sba(pdch->sba_tbl[i]);
 	}
 }
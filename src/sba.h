@@ -38,6 +38,8 @@ struct gprs_rlcmac_sba {
 	uint8_t ts_no;
 	uint32_t fn;
 	uint8_t ta;
+	/* next entry in the same slot of the PDCH's SBA table */
+	struct gprs_rlcmac_sba *next_in_slot;
 };
 
 /**
@@ -62,6 +64,8 @@ public:
 	void free_sba(gprs_rlcmac_sba *sba);
 
 private:
+	struct gprs_rlcmac_pdch *least_loaded_pdch();
+
 	BTS &m_bts;
 	llist_head m_sbas;
 };
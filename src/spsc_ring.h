@@ -0,0 +1,112 @@
+/* spsc_ring.h
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SPSC_RING_CACHELINE 64
+
+/**
+ * I am a bounded ring of N fixed size slots with exactly one producer and
+ * one consumer. Slots are filled and drained in place, so handing over an
+ * element never allocates.
+ *
+ * The producer only ever writes m_head and the consumer only ever writes
+ * m_tail. Each side publishes its index with release semantics after it is
+ * done with the slot, so the ring may be shared between two threads
+ * without a lock. N must be a power of two.
+ */
+template <typename T, unsigned N>
+class SpscRing {
+public:
+	SpscRing() : m_head(0), m_tail(0) {}
+
+	/* producer: slot to fill in, or NULL if the ring is full */
+	T *reserve();
+	/* producer: publish the slot returned by reserve() */
+	void commit();
+
+	/* consumer: oldest filled slot, or NULL if the ring is empty */
+	T *peek();
+	/* consumer: release the slot returned by peek() */
+	void consume();
+
+	unsigned size() const;
+	bool empty() const;
+	static unsigned capacity() { return N; }
+
+private:
+	/* fails to compile unless N is a power of two */
+	typedef char n_is_power_of_two[(N && !(N & (N - 1))) ? 1 : -1];
+
+	unsigned m_head;
+	char m_pad_head[SPSC_RING_CACHELINE - sizeof(unsigned)];
+	unsigned m_tail;
+	char m_pad_tail[SPSC_RING_CACHELINE - sizeof(unsigned)];
+	T m_slots[N];
+};
+
+template <typename T, unsigned N>
+inline T *SpscRing<T, N>::reserve()
+{
+	unsigned head = __atomic_load_n(&m_head, __ATOMIC_RELAXED);
+	unsigned tail = __atomic_load_n(&m_tail, __ATOMIC_ACQUIRE);
+
+	if (head - tail >= N)
+		return NULL;
+	return &m_slots[head & (N - 1)];
+}
+
+template <typename T, unsigned N>
+inline void SpscRing<T, N>::commit()
+{
+	unsigned head = __atomic_load_n(&m_head, __ATOMIC_RELAXED);
+	__atomic_store_n(&m_head, head + 1, __ATOMIC_RELEASE);
+}
+
+template <typename T, unsigned N>
+inline T *SpscRing<T, N>::peek()
+{
+	unsigned tail = __atomic_load_n(&m_tail, __ATOMIC_RELAXED);
+	unsigned head = __atomic_load_n(&m_head, __ATOMIC_ACQUIRE);
+
+	if (head == tail)
+		return NULL;
+	return &m_slots[tail & (N - 1)];
+}
+
+template <typename T, unsigned N>
+inline void SpscRing<T, N>::consume()
+{
+	unsigned tail = __atomic_load_n(&m_tail, __ATOMIC_RELAXED);
+	__atomic_store_n(&m_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+template <typename T, unsigned N>
+inline unsigned SpscRing<T, N>::size() const
+{
+	return __atomic_load_n(&m_head, __ATOMIC_ACQUIRE) -
+		__atomic_load_n(&m_tail, __ATOMIC_ACQUIRE);
+}
+
+template <typename T, unsigned N>
+inline bool SpscRing<T, N>::empty() const
+{
+	return size() == 0;
+}
@@ -226,6 +226,7 @@ gprs_rlcmac_tbf::gprs_rlcmac_tbf(BTS *bts_, gprs_rlcmac_tbf_direction dir) :
 	 * Just set them to 0 like talloc_zero did */
 	memset(&pdch, 0, sizeof(pdch));
 	memset(&Tarr, 0, sizeof(Tarr));
+	memset(&Tdeadline, 0, sizeof(Tdeadline));
 	memset(&Narr, 0, sizeof(Narr));
 	memset(&gsm_timer, 0, sizeof(gsm_timer));
 
@@ -483,9 +484,10 @@ void tbf_free(struct gprs_rlcmac_tbf *tbf)
 	LOGPTBF(tbf, LOGL_INFO, "free\n");
 	tbf->check_pending_ass();
 	tbf->stop_timers("freeing TBF");
+	tbf->release_poll_block();
 	/* TODO: Could/Should generate  bssgp_tx_llc_discarded */
 	tbf_unlink_pdch(tbf);
-	llist_del(&tbf->list());
+	tbf->bts->tbf_list_del(tbf);
 
 	if (tbf->ms())
 		tbf->set_ms(NULL);
@@ -653,25 +655,42 @@ static inline void tbf_timeout_free(struct gprs_rlcmac_tbf *tbf, enum tbf_timers
 	tbf_free(tbf);
 }
 
-#define T_CBACK(t, diag) static void cb_##t(void *_tbf) { tbf_timeout_free((struct gprs_rlcmac_tbf *)_tbf, t, diag); }
+#define T_CBACK(t, diag) static void cb_##t(void *_tbf) { \
+	struct gprs_rlcmac_tbf *tbf = (struct gprs_rlcmac_tbf *)_tbf; \
+	if (!tbf->t_rearm_lazy(t)) \
+		tbf_timeout_free(tbf, t, diag); \
+}
 
 T_CBACK(T3169, true)
 T_CBACK(T3191, true)
 T_CBACK(T3193, false)
 T_CBACK(T3195, true)
 
+/* Called when Tarr[t] fires. If the timer was restarted lazily in the
+ * meantime, arm it again for the rest of the time and return true. */
+bool gprs_rlcmac_tbf::t_rearm_lazy(enum tbf_timers t)
+{
+	struct timeval now, left;
+
+	osmo_gettimeofday(&now, NULL);
+	if (!timercmp(&Tdeadline[t], &now, >))
+		return false;
+
+	timersub(&Tdeadline[t], &now, &left);
+	osmo_timer_schedule(&Tarr[t], left.tv_sec, left.tv_usec);
+	return true;
+}
+
 void gprs_rlcmac_tbf::t_start(enum tbf_timers t, int T, const char *reason, bool force,
-			      const char *file, unsigned line)
+			      const char *file, unsigned line, bool lazy)
 {
 	int current_fn = get_current_fn();
 	int sec;
 	int microsec;
-	struct osmo_tdef *tdef;
-
-	if (!(tdef = osmo_tdef_get_entry(bts->bts_data()->T_defs_bts, T)))
-		tdef = osmo_tdef_get_entry(bts->bts_data()->T_defs_pcu, T);
+	int tp = bts_tbf_timer_param(T);
+	struct timeval now, deadline;
 
-	if (t >= T_MAX || !tdef) {
+	if (t >= T_MAX || tp < 0) {
 		LOGPSRC(DTBF, LOGL_ERROR, file, line, "%s attempting to start unknown timer %s [%s], cur_fn=%d\n",
 			tbf_name(this), get_value_string(tbf_timers_names, t), reason, current_fn);
 		return;
@@ -680,19 +699,8 @@ void gprs_rlcmac_tbf::t_start(enum tbf_timers t, int T, const char *reason, bool
 	if (!force && osmo_timer_pending(&Tarr[t]))
 		return;
 
-	switch (tdef->unit) {
-	case OSMO_TDEF_MS:
-		sec = 0;
-		microsec = tdef->val * 1000;
-		break;
-	case OSMO_TDEF_S:
-		sec = tdef->val;
-		microsec = 0;
-		break;
-	default:
-		/* so far only timers using MS and S */
-		OSMO_ASSERT(false);
-	}
+	sec = bts->bts_data()->params.tbf_timer[tp].sec;
+	microsec = bts->bts_data()->params.tbf_timer[tp].usec;
 
 	LOGPSRC(DTBF, LOGL_DEBUG, file, line, "%s %sstarting timer %s [%s] with %u sec. %u microsec, cur_fn=%d\n",
 	     tbf_name(this), osmo_timer_pending(&Tarr[t]) ? "re" : "",
@@ -721,13 +729,39 @@ void gprs_rlcmac_tbf::t_start(enum tbf_timers t, int T, const char *reason, bool
 		     tbf_name(this), get_value_string(tbf_timers_names, t), reason, current_fn);
 	}
 
+	osmo_gettimeofday(&now, NULL);
+	deadline.tv_sec = now.tv_sec + sec + (now.tv_usec + microsec) / 1000000;
+	deadline.tv_usec = (now.tv_usec + microsec) % 1000000;
+
+	/* A pending timer that expires no later than the new deadline is
+	 * left in place, t_rearm_lazy() moves it on when it fires. */
+	if (lazy && osmo_timer_pending(&Tarr[t])
+	    && !timercmp(&Tarr[t].timeout, &deadline, >)) {
+		Tdeadline[t] = deadline;
+		return;
+	}
+
+	Tdeadline[t] = deadline;
 	osmo_timer_schedule(&Tarr[t], sec, microsec);
 }
 
+/* Frame number of the uplink block an MS answers a poll in, sent in the
+ * downlink block at fn: 3 to 6 blocks later, that is N+13, N+17 or N+18,
+ * N+21 or N+22 and N+26 for RRBP 0 to 3 (TS 44.060 Table 10.4.5.1) */
+static uint32_t rrbp_fn(uint32_t fn, unsigned int rrbp)
+{
+	unsigned int pos = (fn % 13) / 4;
+	unsigned int end = pos + 3 + rrbp;
+
+	return next_fn(fn, (end / 3) * 13 + (end % 3) * 4 - pos * 4);
+}
+
 int gprs_rlcmac_tbf::check_polling(uint32_t fn, uint8_t ts,
 	uint32_t *poll_fn_, unsigned int *rrbp_)
 {
-	uint32_t new_poll_fn = next_fn(fn, 13);
+	struct gprs_rlcmac_pdch *pdch = &trx->pdch[ts];
+	unsigned int rrbp, max_rrbp = bts_data()->fixed_rrbp ? 0 : 3;
+	uint32_t new_poll_fn = 0;
 
 	if (!is_control_ts(ts)) {
 		LOGPTBF(this, LOGL_DEBUG, "Polling cannot be "
@@ -737,17 +771,28 @@ int gprs_rlcmac_tbf::check_polling(uint32_t fn, uint8_t ts,
 	}
 	if (poll_state != GPRS_RLCMAC_POLL_NONE) {
 		LOGPTBF(this, LOGL_DEBUG, "Polling is already scheduled\n");
+		bts->do_rate_ctr_inc(CTR_POLL_DEFERRED_PENDING);
 		return -EBUSY;
 	}
-	if (bts->sba()->find(trx->trx_no, ts, next_fn(fn, 13))) {
-		LOGPTBF(this, LOGL_DEBUG, "Polling is already scheduled "
-			"for single block allocation at FN %d TS %d ...\n",
-			new_poll_fn, ts);
+
+	/* take the earliest uplink block not given to another poll or to a
+	 * single block allocation yet */
+	for (rrbp = 0; rrbp <= max_rrbp; rrbp++) {
+		new_poll_fn = rrbp_fn(fn, rrbp);
+		if (pdch->ul_block_free(new_poll_fn))
+			break;
+	}
+	if (rrbp > max_rrbp) {
+		LOGPTBF(this, LOGL_DEBUG, "No free uplink block for polling "
+			"up to FN %d TS %d ...\n", new_poll_fn, ts);
+		bts->do_rate_ctr_inc(CTR_POLL_DEFERRED_NO_BLOCK);
 		return -EBUSY;
 	}
+	if (rrbp > 0)
+		bts->do_rate_ctr_inc(CTR_POLL_LATE_RRBP);
 
 	*poll_fn_ = new_poll_fn;
-	*rrbp_ = 0;
+	*rrbp_ = rrbp;
 
 	return 0;
 }
@@ -771,6 +816,7 @@ void gprs_rlcmac_tbf::set_polling(uint32_t new_poll_fn, uint8_t ts, enum gprs_rl
 	poll_state = GPRS_RLCMAC_POLL_SCHED;
 	poll_fn = new_poll_fn;
 	poll_ts = ts;
+	trx->pdch[ts].reserve_ul_block(new_poll_fn, PDCH_UL_RSV_POLL);
 
 	switch (t) {
 	case GPRS_RLCMAC_POLL_UL_ASS:
@@ -798,6 +844,13 @@ void gprs_rlcmac_tbf::set_polling(uint32_t new_poll_fn, uint8_t ts, enum gprs_rl
 	}
 }
 
+/* Give the uplink block of a pending poll back to the PDCH */
+void gprs_rlcmac_tbf::release_poll_block()
+{
+	if (poll_state == GPRS_RLCMAC_POLL_SCHED)
+		trx->pdch[poll_ts].release_ul_block(poll_fn);
+}
+
 void gprs_rlcmac_tbf::poll_timeout()
 {
 	uint16_t pgroup;
@@ -806,6 +859,7 @@ void gprs_rlcmac_tbf::poll_timeout()
 	LOGPTBF(this, LOGL_NOTICE, "poll timeout for FN=%d, TS=%d (curr FN %d)\n",
 		poll_fn, poll_ts, bts->current_frame_number());
 
+	release_poll_block();
 	poll_state = GPRS_RLCMAC_POLL_NONE;
 
 	if (n_inc(N3101)) {
@@ -904,6 +958,7 @@ void gprs_rlcmac_tbf::poll_timeout()
 				LOGPTBF(dl_tbf, LOGL_ERROR, "IMSI to paging group failed! (%s)\n", imsi());
 			dl_tbf->bts->snd_dl_ass(dl_tbf, false, pgroup);
 			dl_tbf->m_wait_confirm = 1;
+			dl_tbf->update_ready();
 		}
 	} else
 		LOGPTBF(this, LOGL_ERROR, "Poll Timeout, but no event!\n");
@@ -928,6 +983,7 @@ static int setup_tbf(struct gprs_rlcmac_tbf *tbf, GprsMs *ms, int8_t use_trx, ui
 	rc = bts->alloc_algorithm(bts, ms, tbf, single_slot, use_trx);
 	/* if no resource */
 	if (rc < 0) {
+		tbf->bts->do_rate_ctr_inc(CTR_TBF_ALLOC_FAILED);
 		return -1;
 	}
 	/* assign control ts */
@@ -1121,6 +1177,9 @@ struct gprs_rlcmac_dl_tbf *tbf_alloc_dl_tbf(struct gprs_rlcmac_bts *bts, GprsMs
 static void tbf_timer_cb(void *_tbf)
 {
 	struct gprs_rlcmac_tbf *tbf = (struct gprs_rlcmac_tbf *)_tbf;
+
+	if (tbf->t_rearm_lazy(T0))
+		return;
 	tbf->handle_timeout();
 }
 
@@ -1143,6 +1202,7 @@ void gprs_rlcmac_tbf::handle_timeout()
 	if ((state_flags & (1 << GPRS_RLCMAC_FLAG_CCCH))) {
 		gprs_rlcmac_dl_tbf *dl_tbf = as_dl_tbf(this);
 		dl_tbf->m_wait_confirm = 0;
+		dl_tbf->update_ready();
 		if (dl_tbf->state_is(GPRS_RLCMAC_ASSIGN)) {
 			tbf_assign_control_ts(dl_tbf);
 
@@ -1456,13 +1516,24 @@ const char *gprs_rlcmac_tbf::name() const
 
 void gprs_rlcmac_tbf::rotate_in_list()
 {
-	llist_del(&list());
+	bts->tbf_list_del(this);
 	if (direction == GPRS_RLCMAC_UL_TBF)
 		llist_add(&list(), &bts->ul_tbfs());
 	else
 		llist_add(&list(), &bts->dl_tbfs());
 }
 
+/* Tell the PDCHs whether the scheduler has to consider this TBF */
+void gprs_rlcmac_tbf::update_ready()
+{
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(pdch); i++) {
+		if (pdch[i])
+			pdch[i]->update_ready(this);
+	}
+}
+
 uint8_t gprs_rlcmac_tbf::tsc() const
 {
 	return trx->pdch[first_ts].tsc;
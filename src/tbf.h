@@ -164,6 +164,9 @@ enum tbf_counters { /* TBF counters from 3GPP TS 44.060 §13.4 */
 #define GPRS_RLCMAC_FLAG_TO_MASK	0xf0 /* timeout bits */
 
 #define T_START(tbf, t, T, r, f) tbf->t_start(t, T, r, f, __FILE__, __LINE__)
+/* Restart a timer that is refreshed very often: only its deadline is moved,
+ * the pending osmo_timer re-arms itself when it fires too early. */
+#define T_START_LAZY(tbf, t, T, r) tbf->t_start(t, T, r, true, __FILE__, __LINE__, true)
 
 #define TBF_SET_STATE(t, st) do { t->set_state(st, __FILE__, __LINE__); } while(0)
 #define TBF_SET_ASS_STATE_DL(t, st) do { t->set_ass_state_dl(st, __FILE__, __LINE__); } while(0)
@@ -223,13 +226,15 @@ struct gprs_rlcmac_tbf {
 	bool timers_pending(enum tbf_timers t);
 	void t_stop(enum tbf_timers t, const char *reason);
 	void t_start(enum tbf_timers t, int T, const char *reason, bool force,
-		     const char *file, unsigned line);
+		     const char *file, unsigned line, bool lazy = false);
+	bool t_rearm_lazy(enum tbf_timers t);
 	int establish_dl_tbf_on_pacch();
 
 	int check_polling(uint32_t fn, uint8_t ts,
 		uint32_t *poll_fn, unsigned int *rrbp);
 	void set_polling(uint32_t poll_fn, uint8_t ts, enum gprs_rlcmac_tbf_poll_type t);
 	void poll_timeout();
+	void release_poll_block();
 
 	/** tlli handling */
 	uint32_t tlli() const;
@@ -262,6 +267,7 @@ struct gprs_rlcmac_tbf {
 
 	/* attempt to make things a bit more fair */
 	void rotate_in_list();
+	void update_ready();
 
 	LListHead<gprs_rlcmac_tbf>& ms_list() {return this->m_ms_list;}
 	const LListHead<gprs_rlcmac_tbf>& ms_list() const {return this->m_ms_list;}
@@ -342,6 +348,7 @@ private:
 	LListHead<gprs_rlcmac_tbf> m_ms_list;
 	bool m_egprs_enabled;
 	struct osmo_timer_list Tarr[T_MAX];
+	struct timeval Tdeadline[T_MAX]; /* expiry of Tarr, may be behind Tarr[].timeout */
 	uint8_t Narr[N_MAX];
 	mutable char m_name_buf[60];
 };
@@ -461,6 +468,7 @@ inline void gprs_rlcmac_tbf::set_state(enum gprs_rlcmac_tbf_state new_state, con
 		tbf_name(this),
 		tbf_state_name[state], tbf_state_name[new_state]);
 	state = new_state;
+	update_ready();
 }
 
 inline void gprs_rlcmac_tbf::set_ass_state_dl(enum gprs_rlcmac_tbf_dl_ass_state new_state, const char *file, int line)
@@ -501,6 +509,7 @@ inline void gprs_rlcmac_tbf::poll_sched_unset(const char *file, int line)
 {
 	LOGPSRC(DTBF, LOGL_DEBUG, file, line, "%s changes poll state from %s to GPRS_RLCMAC_POLL_NONE\n",
 		tbf_name(this), get_value_string(gprs_rlcmac_tbf_poll_state_names, poll_state));
+	release_poll_block();
 	poll_state = GPRS_RLCMAC_POLL_NONE;
 }
 
@@ -55,6 +55,8 @@ extern "C" {
 
 /* After sending these frames, we poll for ack/nack. */
 #define POLL_ACK_AFTER_FRAMES 20
+/* With adaptive-ack-nack, never poll more often than every N blocks */
+#define POLL_ACK_MIN_FRAMES 4
 
 static inline void tbf_update_ms_class(struct gprs_rlcmac_tbf *tbf,
 					const uint8_t ms_class)
@@ -82,11 +84,16 @@ gprs_rlcmac_dl_tbf::gprs_rlcmac_dl_tbf(BTS *bts_) :
 	m_dl_ack_requested(false),
 	m_last_dl_poll_fn(0),
 	m_last_dl_drained_fn(0),
+	m_last_rebalance_fn(-1),
+	m_rebalance_ul_slots(0),
+	m_rebalance_dl_slots(0),
+	m_rtt_blocks(0),
 	m_dl_gprs_ctrs(NULL),
 	m_dl_egprs_ctrs(NULL)
 {
 	memset(&m_llc_timer, 0, sizeof(m_llc_timer));
 	osmo_timer_setup(&m_llc_timer, llc_timer_cb, this);
+	memset(&m_dl_ack_poll_tv, 0, sizeof(m_dl_ack_poll_tv));
 }
 
 void gprs_rlcmac_dl_tbf::cleanup()
@@ -332,6 +339,10 @@ drop_frame:
 			bssgp_tx_llc_discarded(bctx, tlli(), frames, octets);
 	}
 
+	if (msg)
+		pcu_hist_add(&bts_data()->llc_queue_delay,
+			     pcu_timespec_diff_us(&info->recv_time, &tv_now) / 1000);
+
 	return msg;
 }
 
@@ -432,6 +443,16 @@ int gprs_rlcmac_dl_tbf::take_next_bsn(uint32_t fn,
 		bts->do_rate_ctr_inc(CTR_RLC_RESTARTED);
 		if (restart_bsn_cycle())
 			return take_next_bsn(fn, previous_bsn, may_combine);
+	} else if (dl_window_stalled() && dl_ack_outstanding()) {
+		/* The window is stalled, but the Ack/Nack that tells which
+		 * blocks are missing is on its way. Only repeat V(A) instead
+		 * of resending blocks that have probably been received. */
+		LOGPTBFDL(this, LOGL_DEBUG,
+			  "Window stalled, resending BSN %d until Ack/Nack is received.\n",
+			  m_window.v_a());
+		bts->do_rate_ctr_inc(CTR_RLC_STALLED);
+		m_window.m_v_b.mark_resend(m_window.v_a());
+		return take_next_bsn(fn, previous_bsn, may_combine);
 	} else if (dl_window_stalled()) {
 		/* There are no more packages to send, but the window is stalled.
 		 * Restart the bsn_cycle to resend all unacked messages */
@@ -450,7 +471,8 @@ int gprs_rlcmac_dl_tbf::take_next_bsn(uint32_t fn,
 			  m_window.v_s(), mcs_name(new_cs));
 
 		bsn = create_new_bsn(fn, new_cs);
-	} else if (bts->bts_data()->dl_tbf_preemptive_retransmission && !m_window.window_empty()) {
+	} else if (bts->bts_data()->dl_tbf_preemptive_retransmission && !m_window.window_empty()
+		   && !dl_ack_outstanding()) {
 		/* The window contains unacked packages, but not acked.
 		 * Mark unacked bsns as RESEND */
 		LOGPTBFDL(this, LOGL_DEBUG,
@@ -487,6 +509,30 @@ int gprs_rlcmac_dl_tbf::take_next_bsn(uint32_t fn,
  * The messages are fragmented and forwarded as data blocks.
  */
 struct msgb *gprs_rlcmac_dl_tbf::create_dl_acked_block(uint32_t fn, uint8_t ts)
+{
+	struct msgb *dl_msg;
+	int len;
+
+	dl_msg = msgb_alloc(mcs_size_dl(MCS9), "rlcmac_dl_data");
+	if (!dl_msg)
+		return NULL;
+
+	len = render_dl_acked_block(fn, ts, dl_msg->data);
+	if (len <= 0) {
+		msgb_free(dl_msg);
+		return NULL;
+	}
+
+	msgb_put(dl_msg, len);
+	return dl_msg;
+}
+
+/*
+ * Encode the next DL data block into data, which has room for any coding
+ * scheme. Returns the length of the block or 0 if there is none.
+ */
+int gprs_rlcmac_dl_tbf::render_dl_acked_block(uint32_t fn, uint8_t ts,
+	uint8_t *data)
 {
 	int bsn, bsn2 = -1;
 	bool may_combine;
@@ -496,12 +542,12 @@ struct msgb *gprs_rlcmac_dl_tbf::create_dl_acked_block(uint32_t fn, uint8_t ts)
 
 	bsn = take_next_bsn(fn, -1, &may_combine);
 	if (bsn < 0)
-		return NULL;
+		return 0;
 
 	if (may_combine)
 		bsn2 = take_next_bsn(fn, bsn, &may_combine);
 
-	return create_dl_acked_block(fn, ts, bsn, bsn2);
+	return render_dl_acked_block(fn, ts, bsn, bsn2, data);
 }
 
 /* depending on the current TBF, we assign on PACCH or AGCH */
@@ -535,6 +581,7 @@ void gprs_rlcmac_dl_tbf::trigger_ass(struct gprs_rlcmac_tbf *old_tbf)
 			LOGPTBFDL(this, LOGL_ERROR, "IMSI to paging group failed! (%s)\n", imsi());
 		bts->snd_dl_ass(this, false, pgroup);
 		m_wait_confirm = 1;
+		update_ready();
 	}
 }
 
@@ -673,12 +720,10 @@ bool gprs_rlcmac_dl_tbf::handle_ack_nack()
 	return ack_recovered;
 }
 
-struct msgb *gprs_rlcmac_dl_tbf::create_dl_acked_block(
+int gprs_rlcmac_dl_tbf::render_dl_acked_block(
 				const uint32_t fn, const uint8_t ts,
-				int index, int index2)
+				int index, int index2, uint8_t *msg_data)
 {
-	uint8_t *msg_data;
-	struct msgb *dl_msg;
 	unsigned msg_len;
 	bool need_poll;
 	/* TODO: support MCS-7 - MCS-9, where data_block_idx can be 1 */
@@ -752,13 +797,9 @@ struct msgb *gprs_rlcmac_dl_tbf::create_dl_acked_block(
 	rlc.pr = 0; /* FIXME: power reduction */
 	rlc.tfi = m_tfi; /* TFI */
 
-	/* return data block(s) as message */
+	/* encode data block(s) in place */
 	msg_len = mcs_size_dl(cs);
-	dl_msg = msgb_alloc(msg_len, "rlcmac_dl_data");
-	if (!dl_msg)
-		return NULL;
-
-	msg_data = msgb_put(dl_msg, msg_len);
+	memset(msg_data, 0, msg_len);
 
 	OSMO_ASSERT(rlc.num_data_blocks <= ARRAY_SIZE(rlc.block_info));
 	OSMO_ASSERT(rlc.num_data_blocks > 0);
@@ -846,7 +887,7 @@ struct msgb *gprs_rlcmac_dl_tbf::create_dl_acked_block(
 	/* poll after POLL_ACK_AFTER_FRAMES frames, or when final block is tx.
 	 */
 	if (m_tx_counter >= POLL_ACK_AFTER_FRAMES || m_dl_ack_requested ||
-			need_poll) {
+			need_poll || adaptive_poll_due()) {
 		if (m_dl_ack_requested) {
 			LOGPTBFDL(this, LOGL_DEBUG,
 				  "Scheduling Ack/Nack polling, because it was requested explicitly "
@@ -854,6 +895,11 @@ struct msgb *gprs_rlcmac_dl_tbf::create_dl_acked_block(
 		} else if (need_poll) {
 			LOGPTBFDL(this, LOGL_DEBUG,
 				  "Scheduling Ack/Nack polling, because polling timed out.\n");
+		} else if (m_tx_counter < POLL_ACK_AFTER_FRAMES) {
+			LOGPTBFDL(this, LOGL_DEBUG,
+				  "Scheduling Ack/Nack polling, because window is filling up "
+				  "(%d of %d, RTT %d blocks).\n",
+				  m_window.distance(), m_window.ws(), m_rtt_blocks);
 		} else {
 			LOGPTBFDL(this, LOGL_DEBUG,
 				  "Scheduling Ack/Nack polling, because %d blocks sent.\n",
@@ -863,11 +909,12 @@ struct msgb *gprs_rlcmac_dl_tbf::create_dl_acked_block(
 		rc = check_polling(fn, ts, &new_poll_fn, &rrbp);
 		if (rc >= 0) {
 			set_polling(new_poll_fn, ts, GPRS_RLCMAC_POLL_DL_ACK);
+			osmo_clock_gettime(CLOCK_MONOTONIC, &m_dl_ack_poll_tv);
 
 			m_tx_counter = 0;
 			/* start timer whenever we send the final block */
 			if (is_final)
-				T_START(this, T3191, 3191, "final block (DL-TBF)", true);
+				T_START_LAZY(this, T3191, 3191, "final block (DL-TBF)");
 
 			state_flags &= ~(1 << GPRS_RLCMAC_FLAG_TO_DL_ACK); /* clear poll timeout flag */
 
@@ -891,12 +938,12 @@ struct msgb *gprs_rlcmac_dl_tbf::create_dl_acked_block(
 	LOGPTBFDL(this, LOGL_DEBUG, "msg block (BSN %d, %s%s): %s\n",
 		  index, mcs_name(cs),
 		  need_padding ? ", padded" : "",
-		  msgb_hexdump(dl_msg));
+		  osmo_hexdump(msg_data, msg_len));
 
 	/* Increment TX-counter */
 	m_tx_counter++;
 
-	return dl_msg;
+	return msg_len;
 }
 
 static uint16_t bitnum_to_bsn(int bitnum, uint16_t ssn)
@@ -1133,6 +1180,7 @@ int gprs_rlcmac_dl_tbf::release()
 	/* reset rlc states */
 	m_tx_counter = 0;
 	m_wait_confirm = 0;
+	update_ready();
 	m_window.reset();
 
 	TBF_ASS_TYPE_UNSET(this, GPRS_RLCMAC_FLAG_CCCH);
@@ -1172,6 +1220,7 @@ int gprs_rlcmac_dl_tbf::rcvd_dl_ack(bool final_ack, unsigned first_bsn,
 	int rc;
 	LOGPTBFDL(this, LOGL_DEBUG, "downlink acknowledge\n");
 
+	update_rtt();
 	rc = update_window(first_bsn, rbb);
 
 	if (final_ack) {
@@ -1189,6 +1238,7 @@ int gprs_rlcmac_dl_tbf::rcvd_dl_ack(bool final_ack, uint8_t ssn, uint8_t *rbb)
 {
 	LOGPTBFDL(this, LOGL_DEBUG, "downlink acknowledge\n");
 
+	update_rtt();
 	if (!final_ack)
 		return update_window(ssn, rbb);
 
@@ -1201,6 +1251,45 @@ bool gprs_rlcmac_dl_tbf::dl_window_stalled() const
 	return m_window.window_stalled();
 }
 
+/* The poll was set up with m_tx_counter = 0, so the number of blocks sent
+ * until its answer arrives is the round trip in blocks of this TBF. */
+void gprs_rlcmac_dl_tbf::update_rtt()
+{
+	int rtt = OSMO_MIN(m_tx_counter, 255);
+	struct timespec now;
+
+	if (m_dl_ack_poll_tv.tv_sec || m_dl_ack_poll_tv.tv_nsec) {
+		osmo_clock_gettime(CLOCK_MONOTONIC, &now);
+		pcu_hist_add(&bts_data()->dl_ack_rtt,
+			     pcu_timespec_diff_us(&m_dl_ack_poll_tv, &now) / 1000);
+		memset(&m_dl_ack_poll_tv, 0, sizeof(m_dl_ack_poll_tv));
+	}
+
+	if (!m_rtt_blocks)
+		m_rtt_blocks = rtt;
+	else
+		m_rtt_blocks = (3 * m_rtt_blocks + rtt + 2) / 4;
+}
+
+/* Poll as soon as the window would stall before the answer could arrive */
+bool gprs_rlcmac_dl_tbf::adaptive_poll_due() const
+{
+	if (!bts->bts_data()->adaptive_ack_nack || poll_scheduled())
+		return false;
+
+	if (m_tx_counter < POLL_ACK_MIN_FRAMES)
+		return false;
+
+	return m_window.distance() + m_rtt_blocks >= m_window.ws();
+}
+
+/* Is the Ack/Nack answering our last DL poll still to be received? */
+bool gprs_rlcmac_dl_tbf::dl_ack_outstanding() const
+{
+	return bts->bts_data()->adaptive_ack_nack && poll_scheduled() &&
+		poll_fn == (uint32_t)m_last_dl_poll_fn;
+}
+
 void gprs_rlcmac_dl_tbf::request_dl_ack()
 {
 	m_dl_ack_requested = true;
@@ -1213,7 +1302,7 @@ bool gprs_rlcmac_dl_tbf::need_control_ts() const
 
 	return state_flags & (1 << GPRS_RLCMAC_FLAG_TO_DL_ACK) ||
 		m_tx_counter >= POLL_ACK_AFTER_FRAMES ||
-		m_dl_ack_requested;
+		m_dl_ack_requested || adaptive_poll_due();
 }
 
 bool gprs_rlcmac_dl_tbf::have_data() const
@@ -1247,14 +1336,11 @@ int gprs_rlcmac_dl_tbf::frames_since_last_drain(unsigned fn) const
 
 bool gprs_rlcmac_dl_tbf::keep_open(unsigned fn) const
 {
-	int keep_time_frames;
-	unsigned long dl_tbf_idle_msec;
+	int keep_time_frames = bts_data()->params.dl_tbf_idle_frames;
 
-	dl_tbf_idle_msec = osmo_tdef_get(bts_data()->T_defs_pcu, -2031, OSMO_TDEF_MS, -1);
-	if (dl_tbf_idle_msec == 0)
+	if (keep_time_frames < 0)
 		return false;
 
-	keep_time_frames = msecs_to_frames(dl_tbf_idle_msec);
 	return frames_since_last_drain(fn) <= keep_time_frames;
 }
 
@@ -1376,13 +1462,36 @@ enum egprs_rlcmac_dl_spb gprs_rlcmac_dl_tbf::get_egprs_dl_spb(const int bsn)
 void gprs_rlcmac_dl_tbf::set_window_size()
 {
 	const struct gprs_rlcmac_bts *b = bts->bts_data();
-	uint16_t ws = egprs_window_size(b, dl_slots());
+	uint16_t ws = egprs_window_size(b, assigned_dl_slots());
 
 	LOGPTBFDL(this, LOGL_INFO, "setting EGPRS DL window size to %u, base(%u) slots(%u) ws_pdch(%u)\n",
-		  ws, b->ws_base, pcu_bitcount(dl_slots()), b->ws_pdch);
+		  ws, b->ws_base, pcu_bitcount(assigned_dl_slots()), b->ws_pdch);
 	m_window.set_ws(ws);
 }
 
+/* DL slots the MS is told about in a Packet Downlink Assignment: the ones
+ * the PdchBalancer moves the TBF to, if any, else the current ones */
+uint8_t gprs_rlcmac_dl_tbf::assigned_dl_slots() const
+{
+	if (m_rebalance_dl_slots)
+		return m_rebalance_dl_slots;
+
+	return dl_slots();
+}
+
+/* The MS acked the assignment of the PdchBalancer, DL blocks may be sent on
+ * the new slots from now on. Until then they are sent on the old ones. */
+void gprs_rlcmac_dl_tbf::rebalance_acked()
+{
+	if (!m_rebalance_dl_slots)
+		return;
+
+	LOGPTBFDL(this, LOGL_INFO, "Moving to DL slots %02x\n", m_rebalance_dl_slots);
+	move_dl_tbf_slots(this, m_rebalance_ul_slots, m_rebalance_dl_slots);
+	m_rebalance_ul_slots = 0;
+	m_rebalance_dl_slots = 0;
+}
+
 void gprs_rlcmac_dl_tbf::update_coding_scheme_counter_dl(enum CodingScheme cs)
 {
 	switch (cs) {
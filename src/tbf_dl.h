@@ -57,6 +57,7 @@ struct gprs_rlcmac_dl_tbf : public gprs_rlcmac_tbf {
 	int rcvd_dl_ack(bool final, uint8_t ssn, uint8_t *rbb);
 	int rcvd_dl_ack(bool final_ack, unsigned first_bsn, struct bitvec *rbb);
 	struct msgb *create_dl_acked_block(uint32_t fn, uint8_t ts);
+	int render_dl_acked_block(uint32_t fn, uint8_t ts, uint8_t *data);
 	void trigger_ass(struct gprs_rlcmac_tbf *old_tbf);
 
 	bool handle_ack_nack();
@@ -70,6 +71,8 @@ struct gprs_rlcmac_dl_tbf : public gprs_rlcmac_tbf {
 	int abort();
 	uint16_t window_size() const;
 	void set_window_size();
+	uint8_t assigned_dl_slots() const;
+	void rebalance_acked();
 	void update_coding_scheme_counter_dl(enum CodingScheme cs);
 
 	struct msgb *llc_dequeue(bssgp_bvc_ctx *bctx);
@@ -84,6 +87,11 @@ struct gprs_rlcmac_dl_tbf : public gprs_rlcmac_tbf {
 	bool m_dl_ack_requested;
 	int32_t m_last_dl_poll_fn;
 	int32_t m_last_dl_drained_fn;
+	int32_t m_last_rebalance_fn; /* last move by the PdchBalancer, -1 = never */
+	uint8_t m_rebalance_ul_slots; /* slots assigned by the PdchBalancer, */
+	uint8_t m_rebalance_dl_slots; /* used once the MS acked, 0 = none */
+	uint8_t m_rtt_blocks; /* smoothed blocks sent during a poll round trip */
+	struct timespec m_dl_ack_poll_tv; /* when the pending DL ack poll was sent */
 
 	struct BandWidth {
 		struct timespec dl_bw_tv; /* timestamp for dl bw calculation */
@@ -112,12 +120,15 @@ protected:
 		bool *may_combine);
 	bool restart_bsn_cycle();
 	int create_new_bsn(const uint32_t fn, enum CodingScheme cs);
-	struct msgb *create_dl_acked_block(const uint32_t fn, const uint8_t ts,
-					int index, int index2 = -1);
+	int render_dl_acked_block(const uint32_t fn, const uint8_t ts,
+					int index, int index2, uint8_t *data);
 	int update_window(const uint8_t ssn, const uint8_t *rbb);
 	int update_window(unsigned first_bsn, const struct bitvec *rbb);
 	int maybe_start_new_window();
 	bool dl_window_stalled() const;
+	bool adaptive_poll_due() const;
+	bool dl_ack_outstanding() const;
+	void update_rtt();
 	void reuse_tbf();
 	void start_llc_timer();
 	int analyse_errors(char *show_rbb, uint8_t ssn, ana_result *res);
@@ -51,14 +51,20 @@ extern "C" {
 
 /* After receiving these frames, we send ack/nack. */
 #define SEND_ACK_AFTER_FRAMES 20
+/* With adaptive-ack-nack, nack a gap once this many frames were received */
+#define SEND_NACK_AFTER_FRAMES 8
 
 extern void *tall_pcu_ctx;
 
 gprs_rlcmac_ul_tbf::gprs_rlcmac_ul_tbf(BTS *bts_) :
 	gprs_rlcmac_tbf(bts_, GPRS_RLCMAC_UL_TBF),
 	m_rx_counter(0),
+	m_ack_rx_counter(0),
 	m_contention_resolution_done(0),
 	m_final_ack_sent(0),
+	m_ext_idle(0),
+	m_ext_idle_fn(0),
+	m_ext_usf_fn(0),
 	m_ul_gprs_ctrs(NULL),
 	m_ul_egprs_ctrs(NULL)
 {
@@ -211,7 +217,7 @@ int gprs_rlcmac_ul_tbf::rcv_data_block_acknowledged(
 	unsigned int block_idx;
 
 	/* restart T3169 */
-	T_START(this, T3169, 3169, "acked (data)", true);
+	T_START_LAZY(this, T3169, 3169, "acked (data)");
 
 	/* Increment RX-counter */
 	this->m_rx_counter++;
@@ -316,6 +322,12 @@ int gprs_rlcmac_ul_tbf::rcv_data_block_acknowledged(
 		}
 
 		m_window.receive_bsn(rdbi->bsn);
+
+		if (m_ext_idle) {
+			LOGPTBFUL(this, LOGL_DEBUG, "New data in extended mode\n");
+			m_ext_idle = 0;
+			bts->do_rate_ctr_inc(CTR_TBF_UL_EXT_RESUMED);
+		}
 	}
 
 	/* Raise V(Q) if possible, and retrieve LLC frames from blocks.
@@ -340,7 +352,7 @@ int gprs_rlcmac_ul_tbf::rcv_data_block_acknowledged(
 		LOGPTBFUL(this, LOGL_DEBUG,
 			  "No gaps in received block, last block: BSN=%d CV=%d\n",
 			  rdbi->bsn, rdbi->cv);
-		if (rdbi->cv == 0) {
+		if (rdbi->cv == 0 && !enter_ext_idle()) {
 			LOGPTBFUL(this, LOGL_DEBUG, "Finished with UL TBF\n");
 			TBF_SET_STATE(this, GPRS_RLCMAC_FINISHED);
 			/* Reset N3103 counter. */
@@ -374,7 +386,10 @@ void gprs_rlcmac_ul_tbf::maybe_schedule_uplink_acknack(
 	}
 	if (countdown_finished) {
 		require_ack = true;
-		if (state_is(GPRS_RLCMAC_FLOW))
+		if (m_ext_idle)
+			LOGPTBFUL(this, LOGL_DEBUG,
+				  "Scheduling Ack/Nack, because all data was received and the TBF stays in extended mode.\n");
+		else if (state_is(GPRS_RLCMAC_FLOW))
 			LOGPTBFUL(this, LOGL_DEBUG,
 				  "Scheduling Ack/Nack, because some data is missing and last block has CV==0.\n");
 		else if (state_is(GPRS_RLCMAC_FINISHED))
@@ -387,10 +402,21 @@ void gprs_rlcmac_ul_tbf::maybe_schedule_uplink_acknack(
 			  "Scheduling Ack/Nack, because %d frames received.\n",
 			  SEND_ACK_AFTER_FRAMES);
 	}
+	if (bts->bts_data()->adaptive_ack_nack && !require_ack &&
+	    m_window.v_q() != m_window.v_r() &&
+	    m_rx_counter - m_ack_rx_counter >= SEND_NACK_AFTER_FRAMES) {
+		/* Let the MS resend missing blocks before its window stalls */
+		require_ack = true;
+		LOGPTBFUL(this, LOGL_DEBUG,
+			  "Scheduling Ack/Nack, because BSN %d is missing.\n",
+			  m_window.v_q());
+	}
 
 	if (!require_ack)
 		return;
 
+	m_ack_rx_counter = m_rx_counter;
+
 	if (ul_ack_state_is(GPRS_RLCMAC_UL_ACK_NONE)) {
 		/* trigger sending at next RTS */
 		TBF_SET_ACK_STATE(this, GPRS_RLCMAC_UL_ACK_SEND_ACK);
@@ -401,12 +427,76 @@ void gprs_rlcmac_ul_tbf::maybe_schedule_uplink_acknack(
 	}
 }
 
+/* Keep an EGPRS UL TBF in FLOW after its last block (extended UL TBF mode,
+ * TS 44.060 9.3.1b), so that the next data of the MS does not need a new
+ * access. Returns false if the TBF is to be finished instead. */
+bool gprs_rlcmac_ul_tbf::enter_ext_idle()
+{
+	uint32_t fn = bts->current_frame_number();
+
+	if (m_ext_idle)
+		return true;
+	if (!is_egprs_enabled() || bts->bts_data()->params.ul_tbf_ext_frames < 0)
+		return false;
+
+	LOGPTBFUL(this, LOGL_DEBUG, "All data received, keeping UL TBF in extended mode\n");
+	m_ext_idle = 1;
+	m_ext_idle_fn = fn;
+	m_ext_usf_fn = fn;
+	bts->do_rate_ctr_inc(CTR_TBF_UL_EXT_IDLE);
+
+	return true;
+}
+
+void gprs_rlcmac_ul_tbf::finish_ext_idle()
+{
+	LOGPTBFUL(this, LOGL_DEBUG, "No new data in extended mode, finished with UL TBF\n");
+	m_ext_idle = 0;
+	TBF_SET_STATE(this, GPRS_RLCMAC_FINISHED);
+	/* Reset N3103 counter. */
+	n_reset(N3103);
+
+	/* the final Ack/Nack releases the TBF */
+	if (ul_ack_state_is(GPRS_RLCMAC_UL_ACK_NONE))
+		TBF_SET_ACK_STATE(this, GPRS_RLCMAC_UL_ACK_SEND_ACK);
+}
+
+/* An idle extended UL TBF is finished after X2032 without new data ... */
+bool gprs_rlcmac_ul_tbf::ext_idle_expired(uint32_t fn) const
+{
+	const struct gprs_rlcmac_bts_params *params = &bts->bts_data()->params;
+	uint32_t idle;
+
+	if (!m_ext_idle)
+		return false;
+
+	idle = (fn + GSM_MAX_FN - m_ext_idle_fn) % GSM_MAX_FN;
+	return params->ul_tbf_ext_frames < 0 ||
+		idle >= (uint32_t)params->ul_tbf_ext_frames;
+}
+
+/* ... and until then only gets a USF every X2033, so that the MS can
+ * resume. */
+bool gprs_rlcmac_ul_tbf::ext_usf_due(uint32_t fn) const
+{
+	const struct gprs_rlcmac_bts_params *params = &bts->bts_data()->params;
+
+	if (!m_ext_idle)
+		return true;
+
+	return (fn + GSM_MAX_FN - m_ext_usf_fn) % GSM_MAX_FN >=
+		(uint32_t)params->ul_tbf_ext_usf_frames;
+}
+
+void gprs_rlcmac_ul_tbf::ext_usf_granted(uint32_t fn)
+{
+	if (m_ext_idle)
+		m_ext_usf_fn = fn;
+}
+
 /* Send Uplink unit-data to SGSN. */
 int gprs_rlcmac_ul_tbf::snd_ul_ud()
 {
-	uint8_t qos_profile[3];
-	struct msgb *llc_pdu;
-	unsigned msg_len = NS_HDR_LEN + BSSGP_HDR_LEN + m_llc.frame_length();
 	struct bssgp_bvc_ctx *bctx = gprs_bssgp_pcu_current_bctx();
 
 	LOGP(DBSSGP, LOGL_INFO, "LLC [PCU -> SGSN] %s len=%d\n", tbf_name(this), m_llc.frame_length());
@@ -416,13 +506,7 @@ int gprs_rlcmac_ul_tbf::snd_ul_ud()
 		return -EIO;
 	}
 
-	llc_pdu = msgb_alloc_headroom(msg_len, msg_len,"llc_pdu");
-	uint8_t *buf = msgb_push(llc_pdu, TL16V_GROSS_LEN(sizeof(uint8_t)*m_llc.frame_length()));
-	tl16v_put(buf, BSSGP_IE_LLC_PDU, sizeof(uint8_t)*m_llc.frame_length(), m_llc.frame);
-	qos_profile[0] = QOS_PROFILE >> 16;
-	qos_profile[1] = QOS_PROFILE >> 8;
-	qos_profile[2] = QOS_PROFILE;
-	bssgp_tx_ul_ud(bctx, tlli(), qos_profile, llc_pdu);
+	gprs_bssgp_pcu_tx_ul_ud(tlli(), m_llc.frame, m_llc.frame_length());
 
 	m_llc.reset_frame_space();
 	return 0;
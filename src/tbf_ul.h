@@ -56,6 +56,13 @@ struct gprs_rlcmac_ul_tbf : public gprs_rlcmac_tbf {
 	bool ctrl_ack_to_toggle();
 	bool handle_ctrl_ack();
 	void enable_egprs();
+	/* idle in extended mode for longer than X2032 */
+	bool ext_idle_expired(uint32_t fn) const;
+	void finish_ext_idle();
+	/* whether the UL scheduler may grant the USF, see X2033 */
+	bool ext_usf_due(uint32_t fn) const;
+	void ext_usf_granted(uint32_t fn);
+	bool ext_idle() const;
 	/* blocks were acked */
 	int rcv_data_block_acknowledged(
 		const struct gprs_rlc_data_info *rlc,
@@ -91,15 +98,20 @@ struct gprs_rlcmac_ul_tbf : public gprs_rlcmac_tbf {
 	 * variables are in both (dl and ul) structs and not outside union.
 	 */
 	int32_t m_rx_counter; /* count all received blocks */
+	int32_t m_ack_rx_counter; /* m_rx_counter at the last Ack/Nack trigger */
 	uint8_t m_usf[8];	/* list USFs per PDCH (timeslot) */
 	uint8_t m_contention_resolution_done; /* set after done */
 	uint8_t m_final_ack_sent; /* set if we sent final ack */
+	uint8_t m_ext_idle; /* all data received, kept in FLOW for more */
+	uint32_t m_ext_idle_fn; /* FN the TBF became idle */
+	uint32_t m_ext_usf_fn; /* FN of the last USF while idle */
 
 	struct rate_ctr_group *m_ul_gprs_ctrs;
 	struct rate_ctr_group *m_ul_egprs_ctrs;
 
 protected:
 	void maybe_schedule_uplink_acknack(const gprs_rlc_data_info *rlc, bool countdown_finished);
+	bool enter_ext_idle();
 
 	/* Please note that all variables below will be reset when changing
 	 * from WAIT RELEASE back to FLOW state (re-use of TBF).
@@ -123,6 +135,11 @@ inline uint16_t gprs_rlcmac_ul_tbf::window_size() const
 	return m_window.ws();
 }
 
+inline bool gprs_rlcmac_ul_tbf::ext_idle() const
+{
+	return m_ext_idle;
+}
+
 inline void gprs_rlcmac_ul_tbf::enable_egprs()
 {
 	m_window.set_sns(RLC_EGPRS_SNS);
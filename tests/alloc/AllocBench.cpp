@@ -0,0 +1,216 @@
+/* AllocBench.cpp
+ *
+ * Measure the allocation rate of algorithm B for every multislot class,
+ * and of algorithm A during a burst that fills all TFIs of a BTS with 8
+ * TRX. The allocation results themselves are covered by AllocTest and
+ * MslotTest, this only reports how fast they are obtained.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include "gprs_rlcmac.h"
+#include "gprs_debug.h"
+#include "gprs_ms.h"
+#include "tbf.h"
+#include "bts.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+extern "C" {
+#include "mslot_class.h"
+#include <osmocom/core/application.h>
+#include <osmocom/core/msgb.h>
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/utils.h>
+}
+
+/* globals used by the code */
+void *tall_pcu_ctx;
+int16_t spoof_mnc = 0, spoof_mcc = 0;
+bool spoof_mnc_3_digits = false;
+
+/* TBFs allocated per round before all of them are freed again */
+#define TBFS_PER_ROUND 8
+
+/* TBFs a burst can allocate at most: 32 TFIs per direction on 8 TRX */
+#define TBFS_PER_BURST (2 * 32 * 8)
+
+static double elapsed_sec(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* Allocate up to TBFS_PER_ROUND DL TBFs of the given class on a fresh
+ * TRX and free them again, return the number of successful allocations */
+static unsigned alloc_round(BTS *the_bts, uint8_t ms_class)
+{
+	struct gprs_rlcmac_tbf *tbfs[TBFS_PER_ROUND];
+	unsigned i, num;
+
+	for (num = 0; num < TBFS_PER_ROUND; num++) {
+		GprsMs *ms = the_bts->ms_alloc(ms_class, 0);
+		GprsMs::Guard guard(ms);
+
+		tbfs[num] = tbf_alloc_dl_tbf(the_bts->bts_data(), ms, 0, false);
+		if (!tbfs[num])
+			break;
+	}
+
+	for (i = 0; i < num; i++)
+		tbf_free(tbfs[i]);
+
+	return num;
+}
+
+static void bench_all_classes(unsigned rounds)
+{
+	BTS the_bts;
+	struct gprs_rlcmac_bts *bts = the_bts.bts_data();
+	uint64_t total = 0;
+	double total_sec = 0;
+	unsigned ms_class, ts;
+
+	bts->alloc_algorithm = alloc_algorithm_b;
+	osmo_tdef_set(bts->T_defs_pcu, -2030, 0, OSMO_TDEF_S);
+	bts_update_params(bts);
+	for (ts = 0; ts < 8; ts++)
+		bts->trx[0].pdch[ts].enable();
+
+	printf("class  allocs/round  allocs/s\n");
+
+	for (ms_class = 1; ms_class < mslot_class_max(); ms_class++) {
+		struct timespec start;
+		unsigned round, num = 0;
+		double sec;
+
+		if (mslot_class_get_tx(ms_class) == MS_NA)
+			continue;
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (round = 0; round < rounds; round++)
+			num += alloc_round(&the_bts, ms_class);
+		sec = elapsed_sec(&start);
+
+		printf("%5u  %12u  %8.0f\n", ms_class, num / rounds, num / sec);
+		total += num;
+		total_sec += sec;
+	}
+
+	printf("total  %12s  %8.0f\n", "", total / total_sec);
+}
+
+/* Allocate UL and DL TBFs for new MS until the BTS is full, every one of
+ * them searches the TRX for a free TFI (and USF), then free them again */
+static unsigned alloc_burst(BTS *the_bts, struct gprs_rlcmac_tbf **tbfs)
+{
+	struct gprs_rlcmac_bts *bts = the_bts->bts_data();
+	bool ul_full = false, dl_full = false;
+	unsigned i, num = 0;
+
+	while (!ul_full || !dl_full) {
+		GprsMs *ms = the_bts->ms_alloc(1, 0);
+		GprsMs::Guard guard(ms);
+		struct gprs_rlcmac_tbf *tbf;
+
+		if (!ul_full) {
+			tbf = tbf_alloc_ul_tbf(bts, ms, -1, true);
+			if (tbf)
+				tbfs[num++] = tbf;
+			else
+				ul_full = true;
+		}
+		if (!dl_full) {
+			tbf = tbf_alloc_dl_tbf(bts, ms, -1, true);
+			if (tbf)
+				tbfs[num++] = tbf;
+			else
+				dl_full = true;
+		}
+	}
+
+	for (i = 0; i < num; i++)
+		tbf_free(tbfs[i]);
+
+	return num;
+}
+
+static void bench_burst(unsigned rounds)
+{
+	BTS the_bts;
+	struct gprs_rlcmac_bts *bts = the_bts.bts_data();
+	struct gprs_rlcmac_tbf *tbfs[TBFS_PER_BURST];
+	struct timespec start;
+	unsigned round, trx, ts, num = 0;
+	double sec;
+
+	bts->alloc_algorithm = alloc_algorithm_a;
+	osmo_tdef_set(bts->T_defs_pcu, -2030, 0, OSMO_TDEF_S);
+	bts_update_params(bts);
+	for (trx = 0; trx < 8; trx++) {
+		for (ts = 0; ts < 8; ts++)
+			bts->trx[trx].pdch[ts].enable();
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (round = 0; round < rounds; round++)
+		num += alloc_burst(&the_bts, tbfs);
+	sec = elapsed_sec(&start);
+
+	printf("burst  %12u  %8.0f\n", num / rounds, num / sec);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned rounds = 2000;
+
+	if (argc > 1)
+		rounds = atoi(argv[1]);
+	if (!rounds) {
+		fprintf(stderr, "usage: %s [ROUNDS]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	tall_pcu_ctx = talloc_named_const(NULL, 1, "AllocBench context");
+	if (!tall_pcu_ctx)
+		abort();
+
+	msgb_talloc_ctx_init(tall_pcu_ctx, 0);
+	osmo_init_logging2(tall_pcu_ctx, &gprs_log_info);
+	log_set_use_color(osmo_stderr_target, 0);
+	log_set_print_filename(osmo_stderr_target, 0);
+	/* keep the allocation path free of log output */
+	log_set_log_level(osmo_stderr_target, LOGL_FATAL);
+
+	bench_all_classes(rounds);
+	bench_burst(rounds / 20 + 1);
+
+	return EXIT_SUCCESS;
+}
+
+/*
+ * stubs that should not be reached
+ */
+extern "C" {
+void l1if_pdch_req() { abort(); }
+void l1if_connect_pdch() { abort(); }
+void l1if_close_pdch() { abort(); }
+void l1if_open_pdch() { abort(); }
+}
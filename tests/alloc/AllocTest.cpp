@@ -799,6 +799,99 @@ static void test_2_consecutive_dl_tbfs()
 	tbf_free(dl_tbf2);
 }
 
+/* The summary the TRX keep for the allocator must match their PDCHs */
+static void check_trx_masks(struct gprs_rlcmac_bts *bts)
+{
+	unsigned trx_no, ts;
+
+	for (trx_no = 0; trx_no < 8; trx_no++) {
+		struct gprs_rlcmac_trx *trx = &bts->trx[trx_no];
+		uint32_t assigned_tfi[2] = { 0, 0 };
+		uint8_t pdch_mask = 0, idle_pdch_mask = 0;
+
+		for (ts = 0; ts < 8; ts++) {
+			struct gprs_rlcmac_pdch *pdch = &trx->pdch[ts];
+
+			if (!pdch->is_enabled())
+				continue;
+
+			pdch_mask |= 1 << ts;
+			if (!pdch->is_draining() &&
+			    pdch->num_tbfs(GPRS_RLCMAC_DL_TBF) <= PDCH_IDLE_TBF_THRESH)
+				idle_pdch_mask |= 1 << ts;
+			assigned_tfi[GPRS_RLCMAC_UL_TBF] |= pdch->assigned_tfi(GPRS_RLCMAC_UL_TBF);
+			assigned_tfi[GPRS_RLCMAC_DL_TBF] |= pdch->assigned_tfi(GPRS_RLCMAC_DL_TBF);
+		}
+
+		OSMO_ASSERT(trx->pdch_mask == pdch_mask);
+		OSMO_ASSERT(trx->idle_pdch_mask == idle_pdch_mask);
+		OSMO_ASSERT(trx->assigned_tfi[GPRS_RLCMAC_UL_TBF] == assigned_tfi[GPRS_RLCMAC_UL_TBF]);
+		OSMO_ASSERT(trx->assigned_tfi[GPRS_RLCMAC_DL_TBF] == assigned_tfi[GPRS_RLCMAC_DL_TBF]);
+	}
+}
+
+static void test_trx_masks()
+{
+	BTS the_bts;
+	struct gprs_rlcmac_bts *bts = the_bts.bts_data();
+	gprs_rlcmac_tbf *tbfs[2 * 32 * 8];
+	bool ul_full = false, dl_full = false;
+	unsigned trx_no, ts, i, num = 0;
+
+	printf("Testing the PDCH and TFI masks of the TRX\n");
+
+	bts->alloc_algorithm = alloc_algorithm_a;
+	for (trx_no = 0; trx_no < 8; trx_no++) {
+		for (ts = 0; ts < 8; ts++) {
+			if (trx_no == 7 && ts == 3)
+				continue;
+			bts->trx[trx_no].pdch[ts].enable();
+		}
+	}
+	check_trx_masks(bts);
+
+	/* fill the TFIs of all TRX */
+	while (!ul_full || !dl_full) {
+		GprsMs *ms = the_bts.ms_alloc(1, 0);
+		GprsMs::Guard guard(ms);
+		gprs_rlcmac_tbf *tbf;
+
+		if (!ul_full) {
+			tbf = tbf_alloc_ul_tbf(bts, ms, -1, true);
+			if (tbf)
+				tbfs[num++] = tbf;
+			else
+				ul_full = true;
+		}
+		if (!dl_full) {
+			tbf = tbf_alloc_dl_tbf(bts, ms, -1, true);
+			if (tbf)
+				tbfs[num++] = tbf;
+			else
+				dl_full = true;
+		}
+		check_trx_masks(bts);
+	}
+	OSMO_ASSERT(num > 0 && num <= ARRAY_SIZE(tbfs));
+
+	/* free every other TBF first */
+	for (i = 0; i < num; i += 2) {
+		tbf_free(tbfs[i]);
+		check_trx_masks(bts);
+	}
+	for (i = 1; i < num; i += 2) {
+		tbf_free(tbfs[i]);
+		check_trx_masks(bts);
+	}
+
+	bts->trx[0].pdch[5].disable();
+	check_trx_masks(bts);
+	bts->trx[7].pdch[3].enable();
+	check_trx_masks(bts);
+
+	printf("  The masks match the PDCHs\n");
+}
+
 int main(int argc, char **argv)
 {
 	tall_pcu_ctx = talloc_named_const(NULL, 1, "moiji-mobile AllocTest context");
@@ -820,6 +913,7 @@ int main(int argc, char **argv)
 	test_many_connections(alloc_algorithm_b, 32, "B");
 	test_many_connections(alloc_algorithm_dynamic, 160, "dynamic");
 	test_2_consecutive_dl_tbfs();
+	test_trx_masks();
 	return EXIT_SUCCESS;
 }
 
@@ -0,0 +1,182 @@
+/* PdchPoolTest.cpp
+ *
+ * Tests of the dynamic PDCH pool against a fake BTS that switches the
+ * requested TS right away: TS are asked for under pressure, next to the
+ * PDCHs in use and up to the configured maximum, and given back after the
+ * load stayed low. A TS the BTS stops listing as dynamic is never given
+ * back.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include "bts.h"
+#include "pdch.h"
+#include "pdch_pool.h"
+#include "pcu_utils.h"
+#include "gprs_debug.h"
+#include <gprs_rlcmac.h>
+
+extern "C" {
+#include <osmocom/core/application.h>
+#include <osmocom/core/msgb.h>
+#include <osmocom/core/rate_ctr.h>
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/utils.h>
+#include <osmocom/pcu/pcuif_proto.h>
+}
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* globals used by the code */
+void *tall_pcu_ctx;
+int16_t spoof_mnc = 0, spoof_mcc = 0;
+bool spoof_mnc_3_digits = false;
+
+/* the ACT_REQ the fake BTS still has to answer */
+static struct gsm_pcu_if_act_req act_reqs[16];
+static unsigned num_act_reqs;
+
+/* override, requires '-Wl,--wrap=pcu_sock_send' */
+int __real_pcu_sock_send(struct msgb *msg);
+int __wrap_pcu_sock_send(struct msgb *msg)
+{
+	struct gsm_pcu_if *pcu_prim = (struct gsm_pcu_if *)msg->data;
+	struct gsm_pcu_if_act_req *act_req = &pcu_prim->u.act_req;
+
+	if (pcu_prim->msg_type == PCU_IF_MSG_ACT_REQ) {
+		printf("ACT_REQ trx=%u ts=%u %s\n", act_req->trx_nr,
+			act_req->ts_nr, act_req->activate ? "activate" : "release");
+		OSMO_ASSERT(num_act_reqs < ARRAY_SIZE(act_reqs));
+		act_reqs[num_act_reqs++] = *act_req;
+	}
+
+	msgb_free(msg);
+	return 0;
+}
+
+/* Switch the TS and answer with what the INFO.ind would say about it */
+static void fake_bts_answer(BTS *the_bts)
+{
+	struct gprs_rlcmac_bts *bts = the_bts->bts_data();
+	unsigned i;
+
+	for (i = 0; i < num_act_reqs; i++) {
+		struct gsm_pcu_if_act_req *act_req = &act_reqs[i];
+		struct gprs_rlcmac_pdch *pdch =
+			&bts->trx[act_req->trx_nr].pdch[act_req->ts_nr];
+
+		if (act_req->activate && !pdch->is_enabled())
+			pdch->enable();
+		OSMO_ASSERT(!!pdch->is_enabled() == !!act_req->activate);
+		the_bts->pdch_pool()->info_ind(act_req->trx_nr, act_req->ts_nr,
+			act_req->activate);
+	}
+	num_act_reqs = 0;
+}
+
+static void advance(BTS *the_bts, uint32_t *fn, unsigned frames)
+{
+	unsigned i;
+
+	for (i = 0; i < frames; i++) {
+		*fn = (*fn + 1) % GSM_MAX_FN;
+		the_bts->set_current_frame_number(*fn);
+		fake_bts_answer(the_bts);
+	}
+}
+
+static uint64_t ctr(BTS *the_bts, unsigned id)
+{
+	return the_bts->rate_counters()->ctr[id].current;
+}
+
+static void test_pdch_pool()
+{
+	BTS the_bts;
+	struct gprs_rlcmac_bts *bts = the_bts.bts_data();
+	struct gprs_rlcmac_trx *trx = &bts->trx[0];
+	unsigned interval = msecs_to_frames(PDCH_POOL_INTERVAL_MS);
+	uint32_t fn = 0;
+	unsigned ts, i;
+
+	printf("=== start %s ===\n", __func__);
+
+	/* TS 0-3 are PDCH, TS 4-7 TCH/F_PDCH */
+	bts->alloc_algorithm = alloc_algorithm_a;
+	bts->dyn_pdch_min = 0;
+	bts->dyn_pdch_max = 2;
+	trx->dyn_pdch_mask = 0xf0;
+	for (ts = 0; ts < 4; ts++)
+		trx->pdch[ts].enable();
+	the_bts.set_current_frame_number(fn);
+
+	/* every failed allocation asks for one more TS, next to TS 3 */
+	for (i = 0; i < 3; i++) {
+		the_bts.do_rate_ctr_inc(CTR_TBF_ALLOC_FAILED);
+		advance(&the_bts, &fn, interval);
+	}
+	OSMO_ASSERT(trx->pdch_mask == 0x3f);
+	OSMO_ASSERT(ctr(&the_bts, CTR_PDCH_DYN_ACTIVATED) == 2);
+	printf("still failing, but at most 2 dynamic PDCH\n");
+
+	/* low load for PDCH_POOL_IDLE_INTERVALS, one of them goes back */
+	advance(&the_bts, &fn, (PDCH_POOL_IDLE_INTERVALS + 1) * interval);
+	OSMO_ASSERT(trx->pdch_mask == 0x1f);
+	OSMO_ASSERT(ctr(&the_bts, CTR_PDCH_DYN_RELEASED) == 1);
+
+	/* the BTS takes TS 4 off the dynamic TS while it is drained */
+	for (i = 0; i < (PDCH_POOL_IDLE_INTERVALS + 1) * interval; i++) {
+		advance(&the_bts, &fn, 1);
+		if (trx->pdch[4].is_draining())
+			break;
+	}
+	OSMO_ASSERT(trx->pdch[4].is_draining());
+	trx->dyn_pdch_mask = 0xe0;
+	advance(&the_bts, &fn, 1);
+	OSMO_ASSERT(trx->pdch[4].is_enabled());
+	OSMO_ASSERT(!trx->pdch[4].is_draining());
+	OSMO_ASSERT(trx->pdch_mask == 0x1f);
+	printf("TS 4 is kept once it is no dynamic TS anymore\n");
+
+	printf("=== end %s ===\n", __func__);
+}
+
+int main(int argc, char **argv)
+{
+	tall_pcu_ctx = talloc_named_const(NULL, 1, "PdchPoolTest context");
+	if (!tall_pcu_ctx)
+		abort();
+
+	msgb_talloc_ctx_init(tall_pcu_ctx, 0);
+	osmo_init_logging2(tall_pcu_ctx, &gprs_log_info);
+	log_set_use_color(osmo_stderr_target, 0);
+	log_set_print_filename(osmo_stderr_target, 0);
+	log_parse_category_mask(osmo_stderr_target, "DRLCMAC,1");
+
+	test_pdch_pool();
+
+	return EXIT_SUCCESS;
+}
+
+/*
+ * stubs that should not be reached
+ */
+extern "C" {
+void l1if_pdch_req() { abort(); }
+void l1if_connect_pdch() { abort(); }
+void l1if_close_pdch() { abort(); }
+void l1if_open_pdch() { abort(); }
+}
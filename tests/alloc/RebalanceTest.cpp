@@ -0,0 +1,285 @@
+/* RebalanceTest.cpp
+ *
+ * Let DL users of multislot class 12 come and go on one TRX with 8 PDCH
+ * and compare the throughput with and without the PDCH rebalancing. Every
+ * PDCH serves its DL TBFs round robin, one block per block period, so a
+ * TBF gets the sum of its shares of the PDCHs. Users leave when their
+ * transfer is done and a new user arrives in their place a little later,
+ * which leaves some PDCHs crowded and others idle. A moved TBF is not
+ * served until its MS acked the assignment, and it must never be on a
+ * PDCH that was not confirmed to the MS.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include "bts.h"
+#include "tbf.h"
+#include "tbf_dl.h"
+#include "gprs_debug.h"
+#include "gprs_ms.h"
+#include <gprs_rlcmac.h>
+
+extern "C" {
+#include <osmocom/core/application.h>
+#include <osmocom/core/msgb.h>
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/utils.h>
+#include <osmocom/core/rate_ctr.h>
+#include <osmocom/gsm/gsm_utils.h>
+}
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* globals used by the code */
+void *tall_pcu_ctx;
+int16_t spoof_mnc = 0, spoof_mcc = 0;
+bool spoof_mnc_3_digits = false;
+
+#define SIM_MS_CLASS	12	/* 4 DL slots */
+#define SIM_NUM_TS	8
+#define SIM_USERS	12
+/* blocks a user transfers, and the pause before the next user arrives */
+#define SIM_MIN_BLOCKS	200
+#define SIM_MAX_BLOCKS	4000
+#define SIM_MAX_PAUSE	400
+/* from the Packet Downlink Assignment to the poll answer */
+#define SIM_ASS_BLOCKS	8
+
+static uint8_t llc_data[200];
+
+struct sim_user {
+	gprs_rlcmac_dl_tbf *tbf;
+	unsigned left;		/* blocks still to transfer */
+	unsigned start;		/* block of arrival */
+	unsigned wait;		/* blocks until arrival resp. assignment ack */
+	uint8_t announced;	/* DL slots of the assignment in flight */
+	uint8_t confirmed;	/* DL slots the MS knows about */
+};
+
+struct sim_result {
+	unsigned blocks;
+	unsigned served;	/* PDCH blocks that carried data */
+	unsigned transfers;
+	unsigned long long transfer_blocks;
+	unsigned moved;
+};
+
+static uint32_t rnd;
+
+static unsigned sim_rand(unsigned max)
+{
+	/* fixed LCG so that both runs see the same users */
+	rnd = rnd * 1103515245 + 12345;
+	return ((rnd >> 16) & 0x7fff) % max;
+}
+
+static unsigned fn2bn(unsigned fn)
+{
+	return (fn % 52) / 4;
+}
+
+static unsigned fn_add_blocks(unsigned fn, unsigned blocks)
+{
+	unsigned bn = fn2bn(fn) + blocks;
+	fn = fn - (fn % 52);
+	fn += bn * 4 + bn / 3;
+	return fn % GSM_MAX_FN;
+}
+
+static void user_arrive(BTS *the_bts, struct sim_user *user, unsigned id,
+	unsigned block)
+{
+	GprsMs *ms = the_bts->ms_alloc(SIM_MS_CLASS, 0);
+	GprsMs::Guard guard(ms);
+	gprs_rlcmac_dl_tbf *tbf;
+
+	tbf = tbf_alloc_dl_tbf(the_bts->bts_data(), ms, 0, false);
+	OSMO_ASSERT(tbf);
+	tbf->update_ms(0xf1000000 + id, GPRS_RLCMAC_DL_TBF);
+	tbf->set_ta(0);
+	tbf->append_data(SIM_MS_CLASS, 1000, llc_data, sizeof(llc_data));
+
+	/* "Establish" the DL TBF */
+	TBF_SET_ASS_STATE_DL(tbf, GPRS_RLCMAC_DL_ASS_NONE);
+	TBF_SET_STATE(tbf, GPRS_RLCMAC_FLOW);
+	tbf->m_wait_confirm = 0;
+
+	user->tbf = tbf;
+	user->left = SIM_MIN_BLOCKS + sim_rand(SIM_MAX_BLOCKS - SIM_MIN_BLOCKS);
+	user->start = block;
+	user->wait = 0;
+	user->announced = 0;
+	user->confirmed = tbf->dl_slots();
+}
+
+static void run_sim(unsigned rebalance_interval, unsigned num_blocks,
+	struct sim_result *res)
+{
+	BTS the_bts;
+	struct gprs_rlcmac_bts *bts = the_bts.bts_data();
+	struct rate_ctr_group *ctrs = the_bts.rate_counters();
+	struct sim_user users[SIM_USERS];
+	gprs_rlcmac_dl_tbf *tbf;
+	unsigned next[SIM_NUM_TS] = { 0 };
+	unsigned block, ts, i, n;
+	uint32_t fn = 0;
+
+	bts->alloc_algorithm = alloc_algorithm_b;
+	bts->initial_cs_dl = 1;
+	bts->initial_cs_ul = 1;
+	bts->rebalance_interval = rebalance_interval;
+	bts->rebalance_min_gain = 50;
+	bts_update_params(bts);
+	for (ts = 0; ts < SIM_NUM_TS; ts++)
+		bts->trx[0].pdch[ts].enable();
+	the_bts.set_current_frame_number(fn);
+
+	rnd = 4711;
+	memset(users, 0, sizeof(users));
+	for (i = 0; i < SIM_USERS; i++)
+		user_arrive(&the_bts, &users[i], i, 0);
+
+	for (block = 0; block < num_blocks; block++) {
+		the_bts.set_current_frame_number(fn);
+
+		for (i = 0; i < SIM_USERS; i++) {
+			struct sim_user *user = &users[i];
+
+			if (user->wait && --user->wait)
+				continue;
+			if (!user->tbf) {
+				if (user->start <= block)
+					user_arrive(&the_bts, user, i, block);
+				continue;
+			}
+
+			/* the assignment is sent, then the MS acks it */
+			tbf = user->tbf;
+			if (tbf->state_is(GPRS_RLCMAC_ASSIGN)) {
+				if (!tbf->dl_ass_state_is(GPRS_RLCMAC_DL_ASS_WAIT_ACK)
+				    && !user->wait) {
+					TBF_SET_ASS_STATE_DL(tbf, GPRS_RLCMAC_DL_ASS_WAIT_ACK);
+					user->announced = tbf->assigned_dl_slots();
+					user->wait = SIM_ASS_BLOCKS;
+					continue;
+				}
+				TBF_SET_ASS_STATE_DL(tbf, GPRS_RLCMAC_DL_ASS_NONE);
+				TBF_SET_STATE(tbf, GPRS_RLCMAC_FLOW);
+				user->confirmed = user->announced;
+				tbf->rebalance_acked();
+			}
+
+			/* the scheduler sends the TBF's blocks, resends
+			 * included, on the PDCHs it is attached to */
+			OSMO_ASSERT((tbf->dl_slots() & ~user->confirmed) == 0);
+		}
+
+		/* every PDCH serves one of its TBFs in FLOW */
+		for (ts = 0; ts < SIM_NUM_TS; ts++) {
+			for (n = 0; n < SIM_USERS; n++) {
+				i = (next[ts] + n) % SIM_USERS;
+				tbf = users[i].tbf;
+				if (!tbf || !tbf->state_is(GPRS_RLCMAC_FLOW)
+				    || !(tbf->dl_slots() & (1 << ts)))
+					continue;
+
+				next[ts] = i + 1;
+				res->served += 1;
+				if (--users[i].left == 0) {
+					res->transfers += 1;
+					res->transfer_blocks += block + 1 - users[i].start;
+					tbf_free(tbf);
+					users[i].tbf = NULL;
+					users[i].wait = 1 + sim_rand(SIM_MAX_PAUSE);
+					users[i].start = block + users[i].wait;
+				}
+				break;
+			}
+		}
+
+		fn = fn_add_blocks(fn, 1);
+	}
+
+	for (i = 0; i < SIM_USERS; i++) {
+		if (users[i].tbf)
+			tbf_free(users[i].tbf);
+	}
+
+	res->blocks = num_blocks;
+	res->moved = ctrs->ctr[CTR_TBF_REBALANCED].current;
+}
+
+static void print_result(const char *name, const struct sim_result *res)
+{
+	fprintf(stderr, "%-10s  %6.1f%%  %9u  %8.1f  %6u\n", name,
+		100.0 * res->served / (res->blocks * SIM_NUM_TS), res->transfers,
+		res->transfers ? (double)res->transfer_blocks / res->transfers : 0.0,
+		res->moved);
+}
+
+int main(int argc, char **argv)
+{
+	static const unsigned intervals[] = { 1, 5 };
+	unsigned num_blocks = 100000;
+	struct sim_result off, res;
+	char name[16];
+	unsigned i;
+
+	tall_pcu_ctx = talloc_named_const(NULL, 1, "RebalanceTest context");
+	if (!tall_pcu_ctx)
+		abort();
+
+	msgb_talloc_ctx_init(tall_pcu_ctx, 0);
+	osmo_init_logging2(tall_pcu_ctx, &gprs_log_info);
+	log_set_use_color(osmo_stderr_target, 0);
+	log_set_print_filename(osmo_stderr_target, 0);
+	log_set_log_level(osmo_stderr_target, LOGL_FATAL);
+
+	fprintf(stderr, "%u blocks, %u users of class %u on %u PDCH\n",
+		num_blocks, SIM_USERS, SIM_MS_CLASS, SIM_NUM_TS);
+	fprintf(stderr, "rebalance   PDCH busy  transfers  avg time   moved\n");
+
+	memset(&off, 0, sizeof(off));
+	run_sim(0, num_blocks, &off);
+	print_result("off", &off);
+	OSMO_ASSERT(off.moved == 0);
+
+	for (i = 0; i < ARRAY_SIZE(intervals); i++) {
+		snprintf(name, sizeof(name), "every %us", intervals[i]);
+		memset(&res, 0, sizeof(res));
+		run_sim(intervals[i], num_blocks, &res);
+		print_result(name, &res);
+
+		/* the same users keep the PDCHs busier */
+		OSMO_ASSERT(res.moved > 0);
+		OSMO_ASSERT(res.served > off.served);
+		printf("rebalancing every %us: more PDCH blocks used\n",
+			intervals[i]);
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/*
+ * stubs that should not be reached
+ */
+extern "C" {
+void l1if_pdch_req() { abort(); }
+void l1if_connect_pdch() { abort(); }
+void l1if_close_pdch() { abort(); }
+void l1if_open_pdch() { abort(); }
+}
@@ -1151,6 +1151,272 @@ static void test_rlc_info_init()
 	printf("=== end %s ===\n", __func__);
 }
 
+static void test_rlc_layout()
+{
+	struct gprs_rlc_data_info rlc;
+	unsigned int cs, ul, with_padding, cps, i;
+	int punct, punct2, padding;
+
+	printf("=== start %s ===\n", __func__);
+
+	for (cs = CS1; cs < NUM_SCHEMES; cs++) {
+		enum HeaderType ht = mcs_header_type((enum CodingScheme) cs);
+
+		for (ul = 0; ul < 2; ul++) {
+			for (with_padding = 0; with_padding < 2; with_padding++) {
+				unsigned int header_bits = ul ?
+					num_data_header_bits_UL(ht) :
+					num_data_header_bits_DL(ht);
+				unsigned int padding_bits = with_padding ?
+					mcs_opt_padding_bits((enum CodingScheme) cs) : 0;
+				unsigned int data_len =
+					mcs_max_data_block_bytes((enum CodingScheme) cs) -
+					padding_bits / 8;
+
+				if (ul)
+					gprs_rlc_data_info_init_ul(&rlc,
+						(enum CodingScheme) cs, with_padding);
+				else
+					gprs_rlc_data_info_init_dl(&rlc,
+						(enum CodingScheme) cs, with_padding, 0);
+
+				OSMO_ASSERT(rlc.num_data_blocks == num_data_blocks(ht));
+				for (i = 0; i < rlc.num_data_blocks; i++) {
+					OSMO_ASSERT(rlc.block_info[i].data_len == data_len);
+					OSMO_ASSERT(rlc.data_offs_bits[i] ==
+						header_bits + padding_bits +
+						(i+1) * num_data_block_header_bits(ht) +
+						i * 8 * data_len);
+				}
+			}
+		}
+
+		for (cps = 0; cps < 32; cps++) {
+			gprs_rlc_mcs_cps_decode(cps, (enum CodingScheme) cs,
+				&punct, &punct2, &padding);
+			OSMO_ASSERT(gprs_rlc_mcs_cps_padding(cps,
+				(enum CodingScheme) cs) == !!padding);
+		}
+	}
+
+	/* MCS-3 and MCS-6 parse the padding from the CPS */
+	for (cps = 0; cps < 16; cps++) {
+		uint8_t data[74] = {0};
+		struct gprs_rlc_ul_header_egprs_3 *egprs3 =
+			(struct gprs_rlc_ul_header_egprs_3 *) data;
+
+		egprs3->cps_hi = cps >> 0;
+		egprs3->cps_lo = cps >> 2;
+		Decoding::rlc_parse_ul_data_header(&rlc, data, MCS3);
+		gprs_rlc_mcs_cps_decode(cps, MCS3, &punct, &punct2, &padding);
+		OSMO_ASSERT(rlc.cps == cps);
+		OSMO_ASSERT(rlc.with_padding == !!padding);
+		OSMO_ASSERT(rlc.data_offs_bits[0] ==
+			(padding ? 31 + 48 : 31) + 1);
+	}
+
+	printf("=== end %s ===\n", __func__);
+}
+
+static bool rlc_bit(const uint8_t *data, unsigned int bit)
+{
+	return (data[bit / 8] >> (bit % 8)) & 1;
+}
+
+static bool rlc_data_area(const struct gprs_rlc_data_info *rlc,
+	unsigned int bit)
+{
+	unsigned int i;
+
+	for (i = 0; i < rlc->num_data_blocks; i++) {
+		if (bit >= rlc->data_offs_bits[i] && bit <
+		    rlc->data_offs_bits[i] + 8 * rlc->block_info[i].data_len)
+			return true;
+	}
+	return false;
+}
+
+/* Read the DL header fields back through the 44.060 overlays */
+static void read_dl_data_header(struct gprs_rlc_data_info *out,
+	const struct gprs_rlc_data_info *rlc, const uint8_t *data)
+{
+	const struct rlc_dl_header *gprs = (const struct rlc_dl_header *)data;
+	const struct gprs_rlc_dl_header_egprs_1 *egprs1 =
+		(const struct gprs_rlc_dl_header_egprs_1 *)data;
+	const struct gprs_rlc_dl_header_egprs_2 *egprs2 =
+		(const struct gprs_rlc_dl_header_egprs_2 *)data;
+	const struct gprs_rlc_dl_header_egprs_3 *egprs3 =
+		(const struct gprs_rlc_dl_header_egprs_3 *)data;
+	unsigned int i;
+
+	memset(out, 0, sizeof(*out));
+
+	switch (mcs_header_type(rlc->cs)) {
+	case HEADER_GPRS_DATA:
+		out->usf = gprs->usf;
+		out->es_p = gprs->s_p;
+		out->rrbp = gprs->rrbp;
+		out->tfi = gprs->tfi;
+		out->pr = gprs->pr;
+		out->block_info[0].bsn = gprs->bsn;
+		out->block_info[0].e = gprs->e;
+		out->block_info[0].cv = !gprs->fbi;
+		return;
+	case HEADER_EGPRS_DATA_TYPE_1:
+		out->usf = egprs1->usf;
+		out->es_p = egprs1->es_p;
+		out->rrbp = egprs1->rrbp;
+		out->tfi = egprs1->tfi_hi | (egprs1->tfi_lo << 1);
+		out->pr = egprs1->pr;
+		out->cps = egprs1->cps;
+		out->block_info[0].bsn = egprs1->bsn1_hi |
+			(egprs1->bsn1_mid << 2) | (egprs1->bsn1_lo << 10);
+		out->block_info[1].bsn = (out->block_info[0].bsn +
+			(egprs1->bsn2_hi | (egprs1->bsn2_lo << 7))) &
+			(RLC_EGPRS_SNS - 1);
+		break;
+	case HEADER_EGPRS_DATA_TYPE_2:
+		out->usf = egprs2->usf;
+		out->es_p = egprs2->es_p;
+		out->rrbp = egprs2->rrbp;
+		out->tfi = egprs2->tfi_hi | (egprs2->tfi_lo << 1);
+		out->pr = egprs2->pr;
+		out->cps = egprs2->cps;
+		out->block_info[0].bsn = egprs2->bsn1_hi |
+			(egprs2->bsn1_mid << 2) | (egprs2->bsn1_lo << 10);
+		break;
+	case HEADER_EGPRS_DATA_TYPE_3:
+		out->usf = egprs3->usf;
+		out->es_p = egprs3->es_p;
+		out->rrbp = egprs3->rrbp;
+		out->tfi = egprs3->tfi_hi | (egprs3->tfi_lo << 1);
+		out->pr = egprs3->pr;
+		out->cps = egprs3->cps;
+		out->block_info[0].bsn = egprs3->bsn1_hi |
+			(egprs3->bsn1_mid << 2) | (egprs3->bsn1_lo << 10);
+		out->block_info[0].spb = egprs3->spb;
+		break;
+	default:
+		OSMO_ASSERT(0);
+	}
+
+	/* E and FBI directly precede the data of each block */
+	for (i = 0; i < rlc->num_data_blocks; i++) {
+		out->block_info[i].e = rlc_bit(data, rlc->data_offs_bits[i] - 2);
+		out->block_info[i].cv = !rlc_bit(data, rlc->data_offs_bits[i] - 1);
+	}
+}
+
+static void test_rlc_header_bits()
+{
+	static const unsigned int bsns[] = { 0, 1, 63, 64, 127, 128, 1023, 2047 };
+	struct gprs_rlc_data_info rlc, out, ref;
+	/* room for the two data units of MCS-9 and the header */
+	uint8_t data[2][2 * RLC_MAX_LEN + 8];
+	uint8_t flipped[sizeof(data[0])];
+	unsigned int cs, tfi, i, bit, fill, sns;
+
+	printf("=== start %s ===\n", __func__);
+
+	/* DL: every field is written where the overlays read it, the data
+	 * areas are left alone */
+	for (cs = CS1; cs < NUM_SCHEMES; cs++) {
+		enum HeaderType ht = mcs_header_type((enum CodingScheme) cs);
+
+		sns = mcs_is_edge((enum CodingScheme) cs) ? RLC_EGPRS_SNS : RLC_GPRS_SNS;
+
+		for (tfi = 0; tfi < 32; tfi++) {
+			for (i = 0; i < ARRAY_SIZE(bsns); i++) {
+				gprs_rlc_data_info_init_dl(&rlc,
+					(enum CodingScheme) cs, false, 0);
+				rlc.usf = tfi % 8;
+				rlc.es_p = ht == HEADER_GPRS_DATA ? tfi / 8 % 2 : tfi / 8;
+				rlc.rrbp = tfi % 4;
+				rlc.tfi = tfi;
+				rlc.pr = tfi / 4 % 4;
+				rlc.block_info[0].bsn = bsns[i] % sns;
+				rlc.block_info[0].e = tfi % 2;
+				rlc.block_info[0].cv = tfi / 2 % 2 ? 0 : 5;
+				rlc.block_info[1].bsn = (bsns[i] + tfi) % sns;
+				rlc.block_info[1].e = !rlc.block_info[0].e;
+				rlc.block_info[1].cv = tfi / 3 % 2 ? 0 : 7;
+				if (ht == HEADER_EGPRS_DATA_TYPE_1)
+					rlc.cps = tfi;
+				else if (ht == HEADER_EGPRS_DATA_TYPE_2)
+					rlc.cps = tfi % 8;
+				else if (ht == HEADER_EGPRS_DATA_TYPE_3)
+					rlc.cps = tfi % 16;
+				if (ht == HEADER_EGPRS_DATA_TYPE_3)
+					rlc.block_info[0].spb = tfi % 4;
+
+				for (fill = 0; fill < 2; fill++) {
+					memset(data[fill], fill ? 0xff : 0x00,
+						sizeof(data[fill]));
+					Encoding::rlc_write_dl_data_header(&rlc,
+						data[fill]);
+					read_dl_data_header(&out, &rlc, data[fill]);
+
+					OSMO_ASSERT(out.usf == rlc.usf);
+					OSMO_ASSERT(out.es_p == rlc.es_p);
+					OSMO_ASSERT(out.rrbp == rlc.rrbp);
+					OSMO_ASSERT(out.tfi == rlc.tfi);
+					OSMO_ASSERT(out.pr == rlc.pr);
+					OSMO_ASSERT(ht == HEADER_GPRS_DATA ||
+						out.cps == rlc.cps);
+					OSMO_ASSERT(out.block_info[0].bsn ==
+						rlc.block_info[0].bsn);
+					OSMO_ASSERT(out.block_info[0].spb ==
+						rlc.block_info[0].spb);
+					OSMO_ASSERT(out.block_info[0].e ==
+						rlc.block_info[0].e);
+					OSMO_ASSERT(!out.block_info[0].cv ==
+						!rlc.block_info[0].cv);
+					if (rlc.num_data_blocks < 2)
+						continue;
+					OSMO_ASSERT(out.block_info[1].bsn ==
+						rlc.block_info[1].bsn);
+					OSMO_ASSERT(out.block_info[1].e ==
+						rlc.block_info[1].e);
+					OSMO_ASSERT(!out.block_info[1].cv ==
+						!rlc.block_info[1].cv);
+				}
+
+				for (bit = 0; bit < 8 * sizeof(data[0]); bit++) {
+					if (!rlc_data_area(&rlc, bit))
+						continue;
+					OSMO_ASSERT(!rlc_bit(data[0], bit));
+					OSMO_ASSERT(rlc_bit(data[1], bit));
+				}
+			}
+		}
+	}
+
+	/* UL: the parsed header does not depend on the data areas */
+	srand(1);
+	for (cs = CS1; cs < NUM_SCHEMES; cs++) {
+		for (i = 0; i < sizeof(data[0]); i++)
+			data[0][i] = rand();
+
+		memset(&ref, 0, sizeof(ref));
+		Decoding::rlc_parse_ul_data_header(&ref, data[0],
+			(enum CodingScheme) cs);
+
+		for (bit = 0; bit < 8 * sizeof(data[0]); bit++) {
+			if (!rlc_data_area(&ref, bit))
+				continue;
+
+			memcpy(flipped, data[0], sizeof(flipped));
+			flipped[bit / 8] ^= 1 << (bit % 8);
+			memset(&rlc, 0, sizeof(rlc));
+			Decoding::rlc_parse_ul_data_header(&rlc, flipped,
+				(enum CodingScheme) cs);
+			OSMO_ASSERT(memcmp(&rlc, &ref, sizeof(rlc)) == 0);
+		}
+	}
+
+	printf("=== end %s ===\n", __func__);
+}
+
 static void setup_bts(BTS *the_bts, uint8_t ts_no, uint8_t cs = 1)
 {
 	gprs_rlcmac_bts *bts;
@@ -1405,6 +1671,8 @@ int main(int argc, char **argv)
 
 	test_coding_scheme();
 	test_rlc_info_init();
+	test_rlc_layout();
+	test_rlc_header_bits();
 	test_rlc_unit_decoder();
 	test_rlc_unaligned_copy();
 	test_rlc_unit_encoder();
@@ -0,0 +1,147 @@
+/* RlcHeaderBench.cpp
+ *
+ * Measure how many RLC data block headers per second are set up and
+ * written for the downlink resp. parsed for the uplink, per coding
+ * scheme. The headers are filled with pseudo random bits.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include "gprs_debug.h"
+#include "decoding.h"
+#include "encoding.h"
+#include "rlc.h"
+#include <gprs_rlcmac.h>
+
+extern "C" {
+#include "coding_scheme.h"
+
+#include <osmocom/core/application.h>
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/utils.h>
+}
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* globals used by the code */
+void *tall_pcu_ctx;
+int16_t spoof_mnc = 0, spoof_mcc = 0;
+bool spoof_mnc_3_digits = false;
+
+#define BENCH_NUM_BLOCKS	64
+
+static uint8_t blocks[BENCH_NUM_BLOCKS][RLC_MAX_LEN];
+
+static double elapsed_sec(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* keeps the compiler from dropping the work */
+static volatile unsigned sink;
+
+static double bench_parse(enum CodingScheme cs, unsigned rounds)
+{
+	struct gprs_rlc_data_info rlc;
+	struct timespec start;
+	unsigned round, i, sum = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (round = 0; round < rounds; round++) {
+		for (i = 0; i < BENCH_NUM_BLOCKS; i++)
+			sum += Decoding::rlc_parse_ul_data_header(&rlc,
+				blocks[i], cs);
+	}
+	sink = sum;
+
+	return rounds * BENCH_NUM_BLOCKS / elapsed_sec(&start);
+}
+
+static double bench_write(enum CodingScheme cs, unsigned rounds)
+{
+	struct gprs_rlc_data_info rlc;
+	struct timespec start;
+	unsigned round, i, sum = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (round = 0; round < rounds; round++) {
+		for (i = 0; i < BENCH_NUM_BLOCKS; i++) {
+			gprs_rlc_data_info_init_dl(&rlc, cs, false, 0);
+			rlc.usf = i;
+			rlc.tfi = round;
+			rlc.block_info[0].bsn = i;
+			rlc.block_info[1].bsn = i + 1;
+			rlc.block_info[0].cv = i & 1;
+			Encoding::rlc_write_dl_data_header(&rlc, blocks[i]);
+			sum += blocks[i][0];
+		}
+	}
+	sink = sum;
+
+	return rounds * BENCH_NUM_BLOCKS / elapsed_sec(&start);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned rounds = 100000;
+	unsigned i, j;
+	int cs;
+
+	if (argc > 1)
+		rounds = atoi(argv[1]);
+	if (!rounds) {
+		fprintf(stderr, "usage: %s [ROUNDS]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	tall_pcu_ctx = talloc_named_const(NULL, 1, "RlcHeaderBench context");
+	if (!tall_pcu_ctx)
+		abort();
+
+	osmo_init_logging2(tall_pcu_ctx, &gprs_log_info);
+	log_set_use_color(osmo_stderr_target, 0);
+	log_set_print_filename(osmo_stderr_target, 0);
+	log_set_log_level(osmo_stderr_target, LOGL_FATAL);
+
+	srand(1);
+	for (i = 0; i < BENCH_NUM_BLOCKS; i++)
+		for (j = 0; j < sizeof(blocks[i]); j++)
+			blocks[i][j] = rand();
+
+	printf("%u rounds of %d blocks\n", rounds, BENCH_NUM_BLOCKS);
+	printf("CS      parse UL/s   write DL/s\n");
+	for (cs = CS1; cs < NUM_SCHEMES; cs++)
+		printf("%-6s %11.0f  %11.0f\n", mcs_name((enum CodingScheme) cs),
+			bench_parse((enum CodingScheme) cs, rounds),
+			bench_write((enum CodingScheme) cs, rounds));
+
+	return EXIT_SUCCESS;
+}
+
+/*
+ * stubs that should not be reached
+ */
+extern "C" {
+void l1if_pdch_req() { abort(); }
+void l1if_connect_pdch() { abort(); }
+void l1if_close_pdch() { abort(); }
+void l1if_open_pdch() { abort(); }
+}
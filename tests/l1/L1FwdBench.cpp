@@ -0,0 +1,184 @@
+/* L1FwdBench.cpp
+ *
+ * Submit PDTCH blocks for all 8 TS of a frame through the sysmoBTS L1
+ * forwarding transport to a local fake L1, which only receives the
+ * datagrams. Reports the primitives per second, the send calls per frame
+ * and the payload copies per block.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include "gprs_debug.h"
+
+extern "C" {
+#include "sysmo_l1_if.h"
+#include <osmocom/core/application.h>
+#include <osmocom/core/msgb.h>
+#include <osmocom/core/rate_ctr.h>
+#include <osmocom/core/select.h>
+#include <osmocom/core/socket.h>
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/utils.h>
+
+void *l1if_open_pdch(uint8_t trx_no, uint32_t hlayer1,
+	struct gsmtap_inst *gsmtap);
+int l1if_close_pdch(void *obj);
+int l1if_pdch_req(void *obj, uint8_t ts, int is_ptcch, uint32_t fn,
+	uint16_t arfcn, uint8_t block_nr, uint8_t *data, uint8_t len);
+}
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* globals used by the code */
+void *tall_pcu_ctx;
+int16_t spoof_mnc = 0, spoof_mcc = 0;
+bool spoof_mnc_3_digits = false;
+
+#define FAKE_L1_HOST	"127.0.0.1"
+#define FAKE_L1_PORT	9996	/* L1FWD_PDTCH_PORT */
+#define BENCH_NUM_TS	8
+#define BENCH_ARFCN	871
+
+static double elapsed_sec(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* the fake L1 only takes the primitives off the socket */
+static unsigned fake_l1_drain(int fd)
+{
+	static GsmL1_Prim_t prims[L1IF_PDCH_RING_SIZE];
+	struct mmsghdr msgs[L1IF_PDCH_RING_SIZE];
+	struct iovec iov[L1IF_PDCH_RING_SIZE];
+	unsigned i, num = 0;
+	int rc;
+
+	memset(msgs, 0, sizeof(msgs));
+	for (i = 0; i < ARRAY_SIZE(msgs); i++) {
+		iov[i].iov_base = &prims[i];
+		iov[i].iov_len = sizeof(prims[i]);
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	do {
+		rc = recvmmsg(fd, msgs, ARRAY_SIZE(msgs), MSG_DONTWAIT, NULL);
+		if (rc > 0)
+			num += rc;
+	} while (rc > 0);
+
+	return num;
+}
+
+static void bench_fwd(unsigned num_frames)
+{
+	struct femtol1_hdl *fl1h;
+	struct rate_ctr_group *ctrs;
+	struct timespec start;
+	uint8_t data[54];
+	unsigned long long received = 0;
+	unsigned frame, ts;
+	uint32_t fn = 0;
+	double sec;
+	int fake_l1;
+
+	fake_l1 = osmo_sock_init(AF_INET, SOCK_DGRAM, IPPROTO_UDP,
+		FAKE_L1_HOST, FAKE_L1_PORT, OSMO_SOCK_F_BIND | OSMO_SOCK_F_NONBLOCK);
+	if (fake_l1 < 0) {
+		fprintf(stderr, "cannot bind the fake L1 to %s:%d\n",
+			FAKE_L1_HOST, FAKE_L1_PORT);
+		exit(EXIT_FAILURE);
+	}
+
+	fl1h = (struct femtol1_hdl *)l1if_open_pdch(0, 0x1234, NULL);
+	OSMO_ASSERT(fl1h);
+	ctrs = fl1h->pdch_ring.ctrs;
+
+	memset(data, 0x2b, sizeof(data));
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (frame = 0; frame < num_frames; frame++) {
+		for (ts = 0; ts < BENCH_NUM_TS; ts++)
+			l1if_pdch_req(fl1h, ts, 0, fn, BENCH_ARFCN,
+				(fn % 52) / 4, data, sizeof(data));
+
+		/* one main loop iteration submits the frame */
+		osmo_select_main(1);
+		received += fake_l1_drain(fake_l1);
+
+		fn = (fn + 4) % GSM_MAX_FN;
+	}
+	sec = elapsed_sec(&start);
+
+	/* whatever the socket buffer held back */
+	while (l1if_pdch_ring_pending(&fl1h->pdch_ring)) {
+		osmo_select_main(1);
+		received += fake_l1_drain(fake_l1);
+	}
+	received += fake_l1_drain(fake_l1);
+
+	printf("%u frames of %d TS, %llu primitives received, %llu dropped\n",
+		num_frames, BENCH_NUM_TS, received,
+		(unsigned long long)ctrs->ctr[L1IF_PDCH_CTR_DROPPED].current);
+	printf("%.0f primitives/s\n", ctrs->ctr[L1IF_PDCH_CTR_PRIMS].current / sec);
+	printf("%.2f send calls per frame\n",
+		(double)ctrs->ctr[L1IF_PDCH_CTR_SYSCALLS].current / num_frames);
+	printf("%.2f payload copies per block\n",
+		(double)ctrs->ctr[L1IF_PDCH_CTR_COPIES].current /
+		(num_frames * BENCH_NUM_TS));
+
+	l1if_close_pdch(fl1h);
+	close(fake_l1);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned num_frames = 100000;
+
+	if (argc > 1)
+		num_frames = atoi(argv[1]);
+	if (!num_frames) {
+		fprintf(stderr, "usage: %s [FRAMES]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	tall_pcu_ctx = talloc_named_const(NULL, 1, "L1FwdBench context");
+	if (!tall_pcu_ctx)
+		abort();
+
+	msgb_talloc_ctx_init(tall_pcu_ctx, 0);
+	osmo_init_logging2(tall_pcu_ctx, &gprs_log_info);
+	log_set_use_color(osmo_stderr_target, 0);
+	log_set_print_filename(osmo_stderr_target, 0);
+	/* keep the submission path free of log output */
+	log_set_log_level(osmo_stderr_target, LOGL_FATAL);
+
+	/* the forwarding transport sends to the fake L1 */
+	setenv("L1FWD_BTS_HOST", FAKE_L1_HOST, 1);
+
+	bench_fwd(num_frames);
+
+	return EXIT_SUCCESS;
+}
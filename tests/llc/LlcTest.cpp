@@ -25,6 +25,7 @@ extern "C" {
 }
 
 #include "llc.h"
+#include "bts.h"
 #include "gprs_debug.h"
 
 extern "C" {
@@ -218,6 +219,88 @@ static void test_llc_merge()
 	printf("=== end %s ===\n", __func__);
 }
 
+static void test_llc_budget()
+{
+	BTS the_bts;
+	LlcController *llc = the_bts.llc();
+	struct rate_ctr_group *ctrs = the_bts.rate_counters();
+	gprs_llc_queue queue1;
+	gprs_llc_queue queue2;
+	gprs_llc_queue queue3;
+	struct timespec expire_time = {0};
+	struct timespec now;
+
+	printf("=== start %s ===\n", __func__);
+
+	the_bts.bts_data()->llc_queue_budget = 16;
+	queue1.init(llc);
+	queue2.init(llc);
+	queue3.init(llc);
+
+	enqueue_data(&queue1, "*A*", &expire_time);
+	enqueue_data(&queue1, "*B*", &expire_time);
+	enqueue_data(&queue2, "*C*", &expire_time);
+	enqueue_data(&queue1, "*D*", &expire_time);
+	enqueue_data(&queue2, "*E*", &expire_time);
+
+	OSMO_ASSERT(llc->frames() == 5);
+	OSMO_ASSERT(llc->octets() == 15);
+	OSMO_ASSERT(llc->queues() == 2);
+
+	/* over budget, the longest queue loses its oldest frame */
+	enqueue_data(&queue1, "*F*", &expire_time);
+
+	OSMO_ASSERT(ctrs->ctr[CTR_LLC_FRAME_EVICTED].current == 1);
+	OSMO_ASSERT(queue1.size() == 3);
+	OSMO_ASSERT(queue2.size() == 2);
+	OSMO_ASSERT(llc->frames() == 5);
+	OSMO_ASSERT(llc->octets() == 15);
+
+	/* frames of queues nobody dequeues from expire in the sweep */
+	the_bts.bts_data()->llc_queue_budget = 0;
+	osmo_clock_gettime(CLOCK_MONOTONIC, &expire_time);
+	expire_time.tv_sec += 1;
+	enqueue_data(&queue3, "*G*", &expire_time);
+	expire_time.tv_sec += 2;
+	enqueue_data(&queue3, "*H*", &expire_time);
+	OSMO_ASSERT(llc->queues() == 3);
+
+	osmo_clock_gettime(CLOCK_MONOTONIC, &now);
+	OSMO_ASSERT(llc->sweep(&now) == 0);
+
+	clk_mono_override_time->tv_sec += 2;
+	osmo_clock_gettime(CLOCK_MONOTONIC, &now);
+	OSMO_ASSERT(llc->sweep(&now) == 1);
+	OSMO_ASSERT(ctrs->ctr[CTR_LLC_FRAME_TIMEDOUT].current == 1);
+	OSMO_ASSERT(queue3.size() == 1);
+	OSMO_ASSERT(llc->frames() == 6);
+	OSMO_ASSERT(llc->octets() == 18);
+
+	/* merging keeps the totals */
+	queue2.move_and_merge(&queue3);
+	OSMO_ASSERT(llc->queues() == 2);
+	OSMO_ASSERT(llc->frames() == 6);
+
+	queue1.clear(NULL);
+	queue2.clear(NULL);
+	OSMO_ASSERT(llc->frames() == 0);
+	OSMO_ASSERT(llc->octets() == 0);
+	OSMO_ASSERT(llc->queues() == 0);
+
+	/* a queue that goes away is no longer indexed */
+	{
+		gprs_llc_queue queue4;
+
+		queue4.init(llc);
+		enqueue_data(&queue4, "*G*", &expire_time);
+		OSMO_ASSERT(llc->queues() == 1);
+	}
+	OSMO_ASSERT(llc->frames() == 0);
+	OSMO_ASSERT(llc->queues() == 0);
+
+	printf("=== end %s ===\n", __func__);
+}
+
 int main(int argc, char **argv)
 {
 	struct vty_app_info pcu_vty_info = {0};
@@ -244,6 +327,7 @@ int main(int argc, char **argv)
 	test_llc_queue();
 	test_llc_meta();
 	test_llc_merge();
+	test_llc_budget();
 
 	if (getenv("TALLOC_REPORT_FULL"))
 		talloc_report_full(tall_pcu_ctx, stderr);
@@ -0,0 +1,278 @@
+/* ShowMsTest.cpp
+ *
+ * Tests of the MS and TBF listings of the VTY: a long listing is printed
+ * in slices of at most PCU_VTY_WALK_SLICE_ENTRIES, one per main loop
+ * iteration, so an RTS never waits for all of it. MS and TBFs that go
+ * away while the listing is in progress are skipped.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include "bts.h"
+#include "tbf.h"
+#include "gprs_debug.h"
+#include "gprs_ms.h"
+#include "pcu_vty_functions.h"
+#include <gprs_rlcmac.h>
+
+extern "C" {
+#include <osmocom/core/application.h>
+#include <osmocom/core/msgb.h>
+#include <osmocom/core/select.h>
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/utils.h>
+#include <osmocom/vty/buffer.h>
+#include <osmocom/vty/vty.h>
+}
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* globals used by the code */
+void *tall_pcu_ctx;
+int16_t spoof_mnc = 0, spoof_mcc = 0;
+bool spoof_mnc_3_digits = false;
+
+#define TEST_TS		7
+#define TEST_NUM_MS	2000
+/* Worst time an RTS may wait for a slice of the listing. A slice takes
+ * about 1 ms at most, this leaves room for slow or loaded test hosts. */
+#define TEST_RTS_LATENCY_MAX_US	50000
+
+/* override, requires '-Wl,--wrap=pcu_sock_send' */
+int __real_pcu_sock_send(struct msgb *msg);
+int __wrap_pcu_sock_send(struct msgb *msg)
+{
+	msgb_free(msg);
+	return 0;
+}
+
+static unsigned fn2bn(unsigned fn)
+{
+	return (fn % 52) / 4;
+}
+
+static unsigned fn_next_block(unsigned fn)
+{
+	unsigned bn = fn2bn(fn) + 1;
+	fn = fn - (fn % 52);
+	fn += bn * 4 + bn / 3;
+	return fn % GSM_MAX_FN;
+}
+
+static uint32_t elapsed_us(const struct timespec *start, const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) * 1000000 +
+		(end->tv_nsec - start->tv_nsec) / 1000;
+}
+
+/* Take what has been printed to the VTY. Returns the number of lines that
+ * start with prefix, the last line goes to last. */
+static unsigned vty_take(struct vty *vty, const char *prefix, char *last,
+	size_t last_len)
+{
+	char *out = buffer_getstr(vty->obuf);
+	char *line, *save = NULL;
+	unsigned num = 0;
+
+	buffer_reset(vty->obuf);
+	OSMO_ASSERT(out);
+
+	for (line = strtok_r(out, "\r\n", &save); line;
+	     line = strtok_r(NULL, "\r\n", &save)) {
+		if (!strncmp(line, prefix, strlen(prefix)))
+			num += 1;
+		if (last)
+			osmo_strlcpy(last, line, last_len);
+	}
+
+	talloc_free(out);
+	return num;
+}
+
+static void test_show_ms_summary()
+{
+	BTS the_bts;
+	struct gprs_rlcmac_bts *bts = the_bts.bts_data();
+	GprsMs *ms[TEST_NUM_MS];
+	struct vty *vty;
+	struct timespec t0, t1;
+	char last[128];
+	uint32_t us, worst_us = 0;
+	uint32_t fn = 0;
+	unsigned first, num, rts = 0;
+	unsigned i;
+
+	printf("=== start %s ===\n", __func__);
+
+	bts->alloc_algorithm = alloc_algorithm_a;
+	bts->trx[0].pdch[TEST_TS].enable();
+	the_bts.set_current_frame_number(fn);
+
+	for (i = 0; i < TEST_NUM_MS; i++) {
+		char imsi[16];
+
+		ms[i] = the_bts.ms_alloc(12, 0);
+		snprintf(imsi, sizeof(imsi), "26242%010u", i);
+		ms[i]->set_tlli(0xc0000000 | i);
+		ms[i]->set_imsi(imsi);
+	}
+
+	vty = vty_new();
+	OSMO_ASSERT(vty);
+
+	/* the command prints the header and the first slice only */
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	pcu_vty_show_ms_summary(vty, bts, 0, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	worst_us = elapsed_us(&t0, &t1);
+	first = vty_take(vty, "c0000", NULL, 0);
+	OSMO_ASSERT(first >= 1 && first <= PCU_VTY_WALK_SLICE_ENTRIES);
+	OSMO_ASSERT(pcu_vty_walks_pending() == 1);
+	printf("listing in progress after the command\n");
+
+	/* The newest MS are listed first. Remove the one the listing
+	 * continues with and some that are still to come, as if they had
+	 * been idle for too long. */
+	the_bts.ms_store().ms_idle(ms[TEST_NUM_MS - 1 - first]);
+	for (i = 0; i < 10; i++)
+		the_bts.ms_store().ms_idle(ms[i]);
+
+	/* every main loop iteration prints one slice, then the RTS that
+	 * waited for it is handled */
+	while (pcu_vty_walks_pending()) {
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		osmo_select_main(1);
+		num = vty_take(vty, "c0000", last, sizeof(last));
+		OSMO_ASSERT(num <= PCU_VTY_WALK_SLICE_ENTRIES);
+
+		gprs_rlcmac_rcv_rts_block(bts, 0, TEST_TS, fn, fn2bn(fn));
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		fn = fn_next_block(fn);
+		rts += 1;
+
+		us = elapsed_us(&t0, &t1);
+		if (us > worst_us)
+			worst_us = us;
+	}
+
+	fprintf(stderr, "%u RTS during the listing, worst latency %u us\n",
+		rts, worst_us);
+	OSMO_ASSERT(rts >= (TEST_NUM_MS - 11 - first) / PCU_VTY_WALK_SLICE_ENTRIES);
+	OSMO_ASSERT(worst_us < TEST_RTS_LATENCY_MAX_US);
+	printf("%s\n", last);
+
+	talloc_free(vty);
+
+	printf("=== end %s ===\n", __func__);
+}
+
+static void test_show_tbf_all()
+{
+	static const char *limit_argv[] = { "limit", "100" };
+	BTS the_bts;
+	struct gprs_rlcmac_bts *bts = the_bts.bts_data();
+	gprs_rlcmac_dl_tbf *tbfs[8 * 32];
+	struct vty *vty;
+	unsigned first, shown, num = 0;
+	unsigned i;
+
+	printf("=== start %s ===\n", __func__);
+
+	bts->alloc_algorithm = alloc_algorithm_a;
+	for (i = 0; i < 8; i++)
+		bts->trx[i].pdch[TEST_TS].enable();
+	the_bts.set_current_frame_number(0);
+
+	/* one DL TBF per TFI */
+	while (num < ARRAY_SIZE(tbfs)) {
+		GprsMs *ms = the_bts.ms_alloc(1, 0);
+
+		tbfs[num] = tbf_alloc_dl_tbf(bts, ms, -1, true);
+		if (!tbfs[num])
+			break;
+		tbfs[num]->state_flags |= (1 << GPRS_RLCMAC_FLAG_CCCH);
+		num += 1;
+	}
+	OSMO_ASSERT(num > 100);
+
+	vty = vty_new();
+	OSMO_ASSERT(vty);
+
+	pcu_vty_show_tbf_all(vty, bts, UINT32_MAX, 0, NULL);
+	first = vty_take(vty, "TBF:", NULL, 0);
+	OSMO_ASSERT(first <= PCU_VTY_WALK_SLICE_ENTRIES);
+	OSMO_ASSERT(pcu_vty_walks_pending() == 1);
+
+	/* the newest TBFs are listed first, free the one the listing
+	 * continues with and the oldest one */
+	tbf_free(tbfs[num - 1 - first]);
+	tbf_free(tbfs[0]);
+
+	shown = first;
+	while (pcu_vty_walks_pending()) {
+		osmo_select_main(1);
+		i = vty_take(vty, "TBF:", NULL, 0);
+		OSMO_ASSERT(i <= PCU_VTY_WALK_SLICE_ENTRIES);
+		shown += i;
+	}
+	OSMO_ASSERT(shown == num - 2);
+	printf("all DL TBFs but the two freed ones shown\n");
+
+	/* the limit applies to the whole listing */
+	pcu_vty_show_tbf_all(vty, bts, UINT32_MAX, ARRAY_SIZE(limit_argv),
+		limit_argv);
+	shown = vty_take(vty, "TBF:", NULL, 0);
+	while (pcu_vty_walks_pending()) {
+		osmo_select_main(1);
+		shown += vty_take(vty, "TBF:", NULL, 0);
+	}
+	printf("%u DL TBFs shown with limit 100\n", shown);
+
+	talloc_free(vty);
+
+	printf("=== end %s ===\n", __func__);
+}
+
+int main(int argc, char **argv)
+{
+	tall_pcu_ctx = talloc_named_const(NULL, 1, "ShowMsTest context");
+	if (!tall_pcu_ctx)
+		abort();
+
+	msgb_talloc_ctx_init(tall_pcu_ctx, 0);
+	osmo_init_logging2(tall_pcu_ctx, &gprs_log_info);
+	log_set_use_color(osmo_stderr_target, 0);
+	log_set_print_filename(osmo_stderr_target, 0);
+	/* keep the RTS path free of log output */
+	log_set_log_level(osmo_stderr_target, LOGL_FATAL);
+
+	test_show_ms_summary();
+	test_show_tbf_all();
+
+	return EXIT_SUCCESS;
+}
+
+/*
+ * stubs that should not be reached
+ */
+extern "C" {
+void l1if_pdch_req() { abort(); }
+void l1if_connect_pdch() { abort(); }
+void l1if_close_pdch() { abort(); }
+void l1if_open_pdch() { abort(); }
+}
@@ -0,0 +1,313 @@
+/* PcuIfBench.cpp
+ *
+ * Run a PCU in a child process against a fake BTS on a local PCU socket,
+ * once over the socket alone and once with the shared memory rings. Every
+ * block the fake BTS sends a TIME.ind and the RTS of all 8 TS and waits for
+ * the 8 DATA.req. Reports the round trip per block, the primitives per
+ * second and the syscalls the fake BTS needs per block.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include "bts.h"
+#include "gprs_debug.h"
+#include "pcu_hist.h"
+#include "pcu_l1_if.h"
+#include "pcuif_shm.h"
+
+extern "C" {
+#include <osmocom/core/application.h>
+#include <osmocom/core/msgb.h>
+#include <osmocom/core/select.h>
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/utils.h>
+#include <osmocom/pcu/pcuif_proto.h>
+}
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* globals used by the code */
+void *tall_pcu_ctx;
+int16_t spoof_mnc = 0, spoof_mcc = 0;
+bool spoof_mnc_3_digits = false;
+
+#define BENCH_NUM_TS	8
+#define BENCH_ARFCN	871
+
+/* the fake BTS, one end of the PCU socket */
+struct fake_bts {
+	int fd;
+	bool rings;
+	struct pcuif_shm shm;
+	unsigned long long syscalls;
+};
+
+static unsigned fn2bn(unsigned fn)
+{
+	return (fn % 52) / 4;
+}
+
+static unsigned fn_add_blocks(unsigned fn, unsigned blocks)
+{
+	unsigned bn = fn2bn(fn) + blocks;
+	fn = fn - (fn % 52);
+	fn += bn * 4 + bn / 3;
+	return fn % GSM_MAX_FN;
+}
+
+/* runs in the child, exits when the fake BTS closes the socket */
+static void run_pcu(const char *path, bool shm)
+{
+	struct gprs_rlcmac_bts *bts = bts_main_data();
+	unsigned ts;
+
+	bts->pcu_sock_path = talloc_strdup(tall_pcu_ctx, path);
+	bts->pcu_sock_shm = shm;
+	for (ts = 0; ts < BENCH_NUM_TS; ts++)
+		bts->trx[0].pdch[ts].enable();
+
+	pcu_l1if_open();
+	while (1)
+		osmo_select_main(0);
+}
+
+/* wait for the offer, map the rings and confirm them on the socket */
+static void fake_bts_accept_shm(struct fake_bts *fb)
+{
+	struct gsm_pcu_if pcu_prim;
+	int fds[3];
+	char cbuf[CMSG_SPACE(sizeof(fds))];
+	struct iovec iov;
+	struct msghdr mh;
+	struct cmsghdr *cmsg;
+	int rc;
+
+	do {
+		iov.iov_base = &pcu_prim;
+		iov.iov_len = sizeof(pcu_prim);
+		memset(&mh, 0, sizeof(mh));
+		mh.msg_iov = &iov;
+		mh.msg_iovlen = 1;
+		mh.msg_control = cbuf;
+		mh.msg_controllen = sizeof(cbuf);
+
+		rc = recvmsg(fb->fd, &mh, 0);
+		OSMO_ASSERT(rc > 0);
+	} while (pcu_prim.msg_type != PCU_IF_MSG_SHM_REQ);
+
+	cmsg = CMSG_FIRSTHDR(&mh);
+	OSMO_ASSERT(cmsg && cmsg->cmsg_type == SCM_RIGHTS
+		&& cmsg->cmsg_len == CMSG_LEN(sizeof(fds)));
+	memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+
+	rc = pcuif_shm_attach(&fb->shm, fds[0], fds[1], fds[2]);
+	OSMO_ASSERT(rc == 0);
+
+	memset(&pcu_prim, 0, sizeof(pcu_prim));
+	pcu_prim.msg_type = PCU_IF_MSG_SHM_CNF;
+	rc = write(fb->fd, &pcu_prim, sizeof(pcu_prim));
+	OSMO_ASSERT(rc == sizeof(pcu_prim));
+
+	fb->rings = true;
+}
+
+static void fake_bts_send(struct fake_bts *fb, const struct gsm_pcu_if *prims,
+	unsigned num)
+{
+	struct gsm_pcu_if *slot;
+	unsigned i;
+
+	if (!fb->rings) {
+		for (i = 0; i < num; i++) {
+			OSMO_ASSERT(write(fb->fd, &prims[i], sizeof(prims[i]))
+				== sizeof(prims[i]));
+			fb->syscalls += 1;
+		}
+		return;
+	}
+
+	for (i = 0; i < num; i++) {
+		slot = pcuif_shm_tx_reserve(&fb->shm);
+		OSMO_ASSERT(slot);
+		memcpy(slot, &prims[i], sizeof(*slot));
+		pcuif_shm_tx_commit(&fb->shm);
+	}
+	pcuif_shm_kick(&fb->shm);
+	fb->syscalls += 1;
+}
+
+/* wait until num DATA.req arrived, everything else is skipped */
+static void fake_bts_wait_data_req(struct fake_bts *fb, unsigned num)
+{
+	struct gsm_pcu_if pcu_prim, *slot;
+	struct pollfd pfd;
+	unsigned seen = 0;
+
+	while (seen < num) {
+		if (!fb->rings) {
+			OSMO_ASSERT(recv(fb->fd, &pcu_prim, sizeof(pcu_prim), 0) > 0);
+			fb->syscalls += 1;
+			seen += pcu_prim.msg_type == PCU_IF_MSG_DATA_REQ;
+			continue;
+		}
+
+		while (seen < num && (slot = pcuif_shm_rx_peek(&fb->shm))) {
+			seen += slot->msg_type == PCU_IF_MSG_DATA_REQ;
+			pcuif_shm_rx_consume(&fb->shm);
+		}
+		if (seen == num)
+			break;
+
+		/* the doorbells are non-blocking, sleep in poll() */
+		pfd.fd = fb->shm.rx_efd;
+		pfd.events = POLLIN;
+		OSMO_ASSERT(poll(&pfd, 1, 1000) == 1);
+		pcuif_shm_ack(&fb->shm);
+		fb->syscalls += 2;
+	}
+}
+
+static void bench_pcuif(const char *name, bool shm, unsigned num_blocks)
+{
+	struct gsm_pcu_if prims[1 + BENCH_NUM_TS];
+	struct fake_bts fb;
+	struct sockaddr_un addr;
+	struct pcu_hist block_us;
+	struct timespec t0, start, end;
+	uint32_t fn = 0;
+	unsigned block, ts;
+	double sec;
+	int lfd, status;
+	pid_t pid;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "/tmp/pcuif_bench.%d",
+		(int)getpid());
+	unlink(addr.sun_path);
+
+	lfd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+	OSMO_ASSERT(lfd >= 0);
+	OSMO_ASSERT(bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+	OSMO_ASSERT(listen(lfd, 1) == 0);
+
+	pid = fork();
+	OSMO_ASSERT(pid >= 0);
+	if (pid == 0) {
+		close(lfd);
+		run_pcu(addr.sun_path, shm);
+	}
+
+	memset(&fb, 0, sizeof(fb));
+	fb.fd = accept(lfd, NULL, NULL);
+	OSMO_ASSERT(fb.fd >= 0);
+	close(lfd);
+	unlink(addr.sun_path);
+
+	if (shm)
+		fake_bts_accept_shm(&fb);
+
+	pcu_hist_reset(&block_us);
+	memset(prims, 0, sizeof(prims));
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (block = 0; block < num_blocks; block++) {
+		prims[0].msg_type = PCU_IF_MSG_TIME_IND;
+		prims[0].u.time_ind.fn = fn;
+		for (ts = 0; ts < BENCH_NUM_TS; ts++) {
+			struct gsm_pcu_if_rts_req *rts = &prims[1 + ts].u.rts_req;
+
+			prims[1 + ts].msg_type = PCU_IF_MSG_RTS_REQ;
+			rts->sapi = PCU_IF_SAPI_PDTCH;
+			rts->fn = fn;
+			rts->arfcn = BENCH_ARFCN;
+			rts->trx_nr = 0;
+			rts->ts_nr = ts;
+			rts->block_nr = fn2bn(fn);
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		fake_bts_send(&fb, prims, ARRAY_SIZE(prims));
+		fake_bts_wait_data_req(&fb, BENCH_NUM_TS);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		pcu_hist_add(&block_us, pcu_timespec_diff_us(&start, &end));
+
+		fn = fn_add_blocks(fn, 1);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	sec = (end.tv_sec - t0.tv_sec) + (end.tv_nsec - t0.tv_nsec) / 1e9;
+
+	/* the PCU exits when it loses the socket */
+	close(fb.fd);
+	waitpid(pid, &status, 0);
+	if (fb.rings)
+		pcuif_shm_free(&fb.shm);
+
+	printf("%-7s %5.1f us avg %5u us p99 %5u us max per block, "
+	       "%.0f primitives/s, %.2f BTS syscalls per block\n",
+		name, (double)block_us.sum / block_us.count,
+		pcu_hist_percentile(&block_us, 990), block_us.max,
+		num_blocks * (1 + 2 * BENCH_NUM_TS) / sec,
+		(double)fb.syscalls / num_blocks);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned num_blocks = 20000;
+
+	if (argc > 1)
+		num_blocks = atoi(argv[1]);
+	if (!num_blocks) {
+		fprintf(stderr, "usage: %s [BLOCKS]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	tall_pcu_ctx = talloc_named_const(NULL, 1, "PcuIfBench context");
+	if (!tall_pcu_ctx)
+		abort();
+
+	msgb_talloc_ctx_init(tall_pcu_ctx, 0);
+	osmo_init_logging2(tall_pcu_ctx, &gprs_log_info);
+	log_set_use_color(osmo_stderr_target, 0);
+	log_set_print_filename(osmo_stderr_target, 0);
+	/* keep the RTS path free of log output */
+	log_set_log_level(osmo_stderr_target, LOGL_FATAL);
+
+	printf("TIME.ind and %d RTS.req per block, %u blocks\n",
+		BENCH_NUM_TS, num_blocks);
+	bench_pcuif("socket", false, num_blocks);
+	bench_pcuif("shm", true, num_blocks);
+
+	return EXIT_SUCCESS;
+}
+
+/*
+ * stubs that should not be reached
+ */
+extern "C" {
+void l1if_pdch_req() { abort(); }
+void l1if_connect_pdch() { abort(); }
+void l1if_close_pdch() { abort(); }
+void l1if_open_pdch() { abort(); }
+}
@@ -0,0 +1,699 @@
+/* Replay PCUIF/Gb captures or synthetic load against the RLC/MAC layer */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * The driver runs the PCU as fast as possible on a virtual frame clock:
+ * every time the frame number advances, the monotonic clock seen by
+ * libosmocore timers is moved forward by the corresponding number of TDMA
+ * frames and all timers are run, so T3191/T3193 & co expire exactly as they
+ * would on air.
+ *
+ * Input is either a capture written by 'osmo-pcu -R FILE' or synthetic
+ * load: N mobiles with one of a few DL traffic models. The synthetic
+ * mobiles answer every poll (Packet Control Ack during assignment, an
+ * all-acked Packet Downlink Ack/Nack otherwise) and the BTS confirms every
+ * Immediate Assignment on PCH. With dynamic TS the BTS switches them to
+ * PDCH and back as the PCU asks, answering each ACT_REQ with an INFO.ind
+ * a little later.
+ */
+
+#include "bts.h"
+#include "tbf.h"
+#include "tbf_dl.h"
+#include "gprs_debug.h"
+#include "gprs_bssgp_pcu.h"
+#include "pcu_l1_if.h"
+#include "pcu_hist.h"
+#include "pcu_utils.h"
+#include "pcuif_capture.h"
+#include <gprs_rlcmac.h>
+
+extern "C" {
+#include "pcu_vty.h"
+
+#include <osmocom/core/application.h>
+#include <osmocom/core/msgb.h>
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/timer.h>
+#include <osmocom/core/utils.h>
+#include <osmocom/core/rate_ctr.h>
+#include <osmocom/gprs/gprs_ns.h>
+#include <osmocom/gsm/gsm_utils.h>
+}
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+
+void *tall_pcu_ctx;
+int16_t spoof_mnc = 0, spoof_mcc = 0;
+bool spoof_mnc_3_digits = false;
+
+/* one TDMA frame is 120ms / 26 */
+#define FRAME_DURATION_NS 4615385
+
+#define MAX_PENDING_CNF 16
+
+/* blocks the BTS takes to switch a dynamic TS */
+#define ACT_DELAY_BLOCKS 25
+
+enum traffic_model {
+	TRAFFIC_BULK,
+	TRAFFIC_WEB,
+	TRAFFIC_PING,
+};
+
+static const struct value_string traffic_model_names[] = {
+	{ TRAFFIC_BULK,	"bulk" },
+	{ TRAFFIC_WEB,	"web" },
+	{ TRAFFIC_PING,	"ping" },
+	{ 0, NULL }
+};
+
+/* LLC PDU size, burst length and interval in blocks, by traffic_model */
+static const struct {
+	uint16_t pdu_len;
+	unsigned burst;
+	unsigned interval;
+} traffic_params[] = {
+	{ 1500, 1, 2 },		/* bulk */
+	{ 1000, 8, 250 },	/* web */
+	{ 84, 1, 50 },		/* ping */
+};
+
+static struct {
+	unsigned num_ms;
+	enum traffic_model model;
+	unsigned seconds;
+	uint8_t pdch_mask;
+	uint8_t dyn_pdch_mask;
+	unsigned dyn_min;
+	const char *capture;
+} opts = {
+	16, TRAFFIC_WEB, 60, 0xff, 0, 0, NULL
+};
+
+static struct {
+	unsigned blocks;
+	unsigned rts;
+	unsigned data_req[PCU_IF_SAPI_PTCCH + 1];
+	unsigned ul_blocks;
+	unsigned dl_ud;
+	unsigned dl_ud_bytes;
+	unsigned records;
+	unsigned act_req;
+	unsigned long long pdch_blocks;
+	size_t talloc_start;
+	size_t talloc_peak;
+} stats;
+
+/* Immediate Assignments waiting for their DATA.cnf */
+static struct gsm_pcu_if_data pending_cnf[MAX_PENDING_CNF];
+static unsigned num_pending_cnf;
+static bool confirm_pch;
+
+/* TS of TRX 0 the BTS runs as PDCH, and the dynamic TS asked for */
+static uint8_t bts_pdch_mask;
+static uint8_t pending_act, pending_rel;
+static unsigned act_answer_block;
+
+static struct timespec *clk_mono;
+static uint32_t virtual_fn;
+static bool virtual_fn_valid;
+
+static uint8_t llc_data[LLC_MAX_LEN];
+
+/* override, requires '-Wl,--wrap=pcu_sock_send' */
+int __real_pcu_sock_send(struct msgb *msg);
+int __wrap_pcu_sock_send(struct msgb *msg)
+{
+	struct gsm_pcu_if *pcu_prim = (struct gsm_pcu_if *)msg->data;
+	struct gsm_pcu_if_data *data_req = &pcu_prim->u.data_req;
+	struct gsm_pcu_if_act_req *act_req = &pcu_prim->u.act_req;
+	uint8_t bit = 1 << (act_req->ts_nr & 7);
+
+	/* the PCU also confirms the PDCH of each INFO.ind */
+	if (pcu_prim->msg_type == PCU_IF_MSG_ACT_REQ && act_req->trx_nr == 0
+	    && (opts.dyn_pdch_mask & bit)) {
+		stats.act_req += 1;
+		if (!pending_act && !pending_rel)
+			act_answer_block = stats.blocks + ACT_DELAY_BLOCKS;
+		if (act_req->activate && !(bts_pdch_mask & bit))
+			pending_act |= bit;
+		if (!act_req->activate && (bts_pdch_mask & bit))
+			pending_rel |= bit;
+	}
+
+	if (pcu_prim->msg_type == PCU_IF_MSG_DATA_REQ) {
+		if (data_req->sapi < ARRAY_SIZE(stats.data_req))
+			stats.data_req[data_req->sapi] += 1;
+
+		/* PCH blocks carry the paging group in front of the MAC block */
+		if (confirm_pch && data_req->sapi == PCU_IF_SAPI_PCH
+		    && data_req->len == 3 + GSM_MACBLOCK_LEN
+		    && num_pending_cnf < ARRAY_SIZE(pending_cnf)) {
+			struct gsm_pcu_if_data *cnf = &pending_cnf[num_pending_cnf++];
+
+			*cnf = *data_req;
+			memcpy(cnf->data, data_req->data + 3, GSM_MACBLOCK_LEN);
+			cnf->len = GSM_MACBLOCK_LEN;
+		}
+	}
+
+	msgb_free(msg);
+	return 0;
+}
+
+static unsigned fn2bn(unsigned fn)
+{
+	return (fn % 52) / 4;
+}
+
+static unsigned fn_add_blocks(unsigned fn, unsigned blocks)
+{
+	unsigned bn = fn2bn(fn) + blocks;
+	fn = fn - (fn % 52);
+	fn += bn * 4 + bn / 3;
+	return fn % GSM_MAX_FN;
+}
+
+/* move the virtual clock to fn and run everything that expired meanwhile */
+static void advance_clock(uint32_t fn)
+{
+	uint32_t frames;
+	uint64_t ns;
+
+	if (!virtual_fn_valid) {
+		virtual_fn = fn;
+		virtual_fn_valid = true;
+		return;
+	}
+
+	frames = (fn + GSM_MAX_FN - virtual_fn) % GSM_MAX_FN;
+	if (frames == 0 || frames > GSM_MAX_FN / 2)
+		return;
+	virtual_fn = fn;
+
+	ns = clk_mono->tv_nsec + (uint64_t)frames * FRAME_DURATION_NS;
+	clk_mono->tv_sec += ns / 1000000000;
+	clk_mono->tv_nsec = ns % 1000000000;
+
+	osmo_gsm_timers_check();
+	osmo_gsm_timers_prepare();
+	osmo_gsm_timers_update();
+	osmo_timers_prepare();
+	osmo_timers_update();
+}
+
+static void sample_talloc()
+{
+	size_t blocks = talloc_total_blocks(tall_pcu_ctx);
+
+	if (blocks > stats.talloc_peak)
+		stats.talloc_peak = blocks;
+}
+
+static void rx_prim(uint8_t msg_type, struct gsm_pcu_if *pcu_prim)
+{
+	pcu_prim->msg_type = msg_type;
+
+	/* never talk to the SGSN of the capture */
+	if (msg_type == PCU_IF_MSG_INFO_IND) {
+		pcu_prim->u.info_ind.remote_ip[0] = 0;
+		pcu_prim->u.info_ind.local_port[0] = 0;
+	}
+
+	if (msg_type == PCU_IF_MSG_RTS_REQ)
+		stats.rts += 1;
+	if (msg_type == PCU_IF_MSG_DATA_IND)
+		stats.ul_blocks += 1;
+
+	pcu_rx(msg_type, pcu_prim);
+}
+
+static void rx_dl_ud(uint32_t tlli, uint32_t tlli_old, const char *imsi,
+	uint8_t ms_class, uint8_t egprs_ms_class, uint16_t delay_csec,
+	const uint8_t *data, uint16_t len)
+{
+	stats.dl_ud += 1;
+	stats.dl_ud_bytes += len;
+
+	gprs_rlcmac_dl_tbf::handle(bts_main_data(), tlli, tlli_old, imsi,
+		ms_class, egprs_ms_class, delay_csec, data, len);
+}
+
+static int replay_record(const struct pcuif_capture_rec_hdr *hdr, uint8_t *buf)
+{
+	struct gsm_pcu_if *pcu_prim = (struct gsm_pcu_if *)buf;
+	struct pcuif_capture_dl_ud *ud = (struct pcuif_capture_dl_ud *)buf;
+
+	advance_clock(hdr->fn);
+
+	switch (hdr->type) {
+	case PCUIF_CAPTURE_T_PCUIF:
+		if (hdr->len != sizeof(*pcu_prim))
+			return -EINVAL;
+		if (pcu_prim->msg_type == PCU_IF_MSG_RTS_REQ)
+			stats.blocks += 1;
+		rx_prim(pcu_prim->msg_type, pcu_prim);
+		break;
+	case PCUIF_CAPTURE_T_GB_DL_UD:
+		if (hdr->len < sizeof(*ud) || hdr->len != sizeof(*ud) + ud->len)
+			return -EINVAL;
+		ud->imsi[sizeof(ud->imsi) - 1] = '\0';
+		rx_dl_ud(ud->tlli, ud->tlli_old, ud->imsi, ud->ms_class,
+			ud->egprs_ms_class, ud->delay_csec, ud->data, ud->len);
+		break;
+	default:
+		fprintf(stderr, "Skipping unknown record type %u\n", hdr->type);
+	}
+
+	gprs_bssgp_pcu_drain();
+	return 0;
+}
+
+static int run_capture(const char *path)
+{
+	static uint8_t buf[sizeof(struct pcuif_capture_dl_ud) + LLC_MAX_LEN + sizeof(struct gsm_pcu_if)];
+	struct pcuif_capture_rec_hdr hdr;
+	FILE *f;
+	int rc;
+
+	f = fopen(path, "rb");
+	if (!f) {
+		fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno));
+		return -errno;
+	}
+
+	rc = pcuif_capture_read_file_hdr(f);
+	if (rc < 0) {
+		fprintf(stderr, "%s is not a PCUIF capture of this version\n", path);
+		fclose(f);
+		return rc;
+	}
+
+	while ((rc = pcuif_capture_read_rec(f, &hdr, buf, sizeof(buf))) > 0) {
+		stats.records += 1;
+		rc = replay_record(&hdr, buf);
+		if (rc < 0)
+			break;
+		sample_talloc();
+	}
+
+	fclose(f);
+	if (rc < 0)
+		fprintf(stderr, "Capture broken after %u records\n", stats.records);
+	return rc;
+}
+
+static void send_info_ind(void)
+{
+	struct gsm_pcu_if prim;
+	unsigned ts;
+
+	memset(&prim, 0, sizeof(prim));
+	prim.u.info_ind.version = PCU_IF_VERSION;
+	prim.u.info_ind.flags = PCU_IF_FLAG_ACTIVE | PCU_IF_FLAG_CS1 |
+		PCU_IF_FLAG_CS2 | PCU_IF_FLAG_CS3 | PCU_IF_FLAG_CS4;
+	prim.u.info_ind.bsic = 63;
+	prim.u.info_ind.initial_cs = 1;
+	prim.u.info_ind.nsei = 1234;
+	prim.u.info_ind.nsvci[0] = 1234;
+	prim.u.info_ind.bvci = 1234;
+	prim.u.info_ind.trx[0].arfcn = 871;
+	prim.u.info_ind.trx[0].pdch_mask = bts_pdch_mask;
+	prim.u.info_ind.trx[0].dyn_pdch_mask = opts.dyn_pdch_mask;
+	for (ts = 0; ts < 8; ts++)
+		prim.u.info_ind.trx[0].tsc[ts] = 7;
+
+	rx_prim(PCU_IF_MSG_INFO_IND, &prim);
+}
+
+static void send_ul_block(RlcMacUplink_t *ulreq, uint8_t ts, uint32_t fn)
+{
+	struct gsm_pcu_if prim;
+	bitvec *rlc_block;
+	int num_bytes;
+
+	memset(&prim, 0, sizeof(prim));
+
+	rlc_block = bitvec_alloc(GSM_MACBLOCK_LEN, tall_pcu_ctx);
+	OSMO_ASSERT(encode_gsm_rlcmac_uplink(rlc_block, ulreq) == 0);
+	num_bytes = bitvec_pack(rlc_block, prim.u.data_ind.data);
+	bitvec_free(rlc_block);
+
+	prim.u.data_ind.sapi = PCU_IF_SAPI_PDTCH;
+	prim.u.data_ind.len = num_bytes;
+	prim.u.data_ind.fn = fn;
+	prim.u.data_ind.arfcn = 871;
+	prim.u.data_ind.ts_nr = ts;
+	prim.u.data_ind.block_nr = fn2bn(fn);
+	prim.u.data_ind.rssi = -60;
+	prim.u.data_ind.lqual_cb = 120;
+
+	rx_prim(PCU_IF_MSG_DATA_IND, &prim);
+}
+
+/* what a well-behaved MS sends when it is polled on this block */
+static void answer_poll(gprs_rlcmac_dl_tbf *tbf, uint8_t ts, uint32_t fn)
+{
+	RlcMacUplink_t ulreq;
+
+	memset(&ulreq, 0, sizeof(ulreq));
+
+	if (tbf->state_is(GPRS_RLCMAC_ASSIGN)
+	    || tbf->dl_ass_state_is(GPRS_RLCMAC_DL_ASS_WAIT_ACK)
+	    || tbf->ul_ass_state_is(GPRS_RLCMAC_UL_ASS_WAIT_ACK)) {
+		Packet_Control_Acknowledgement_t *ctrl_ack =
+			&ulreq.u.Packet_Control_Acknowledgement;
+
+		ulreq.u.MESSAGE_TYPE = MT_PACKET_CONTROL_ACK;
+		ctrl_ack->PayloadType = GPRS_RLCMAC_CONTROL_BLOCK;
+		ctrl_ack->TLLI = tbf->tlli();
+	} else {
+		Packet_Downlink_Ack_Nack_t *ack = &ulreq.u.Packet_Downlink_Ack_Nack;
+
+		ulreq.u.MESSAGE_TYPE = MT_PACKET_DOWNLINK_ACK_NACK;
+		ack->PayloadType = GPRS_RLCMAC_CONTROL_BLOCK;
+		ack->DOWNLINK_TFI = tbf->tfi();
+		ack->Ack_Nack_Description.FINAL_ACK_INDICATION =
+			tbf->state_is(GPRS_RLCMAC_FINISHED);
+		ack->Ack_Nack_Description.STARTING_SEQUENCE_NUMBER =
+			tbf->window()->v_s();
+		memset(ack->Ack_Nack_Description.RECEIVED_BLOCK_BITMAP, 0xff,
+			sizeof(ack->Ack_Nack_Description.RECEIVED_BLOCK_BITMAP));
+	}
+
+	send_ul_block(&ulreq, ts, fn);
+}
+
+static void generate_traffic(unsigned block)
+{
+	const unsigned interval = traffic_params[opts.model].interval;
+	char imsi[OSMO_IMSI_BUF_SIZE];
+	unsigned i, j;
+
+	for (i = 0; i < opts.num_ms; i++) {
+		/* spread the MS over the interval */
+		if ((block + i) % interval != 0)
+			continue;
+
+		snprintf(imsi, sizeof(imsi), "001010000%06u", i);
+		for (j = 0; j < traffic_params[opts.model].burst; j++)
+			rx_dl_ud(0xc0000000 | i, 0, imsi, 12, 0, 1000,
+				llc_data, traffic_params[opts.model].pdu_len);
+	}
+}
+
+static int run_synthetic(void)
+{
+	struct gsm_pcu_if prim;
+	gprs_rlcmac_dl_tbf *tbf;
+	uint32_t fn = 0;
+	unsigned total_blocks = opts.seconds * 1000 * 12 / 240;
+	unsigned block, ts, i;
+
+	confirm_pch = true;
+	bts_pdch_mask = opts.pdch_mask;
+
+	memset(&prim, 0, sizeof(prim));
+	prim.u.time_ind.fn = fn;
+	rx_prim(PCU_IF_MSG_TIME_IND, &prim);
+	advance_clock(fn);
+
+	send_info_ind();
+
+	for (block = 0; block < total_blocks; block++) {
+		memset(&prim, 0, sizeof(prim));
+		prim.u.time_ind.fn = fn;
+		rx_prim(PCU_IF_MSG_TIME_IND, &prim);
+		advance_clock(fn);
+
+		for (i = 0; i < num_pending_cnf; i++) {
+			memset(&prim, 0, sizeof(prim));
+			prim.u.data_cnf = pending_cnf[i];
+			prim.u.data_cnf.fn = fn;
+			rx_prim(PCU_IF_MSG_DATA_CNF, &prim);
+		}
+		num_pending_cnf = 0;
+
+		/* switch the dynamic TS the PCU asked for */
+		if ((pending_act || pending_rel) && block >= act_answer_block) {
+			bts_pdch_mask = (bts_pdch_mask | pending_act) & ~pending_rel;
+			pending_act = pending_rel = 0;
+			send_info_ind();
+		}
+
+		generate_traffic(block);
+		gprs_bssgp_pcu_drain();
+
+		for (ts = 0; ts < 8; ts++) {
+			if (!(bts_pdch_mask & (1 << ts)))
+				continue;
+
+			tbf = BTS::main_bts()->dl_tbf_by_poll_fn(fn, 0, ts);
+			if (tbf)
+				answer_poll(tbf, ts, fn);
+
+			memset(&prim, 0, sizeof(prim));
+			prim.u.rts_req.sapi = PCU_IF_SAPI_PDTCH;
+			prim.u.rts_req.fn = fn;
+			prim.u.rts_req.arfcn = 871;
+			prim.u.rts_req.ts_nr = ts;
+			prim.u.rts_req.block_nr = fn2bn(fn);
+			rx_prim(PCU_IF_MSG_RTS_REQ, &prim);
+		}
+
+		stats.blocks += 1;
+		stats.pdch_blocks += pcu_bitcount(bts_pdch_mask);
+		sample_talloc();
+		fn = fn_add_blocks(fn, 1);
+	}
+
+	return 0;
+}
+
+static double timespec_diff_s(const struct timespec *start, const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void print_report(double wall_s, double cpu_s)
+{
+	struct rate_ctr_group *ctrg = BTS::main_bts()->rate_counters();
+	const struct pcu_hist *h = &bts_main_data()->rts_latency;
+	char buf[128];
+	unsigned i;
+
+	printf("Blocks:       %u (%u RTS, %u UL blocks, %u records)\n",
+		stats.blocks, stats.rts, stats.ul_blocks, stats.records);
+	printf("DL-UNITDATA:  %u PDUs, %u bytes\n", stats.dl_ud, stats.dl_ud_bytes);
+	printf("Wall time:    %.3f s, %.0f blocks/s\n", wall_s,
+		wall_s > 0 ? stats.blocks / wall_s : 0.0);
+	printf("CPU time:     %.3f s, %.2f us per RTS\n", cpu_s,
+		stats.rts ? cpu_s * 1e6 / stats.rts : 0.0);
+	printf("RTS latency:  %s\n", pcu_hist_summary(buf, sizeof(buf), h, " us"));
+	printf("talloc:       %zu blocks at start, %zu peak, %zu at end\n",
+		stats.talloc_start, stats.talloc_peak,
+		talloc_total_blocks(tall_pcu_ctx));
+	printf("DATA.req:     PDTCH %u, PTCCH %u, PCH %u, AGCH %u\n",
+		stats.data_req[PCU_IF_SAPI_PDTCH], stats.data_req[PCU_IF_SAPI_PTCCH],
+		stats.data_req[PCU_IF_SAPI_PCH], stats.data_req[PCU_IF_SAPI_AGCH]);
+
+	for (i = 0; i < ctrg->desc->num_ctr; i++) {
+		if (!ctrg->ctr[i].current)
+			continue;
+		printf("  %-28s %llu\n", ctrg->desc->ctr_desc[i].name,
+			(unsigned long long)ctrg->ctr[i].current);
+	}
+}
+
+static void print_help(const char *argv0)
+{
+	printf("Usage: %s [options] [CAPTURE]\n"
+		"Replay a capture written with 'osmo-pcu -R' or, without CAPTURE,\n"
+		"run synthetic DL load.\n\n"
+		"  -n	--num-ms N	Number of synthetic MS (default %u)\n"
+		"  -t	--traffic MODEL	bulk, web or ping (default %s)\n"
+		"  -s	--seconds S	Virtual run time (default %u)\n"
+		"  -p	--pdch-mask M	Enabled PDCH on TRX 0 (default 0x%02x)\n"
+		"  -D	--dyn-pdch M	Dynamic TS on TRX 0, switched to PDCH on\n"
+		"			request (default none)\n"
+		"  -m	--dyn-min N	Dynamic TS kept as PDCH (default 0)\n"
+		"  -d	--debug MASK	Log category mask (default: errors only)\n",
+		argv0, opts.num_ms, get_value_string(traffic_model_names, opts.model),
+		opts.seconds, opts.pdch_mask);
+}
+
+static void handle_options(int argc, char **argv)
+{
+	int rc;
+
+	while (1) {
+		int option_idx = 0, c;
+		static const struct option long_options[] = {
+			{ "help", 0, 0, 'h' },
+			{ "num-ms", 1, 0, 'n' },
+			{ "traffic", 1, 0, 't' },
+			{ "seconds", 1, 0, 's' },
+			{ "pdch-mask", 1, 0, 'p' },
+			{ "dyn-pdch", 1, 0, 'D' },
+			{ "dyn-min", 1, 0, 'm' },
+			{ "debug", 1, 0, 'd' },
+			{ 0, 0, 0, 0 }
+		};
+
+		c = getopt_long(argc, argv, "hn:t:s:p:D:m:d:",
+				long_options, &option_idx);
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'h':
+			print_help(argv[0]);
+			exit(0);
+			break;
+		case 'n':
+			opts.num_ms = atoi(optarg);
+			break;
+		case 't':
+			rc = get_string_value(traffic_model_names, optarg);
+			if (rc < 0) {
+				fprintf(stderr, "Unknown traffic model '%s'\n", optarg);
+				exit(1);
+			}
+			opts.model = (enum traffic_model)rc;
+			break;
+		case 's':
+			opts.seconds = atoi(optarg);
+			break;
+		case 'p':
+			opts.pdch_mask = strtoul(optarg, NULL, 0);
+			break;
+		case 'D':
+			opts.dyn_pdch_mask = strtoul(optarg, NULL, 0);
+			break;
+		case 'm':
+			opts.dyn_min = atoi(optarg);
+			break;
+		case 'd':
+			log_parse_category_mask(osmo_stderr_target, optarg);
+			break;
+		default:
+			print_help(argv[0]);
+			exit(1);
+			break;
+		}
+	}
+
+	if (optind < argc)
+		opts.capture = argv[optind];
+}
+
+int main(int argc, char **argv)
+{
+	struct gprs_rlcmac_bts *bts;
+	struct timespec wall_start, wall_end, cpu_start, cpu_end;
+	int rc;
+
+	tall_pcu_ctx = talloc_named_const(NULL, 1, "pcu_replay context");
+	if (!tall_pcu_ctx)
+		abort();
+
+	msgb_talloc_ctx_init(tall_pcu_ctx, 0);
+	osmo_init_logging2(tall_pcu_ctx, &gprs_log_info);
+	log_set_use_color(osmo_stderr_target, 0);
+	log_set_print_filename(osmo_stderr_target, 0);
+	log_set_log_level(osmo_stderr_target, LOGL_ERROR);
+	gprs_ns_set_log_ss(DNS);
+	bssgp_set_log_ss(DBSSGP);
+
+	handle_options(argc, argv);
+
+	bts = bts_main_data();
+	bts->alloc_algorithm = alloc_algorithm_dynamic;
+	bts->initial_cs_dl = bts->initial_cs_ul = 1;
+	bts->initial_mcs_dl = bts->initial_mcs_ul = 1;
+	bts->cs1 = 1;
+	bts->n3101 = 10;
+	bts->n3103 = 4;
+	bts->n3105 = 8;
+	bts->max_cs_ul = MAX_GPRS_CS;
+	bts->max_cs_dl = MAX_GPRS_CS;
+	bts->max_mcs_ul = MAX_EDGE_MCS;
+	bts->max_mcs_dl = MAX_EDGE_MCS;
+	bts->ws_base = 64;
+	bts->llc_codel_interval_msec = LLC_CODEL_DISABLE;
+	bts->llc_idle_ack_csec = 10;
+	bts->dyn_pdch_max = pcu_bitcount(opts.dyn_pdch_mask);
+	bts->dyn_pdch_min = OSMO_MIN(opts.dyn_min, bts->dyn_pdch_max);
+
+	bssgp_nsi = gprs_ns_instantiate(&gprs_bssgp_ns_cb, tall_pcu_ctx);
+	if (!bssgp_nsi) {
+		fprintf(stderr, "Failed to create NS instance\n");
+		return EXIT_FAILURE;
+	}
+
+	osmo_clock_override_enable(CLOCK_MONOTONIC, true);
+	clk_mono = osmo_clock_override_gettimespec(CLOCK_MONOTONIC);
+	clk_mono->tv_sec = 0;
+	clk_mono->tv_nsec = 0;
+
+	memset(llc_data, 0x2b, sizeof(llc_data));
+	stats.talloc_start = stats.talloc_peak = talloc_total_blocks(tall_pcu_ctx);
+
+	clock_gettime(CLOCK_MONOTONIC, &wall_start);
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_start);
+
+	if (opts.capture)
+		rc = run_capture(opts.capture);
+	else
+		rc = run_synthetic();
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_end);
+	clock_gettime(CLOCK_MONOTONIC, &wall_end);
+
+	if (!opts.capture)
+		printf("Synthetic load: %u MS, %s traffic, %u s, PDCH mask 0x%02x\n",
+			opts.num_ms, get_value_string(traffic_model_names, opts.model),
+			opts.seconds, opts.pdch_mask);
+	if (opts.dyn_pdch_mask)
+		printf("Dynamic TS:   0x%02x, %u ACT_REQ, %.2f PDCH on average, "
+			"0x%02x at the end\n", opts.dyn_pdch_mask, stats.act_req,
+			stats.blocks ? (double)stats.pdch_blocks / stats.blocks : 0.0,
+			bts_pdch_mask);
+	print_report(timespec_diff_s(&wall_start, &wall_end),
+		timespec_diff_s(&cpu_start, &cpu_end));
+
+	if (getenv("TALLOC_REPORT_FULL"))
+		talloc_report_full(tall_pcu_ctx, stderr);
+	return rc < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/*
+ * stubs that should not be reached
+ */
+extern "C" {
+void l1if_pdch_req() { abort(); }
+void l1if_connect_pdch() { abort(); }
+void l1if_close_pdch() { abort(); }
+void l1if_open_pdch() { abort(); }
+}
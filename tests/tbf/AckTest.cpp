@@ -0,0 +1,365 @@
+/* AckTest.cpp
+ *
+ * Run a single GPRS DL TBF over a lossy radio channel and compare the
+ * fixed Ack/Nack polling with 'adaptive-ack-nack'. The simulated MS keeps
+ * a real receive window, drops every DL data block and every Ack/Nack with
+ * the given probability and answers each DL ack poll with the bitmap of
+ * what it actually received.
+ *
+ * A second set of runs puts single block allocations on the same PDCH so
+ * that polls compete for the uplink blocks, and checks that polling in the
+ * earliest free block stalls the DL window less often than 'fixed-rrbp'.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include "bts.h"
+#include "tbf.h"
+#include "tbf_dl.h"
+#include "rlc.h"
+#include "gprs_debug.h"
+#include "gprs_ms.h"
+#include "pcu_l1_if.h"
+#include <gprs_rlcmac.h>
+
+extern "C" {
+#include <osmocom/core/application.h>
+#include <osmocom/core/msgb.h>
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/utils.h>
+#include <osmocom/core/rate_ctr.h>
+#include <osmocom/gsm/gsm_utils.h>
+}
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* globals used by the code */
+void *tall_pcu_ctx;
+int16_t spoof_mnc = 0, spoof_mcc = 0;
+bool spoof_mnc_3_digits = false;
+
+#define SIM_TLLI	0xf1223344
+#define SIM_MS_CLASS	12	/* 4 DL slots */
+#define SIM_FIRST_TS	4
+#define SIM_NUM_TS	4
+#define SIM_SNS		128
+#define SIM_WS		64
+/* CS-1 payload, one block period is 240ms / 12 */
+#define SIM_BLOCK_BYTES	20
+#define SIM_BLOCK_MS	20
+
+static uint8_t llc_data[200];
+
+/* the simulated MS */
+static struct {
+	uint8_t tfi;
+	uint16_t v_r;
+	bool received[SIM_SNS];
+	float loss;
+	uint32_t rnd;
+
+	unsigned data_blocks;	/* DL data blocks sent to the MS */
+	unsigned delivered;	/* BSNs received for the first time */
+} ms_sim;
+
+static bool channel_lost()
+{
+	/* fixed LCG so that every mode sees the same loss pattern */
+	ms_sim.rnd = ms_sim.rnd * 1103515245 + 12345;
+	return ((ms_sim.rnd >> 16) & 0x7fff) < ms_sim.loss * 0x8000;
+}
+
+static void ms_receive_bsn(uint16_t bsn)
+{
+	uint16_t offset = (bsn + SIM_SNS - ms_sim.v_r) % SIM_SNS;
+
+	if (offset < SIM_WS) {
+		/* advance V(R), blocks falling out of the window are forgotten */
+		while (ms_sim.v_r != (bsn + 1) % SIM_SNS) {
+			ms_sim.received[(ms_sim.v_r + SIM_WS) % SIM_SNS] = false;
+			ms_sim.v_r = (ms_sim.v_r + 1) % SIM_SNS;
+		}
+	} else if ((ms_sim.v_r + SIM_SNS - bsn) % SIM_SNS > SIM_WS) {
+		/* outside of the receive window */
+		return;
+	}
+
+	if (!ms_sim.received[bsn]) {
+		ms_sim.received[bsn] = true;
+		ms_sim.delivered += 1;
+	}
+}
+
+/* override, requires '-Wl,--wrap=pcu_sock_send' */
+int __real_pcu_sock_send(struct msgb *msg);
+int __wrap_pcu_sock_send(struct msgb *msg)
+{
+	struct gsm_pcu_if *pcu_prim = (struct gsm_pcu_if *)msg->data;
+	struct gsm_pcu_if_data *data_req = &pcu_prim->u.data_req;
+	const struct rlc_dl_header *rh = (const struct rlc_dl_header *)data_req->data;
+
+	if (pcu_prim->msg_type == PCU_IF_MSG_DATA_REQ
+	    && data_req->sapi == PCU_IF_SAPI_PDTCH
+	    && data_req->len >= sizeof(*rh)
+	    && rh->pt == 0 && rh->tfi == ms_sim.tfi) {
+		ms_sim.data_blocks += 1;
+		if (!channel_lost())
+			ms_receive_bsn(rh->bsn);
+	}
+
+	msgb_free(msg);
+	return 0;
+}
+
+static unsigned fn2bn(unsigned fn)
+{
+	return (fn % 52) / 4;
+}
+
+static unsigned fn_add_blocks(unsigned fn, unsigned blocks)
+{
+	unsigned bn = fn2bn(fn) + blocks;
+	fn = fn - (fn % 52);
+	fn += bn * 4 + bn / 3;
+	return fn % GSM_MAX_FN;
+}
+
+static void answer_dl_poll(BTS *the_bts, gprs_rlcmac_dl_tbf *tbf,
+	uint8_t ts, uint32_t fn)
+{
+	RlcMacUplink_t ulreq;
+	Packet_Downlink_Ack_Nack_t *ack = &ulreq.u.Packet_Downlink_Ack_Nack;
+	struct pcu_l1_meas meas;
+	bitvec *rlc_block;
+	uint8_t buf[GSM_MACBLOCK_LEN];
+	unsigned i;
+	int num_bytes;
+
+	if (channel_lost())
+		return;
+
+	memset(&ulreq, 0, sizeof(ulreq));
+	ulreq.u.MESSAGE_TYPE = MT_PACKET_DOWNLINK_ACK_NACK;
+	ack->PayloadType = GPRS_RLCMAC_CONTROL_BLOCK;
+	ack->DOWNLINK_TFI = tbf->tfi();
+	ack->Ack_Nack_Description.STARTING_SEQUENCE_NUMBER = ms_sim.v_r;
+
+	/* bit i (MSB first) stands for BSN SSN - 64 + i */
+	for (i = 0; i < SIM_WS; i++) {
+		if (ms_sim.received[(ms_sim.v_r + SIM_SNS - SIM_WS + i) % SIM_SNS])
+			ack->Ack_Nack_Description.RECEIVED_BLOCK_BITMAP[i / 8] |=
+				0x80 >> (i % 8);
+	}
+
+	rlc_block = bitvec_alloc(GSM_MACBLOCK_LEN, tall_pcu_ctx);
+	OSMO_ASSERT(encode_gsm_rlcmac_uplink(rlc_block, &ulreq) == 0);
+	num_bytes = bitvec_pack(rlc_block, buf);
+	bitvec_free(rlc_block);
+
+	meas.set_rssi(-60);
+	the_bts->bts_data()->trx[0].pdch[ts].rcv_block(buf, num_bytes, fn, &meas);
+}
+
+struct sim_result {
+	unsigned blocks;
+	unsigned data_blocks;
+	unsigned delivered;
+	unsigned resent;
+	unsigned polls;
+	unsigned stalled;
+	unsigned deferred;
+};
+
+static void run_sim(float loss, bool adaptive, unsigned num_blocks,
+	struct sim_result *res, unsigned sba_per_block = 0,
+	bool fixed_rrbp = false)
+{
+	BTS the_bts;
+	struct gprs_rlcmac_bts *bts = the_bts.bts_data();
+	struct rate_ctr_group *ctrs = the_bts.rate_counters();
+	gprs_rlcmac_dl_tbf *tbf;
+	GprsMs *ms;
+	uint32_t fn = 0, sba_fn;
+	unsigned block, ts, i;
+	uint8_t trx_no, sba_trx, sba_ts;
+	int tfi;
+
+	bts->alloc_algorithm = alloc_algorithm_b;
+	bts->initial_cs_dl = 1;
+	bts->initial_cs_ul = 1;
+	bts->adaptive_ack_nack = adaptive;
+	bts->fixed_rrbp = fixed_rrbp;
+	osmo_tdef_set(bts->T_defs_pcu, -2030, 0, OSMO_TDEF_S);
+	osmo_tdef_set(bts->T_defs_pcu, -2031, 0, OSMO_TDEF_S);
+	bts_update_params(bts);
+	for (ts = SIM_FIRST_TS; ts < SIM_FIRST_TS + SIM_NUM_TS; ts++)
+		bts->trx[0].pdch[ts].enable();
+	the_bts.set_current_frame_number(fn);
+
+	memset(&ms_sim, 0, sizeof(ms_sim));
+	ms_sim.loss = loss;
+	ms_sim.rnd = 4711;
+
+	ms = the_bts.ms_alloc(SIM_MS_CLASS, 0);
+	GprsMs::Guard guard(ms);
+
+	tfi = the_bts.tfi_find_free(GPRS_RLCMAC_DL_TBF, &trx_no, -1);
+	OSMO_ASSERT(tfi >= 0);
+	tbf = tbf_alloc_dl_tbf(bts, ms, trx_no, false);
+	OSMO_ASSERT(tbf);
+	tbf->update_ms(SIM_TLLI, GPRS_RLCMAC_DL_TBF);
+	tbf->set_ta(0);
+
+	/* "Establish" the DL TBF */
+	TBF_SET_ASS_STATE_DL(tbf, GPRS_RLCMAC_DL_ASS_SEND_ASS);
+	TBF_SET_STATE(tbf, GPRS_RLCMAC_FLOW);
+	tbf->m_wait_confirm = 0;
+	ms_sim.tfi = tbf->tfi();
+
+	for (block = 0; block < num_blocks; block++) {
+		the_bts.set_current_frame_number(fn);
+
+		tbf = ms->dl_tbf();
+		if (!tbf) {
+			fprintf(stderr, "DL TBF got lost after %u blocks\n", block);
+			break;
+		}
+		while (tbf->llc_queue_size() < 4)
+			tbf->append_data(SIM_MS_CLASS, 1000, llc_data, sizeof(llc_data));
+
+		/* the other MS of the cell, they never send their block */
+		for (i = 0; i < sba_per_block; i++)
+			the_bts.sba()->alloc(&sba_trx, &sba_ts, &sba_fn, 0);
+
+		for (ts = SIM_FIRST_TS; ts < SIM_FIRST_TS + SIM_NUM_TS; ts++) {
+			tbf = the_bts.dl_tbf_by_poll_fn(fn, 0, ts);
+			if (tbf) {
+				res->polls += 1;
+				answer_dl_poll(&the_bts, tbf, ts, fn);
+			}
+
+			gprs_rlcmac_rcv_rts_block(bts, 0, ts, fn, fn2bn(fn));
+		}
+
+		fn = fn_add_blocks(fn, 1);
+	}
+
+	res->blocks = block;
+	res->data_blocks = ms_sim.data_blocks;
+	res->delivered = ms_sim.delivered;
+	res->resent = ctrs->ctr[CTR_RLC_RESENT].current;
+	res->stalled = ctrs->ctr[CTR_RLC_STALLED].current;
+	res->deferred = ctrs->ctr[CTR_POLL_DEFERRED_NO_BLOCK].current;
+}
+
+static void print_result(float loss, bool adaptive, const struct sim_result *res)
+{
+	double sec = res->blocks * SIM_BLOCK_MS / 1000.0;
+
+	fprintf(stderr, "%4.0f%%  %-8s  %6u  %8u  %8u  %6.1f%%  %8.1f\n",
+		loss * 100, adaptive ? "adaptive" : "fixed", res->polls,
+		res->data_blocks, res->resent,
+		res->data_blocks ? 100.0 * res->resent / res->data_blocks : 0.0,
+		res->delivered * SIM_BLOCK_BYTES * 8 / sec / 1000);
+}
+
+static void print_contention(unsigned sba_per_block, bool fixed_rrbp,
+	const struct sim_result *res)
+{
+	double sec = res->blocks * SIM_BLOCK_MS / 1000.0;
+
+	fprintf(stderr, "%3u  %-8s  %6u  %8u  %8u  %8u  %8.1f\n",
+		sba_per_block, fixed_rrbp ? "fixed" : "earliest", res->polls,
+		res->deferred, res->stalled, res->resent,
+		res->delivered * SIM_BLOCK_BYTES * 8 / sec / 1000);
+}
+
+int main(int argc, char **argv)
+{
+	static const float loss_rates[] = { 0, 0.05, 0.1, 0.2 };
+	static const unsigned sba_rates[] = { 1, 2, 3 };
+	unsigned num_blocks = 10000;
+	struct sim_result fixed, res;
+	unsigned i;
+
+	tall_pcu_ctx = talloc_named_const(NULL, 1, "AckTest context");
+	if (!tall_pcu_ctx)
+		abort();
+
+	msgb_talloc_ctx_init(tall_pcu_ctx, 0);
+	osmo_init_logging2(tall_pcu_ctx, &gprs_log_info);
+	log_set_use_color(osmo_stderr_target, 0);
+	log_set_print_filename(osmo_stderr_target, 0);
+	log_set_log_level(osmo_stderr_target, LOGL_FATAL);
+
+	fprintf(stderr, "%u blocks on %u PDCH per run, CS-1, window size %u\n",
+		num_blocks, SIM_NUM_TS, SIM_WS);
+	fprintf(stderr, "loss  mode         polls      sent    resent     retx  kbit/s\n");
+
+	for (i = 0; i < ARRAY_SIZE(loss_rates); i++) {
+		memset(&fixed, 0, sizeof(fixed));
+		run_sim(loss_rates[i], false, num_blocks, &fixed);
+		print_result(loss_rates[i], false, &fixed);
+
+		memset(&res, 0, sizeof(res));
+		run_sim(loss_rates[i], true, num_blocks, &res);
+		print_result(loss_rates[i], true, &res);
+
+		OSMO_ASSERT(res.blocks == num_blocks && fixed.blocks == num_blocks);
+		if (loss_rates[i] < 0.1)
+			continue;
+
+		/* fewer retransmissions per data block, no less goodput */
+		OSMO_ASSERT((unsigned long long)res.resent * fixed.data_blocks <
+			(unsigned long long)fixed.resent * res.data_blocks);
+		OSMO_ASSERT(res.delivered >= fixed.delivered);
+		printf("%.0f%% loss: adaptive polling resends less, same goodput "
+			"or better\n", loss_rates[i] * 100);
+	}
+
+	fprintf(stderr, "\nsingle block allocations per block on the same PDCH, "
+		"5%% loss, adaptive\n");
+	fprintf(stderr, "sba  rrbp         polls  deferred   stalled    resent    kbit/s\n");
+
+	for (i = 0; i < ARRAY_SIZE(sba_rates); i++) {
+		memset(&fixed, 0, sizeof(fixed));
+		run_sim(0.05, true, num_blocks, &fixed, sba_rates[i], true);
+		print_contention(sba_rates[i], true, &fixed);
+
+		memset(&res, 0, sizeof(res));
+		run_sim(0.05, true, num_blocks, &res, sba_rates[i], false);
+		print_contention(sba_rates[i], false, &res);
+
+		/* the polls move to a free block instead of waiting */
+		OSMO_ASSERT(res.deferred < fixed.deferred);
+		OSMO_ASSERT(res.stalled < fixed.stalled);
+		printf("%u SBA per block: earliest free RRBP stalls less than "
+			"fixed RRBP\n", sba_rates[i]);
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/*
+ * stubs that should not be reached
+ */
+extern "C" {
+void l1if_pdch_req() { abort(); }
+void l1if_connect_pdch() { abort(); }
+void l1if_close_pdch() { abort(); }
+void l1if_open_pdch() { abort(); }
+}
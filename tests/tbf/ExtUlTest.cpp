@@ -0,0 +1,507 @@
+/* ExtUlTest.cpp
+ *
+ * Let an EGPRS MS run a request/response pattern, like a browser or a
+ * chat client, and compare the round trip time with and without the
+ * extended UL TBF mode (X2032). The MS sends a short request on an UL TBF,
+ * the response arrives a fixed time later and the MS sends its next
+ * request after a random think time. Without the extended mode every
+ * request needs a RACH and an Immediate Assignment on the AGCH, with it
+ * the MS answers the USFs of the idle TBF with dummy blocks and sends the
+ * next request right away, as long as the think time is shorter than the
+ * extension. The tables go to stderr.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include "bts.h"
+#include "tbf.h"
+#include "tbf_ul.h"
+#include "rlc.h"
+#include "gprs_debug.h"
+#include "gprs_ms.h"
+#include "pcu_l1_if.h"
+#include "coding_scheme.h"
+#include <gprs_rlcmac.h>
+
+extern "C" {
+#include <osmocom/core/application.h>
+#include <osmocom/core/msgb.h>
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/utils.h>
+#include <osmocom/core/rate_ctr.h>
+#include <osmocom/gsm/gsm_utils.h>
+#include <osmocom/gprs/protocol/gsm_04_60.h>
+#include <osmocom/pcu/pcuif_proto.h>
+}
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* globals used by the code */
+void *tall_pcu_ctx;
+int16_t spoof_mnc = 0, spoof_mcc = 0;
+bool spoof_mnc_3_digits = false;
+
+#define RFN_MODULUS	42432
+
+#define SIM_TLLI	0xf1223344
+#define SIM_MS_CLASS	12
+#define SIM_FIRST_TS	4
+#define SIM_NUM_TS	4
+#define SIM_BLOCK_MS	20
+/* MCS-1 blocks of a request, e.g. a TCP ACK and a small GET */
+#define SIM_REQ_BLOCKS	3
+/* from the RACH until the MS decoded the Immediate Assignment */
+#define SIM_ACCESS_BLOCKS 10
+/* from the last block of the request until the response arrived, the
+ * DL TBF is kept open (X2031) and this does not depend on the mode */
+#define SIM_RESP_BLOCKS	15
+#define SIM_MAX_THINK	150
+
+enum sim_ms_state {
+	SIM_MS_THINK,	/* waiting to send the next request */
+	SIM_MS_REQUEST,	/* has a request, but no UL TBF in FLOW */
+	SIM_MS_ACCESS,	/* RACH sent, waiting for the Immediate Assignment */
+	SIM_MS_SEND,	/* sending the request on the UL TBF */
+	SIM_MS_WAIT,	/* waiting for the response */
+};
+
+/* the simulated MS */
+static struct {
+	enum sim_ms_state state;
+	int tfi;		/* of the UL TBF, -1 if there is none */
+	uint8_t ts;
+	uint8_t usf;
+	uint16_t bsn;		/* V(S) */
+	unsigned left;		/* blocks of the request still to send */
+	unsigned req_block;	/* block the request was ready */
+	unsigned next_block;	/* block of the next state change */
+	uint8_t granted[8];	/* USF of the last DL block per TS */
+	unsigned agch;		/* Immediate Assignments sent */
+	unsigned agch_seen;	/* agch at the RACH */
+	uint32_t rnd;
+
+	unsigned requests;
+	unsigned long long rtt_blocks;
+	unsigned max_rtt_blocks;
+	unsigned accesses;
+	unsigned dummies;	/* dummy blocks sent on USFs of the idle TBF */
+} ms_sim;
+
+static unsigned sim_rand(unsigned max)
+{
+	/* fixed LCG so that every mode sees the same think times */
+	ms_sim.rnd = ms_sim.rnd * 1103515245 + 12345;
+	return ((ms_sim.rnd >> 16) & 0x7fff) % max;
+}
+
+/* override, requires '-Wl,--wrap=pcu_sock_send' */
+int __real_pcu_sock_send(struct msgb *msg);
+int __wrap_pcu_sock_send(struct msgb *msg)
+{
+	struct gsm_pcu_if *pcu_prim = (struct gsm_pcu_if *)msg->data;
+	struct gsm_pcu_if_data *data_req = &pcu_prim->u.data_req;
+
+	if (pcu_prim->msg_type == PCU_IF_MSG_DATA_REQ) {
+		if (data_req->sapi == PCU_IF_SAPI_PDTCH && data_req->len
+		    && data_req->ts_nr < 8)
+			ms_sim.granted[data_req->ts_nr] = data_req->data[0] & 0x07;
+		else if (data_req->sapi == PCU_IF_SAPI_AGCH)
+			ms_sim.agch += 1;
+	}
+
+	msgb_free(msg);
+	return 0;
+}
+
+static unsigned fn2bn(unsigned fn)
+{
+	return (fn % 52) / 4;
+}
+
+static unsigned fn_add_blocks(unsigned fn, unsigned blocks)
+{
+	unsigned bn = fn2bn(fn) + blocks;
+	fn = fn - (fn % 52);
+	fn += bn * 4 + bn / 3;
+	return fn % GSM_MAX_FN;
+}
+
+/* LSB first, as the RLC data of the EGPRS UL blocks */
+static void put_bits(uint8_t *buf, unsigned bit, uint32_t value, unsigned num)
+{
+	unsigned i;
+
+	for (i = 0; i < num; i++) {
+		if ((value >> i) & 1)
+			buf[(bit + i) / 8] |= 1 << ((bit + i) % 8);
+	}
+}
+
+static gprs_rlcmac_ul_tbf *sim_ul_tbf(BTS *the_bts)
+{
+	if (ms_sim.tfi < 0)
+		return NULL;
+	return the_bts->ul_tbf_by_tfi(ms_sim.tfi, 0, ms_sim.ts);
+}
+
+static void send_ul_ctrl(BTS *the_bts, RlcMacUplink_t *ulreq, uint8_t ts,
+	uint32_t fn)
+{
+	struct pcu_l1_meas meas;
+	bitvec *rlc_block;
+	uint8_t buf[GSM_MACBLOCK_LEN];
+	int num_bytes;
+
+	rlc_block = bitvec_alloc(GSM_MACBLOCK_LEN, tall_pcu_ctx);
+	OSMO_ASSERT(encode_gsm_rlcmac_uplink(rlc_block, ulreq) == 0);
+	num_bytes = bitvec_pack(rlc_block, buf);
+	bitvec_free(rlc_block);
+
+	meas.set_rssi(-60);
+	the_bts->bts_data()->trx[0].pdch[ts].rcv_block(buf, num_bytes, fn, &meas);
+}
+
+static void send_control_ack(BTS *the_bts, uint8_t ts, uint32_t fn)
+{
+	RlcMacUplink_t ulreq;
+
+	memset(&ulreq, 0, sizeof(ulreq));
+	ulreq.u.MESSAGE_TYPE = MT_PACKET_CONTROL_ACK;
+	ulreq.u.Packet_Control_Acknowledgement.PayloadType = GPRS_RLCMAC_CONTROL_BLOCK;
+	ulreq.u.Packet_Control_Acknowledgement.TLLI = SIM_TLLI;
+	send_ul_ctrl(the_bts, &ulreq, ts, fn);
+}
+
+static void send_dummy(BTS *the_bts, uint8_t ts, uint32_t fn)
+{
+	RlcMacUplink_t ulreq;
+
+	memset(&ulreq, 0, sizeof(ulreq));
+	ulreq.u.MESSAGE_TYPE = MT_PACKET_UPLINK_DUMMY_CONTROL_BLOCK;
+	ulreq.u.Packet_Uplink_Dummy_Control_Block.PayloadType = GPRS_RLCMAC_CONTROL_BLOCK;
+	ulreq.u.Packet_Uplink_Dummy_Control_Block.TLLI = SIM_TLLI;
+	send_ul_ctrl(the_bts, &ulreq, ts, fn);
+}
+
+/* One MCS-1 data block of the request, with the TLLI until the contention
+ * resolution is done */
+static void send_ul_data(BTS *the_bts, gprs_rlcmac_ul_tbf *tbf, uint32_t fn)
+{
+	struct gprs_rlc_ul_header_egprs_3 *egprs3;
+	struct gprs_rlc_data_info rlc;
+	struct pcu_l1_meas meas;
+	uint8_t buf[64];
+	unsigned len = mcs_size_ul(MCS1);
+	unsigned cps, offs;
+	bool ti = !tbf->m_contention_resolution_done;
+
+	OSMO_ASSERT(len <= sizeof(buf));
+	memset(buf, 0, sizeof(buf));
+
+	cps = gprs_rlc_mcs_cps(MCS1, EGPRS_PS_1, EGPRS_PS_INVALID, false);
+	egprs3 = (struct gprs_rlc_ul_header_egprs_3 *)buf;
+	egprs3->r = 0;
+	egprs3->si = 0;
+	egprs3->cv = ms_sim.left > 15 ? 15 : ms_sim.left - 1;
+	egprs3->tfi_hi = ms_sim.tfi & 0x03;
+	egprs3->tfi_lo = (ms_sim.tfi >> 2) & 0x07;
+	egprs3->bsn1_hi = ms_sim.bsn & 0x1f;
+	egprs3->bsn1_lo = (ms_sim.bsn >> 5) & 0x3f;
+	egprs3->cps_hi = cps & 0x03;
+	egprs3->cps_lo = (cps >> 2) & 0x03;
+	egprs3->pi = 0;
+	egprs3->rsb = 0;
+	egprs3->spb = 0;
+
+	/* E=1: only data of one LLC frame, TI: the TLLI follows */
+	gprs_rlc_data_info_init_ul(&rlc, MCS1, false);
+	offs = rlc.data_offs_bits[0];
+	put_bits(buf, offs - 2, 1, 1);
+	if (ti) {
+		put_bits(buf, offs - 1, 1, 1);
+		/* little endian in EGPRS */
+		put_bits(buf, offs, SIM_TLLI, 32);
+	}
+
+	ms_sim.bsn = (ms_sim.bsn + 1) % RLC_EGPRS_SNS;
+	ms_sim.left -= 1;
+
+	meas.set_rssi(-60);
+	the_bts->bts_data()->trx[0].pdch[ms_sim.ts].rcv_block(buf, len, fn, &meas);
+}
+
+static void rach(BTS *the_bts, uint32_t fn)
+{
+	struct rach_ind_params rip;
+
+	/* EGPRS Packet Channel Request, one phase access */
+	memset(&rip, 0, sizeof(rip));
+	rip.burst_type = GSM_L1_BURST_TYPE_ACCESS_1;
+	rip.is_11bit = true;
+	rip.ra = ((SIM_MS_CLASS - 1) << 5) | sim_rand(8);
+	rip.rfn = fn % RFN_MODULUS;
+	rip.qta = 0;
+
+	ms_sim.accesses += 1;
+	ms_sim.agch_seen = ms_sim.agch;
+	the_bts->rcv_rach(&rip);
+}
+
+/* the TBF of the Immediate Assignment, it has no TLLI yet */
+static bool find_new_tbf(BTS *the_bts)
+{
+	LListHead<gprs_rlcmac_tbf> *pos;
+	gprs_rlcmac_ul_tbf *tbf;
+
+	llist_for_each(pos, &the_bts->ul_tbfs()) {
+		tbf = as_ul_tbf(pos->entry());
+		if (tbf->is_tlli_valid() || !tbf->state_is(GPRS_RLCMAC_FLOW))
+			continue;
+
+		ms_sim.tfi = tbf->tfi();
+		ms_sim.ts = tbf->first_ts;
+		ms_sim.usf = tbf->m_usf[tbf->first_ts];
+		ms_sim.bsn = 0;
+		return true;
+	}
+
+	return false;
+}
+
+static void ms_step(BTS *the_bts, unsigned block, uint32_t fn)
+{
+	gprs_rlcmac_ul_tbf *tbf = sim_ul_tbf(the_bts);
+	unsigned rtt;
+
+	switch (ms_sim.state) {
+	case SIM_MS_THINK:
+		if (block < ms_sim.next_block)
+			break;
+		ms_sim.req_block = block;
+		ms_sim.state = SIM_MS_REQUEST;
+		/* fall through */
+	case SIM_MS_REQUEST:
+		ms_sim.left = SIM_REQ_BLOCKS;
+		if (tbf && tbf->state_is(GPRS_RLCMAC_FLOW)) {
+			/* the TBF is still there in extended mode */
+			ms_sim.state = SIM_MS_SEND;
+		} else if (!tbf) {
+			ms_sim.tfi = -1;
+			rach(the_bts, fn);
+			ms_sim.next_block = block + SIM_ACCESS_BLOCKS;
+			ms_sim.state = SIM_MS_ACCESS;
+		}
+		/* else wait for the final Ack/Nack of the old TBF */
+		break;
+	case SIM_MS_ACCESS:
+		if (ms_sim.tfi < 0 && ms_sim.agch != ms_sim.agch_seen)
+			find_new_tbf(the_bts);
+		if (block < ms_sim.next_block)
+			break;
+		/* without an assignment the MS tries again */
+		ms_sim.state = ms_sim.tfi < 0 ? SIM_MS_REQUEST : SIM_MS_SEND;
+		break;
+	case SIM_MS_SEND:
+		/* the extension ran out before the MS got a USF */
+		if (!tbf || !tbf->state_is(GPRS_RLCMAC_FLOW))
+			ms_sim.state = SIM_MS_REQUEST;
+		break;
+	case SIM_MS_WAIT:
+		if (block < ms_sim.next_block)
+			break;
+		rtt = block - ms_sim.req_block;
+		ms_sim.requests += 1;
+		ms_sim.rtt_blocks += rtt;
+		if (rtt > ms_sim.max_rtt_blocks)
+			ms_sim.max_rtt_blocks = rtt;
+		ms_sim.next_block = block + 1 + sim_rand(SIM_MAX_THINK);
+		ms_sim.state = SIM_MS_THINK;
+		break;
+	}
+}
+
+/* Answer the USF of the last DL block on the TS of the MS */
+static void ms_answer_usf(BTS *the_bts, uint8_t ts, unsigned block,
+	uint32_t fn)
+{
+	gprs_rlcmac_ul_tbf *tbf = sim_ul_tbf(the_bts);
+
+	if (!tbf || ts != ms_sim.ts || ms_sim.granted[ts] != ms_sim.usf
+	    || ms_sim.state == SIM_MS_ACCESS)
+		return;
+
+	if (ms_sim.state == SIM_MS_SEND) {
+		send_ul_data(the_bts, tbf, fn);
+		if (!ms_sim.left) {
+			ms_sim.next_block = block + SIM_RESP_BLOCKS;
+			ms_sim.state = SIM_MS_WAIT;
+		}
+	} else if (tbf->state_is(GPRS_RLCMAC_FLOW)) {
+		ms_sim.dummies += 1;
+		send_dummy(the_bts, ts, fn);
+	}
+}
+
+struct sim_result {
+	unsigned blocks;
+	unsigned requests;
+	unsigned long long rtt_blocks;
+	unsigned max_rtt_blocks;
+	unsigned accesses;
+	unsigned dummies;
+	unsigned resumed;
+};
+
+static void run_sim(unsigned ext_ms, unsigned usf_ms, unsigned num_blocks,
+	struct sim_result *res)
+{
+	BTS the_bts;
+	struct gprs_rlcmac_bts *bts = the_bts.bts_data();
+	struct rate_ctr_group *ctrs = the_bts.rate_counters();
+	uint32_t fn = 0;
+	unsigned block, ts;
+
+	bts->alloc_algorithm = alloc_algorithm_b;
+	bts->egprs_enabled = 1;
+	bts->initial_cs_dl = 1;
+	bts->initial_cs_ul = 1;
+	bts->initial_mcs_dl = 1;
+	bts->initial_mcs_ul = 1;
+	osmo_tdef_set(bts->T_defs_pcu, -2030, 0, OSMO_TDEF_S);
+	osmo_tdef_set(bts->T_defs_pcu, -2031, 0, OSMO_TDEF_S);
+	osmo_tdef_set(bts->T_defs_pcu, -2032, ext_ms, OSMO_TDEF_MS);
+	osmo_tdef_set(bts->T_defs_pcu, -2033, usf_ms, OSMO_TDEF_MS);
+	bts_update_params(bts);
+	for (ts = SIM_FIRST_TS; ts < SIM_FIRST_TS + SIM_NUM_TS; ts++)
+		bts->trx[0].pdch[ts].enable();
+	the_bts.set_current_frame_number(fn);
+
+	memset(&ms_sim, 0, sizeof(ms_sim));
+	memset(ms_sim.granted, 0x07, sizeof(ms_sim.granted));
+	ms_sim.state = SIM_MS_THINK;
+	ms_sim.tfi = -1;
+	ms_sim.rnd = 4711;
+
+	for (block = 0; block < num_blocks; block++) {
+		the_bts.set_current_frame_number(fn);
+
+		ms_step(&the_bts, block, fn);
+
+		for (ts = SIM_FIRST_TS; ts < SIM_FIRST_TS + SIM_NUM_TS; ts++) {
+			/* the final Ack/Nack polls the MS */
+			if (the_bts.ul_tbf_by_poll_fn(fn, 0, ts))
+				send_control_ack(&the_bts, ts, fn);
+			else
+				ms_answer_usf(&the_bts, ts, block, fn);
+			ms_sim.granted[ts] = 0x07;
+
+			gprs_rlcmac_rcv_rts_block(bts, 0, ts, fn, fn2bn(fn));
+		}
+
+		fn = fn_add_blocks(fn, 1);
+	}
+
+	res->blocks = num_blocks;
+	res->requests = ms_sim.requests;
+	res->rtt_blocks = ms_sim.rtt_blocks;
+	res->max_rtt_blocks = ms_sim.max_rtt_blocks;
+	res->accesses = ms_sim.accesses;
+	res->dummies = ms_sim.dummies;
+	res->resumed = ctrs->ctr[CTR_TBF_UL_EXT_RESUMED].current;
+}
+
+static void print_result(const char *name, const struct sim_result *res)
+{
+	fprintf(stderr, "%-14s  %8u  %7.0f  %7u  %8u  %7u  %6.1f%%\n", name,
+		res->requests,
+		res->requests ? (double)res->rtt_blocks * SIM_BLOCK_MS / res->requests : 0.0,
+		res->max_rtt_blocks * SIM_BLOCK_MS, res->accesses, res->resumed,
+		100.0 * res->dummies / res->blocks);
+}
+
+int main(int argc, char **argv)
+{
+	static const unsigned ext_times[] = { 500, 1000, 2000 };
+	static const unsigned usf_intervals[] = { 20, 80, 200 };
+	unsigned num_blocks = 20000;
+	struct sim_result off, res, prev;
+	char name[32];
+	unsigned i;
+
+	tall_pcu_ctx = talloc_named_const(NULL, 1, "ExtUlTest context");
+	if (!tall_pcu_ctx)
+		abort();
+
+	msgb_talloc_ctx_init(tall_pcu_ctx, 0);
+	osmo_init_logging2(tall_pcu_ctx, &gprs_log_info);
+	log_set_use_color(osmo_stderr_target, 0);
+	log_set_print_filename(osmo_stderr_target, 0);
+	log_set_log_level(osmo_stderr_target, LOGL_FATAL);
+
+	fprintf(stderr, "%u blocks, requests of %u MCS-1 blocks, response after %u ms, "
+		"think time up to %u ms\n", num_blocks, SIM_REQ_BLOCKS,
+		SIM_RESP_BLOCKS * SIM_BLOCK_MS, SIM_MAX_THINK * SIM_BLOCK_MS);
+	fprintf(stderr, "extended UL     requests  avg RTT  max RTT  accesses  resumed  idle USF\n");
+
+	memset(&off, 0, sizeof(off));
+	run_sim(0, 80, num_blocks, &off);
+	print_result("off", &off);
+	OSMO_ASSERT(off.requests > 0 && off.resumed == 0);
+
+	for (i = 0; i < ARRAY_SIZE(ext_times); i++) {
+		snprintf(name, sizeof(name), "%u ms", ext_times[i]);
+		memset(&res, 0, sizeof(res));
+		run_sim(ext_times[i], 80, num_blocks, &res);
+		print_result(name, &res);
+
+		/* requests go out on the idle TBF instead of a new access */
+		OSMO_ASSERT(res.resumed > 0);
+		OSMO_ASSERT(res.accesses < off.accesses);
+		OSMO_ASSERT((unsigned long long)res.rtt_blocks * off.requests <
+			(unsigned long long)off.rtt_blocks * res.requests);
+		printf("extended for %u ms: fewer accesses, shorter round trip\n",
+			ext_times[i]);
+	}
+
+	fprintf(stderr, "\nUSF interval of the idle TBF, extended for 2000 ms\n");
+	for (i = 0; i < ARRAY_SIZE(usf_intervals); i++) {
+		snprintf(name, sizeof(name), "USF %u ms", usf_intervals[i]);
+		memset(&res, 0, sizeof(res));
+		run_sim(2000, usf_intervals[i], num_blocks, &res);
+		print_result(name, &res);
+
+		/* the idle TBF costs less with fewer USFs */
+		if (i > 0) {
+			OSMO_ASSERT(res.dummies < prev.dummies);
+			printf("USF every %u ms: fewer idle blocks than every %u ms\n",
+				usf_intervals[i], usf_intervals[i - 1]);
+		}
+		prev = res;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/*
+ * stubs that should not be reached
+ */
+extern "C" {
+void l1if_pdch_req() { abort(); }
+void l1if_connect_pdch() { abort(); }
+void l1if_close_pdch() { abort(); }
+void l1if_open_pdch() { abort(); }
+}
@@ -0,0 +1,207 @@
+/* RachStorm.cpp
+ *
+ * Replay a RACH storm, as after an SGSN outage when every MS of the cell
+ * attaches again, against a cell with 8 PDCH. Every block brings a burst
+ * of RACH.ind, each of them received twice, followed by the time
+ * indications of its frames and the RTS of all 8 TS. The time spent per
+ * block is reported for RACH handling inline and for the RACH queue with
+ * admission control.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include "bts.h"
+#include "tbf.h"
+#include "gprs_debug.h"
+#include "gprs_ms.h"
+#include "pcu_hist.h"
+#include <gprs_rlcmac.h>
+
+extern "C" {
+#include <osmocom/core/application.h>
+#include <osmocom/core/msgb.h>
+#include <osmocom/core/rate_ctr.h>
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/utils.h>
+#include <osmocom/gsm/gsm_utils.h>
+#include <osmocom/pcu/pcuif_proto.h>
+}
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* globals used by the code */
+void *tall_pcu_ctx;
+int16_t spoof_mnc = 0, spoof_mcc = 0;
+bool spoof_mnc_3_digits = false;
+
+#define RFN_MODULUS	42432
+
+static unsigned agch_msgs;
+
+/* override, requires '-Wl,--wrap=pcu_sock_send' */
+int __real_pcu_sock_send(struct msgb *msg);
+int __wrap_pcu_sock_send(struct msgb *msg)
+{
+	struct gsm_pcu_if *pcu_prim = (struct gsm_pcu_if *)msg->data;
+
+	if (pcu_prim->msg_type == PCU_IF_MSG_DATA_REQ &&
+	    pcu_prim->u.data_req.sapi == PCU_IF_SAPI_AGCH)
+		agch_msgs += 1;
+	msgb_free(msg);
+	return 0;
+}
+
+static unsigned fn2bn(unsigned fn)
+{
+	return (fn % 52) / 4;
+}
+
+static unsigned fn_add_blocks(unsigned fn, unsigned blocks)
+{
+	unsigned bn = fn2bn(fn) + blocks;
+	fn = fn - (fn % 52);
+	fn += bn * 4 + bn / 3;
+	return fn % GSM_MAX_FN;
+}
+
+static uint64_t ctr(BTS *the_bts, unsigned id)
+{
+	return the_bts->rate_counters()->ctr[id].current;
+}
+
+static void rach(BTS *the_bts, uint16_t ra, uint32_t fn)
+{
+	struct rach_ind_params rip;
+
+	memset(&rip, 0, sizeof(rip));
+	rip.burst_type = GSM_L1_BURST_TYPE_ACCESS_0;
+	rip.ra = ra;
+	rip.rfn = fn % RFN_MODULUS;
+	rip.qta = 0;
+
+	the_bts->rcv_rach(&rip);
+}
+
+static void bench_storm(const char *name, unsigned num_blocks,
+			unsigned rach_per_block, uint8_t budget, bool admission)
+{
+	BTS the_bts;
+	struct gprs_rlcmac_bts *bts = the_bts.bts_data();
+	struct pcu_hist block_us;
+	struct timespec start, end;
+	uint32_t fn = 0, next, f;
+	unsigned block, i, ts;
+
+	bts->alloc_algorithm = alloc_algorithm_a;
+	bts->rach_queue_budget = budget;
+	if (admission) {
+		bts->rach_buckets[RACH_BUCKET_CELL].rate = 50;
+		bts->rach_buckets[RACH_BUCKET_CELL].depth = 20;
+		bts->rach_buckets[RACH_BUCKET_ONE_PHASE].rate = 20;
+		bts->rach_buckets[RACH_BUCKET_ONE_PHASE].depth = 10;
+	}
+	for (ts = 0; ts < 8; ts++)
+		bts->trx[0].pdch[ts].enable();
+	the_bts.set_current_frame_number(fn);
+
+	pcu_hist_reset(&block_us);
+	agch_msgs = 0;
+
+	for (block = 0; block < num_blocks; block++) {
+		next = fn_add_blocks(fn, 1);
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+
+		/* the burst, mostly one phase access, every RACH.ind twice */
+		for (i = 0; i < rach_per_block; i++) {
+			uint16_t ra = (i % 4 ? 0x78 : 0x70) | ((block + i) & 0x7);
+
+			rach(&the_bts, ra, fn);
+			rach(&the_bts, ra, fn);
+		}
+
+		for (f = fn; f != next; f = (f + 1) % GSM_MAX_FN)
+			the_bts.set_current_frame_number(f);
+
+		for (ts = 0; ts < 8; ts++)
+			gprs_rlcmac_rcv_rts_block(bts, 0, ts, fn, fn2bn(fn));
+
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		pcu_hist_add(&block_us, pcu_timespec_diff_us(&start, &end));
+
+		fn = next;
+	}
+
+	printf("%-10s %5u us max %5u us p99 %5u us p50, "
+	       "%llu IMM.ASS %llu rejected in %u AGCH msgs, "
+	       "%llu queued %llu dup %llu dropped %llu throttled %llu early\n",
+		name, block_us.max, pcu_hist_percentile(&block_us, 990),
+		pcu_hist_percentile(&block_us, 500),
+		(unsigned long long)ctr(&the_bts, CTR_IMMEDIATE_ASSIGN_UL_TBF),
+		(unsigned long long)ctr(&the_bts, CTR_IMMEDIATE_ASSIGN_REJ),
+		agch_msgs,
+		(unsigned long long)ctr(&the_bts, CTR_RACH_QUEUED),
+		(unsigned long long)ctr(&the_bts, CTR_RACH_DUPLICATE),
+		(unsigned long long)ctr(&the_bts, CTR_RACH_DROPPED),
+		(unsigned long long)ctr(&the_bts, CTR_RACH_THROTTLED),
+		(unsigned long long)ctr(&the_bts, CTR_RACH_EARLY_REJECTED));
+}
+
+int main(int argc, char **argv)
+{
+	unsigned rach_per_block = 32;
+	unsigned num_blocks = 2000;
+
+	if (argc > 1)
+		rach_per_block = atoi(argv[1]);
+	if (argc > 2)
+		num_blocks = atoi(argv[2]);
+	if (!rach_per_block || !num_blocks) {
+		fprintf(stderr, "usage: %s [RACH_PER_BLOCK [BLOCKS]]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	tall_pcu_ctx = talloc_named_const(NULL, 1, "RachStorm context");
+	if (!tall_pcu_ctx)
+		abort();
+
+	msgb_talloc_ctx_init(tall_pcu_ctx, 0);
+	osmo_init_logging2(tall_pcu_ctx, &gprs_log_info);
+	log_set_use_color(osmo_stderr_target, 0);
+	log_set_print_filename(osmo_stderr_target, 0);
+	/* keep the RACH and RTS path free of log output */
+	log_set_log_level(osmo_stderr_target, LOGL_FATAL);
+
+	printf("%u RACH.ind (each received twice) per block, %u blocks\n",
+		rach_per_block, num_blocks);
+	bench_storm("inline", num_blocks, rach_per_block, 0, false);
+	bench_storm("queued", num_blocks, rach_per_block, 4, false);
+	bench_storm("admission", num_blocks, rach_per_block, 4, true);
+
+	return EXIT_SUCCESS;
+}
+
+/*
+ * stubs that should not be reached
+ */
+extern "C" {
+void l1if_pdch_req() { abort(); }
+void l1if_connect_pdch() { abort(); }
+void l1if_close_pdch() { abort(); }
+void l1if_open_pdch() { abort(); }
+}
@@ -0,0 +1,327 @@
+/* RachTest.cpp
+ *
+ * Tests of the RACH controller: grouped Immediate Assignment Rejects,
+ * duplicates in the RACH queue, the admission token buckets, queued
+ * requests that get too old and the work per frame during a RACH storm.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include "bts.h"
+#include "encoding.h"
+#include "rach_ctrl.h"
+#include "gprs_debug.h"
+#include <gprs_rlcmac.h>
+
+extern "C" {
+#include <osmocom/core/application.h>
+#include <osmocom/core/bitvec.h>
+#include <osmocom/core/msgb.h>
+#include <osmocom/core/rate_ctr.h>
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/utils.h>
+#include <osmocom/pcu/pcuif_proto.h>
+}
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* globals used by the code */
+void *tall_pcu_ctx;
+int16_t spoof_mnc = 0, spoof_mcc = 0;
+bool spoof_mnc_3_digits = false;
+
+static bool print_agch = true;
+static unsigned agch_msgs;
+
+/* override, requires '-Wl,--wrap=pcu_sock_send' */
+int __real_pcu_sock_send(struct msgb *msg);
+int __wrap_pcu_sock_send(struct msgb *msg)
+{
+	struct gsm_pcu_if *pcu_prim = (struct gsm_pcu_if *)msg->data;
+	struct gsm_pcu_if_data *data_req = &pcu_prim->u.data_req;
+
+	if (pcu_prim->msg_type == PCU_IF_MSG_DATA_REQ &&
+	    data_req->sapi == PCU_IF_SAPI_AGCH) {
+		agch_msgs += 1;
+		if (print_agch)
+			printf("AGCH: %s\n", osmo_hexdump(data_req->data, data_req->len));
+	}
+	msgb_free(msg);
+	return 0;
+}
+
+static void print_ctrs(BTS *the_bts)
+{
+	const struct rate_ctr *ctr = the_bts->rate_counters()->ctr;
+
+	printf("queued=%llu duplicate=%llu dropped=%llu throttled=%llu "
+		"early_rejected=%llu rejects=%llu\n",
+		(unsigned long long) ctr[CTR_RACH_QUEUED].current,
+		(unsigned long long) ctr[CTR_RACH_DUPLICATE].current,
+		(unsigned long long) ctr[CTR_RACH_DROPPED].current,
+		(unsigned long long) ctr[CTR_RACH_THROTTLED].current,
+		(unsigned long long) ctr[CTR_RACH_EARLY_REJECTED].current,
+		(unsigned long long) ctr[CTR_IMMEDIATE_ASSIGN_REJ].current);
+}
+
+/* 8 bit RACH on TS0, single block packet access */
+static void rach(BTS *the_bts, uint16_t ra, uint32_t fn)
+{
+	struct rach_ind_params rip;
+
+	memset(&rip, 0, sizeof(rip));
+	rip.burst_type = GSM_L1_BURST_TYPE_ACCESS_0;
+	rip.ra = ra;
+	rip.rfn = fn;
+	rip.qta = 0;
+
+	the_bts->rcv_rach(&rip);
+}
+
+/* No PDCH is enabled, every request is rejected */
+static void setup_bts(BTS *the_bts, uint8_t budget, uint32_t fn)
+{
+	struct gprs_rlcmac_bts *bts = the_bts->bts_data();
+
+	bts->alloc_algorithm = alloc_algorithm_a;
+	bts->rach_queue_budget = budget;
+	the_bts->set_current_frame_number(fn);
+}
+
+static void test_imm_ass_rej_grouped()
+{
+	static const struct imm_ass_rej_ref refs[] = {
+		{ 0x70, 100, GSM_L1_BURST_TYPE_ACCESS_0 },
+		{ 0x75, 2000, GSM_L1_BURST_TYPE_ACCESS_0 },
+		{ 0x3e5, 12345, GSM_L1_BURST_TYPE_ACCESS_1 },
+		{ 0x7a, 3985, GSM_L1_BURST_TYPE_ACCESS_0 },
+	};
+	bitvec *bv = bitvec_alloc(22, tall_pcu_ctx);
+	unsigned num;
+	int plen;
+
+	printf("=== start %s ===\n", __func__);
+
+	for (num = 1; num <= ARRAY_SIZE(refs); num++) {
+		bitvec_unhex(bv, DUMMY_VEC);
+		plen = Encoding::write_immediate_assignment_reject(bv, refs, num, 10);
+		OSMO_ASSERT(plen == 19);
+		printf("%u request(s): %s\n", num, osmo_hexdump(bv->data, 22));
+	}
+
+	/* a single request with the configured Wait Indication */
+	bitvec_unhex(bv, DUMMY_VEC);
+	plen = Encoding::write_immediate_assignment_reject(bv, 0x3e5, 12345,
+		GSM_L1_BURST_TYPE_ACCESS_1, 5);
+	OSMO_ASSERT(plen == 19);
+	printf("single request: %s\n", osmo_hexdump(bv->data, 22));
+
+	bitvec_free(bv);
+
+	printf("=== end %s ===\n", __func__);
+}
+
+static void test_rach_duplicates()
+{
+	BTS the_bts;
+
+	printf("=== start %s ===\n", __func__);
+
+	setup_bts(&the_bts, 4, 100);
+
+	rach(&the_bts, 0x70, 100);
+	/* the same access burst again, e.g. received on another TRX */
+	rach(&the_bts, 0x70, 100);
+	rach(&the_bts, 0x71, 100);
+	rach(&the_bts, 0x70, 101);
+	OSMO_ASSERT(the_bts.rach()->queued() == 3);
+	print_ctrs(&the_bts);
+
+	/* all three are rejected with one message */
+	the_bts.set_current_frame_number(104);
+	OSMO_ASSERT(the_bts.rach()->queued() == 0);
+	print_ctrs(&the_bts);
+
+	printf("=== end %s ===\n", __func__);
+}
+
+static void test_rach_admission()
+{
+	BTS the_bts;
+	struct gprs_rlcmac_bts *bts = the_bts.bts_data();
+
+	printf("=== start %s ===\n", __func__);
+
+	/* one request per second, at most two in a burst */
+	bts->rach_buckets[RACH_BUCKET_CELL].rate = 1;
+	bts->rach_buckets[RACH_BUCKET_CELL].depth = 2;
+	setup_bts(&the_bts, 0, 1000);
+
+	rach(&the_bts, 0x70, 1000);
+	rach(&the_bts, 0x71, 1000);
+	rach(&the_bts, 0x72, 1000);
+	rach(&the_bts, 0x73, 1000);
+	print_ctrs(&the_bts);
+
+	/* a token after 217 frames (1.0015 s) */
+	the_bts.set_current_frame_number(1217);
+	rach(&the_bts, 0x74, 1217);
+	rach(&the_bts, 0x75, 1217);
+	print_ctrs(&the_bts);
+
+	printf("=== end %s ===\n", __func__);
+}
+
+static void test_rach_queue_age()
+{
+	BTS the_bts;
+
+	printf("=== start %s ===\n", __func__);
+
+	setup_bts(&the_bts, 1, 100);
+
+	rach(&the_bts, 0x70, 100);
+	rach(&the_bts, 0x71, 100);
+	rach(&the_bts, 0x72, 100);
+	OSMO_ASSERT(the_bts.rach()->queued() == 3);
+
+	/* one per frame ... */
+	the_bts.set_current_frame_number(101);
+	OSMO_ASSERT(the_bts.rach()->queued() == 2);
+	print_ctrs(&the_bts);
+
+	/* ... and the others are too old by now */
+	the_bts.set_current_frame_number(100 + RACH_QUEUE_MAX_AGE + 1);
+	OSMO_ASSERT(the_bts.rach()->queued() == 0);
+	print_ctrs(&the_bts);
+
+	printf("=== end %s ===\n", __func__);
+}
+
+static unsigned fn2bn(unsigned fn)
+{
+	return (fn % 52) / 4;
+}
+
+static unsigned fn_add_blocks(unsigned fn, unsigned blocks)
+{
+	unsigned bn = fn2bn(fn) + blocks;
+	fn = fn - (fn % 52);
+	fn += bn * 4 + bn / 3;
+	return fn % GSM_MAX_FN;
+}
+
+/* Every block brings a burst of RACH.ind, each of them received twice, as
+ * after an SGSN outage when every MS of the cell attaches again. Returns
+ * the most AGCH messages sent for one burst or frame. */
+static unsigned rach_storm(uint8_t budget, unsigned rach_per_block,
+	unsigned num_blocks)
+{
+	BTS the_bts;
+	struct gprs_rlcmac_bts *bts = the_bts.bts_data();
+	uint32_t fn = 0, next, f;
+	unsigned block, i, ts, before, max = 0;
+
+	setup_bts(&the_bts, budget, fn);
+	for (ts = 0; ts < 8; ts++)
+		bts->trx[0].pdch[ts].enable();
+
+	for (block = 0; block < num_blocks; block++) {
+		next = fn_add_blocks(fn, 1);
+
+		/* mostly one phase access */
+		before = agch_msgs;
+		for (i = 0; i < rach_per_block; i++) {
+			uint16_t ra = (i % 4 ? 0x78 : 0x70) | ((block + i) & 0x7);
+
+			rach(&the_bts, ra, fn);
+			rach(&the_bts, ra, fn);
+		}
+		max = OSMO_MAX(max, agch_msgs - before);
+
+		for (f = (fn + 1) % GSM_MAX_FN; f != next; f = (f + 1) % GSM_MAX_FN) {
+			before = agch_msgs;
+			the_bts.set_current_frame_number(f);
+			max = OSMO_MAX(max, agch_msgs - before);
+		}
+		before = agch_msgs;
+		the_bts.set_current_frame_number(next);
+		max = OSMO_MAX(max, agch_msgs - before);
+
+		fn = next;
+	}
+
+	if (budget)
+		OSMO_ASSERT(the_bts.rate_counters()->ctr[CTR_RACH_DUPLICATE].current > 0);
+
+	return max;
+}
+
+static void test_rach_storm()
+{
+	unsigned max;
+
+	printf("=== start %s ===\n", __func__);
+
+	print_agch = false;
+
+	/* handled right away, every RACH.ind is answered at once */
+	max = rach_storm(0, 32, 20);
+	OSMO_ASSERT(max == 2 * 32);
+	printf("inline: %u AGCH messages for one burst\n", max);
+
+	/* queued, a burst does no allocation or encoding and every frame
+	 * answers at most 4 of the requests */
+	max = rach_storm(4, 32, 20);
+	OSMO_ASSERT(max <= 4);
+	printf("queued: at most 4 AGCH messages per frame\n");
+
+	print_agch = true;
+
+	printf("=== end %s ===\n", __func__);
+}
+
+int main(int argc, char **argv)
+{
+	tall_pcu_ctx = talloc_named_const(NULL, 1, "RachTest context");
+	if (!tall_pcu_ctx)
+		abort();
+
+	msgb_talloc_ctx_init(tall_pcu_ctx, 0);
+	osmo_init_logging2(tall_pcu_ctx, &gprs_log_info);
+	log_set_use_color(osmo_stderr_target, 0);
+	log_set_print_filename(osmo_stderr_target, 0);
+	log_parse_category_mask(osmo_stderr_target, "DRLCMAC,1");
+
+	test_imm_ass_rej_grouped();
+	test_rach_duplicates();
+	test_rach_admission();
+	test_rach_queue_age();
+	test_rach_storm();
+
+	return EXIT_SUCCESS;
+}
+
+/*
+ * stubs that should not be reached
+ */
+extern "C" {
+void l1if_pdch_req() { abort(); }
+void l1if_connect_pdch() { abort(); }
+void l1if_close_pdch() { abort(); }
+void l1if_open_pdch() { abort(); }
+}
@@ -0,0 +1,246 @@
+/* RtsTest.cpp
+ *
+ * Run the RTS of a PDCH that is shared by 32 DL TBFs, all of them with
+ * data to send. Every DL ack poll is answered with an all-acked Packet
+ * Downlink Ack/Nack, so the TBFs stay in FLOW. The same is done on an idle
+ * PDCH, which only sends dummy blocks. Data and dummy blocks are encoded
+ * into the PCUIF DATA.req, so each of them must cost exactly one msgb.
+ * The CPU time per RTS is reported on stderr.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include "bts.h"
+#include "tbf.h"
+#include "tbf_dl.h"
+#include "gprs_debug.h"
+#include "gprs_ms.h"
+#include "pcu_l1_if.h"
+#include <gprs_rlcmac.h>
+
+extern "C" {
+#include <osmocom/core/application.h>
+#include <osmocom/core/msgb.h>
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/utils.h>
+#include <osmocom/gsm/gsm_utils.h>
+}
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* globals used by the code */
+void *tall_pcu_ctx;
+int16_t spoof_mnc = 0, spoof_mcc = 0;
+bool spoof_mnc_3_digits = false;
+
+#define BENCH_TS	7
+#define BENCH_NUM_TBF	32
+
+static uint8_t llc_data[200];
+
+static unsigned long long msgb_allocs;
+
+enum block_kind {
+	BLOCK_NONE,
+	BLOCK_DATA,
+	BLOCK_DUMMY,
+	BLOCK_CONTROL,
+};
+
+static enum block_kind last_block;
+
+/* override, requires '-Wl,--wrap=pcu_sock_send' */
+int __real_pcu_sock_send(struct msgb *msg);
+int __wrap_pcu_sock_send(struct msgb *msg)
+{
+	struct gsm_pcu_if *pcu_prim = (struct gsm_pcu_if *)msg->data;
+	struct gsm_pcu_if_data *data_req = &pcu_prim->u.data_req;
+
+	if (pcu_prim->msg_type == PCU_IF_MSG_DATA_REQ &&
+	    data_req->sapi == PCU_IF_SAPI_PDTCH && data_req->len >= 2) {
+		if ((data_req->data[0] >> 6) == 0)
+			last_block = BLOCK_DATA;
+		else if ((data_req->data[1] >> 2) == MT_PACKET_DOWNLINK_DUMMY_CONTROL_BLOCK)
+			last_block = BLOCK_DUMMY;
+		else
+			last_block = BLOCK_CONTROL;
+	}
+
+	msgb_free(msg);
+	return 0;
+}
+
+/* override, requires '-Wl,--wrap=msgb_alloc' */
+extern "C" {
+struct msgb *__real_msgb_alloc(uint16_t size, const char *name);
+struct msgb *__wrap_msgb_alloc(uint16_t size, const char *name)
+{
+	msgb_allocs += 1;
+	return __real_msgb_alloc(size, name);
+}
+}
+
+static unsigned fn2bn(unsigned fn)
+{
+	return (fn % 52) / 4;
+}
+
+static unsigned fn_add_blocks(unsigned fn, unsigned blocks)
+{
+	unsigned bn = fn2bn(fn) + blocks;
+	fn = fn - (fn % 52);
+	fn += bn * 4 + bn / 3;
+	return fn % GSM_MAX_FN;
+}
+
+static void answer_dl_poll(BTS *the_bts, gprs_rlcmac_dl_tbf *tbf, uint32_t fn)
+{
+	RlcMacUplink_t ulreq;
+	Packet_Downlink_Ack_Nack_t *ack = &ulreq.u.Packet_Downlink_Ack_Nack;
+	struct pcu_l1_meas meas;
+	bitvec *rlc_block;
+	uint8_t buf[GSM_MACBLOCK_LEN];
+	int num_bytes;
+
+	memset(&ulreq, 0, sizeof(ulreq));
+	ulreq.u.MESSAGE_TYPE = MT_PACKET_DOWNLINK_ACK_NACK;
+	ack->PayloadType = GPRS_RLCMAC_CONTROL_BLOCK;
+	ack->DOWNLINK_TFI = tbf->tfi();
+	ack->Ack_Nack_Description.STARTING_SEQUENCE_NUMBER = tbf->window()->v_s();
+	memset(ack->Ack_Nack_Description.RECEIVED_BLOCK_BITMAP, 0xff,
+		sizeof(ack->Ack_Nack_Description.RECEIVED_BLOCK_BITMAP));
+
+	rlc_block = bitvec_alloc(GSM_MACBLOCK_LEN, tall_pcu_ctx);
+	OSMO_ASSERT(encode_gsm_rlcmac_uplink(rlc_block, &ulreq) == 0);
+	num_bytes = bitvec_pack(rlc_block, buf);
+	bitvec_free(rlc_block);
+
+	meas.set_rssi(-60);
+	the_bts->bts_data()->trx[0].pdch[BENCH_TS].rcv_block(buf, num_bytes, fn, &meas);
+}
+
+static double elapsed_sec(const struct timespec *start, const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void bench_rts(unsigned num_blocks, unsigned num_tbf)
+{
+	BTS the_bts;
+	struct gprs_rlcmac_bts *bts = the_bts.bts_data();
+	GprsMs *ms[BENCH_NUM_TBF];
+	gprs_rlcmac_dl_tbf *tbf;
+	struct timespec start, end;
+	double rts_sec = 0;
+	unsigned long long allocs;
+	unsigned num_data = 0, num_dummy = 0;
+	uint32_t fn = 0;
+	unsigned block, i;
+	int num_tbfs = 0;
+
+	bts->alloc_algorithm = alloc_algorithm_a;
+	bts->initial_cs_dl = 1;
+	bts->trx[0].pdch[BENCH_TS].enable();
+	the_bts.set_current_frame_number(fn);
+
+	for (i = 0; i < num_tbf; i++) {
+		/* the MS objects are kept for X2030, which never expires here */
+		ms[i] = the_bts.ms_alloc(12, 0);
+
+		tbf = tbf_alloc_dl_tbf(bts, ms[i], 0, true);
+		OSMO_ASSERT(tbf);
+		tbf->update_ms(0xc0000000 | i, GPRS_RLCMAC_DL_TBF);
+		tbf->set_ta(0);
+		TBF_SET_ASS_STATE_DL(tbf, GPRS_RLCMAC_DL_ASS_SEND_ASS);
+		TBF_SET_STATE(tbf, GPRS_RLCMAC_FLOW);
+		tbf->m_wait_confirm = 0;
+		num_tbfs += 1;
+	}
+
+	for (block = 0; block < num_blocks; block++) {
+		the_bts.set_current_frame_number(fn);
+
+		for (i = 0; i < num_tbf; i++) {
+			tbf = ms[i]->dl_tbf();
+			if (tbf && tbf->llc_queue_size() < 2)
+				tbf->append_data(12, 1000, llc_data, sizeof(llc_data));
+		}
+
+		tbf = the_bts.dl_tbf_by_poll_fn(fn, 0, BENCH_TS);
+		if (tbf)
+			answer_dl_poll(&the_bts, tbf, fn);
+
+		last_block = BLOCK_NONE;
+		allocs = msgb_allocs;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		gprs_rlcmac_rcv_rts_block(bts, 0, BENCH_TS, fn, fn2bn(fn));
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		rts_sec += elapsed_sec(&start, &end);
+
+		/* only the DATA.req itself */
+		if (last_block == BLOCK_DATA || last_block == BLOCK_DUMMY)
+			OSMO_ASSERT(msgb_allocs - allocs == 1);
+		num_data += last_block == BLOCK_DATA;
+		num_dummy += last_block == BLOCK_DUMMY;
+
+		fn = fn_add_blocks(fn, 1);
+	}
+
+	fprintf(stderr, "%d DL TBFs on TS %d, %u RTS: %.0f ns per RTS, "
+		"%u data and %u dummy blocks\n", num_tbfs, BENCH_TS, num_blocks,
+		rts_sec * 1e9 / num_blocks, num_data, num_dummy);
+
+	if (num_tbf) {
+		OSMO_ASSERT(num_data > 0);
+		printf("%d DL TBFs: one msgb per data block\n", num_tbfs);
+	} else {
+		OSMO_ASSERT(num_dummy == num_blocks);
+		printf("idle PDCH: one msgb per dummy block\n");
+	}
+}
+
+int main(int argc, char **argv)
+{
+	unsigned num_blocks = 20000;
+
+	tall_pcu_ctx = talloc_named_const(NULL, 1, "RtsTest context");
+	if (!tall_pcu_ctx)
+		abort();
+
+	msgb_talloc_ctx_init(tall_pcu_ctx, 0);
+	osmo_init_logging2(tall_pcu_ctx, &gprs_log_info);
+	log_set_use_color(osmo_stderr_target, 0);
+	log_set_print_filename(osmo_stderr_target, 0);
+	/* keep the RTS path free of log output */
+	log_set_log_level(osmo_stderr_target, LOGL_FATAL);
+
+	bench_rts(num_blocks, BENCH_NUM_TBF);
+	bench_rts(num_blocks, 0);
+
+	return EXIT_SUCCESS;
+}
+
+/*
+ * stubs that should not be reached
+ */
+extern "C" {
+void l1if_pdch_req() { abort(); }
+void l1if_connect_pdch() { abort(); }
+void l1if_close_pdch() { abort(); }
+void l1if_open_pdch() { abort(); }
+}
@@ -36,6 +36,7 @@ extern "C" {
 
 #include <osmocom/core/application.h>
 #include <osmocom/core/msgb.h>
+#include <osmocom/core/rate_ctr.h>
 #include <osmocom/core/talloc.h>
 #include <osmocom/core/utils.h>
 #include <osmocom/vty/vty.h>
@@ -176,6 +177,7 @@ static void setup_bts(BTS *the_bts, uint8_t ts_no, uint8_t cs = 1)
 	bts->initial_cs_ul = cs;
 	osmo_tdef_set(bts->T_defs_pcu, -2030, 0, OSMO_TDEF_S);
 	osmo_tdef_set(bts->T_defs_pcu, -2031, 0, OSMO_TDEF_S);
+	bts_update_params(bts);
 	trx = &bts->trx[0];
 
 	trx->pdch[ts_no].enable();
@@ -350,6 +352,7 @@ static void test_tbf_delayed_release()
 
 	setup_bts(&the_bts, ts_no);
 	OSMO_ASSERT(osmo_tdef_set(bts->T_defs_pcu, -2031, 200, OSMO_TDEF_MS) == 0);
+	bts_update_params(bts);
 
 	dl_tbf = create_dl_tbf(&the_bts, ms_class, 0, &trx_no);
 	dl_tbf->update_ms(tlli, GPRS_RLCMAC_DL_TBF);
@@ -526,6 +529,7 @@ static void test_tbf_dl_llc_loss()
 	setup_bts(&the_bts, ts_no);
 	/* keep the MS object 10 seconds */
 	OSMO_ASSERT(osmo_tdef_set(bts->T_defs_pcu, -2030, 10, OSMO_TDEF_S) == 0);
+	bts_update_params(bts);
 
 	gprs_bssgp_create_and_connect(bts, 33001, 0, 33001, 2234, 2234, 2234, 1, 1, false, 0, 0, 0);
 
@@ -2512,6 +2516,7 @@ static void test_tbf_epdan_out_of_rx_window(void)
 
 	setup_bts(&the_bts, ts_no);
 	OSMO_ASSERT(osmo_tdef_set(bts->T_defs_pcu, -2031, 200, OSMO_TDEF_MS) == 0);
+	bts_update_params(bts);
 	bts->egprs_enabled = 1;
 	/* ARQ II */
 	bts->dl_arq_type = EGPRS_ARQ2;
@@ -3048,6 +3053,7 @@ static void test_tbf_egprs_retx_dl(void)
 	bts->cs_downgrade_threshold = 0;
 	setup_bts(&the_bts, ts_no);
 	OSMO_ASSERT(osmo_tdef_set(bts->T_defs_pcu, -2031, 200, OSMO_TDEF_MS) == 0);
+	bts_update_params(bts);
 	bts->egprs_enabled = 1;
 	/* ARQ II */
 	bts->dl_arq_type = EGPRS_ARQ2;
@@ -3077,6 +3083,7 @@ static void test_tbf_egprs_spb_dl(void)
 	bts->cs_downgrade_threshold = 0;
 	setup_bts(&the_bts, ts_no);
 	OSMO_ASSERT(osmo_tdef_set(bts->T_defs_pcu, -2031, 200, OSMO_TDEF_MS) == 0);
+	bts_update_params(bts);
 	bts->egprs_enabled = 1;
 
 	/* ARQ I resegmentation support */
@@ -3109,6 +3116,7 @@ static void test_tbf_egprs_dl()
 
 	setup_bts(&the_bts, ts_no);
 	OSMO_ASSERT(osmo_tdef_set(bts->T_defs_pcu, -2031, 200, OSMO_TDEF_MS) == 0);
+	bts_update_params(bts);
 	bts->egprs_enabled = 1;
 	/* ARQ II */
 	bts->dl_arq_type = EGPRS_ARQ2;
@@ -3249,6 +3257,122 @@ void test_packet_access_rej_epdan()
 
 }
 
+/* EGPRS header type 3 data block, MCS-4 */
+static void send_ul_egprs_block(BTS *the_bts, gprs_rlcmac_ul_tbf *ul_tbf,
+	uint8_t ts_no, uint16_t bsn, uint8_t cv, uint32_t fn)
+{
+	struct gprs_rlc_ul_header_egprs_3 *hdr3;
+	struct gprs_rlcmac_pdch *pdch;
+	uint8_t data[49];
+	uint8_t tfi = ul_tbf->tfi();
+
+	memset(data, 0x2b, sizeof(data));
+	hdr3 = (struct gprs_rlc_ul_header_egprs_3 *)data;
+	hdr3->r = 0;
+	hdr3->si = 0;
+	hdr3->cv = cv;
+	hdr3->tfi_hi = (tfi >> 3) & 0x3;
+	hdr3->tfi_lo = tfi & 0x7;
+	hdr3->bsn1_hi = bsn & 0x1f;
+	hdr3->bsn1_lo = bsn >> 5;
+	hdr3->cps_hi = 0;
+	hdr3->cps_lo = 0;
+	hdr3->spb = 0;
+	hdr3->rsb = 0;
+	hdr3->pi = 0;
+	hdr3->spare = 0;
+	hdr3->dummy = 1;
+	data[4] = 0x0;
+
+	/* the TBF becomes idle at the current FN */
+	the_bts->set_current_frame_number(fn);
+	pdch = &the_bts->bts_data()->trx[ul_tbf->trx->trx_no].pdch[ts_no];
+	pdch->rcv_block(&data[0], sizeof(data), fn, &meas);
+}
+
+static void run_tbf_egprs_ul_ext(void)
+{
+	BTS the_bts;
+	int ts_no = 7;
+	uint32_t fn = 2654218;
+	uint16_t qta = 31;
+	uint32_t tlli = 0xf1223344;
+	uint8_t ms_class = 1;
+	uint8_t egprs_ms_class = 1;
+	gprs_rlcmac_bts *bts;
+	gprs_rlcmac_ul_tbf *ul_tbf;
+	const struct rate_ctr *ctr;
+	uint32_t idle_fn;
+
+	setup_bts(&the_bts, ts_no, 4);
+	bts = the_bts.bts_data();
+	bts->initial_mcs_dl = 9;
+	bts->egprs_enabled = 1;
+	osmo_tdef_set(bts->T_defs_pcu, -2032, 200, OSMO_TDEF_MS);
+	bts_update_params(bts);
+
+	ul_tbf = establish_ul_tbf(&the_bts, ts_no, tlli, &fn, qta, ms_class, egprs_ms_class);
+	OSMO_ASSERT(ul_tbf->is_egprs_enabled());
+
+	/* all data received, the TBF stays in FLOW ... */
+	send_ul_egprs_block(&the_bts, ul_tbf, ts_no, 0, 0, fn);
+	idle_fn = fn;
+	OSMO_ASSERT(ul_tbf->state_is(GPRS_RLCMAC_FLOW));
+	OSMO_ASSERT(ul_tbf->ext_idle());
+	OSMO_ASSERT(ul_tbf->ul_ack_state_is(GPRS_RLCMAC_UL_ACK_SEND_ACK));
+	OSMO_ASSERT(!ul_tbf->ext_idle_expired(idle_fn));
+	OSMO_ASSERT(!ul_tbf->ext_usf_due(idle_fn));
+	OSMO_ASSERT(ul_tbf->ext_usf_due((idle_fn + bts->params.ul_tbf_ext_usf_frames) % GSM_MAX_FN));
+
+	/* ... and gets a non-final Ack/Nack */
+	request_dl_rlc_block(ul_tbf, &fn);
+	OSMO_ASSERT(ul_tbf->state_is(GPRS_RLCMAC_FLOW));
+	OSMO_ASSERT(ul_tbf->ul_ack_state_is(GPRS_RLCMAC_UL_ACK_NONE));
+	OSMO_ASSERT(!ul_tbf->m_final_ack_sent);
+
+	/* the MS resumes with new data ... */
+	send_ul_egprs_block(&the_bts, ul_tbf, ts_no, 1, 5, fn);
+	OSMO_ASSERT(!ul_tbf->ext_idle());
+	fn = fn_add_blocks(fn, 1);
+	/* ... and is idle again after its last block */
+	send_ul_egprs_block(&the_bts, ul_tbf, ts_no, 2, 0, fn);
+	OSMO_ASSERT(ul_tbf->ext_idle());
+	request_dl_rlc_block(ul_tbf, &fn);
+	OSMO_ASSERT(ul_tbf->ul_ack_state_is(GPRS_RLCMAC_UL_ACK_NONE));
+	OSMO_ASSERT(!ul_tbf->m_final_ack_sent);
+
+	/* no new data within X2032, the scheduler finishes the TBF ... */
+	fn = fn_add_blocks(fn, 26);
+	OSMO_ASSERT(ul_tbf->ext_idle_expired(fn));
+	request_dl_rlc_block(ul_tbf, &fn);
+	OSMO_ASSERT(!ul_tbf->ext_idle());
+	OSMO_ASSERT(ul_tbf->state_is(GPRS_RLCMAC_FINISHED));
+	OSMO_ASSERT(ul_tbf->ul_ack_state_is(GPRS_RLCMAC_UL_ACK_SEND_ACK));
+
+	/* ... and sends the final Ack/Nack */
+	request_dl_rlc_block(ul_tbf, &fn);
+	OSMO_ASSERT(ul_tbf->m_final_ack_sent);
+
+	ctr = the_bts.rate_counters()->ctr;
+	fprintf(stderr, "ul_tbf_ext_idle=%llu ul_tbf_ext_resumed=%llu\n",
+		(unsigned long long) ctr[CTR_TBF_UL_EXT_IDLE].current,
+		(unsigned long long) ctr[CTR_TBF_UL_EXT_RESUMED].current);
+}
+
+static void test_tbf_egprs_ul_ext(void)
+{
+	uint8_t loglevel = osmo_stderr_target->loglevel;
+
+	fprintf(stderr, "=== start %s ===\n", __func__);
+
+	/* the TBF is checked by asserts, only the counters are printed */
+	log_set_log_level(osmo_stderr_target, LOGL_FATAL);
+	run_tbf_egprs_ul_ext();
+	log_set_log_level(osmo_stderr_target, loglevel);
+
+	fprintf(stderr, "=== end %s ===\n", __func__);
+}
+
 
 int main(int argc, char **argv)
 {
@@ -3304,6 +3428,7 @@ int main(int argc, char **argv)
 	test_packet_access_rej_epdan();
 	test_packet_access_rej_prr();
 	test_packet_access_rej_prr_no_other_tbfs();
+	test_tbf_egprs_ul_ext();
 
 	if (getenv("TALLOC_REPORT_FULL"))
 		talloc_report_full(tall_pcu_ctx, stderr);
@@ -0,0 +1,139 @@
+/* TimerBench.cpp
+ *
+ * Compare the cost of restarting a pending TBF timer the normal way
+ * (delete and re-insert the osmo_timer) with the lazy restart used for
+ * per block refreshes. A number of unrelated timers is kept pending so
+ * that the timer tree has a realistic size.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include "bts.h"
+#include "tbf.h"
+#include "gprs_debug.h"
+#include "gprs_ms.h"
+#include <gprs_rlcmac.h>
+
+extern "C" {
+#include <osmocom/core/application.h>
+#include <osmocom/core/msgb.h>
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/timer.h>
+#include <osmocom/core/utils.h>
+}
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* globals used by the code */
+void *tall_pcu_ctx;
+int16_t spoof_mnc = 0, spoof_mcc = 0;
+bool spoof_mnc_3_digits = false;
+
+#define BENCH_NUM_TBF		32
+#define BENCH_NUM_OTHER_TIMERS	2000
+
+static struct osmo_timer_list other_timers[BENCH_NUM_OTHER_TIMERS];
+
+static void other_timer_cb(void *data)
+{
+}
+
+static double elapsed_sec(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static double bench_restart(gprs_rlcmac_tbf **tbfs, unsigned rounds, bool lazy)
+{
+	struct timespec start;
+	unsigned round, i;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (round = 0; round < rounds; round++) {
+		for (i = 0; i < BENCH_NUM_TBF; i++)
+			tbfs[i]->t_start(T3191, 3191, "bench", true,
+				__FILE__, __LINE__, lazy);
+	}
+
+	return elapsed_sec(&start) * 1e9 / (rounds * BENCH_NUM_TBF);
+}
+
+int main(int argc, char **argv)
+{
+	gprs_rlcmac_tbf *tbfs[BENCH_NUM_TBF];
+	unsigned rounds = 100000;
+	unsigned i;
+
+	if (argc > 1)
+		rounds = atoi(argv[1]);
+	if (!rounds) {
+		fprintf(stderr, "usage: %s [ROUNDS]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	tall_pcu_ctx = talloc_named_const(NULL, 1, "TimerBench context");
+	if (!tall_pcu_ctx)
+		abort();
+
+	msgb_talloc_ctx_init(tall_pcu_ctx, 0);
+	osmo_init_logging2(tall_pcu_ctx, &gprs_log_info);
+	log_set_use_color(osmo_stderr_target, 0);
+	log_set_print_filename(osmo_stderr_target, 0);
+	log_set_log_level(osmo_stderr_target, LOGL_FATAL);
+
+	BTS the_bts;
+	struct gprs_rlcmac_bts *bts = the_bts.bts_data();
+
+	bts->alloc_algorithm = alloc_algorithm_a;
+	bts->trx[0].pdch[7].enable();
+
+	for (i = 0; i < BENCH_NUM_TBF; i++) {
+		GprsMs *ms = the_bts.ms_alloc(12, 0);
+
+		tbfs[i] = tbf_alloc_dl_tbf(bts, ms, 0, true);
+		OSMO_ASSERT(tbfs[i]);
+	}
+
+	for (i = 0; i < ARRAY_SIZE(other_timers); i++) {
+		osmo_timer_setup(&other_timers[i], other_timer_cb, NULL);
+		osmo_timer_schedule(&other_timers[i], 10 + i % 50, (i * 7919) % 1000000);
+	}
+
+	printf("%d TBFs, %u other timers pending\n",
+		BENCH_NUM_TBF, BENCH_NUM_OTHER_TIMERS);
+	printf("restart T3191: %6.1f ns\n", bench_restart(tbfs, rounds, false));
+	printf("lazy T3191:    %6.1f ns\n", bench_restart(tbfs, rounds, true));
+
+	for (i = 0; i < ARRAY_SIZE(other_timers); i++)
+		osmo_timer_del(&other_timers[i]);
+
+	return EXIT_SUCCESS;
+}
+
+/*
+ * stubs that should not be reached
+ */
+extern "C" {
+void l1if_pdch_req() { abort(); }
+void l1if_connect_pdch() { abort(); }
+void l1if_close_pdch() { abort(); }
+void l1if_open_pdch() { abort(); }
+}
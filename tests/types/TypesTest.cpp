@@ -29,6 +29,8 @@
 #include "decoding.h"
 #include "gprs_rlcmac.h"
 #include "egprs_rlc_compression.h"
+#include "spsc_ring.h"
+#include "pcu_hist.h"
 
 extern "C" {
 #include <osmocom/core/application.h>
@@ -864,7 +866,7 @@ void test_immediate_assign_rej()
 	bitvec_unhex(immediate_assignment_rej, DUMMY_VEC);
 	plen = Encoding::write_immediate_assignment_reject(
 		immediate_assignment_rej, 112, 100,
-		GSM_L1_BURST_TYPE_ACCESS_1);
+		GSM_L1_BURST_TYPE_ACCESS_1, 20);
 
 	printf("assignment reject: %s\n",
 		osmo_hexdump(immediate_assignment_rej->data, 22));
@@ -879,7 +881,7 @@ void test_immediate_assign_rej()
 
 	plen = Encoding::write_immediate_assignment_reject(
 		immediate_assignment_rej, 112, 100,
-		GSM_L1_BURST_TYPE_ACCESS_0);
+		GSM_L1_BURST_TYPE_ACCESS_0, 20);
 
 	printf("assignment reject: %s\n",
 		osmo_hexdump(immediate_assignment_rej->data, 22));
@@ -904,6 +906,187 @@ static void test_lsb()
 	} while (u);
 }
 
+static void test_spsc_ring()
+{
+	SpscRing<uint32_t, 4> ring;
+	uint32_t *slot;
+	unsigned i;
+
+	printf("Testing SPSC ring...\n");
+
+	OSMO_ASSERT(ring.empty());
+	OSMO_ASSERT(ring.peek() == NULL);
+
+	/* wrap around the index a few times */
+	for (i = 0; i < 10; i++) {
+		slot = ring.reserve();
+		OSMO_ASSERT(slot);
+		*slot = i;
+		ring.commit();
+
+		if (i % 2 == 1) {
+			slot = ring.peek();
+			OSMO_ASSERT(slot);
+			printf("  got %u, %u queued\n", *slot, ring.size());
+			ring.consume();
+		}
+
+		if (ring.size() == ring.capacity()) {
+			OSMO_ASSERT(ring.reserve() == NULL);
+			printf("  full at %u\n", i);
+			break;
+		}
+	}
+
+	while ((slot = ring.peek())) {
+		printf("  got %u, %u queued\n", *slot, ring.size());
+		ring.consume();
+	}
+	OSMO_ASSERT(ring.empty());
+}
+
+static void test_pcu_hist()
+{
+	struct pcu_hist h;
+	char buf[128];
+	static const uint32_t samples[] = { 0, 15, 16, 100, 1000, 1000, 50000 };
+	unsigned i;
+
+	printf("Testing histogram...\n");
+
+	pcu_hist_reset(&h);
+	for (i = 0; i < ARRAY_SIZE(samples); i++)
+		pcu_hist_add(&h, samples[i]);
+
+	for (i = 0; i < PCU_HIST_BUCKETS; i++)
+		if (h.buckets[i])
+			printf("  bucket %u (%s): %llu\n", i,
+			       pcu_hist_bucket_str(buf, sizeof(buf), i, ""),
+			       (unsigned long long)h.buckets[i]);
+	printf("  %s\n", pcu_hist_summary(buf, sizeof(buf), &h, ""));
+}
+
+static void test_paging()
+{
+	BTS the_bts;
+	struct gprs_rlcmac_bts *bts = the_bts.bts_data();
+	struct gprs_rlcmac_pdch *pdch = bts->trx[0].pdch;
+	struct rate_ctr_group *ctrg = the_bts.rate_counters();
+	static const uint8_t tmsi_a[] = { 0xf4, 0x00, 0x00, 0x00, 0x0a };
+	static const uint8_t tmsi_e[] = { 0xf4, 0x00, 0x00, 0x00, 0x0e };
+	uint8_t imsi[] = { 0x29, 0x26, 0x24, 0x00, 0x00, 0x00, 0x00, 0x00 };
+	struct msgb *msg;
+	unsigned i;
+
+	printf("Testing paging...\n");
+
+	OSMO_ASSERT(osmo_tdef_set(bts->T_defs_pcu, -2040, 1000, OSMO_TDEF_MS) == 0);
+	bts_update_params(bts);
+	pdch[2].enable();
+	pdch[3].enable();
+	pdch[5].enable();
+
+	/* TBFs on TS 2+3, TS 3 and TS 5: paging on TS 3 and TS 5 reaches all */
+	the_bts.tbf_slots_changed(0, 0, 0x0c);
+	the_bts.tbf_slots_changed(0, 0, 0x08);
+	the_bts.tbf_slots_changed(0, 0, 0x20);
+
+	OSMO_ASSERT(the_bts.add_paging(0, tmsi_a, sizeof(tmsi_a)) == 0);
+	printf("  queued TS2 %u TS3 %u TS5 %u\n", pdch[2].num_paging,
+	       pdch[3].num_paging, pdch[5].num_paging);
+
+	/* the same MI again within X2040 */
+	OSMO_ASSERT(the_bts.add_paging(0, tmsi_a, sizeof(tmsi_a)) == 0);
+	printf("  queued TS3 %u TS5 %u, suppressed %llu\n", pdch[3].num_paging,
+	       pdch[5].num_paging,
+	       (unsigned long long)ctrg->ctr[CTR_PAGING_SUPPRESSED].current);
+
+	/* without suppression the MI is still found in the queue */
+	OSMO_ASSERT(osmo_tdef_set(bts->T_defs_pcu, -2040, 0, OSMO_TDEF_MS) == 0);
+	bts_update_params(bts);
+	OSMO_ASSERT(the_bts.add_paging(0, tmsi_a, sizeof(tmsi_a)) == 0);
+	printf("  queued TS3 %u TS5 %u\n", pdch[3].num_paging, pdch[5].num_paging);
+
+	/* three IMSIs fit in a queue of 4, the last one is dropped */
+	bts->paging_queue_depth = 4;
+	for (i = 0; i < 4; i++) {
+		imsi[7] = 0xf0 | i;
+		OSMO_ASSERT(the_bts.add_paging(0, imsi, sizeof(imsi)) == 0);
+	}
+	printf("  queued TS3 %u TS5 %u, dropped %llu\n", pdch[3].num_paging,
+	       pdch[5].num_paging,
+	       (unsigned long long)ctrg->ctr[CTR_PAGING_DROPPED].current);
+
+	/* TMSI, IMSI, IMSI and TMSI on TS 2: the second IMSI does not fit
+	 * into the first block anymore, it and the TMSI queued behind it go
+	 * into the second one */
+	OSMO_ASSERT(pdch[2].add_paging(0, tmsi_a, sizeof(tmsi_a)) == 0);
+	for (i = 0; i < 2; i++) {
+		imsi[7] = 0xf0 | i;
+		OSMO_ASSERT(pdch[2].add_paging(0, imsi, sizeof(imsi)) == 0);
+	}
+	OSMO_ASSERT(pdch[2].add_paging(0, tmsi_e, sizeof(tmsi_e)) == 0);
+
+	msg = pdch[2].packet_paging_request();
+	OSMO_ASSERT(msg);
+	msgb_free(msg);
+	printf("  after 1st block TS2 %u\n", pdch[2].num_paging);
+
+	msg = pdch[2].packet_paging_request();
+	OSMO_ASSERT(msg);
+	msgb_free(msg);
+	printf("  after 2nd block TS2 %u\n", pdch[2].num_paging);
+	OSMO_ASSERT(pdch[2].packet_paging_request() == NULL);
+
+	/* without a limit, nothing is dropped */
+	bts->paging_queue_depth = 0;
+	for (i = 0; i < 40; i++) {
+		imsi[6] = i;
+		OSMO_ASSERT(pdch[2].add_paging(0, imsi, sizeof(imsi)) == 0);
+	}
+	printf("  queued TS2 %u without a limit\n", pdch[2].num_paging);
+}
+
+static void test_sba()
+{
+	BTS the_bts;
+	struct gprs_rlcmac_bts *bts = the_bts.bts_data();
+	struct gprs_rlcmac_pdch *pdch = bts->trx[0].pdch;
+	struct gprs_rlcmac_sba *sba;
+	uint8_t trx_no, ts_no;
+	uint32_t fn;
+	unsigned i;
+
+	printf("Testing single block allocation...\n");
+
+	pdch[5].enable();
+	pdch[7].enable();
+
+	/* spread over both PDCHs, starting with the highest TS, and never
+	 * twice into the same block */
+	for (i = 0; i < 3; i++) {
+		OSMO_ASSERT(the_bts.sba()->alloc(&trx_no, &ts_no, &fn, 0) == 0);
+		printf("  SBA %u: TRX=%u TS=%u FN=%u\n", i, trx_no, ts_no, fn);
+	}
+	printf("  pending TS5 %u TS7 %u\n", pdch[5].num_sba, pdch[7].num_sba);
+
+	sba = the_bts.sba()->find(&pdch[5], 52);
+	OSMO_ASSERT(sba && sba->ts_no == 5);
+	OSMO_ASSERT(the_bts.sba()->find(&pdch[5], 56) == NULL);
+	the_bts.sba()->free_sba(sba);
+
+	/* TS5 is idle again */
+	OSMO_ASSERT(the_bts.sba()->alloc(&trx_no, &ts_no, &fn, 0) == 0);
+	printf("  SBA 3: TRX=%u TS=%u FN=%u\n", trx_no, ts_no, fn);
+
+	the_bts.sba()->free_resources(&pdch[7]);
+	OSMO_ASSERT(the_bts.sba()->find(0, 7, 56) == NULL);
+	printf("  pending TS5 %u TS7 %u, allocated TS5 %u TS7 %u\n",
+	       pdch[5].num_sba, pdch[7].num_sba,
+	       pdch[5].sba_allocated, pdch[7].sba_allocated);
+	the_bts.sba()->free_resources(&pdch[5]);
+}
+
 int main(int argc, char **argv)
 {
 	tall_pcu_ctx = talloc_named_const(NULL, 1, "types test context");
@@ -933,6 +1116,10 @@ int main(int argc, char **argv)
 	test_immediate_assign_rej();
 	test_lsb();
 	test_egprs_ul_ack_nack();
+	test_spsc_ring();
+	test_pcu_hist();
+	test_paging();
+	test_sba();
 
 	return EXIT_SUCCESS;
 }